@@ -25,6 +25,9 @@
 #define STB_IMAGE_IMPLEMENTATION
 
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
 #include "deps/GLADLibs/include/glad/glad.h"
 #include "deps/GLFW3/include/glfw3.h"
 #include "deps/glm/glm.hpp"
@@ -32,14 +35,26 @@
 #include "deps/glm/gtc/type_ptr.hpp"
 
 #include "tools/camera_object.h"
-#include "tools/Model_Loader.hpp"
-
-
-void inputPolling(GLFWwindow *window);
+#include "tools/Scene_graph.hpp"
+#include "tools/Light_buffer.hpp"
+#include "tools/Light_clusters.hpp"
+#include "tools/Occlusion_benchmark.hpp"
+#include "tools/Frame_profiler.hpp"
+#include "tools/Headless_context.hpp"
+#include "tools/Headless_benchmark.hpp"
+#include "tools/Camera_path.hpp"
+#include "tools/Input_recorder.hpp"
+#include "tools/Simulation_clock.hpp"
+
+
+unsigned int inputPolling(GLFWwindow *window);
+unsigned int pollKeys(GLFWwindow *window);
+void applyKeys(unsigned int keys, float deltatime);
 void mousePolling(GLFWwindow *window, double xposition, double yposition);
 void mouseWheelPolling(GLFWwindow* window, double xoffset, double yoffset);
 void resizewin(GLFWwindow* window, int width, int height);
 const unsigned int windowwidth = 1280, windowheight = 720;
+int framebufferwidth = windowwidth, framebufferheight = windowheight; // What the viewport covers right now, resizewin() keeps it up to date
 
 float framedeltatime = 0.0f;
 float lastframerendered = 0.0f;
@@ -47,47 +62,138 @@ float currentframetime = 0.0f;
 
 Camera_Object cam(glm::vec3(-8.0f, 2.5f, -5.0f));
 
+bool vsync = true; // --no-vsync lets frames run uncapped, the simulation steps at the same rate either way
+bool depthprepass = true; // P toggles it, --no-prepass starts without it
+bool prepasskeyheld = false;
+bool occlusionculling = true; // O toggles it
+bool occlusionkeyheld = false;
+bool deferredshading = false; // G toggles it, --deferred starts with it
+bool deferredkeyheld = false;
+
+Input_recorder inputrecorder; // --record <file>, logs the camera's input for replays
+Input_replay inputreplay; // --replay <file>, drives the camera from such a log instead of the keyboard and mouse
+
 bool firstpolling = true;
 float mouselastxposition = windowwidth/2.0f, mouselastyposition = windowheight/2.0f; // windowwidth/2, windowheight/2, basically.
 
 
-int main ()
+int main (int argc, char **argv)
 {
-    //GLFW Window and Viewport Properties Definition.
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_FALSE);
-    glfwWindowHint(GLFW_DECORATED, GL_TRUE);
-    glfwWindowHint(GLFW_SAMPLES, 0); // Sets MSAA to 0X, 2X, 4X or 8X, providing some sort of anti-aliasing in order to smooth jagged edges.
-
-
-    GLFWwindow *lightingWindow = glfwCreateWindow(windowwidth, windowheight, "OpenGL4.3: CG-Final", NULL, NULL);
-    glfwSetWindowAspectRatio(lightingWindow, 16, 9);
-    //glfwSetWindowPos(lightingWindow, 1920 - windowwidth, 1080 - windowheight); // Centers the window, but only in 720P on a 1080P display
-    glfwSetInputMode(lightingWindow, GLFW_CURSOR, GLFW_CURSOR_DISABLED); // Disables the cursor in order to use the mouse on the camera without obstructions
-    glfwSetCursorPosCallback(lightingWindow, mousePolling);
-    glfwSetScrollCallback(lightingWindow, mouseWheelPolling);
-    glfwSetFramebufferSizeCallback(lightingWindow, resizewin);
-
-    if(lightingWindow == NULL)
+    if(argc > 1 && std::strcmp(argv[1], "--bake-textures") == 0)
+    {   // Offline step: bakes every image under models/ into cache/textures with its mip chain, add --compress for BC1/BC3. Needs no window or GL context.
+        bool compress = argc > 2 && std::strcmp(argv[2], "--compress") == 0;
+        return Texture_baker::bakeDirectory("models", compress) == 0 ? 0 : 1;
+    }
+
+    if(argc > 1 && std::strcmp(argv[1], "--bench-occlusion") == 0)
+    {   // Times the CPU occlusion culler on a synthetic scene and checks a few known answers, also without a window. Takes an optional iteration count.
+        int iterations = argc > 2 ? std::atoi(argv[2]) : 0;
+        return Occlusion_benchmark::run(iterations > 0 ? iterations : 500);
+    }
+
+    std::string tracepath; // --trace <file> writes the profiler's last frames there on exit, as Chrome trace JSON
+    benchmark_settings benchmarksettings; // --headless renders offscreen along a scripted camera path and prints frame time statistics, see the README
+    std::string recordpath, replaypath;
+    bool rebakelighting = false; // --bake-lighting traces the lamp lights again even when the bake cache has them
+    for(int i = 1; i < argc; i++)
     {
-        std::cout << "Failed to create the main window\n" << std::endl;
+        if(std::strcmp(argv[i], "--no-prepass") == 0)
+            depthprepass = false;
+        else if(std::strcmp(argv[i], "--deferred") == 0)
+            deferredshading = true;
+        else if(std::strcmp(argv[i], "--no-vsync") == 0)
+            vsync = false;
+        else if(std::strcmp(argv[i], "--bake-lighting") == 0)
+            rebakelighting = true;
+        else if(std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            tracepath = argv[++i];
+        else if(std::strcmp(argv[i], "--headless") == 0)
+            benchmarksettings.enabled = true;
+        else if(std::strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+            std::sscanf(argv[++i], "%ux%u", &benchmarksettings.width, &benchmarksettings.height);
+        else if(std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            benchmarksettings.frames = std::atoi(argv[++i]);
+        else if(std::strcmp(argv[i], "--timestep") == 0 && i + 1 < argc)
+            benchmarksettings.timestep = std::atof(argv[++i]);
+        else if(std::strcmp(argv[i], "--path") == 0 && i + 1 < argc)
+            benchmarksettings.pathfile = argv[++i];
+        else if(std::strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+            benchmarksettings.dumpframes = benchmark_settings::parseFrameList(argv[++i]);
+        else if(std::strcmp(argv[i], "--dump-dir") == 0 && i + 1 < argc)
+            benchmarksettings.dumpdirectory = argv[++i];
+        else if(std::strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            recordpath = argv[++i];
+        else if(std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            replaypath = argv[++i];
+    }
+
+    const bool headless = benchmarksettings.enabled;
+    const unsigned int viewportwidth  = headless ? benchmarksettings.width : windowwidth;
+    const unsigned int viewportheight = headless ? benchmarksettings.height : windowheight;
+    if(!replaypath.empty() && !inputreplay.load(replaypath))
+        return -1;
+    const bool replaying = inputreplay.replaying(); // In a window or headless, in place of the camera path
+    const bool fixedstep = headless || replaying; // Simulated time moving --timestep per frame instead of the wall clock
+    Camera_path camerapath;
+    if(headless && !replaying && !camerapath.load(benchmarksettings.pathfile))
+        return -1;
+    if(fixedstep && (benchmarksettings.timestep <= 0.0f || viewportwidth == 0 || viewportheight == 0))
         return -1;
+
+    GLFWwindow *lightingWindow = NULL;
+    Headless_context headlesscontext;
+    if(headless)
+    { // No window, no display server, the frames go into Headless_benchmark's FBO
+        if(!headlesscontext.create())
+            return -1;
     }
+    else
+    {
+        //GLFW Window and Viewport Properties Definition.
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_FALSE);
+        glfwWindowHint(GLFW_DECORATED, GL_TRUE);
+        glfwWindowHint(GLFW_SAMPLES, 0); // Sets MSAA to 0X, 2X, 4X or 8X, providing some sort of anti-aliasing in order to smooth jagged edges.
+
+
+        lightingWindow = glfwCreateWindow(windowwidth, windowheight, "OpenGL4.3: CG-Final", NULL, NULL);
+        glfwSetWindowAspectRatio(lightingWindow, 16, 9);
+        //glfwSetWindowPos(lightingWindow, 1920 - windowwidth, 1080 - windowheight); // Centers the window, but only in 720P on a 1080P display
+        glfwSetInputMode(lightingWindow, GLFW_CURSOR, GLFW_CURSOR_DISABLED); // Disables the cursor in order to use the mouse on the camera without obstructions
+        glfwSetCursorPosCallback(lightingWindow, mousePolling);
+        glfwSetScrollCallback(lightingWindow, mouseWheelPolling);
+        glfwSetFramebufferSizeCallback(lightingWindow, resizewin);
+
+        if(lightingWindow == NULL)
+        {
+            std::cout << "Failed to create the main window\n" << std::endl;
+            return -1;
+        }
 
-    glfwMakeContextCurrent(lightingWindow);
+        glfwMakeContextCurrent(lightingWindow);
 
 
-    if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to load GLAD GL function Loader\n" << std::endl;
-        glfwTerminate();
-        return -2;
+        if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cout << "Failed to load GLAD GL function Loader\n" << std::endl;
+            glfwTerminate();
+            return -2;
+        }
     }
 
-    glViewport(0, 0, windowwidth, windowheight);
+    Texture_registry::instance().queryCapabilities(); // Before any model starts acquiring textures on the loader threads
+
+    if(headless)
+    {
+        framebufferwidth  = viewportwidth;
+        framebufferheight = viewportheight;
+    }
+    else
+        glfwGetFramebufferSize(lightingWindow, &framebufferwidth, &framebufferheight); // Not the window size on high DPI screens
+    glViewport(0, 0, framebufferwidth, framebufferheight);
     glEnable(GL_DEPTH_TEST); // Face culling
     glEnable(GL_MULTISAMPLE); // Enables MSAA, in its primitive form
     glEnable(GL_BLEND); // Enables partial transparency
@@ -106,7 +212,8 @@ int main ()
         It can be "solved" by rendering the farthest objects first and then the closest ones, guaranteeing that all objects will be analyzed by the depth buffer.
     */
 
-    glfwSwapInterval(1); // Enables Vsync.
+    if(lightingWindow)
+        glfwSwapInterval(vsync ? 1 : 0); // Enables Vsync.
 
     std::cout << "Vendor:" << glGetString(GL_VENDOR) << "\nRenderer:" << glGetString(GL_RENDERER) << "\nOpenGL version in use:" << glGetString(GL_VERSION) << std::endl;
     std::cout << "Shading language version in use:" << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
@@ -122,168 +229,198 @@ int main ()
     glm::mat4 projectionMatrix = glm::mat4(1.0f);
     glm::mat4 viewMatrix = glm::mat4(1.0f);
 
-    projectionMatrix = glm::perspective(glm::radians(cam.zoom), (float) windowwidth / (float) windowheight, 0.1f, 5000.0f);
+    projectionMatrix = glm::perspective(glm::radians(cam.zoom), (float) framebufferwidth / (float) framebufferheight, 0.1f, 5000.0f);
     modelMatrix = glm::rotate(modelMatrix, glm::radians(-55.0f), glm::vec3(1.0f, 0.0f, 0.0f));
 
     //Object Shader creation(external header)
     Shader vegetationshader("shaders/VegetationVertexShader.vert", "shaders/VegetationFragmentShader.frag", nullptr);
     Shader coloredlightshader("shaders/PointLightSourceVertexShader.vert", "shaders/PointLightSourceFragmentShader.frag", nullptr);
     Shader basicshader("shaders/BasicVertexShader.vert", "shaders/BasicFragmentShader.frag", nullptr);
-
-
-    // Model loading procedures.
-    Model_data terrain("models/Terrain/Terrain.obj");
-    Model_data grass_1("models/Terrain/Grass 1.obj");
-    Model_data grass_2("models/Terrain/Grass 2.obj");
-    Model_data grass_small("models/Terrain/Grass Small.obj");
-    Model_data shrubs("models/Terrain/Shrubs.obj");
-    Model_data moon("models/Terrain/Moon.obj");
-    Model_data skybox("models/Terrain/Skybox.obj");
-
-    Model_data big_tree("models/Big Tree/Big Tree.obj");
-    Model_data tree_leaves("models/Big Tree/Big Tree Leaves.obj");
-    Model_data maple_tree("models/Maple Tree/Maple Tree.obj");
-    Model_data maple_tree_leaves("models/Maple Tree/Maple Leaves.obj");
-    Model_data plant_holder("models/Smaller Objects/Plant Holder.obj");
-    Model_data ext_build_5("models/Buildings/Ext Build 5.obj");
-    Model_data ext_build_4("models/Buildings/Ext Build 4.obj");
-    Model_data ext_build_1("models/Buildings/Ext Build 1.obj");
-    Model_data ext_build_3("models/Buildings/Ext Build 3.obj");
-    Model_data ext_build_2("models/Buildings/Ext Build 2.obj");
-
-    Model_data lamp_post("models/Smaller Objects/Lamp Post.obj");
-    Model_data stop_sign("models/Smaller Objects/Stop Sign.obj");
-
-
-    Model_data lightcube("models/fireflies/lightcube.obj");
-
-    // Model Translation procedures.
-    // When converting blender's coordinate system to the engine's, remember to swap blender's Z and Y axis(blender treats Z as world up, while the engine treats Y as world up)
-    // Also, invert the Z values. If it is something like 12.04f, make it -12.04f. for reference: glm::vec3(X, Y, Z).
-    glm::vec3 tree_and_leaves_translation[2] =
-    {
-        glm::vec3(-12.69f, 3.17f, -65.35f), // Tree
-        glm::vec3(-15.73f, 14.68f, -66.08f) // Leaves
-    };
-    glm::vec3 grass_types_translation[3] =
+    Shader grassshader("shaders/GrassVertexShader.vert", "shaders/VegetationFragmentShader.frag", nullptr); // Grass_field's blades, lit like the vegetation
+    // Depth only twins of the two above for the depth pre-pass, same vertex shaders so they write the exact depth the shading pass tests against.
+    Shader depthvegetationshader("shaders/VegetationVertexShader.vert", "shaders/DepthPrepassFragmentShader.frag", nullptr);
+    Shader depthbasicshader("shaders/BasicVertexShader.vert", "shaders/DepthPrepassFragmentShader.frag", nullptr);
+    Shader depthgrassshader("shaders/GrassVertexShader.vert", "shaders/DepthPrepassFragmentShader.frag", nullptr);
+    // G-buffer twins for deferred shading, again on the same vertex shaders, and the pass that lights what they wrote.
+    Shader gbuffervegetationshader("shaders/VegetationVertexShader.vert", "shaders/VegetationGbufferFragmentShader.frag", nullptr);
+    Shader gbufferbasicshader("shaders/BasicVertexShader.vert", "shaders/BasicGbufferFragmentShader.frag", nullptr);
+    Shader gbuffergrassshader("shaders/GrassVertexShader.vert", "shaders/VegetationGbufferFragmentShader.frag", nullptr);
+    Shader deferredlightingshader("shaders/DeferredLightingVertexShader.vert", "shaders/DeferredLightingFragmentShader.frag", nullptr);
+
+    // Model loading procedures. Models are parsed and their textures decoded in parallel, only the GL uploads happen on this thread.
+    // What gets loaded and where it's placed comes from the scene file, see scenes/neighborhood.scene for its format.
+    Scene_loader sceneloader;
+    Scene_graph scene;
+
+    if(!scene.loadScene("scenes/neighborhood.scene", sceneloader))
     {
-        glm::vec3(-23.35f, 0.65f, -40.02f), // Grass 1(purple)
-        glm::vec3(-11.96f, 1.50f, -52.90f), // Grass 1(Orange)
-        glm::vec3(-11.30f, 0.83f, -47.41f)  // Small Grass(darker orange)
-    };
-    glm::vec3 shrubs_translation = glm::vec3(-69.51f, 0.90f, -0.74f);
-    glm::vec3 mapletree_and_leaves_translation[4] =
-    {
-        glm::vec3(14.75f, 0.57f, 38.78f),
-        glm::vec3(14.75f, 0.57f, 48.48f),
-        glm::vec3(14.75f, 0.57f, 58.86f),
-        glm::vec3(14.75f, 0.57f, 69.91f)
-    };
-
-    glm::vec3 moon_translation = glm::vec3(0.0f, 750.0f, -1500.0f);
-    glm::vec3 plant_holder_translation = glm::vec3(14.84f, 0.0f, 55.55f);
-
+        glfwTerminate();
+        return -3;
+    }
 
-    glm::vec3 lamp_posts_translation[42] =
-    {
-        glm::vec3(0.0f, 0.19f, -20.62f),
-        glm::vec3(10.0f, 0.19f, -30.12f),
-        glm::vec3(20.0f, 0.19f, -20.62f),
-        glm::vec3(26.5f, 0.19f, -15.62f),
-        glm::vec3(26.5f, 0.19f, -35.12f),
-        glm::vec3(39.0f, 0.19f, -45.12f),
-        glm::vec3(26.5f, 0.19f, -55.12f),
-        glm::vec3(39.0f, 0.19f, -65.12f),
-        glm::vec3(26.5f, 0.19f, -74.12f),
-        glm::vec3(-10.0f, 0.19f, -30.12f),
-        glm::vec3(-30.0f, 0.19f, -30.12f),
-        glm::vec3(-50.0f, 0.19f, -30.12f),
-        glm::vec3(-70.0f, 0.19f, -30.12f),
-        glm::vec3(-20.0f, 0.19f, 20.62f),
-        glm::vec3(-40.0f, 0.19f, -20.62f),
-        glm::vec3(-66.0f, 0.19f, -20.62f),
-        glm::vec3(26.5f, 0.19f, -2.36f),
-        glm::vec3(26.5f, 0.19f, -20.88f),
-        glm::vec3(40.0f, 0.19f, -30.12f),
-        glm::vec3(50.0f, 0.19f, -20.62f),
-        glm::vec3(60.0f, 0.19f, -30.12f),
-        glm::vec3(70.0f, 0.19f, -20.62f),
-        glm::vec3(39.0f, 0.19f, -5.62f),
-        glm::vec3(39.0f, 0.19f, 12.38f),
-        glm::vec3(0.0f, 0.19f, 32.73f),
-        glm::vec3(10.0f, 0.19f, 21.1f),
-        glm::vec3(20.0f, 0.19f, 32.74f),
-        glm::vec3(-10.0f, 0.19f, 21.1f),
-        glm::vec3(-30.0f, 0.19f, 21.1f),
-        glm::vec3(-50.0f, 0.19f, 21.1f),
-        glm::vec3(-70.0f, 0.19f, 21.1f),
-        glm::vec3(-20.0f, 0.19f, 32.74f),
-        glm::vec3(-40.0f, 0.19f, 32.74f),
-        glm::vec3(-66.0f, 0.19f, 32.74f),
-        glm::vec3( 40.0f, 0.19f, 21.1f),
-        glm::vec3( 50.0f, 0.19f, 32.74f),
-        glm::vec3( 60.0f, 0.19f, 21.1f),
-        glm::vec3( 70.0f, 0.19f, 32.74f),
-        glm::vec3(-65.5f, 0.19f, -15.62f),
-        glm::vec3(-65.5f, 0.19f,  2.38f),
-        glm::vec3(-53.0f, 0.19f, -5.62f),
-        glm::vec3(-53.0f, 0.19f, 12.38f),
-    };
-
-    float lamp_posts_rotation[42] =
+    sceneloader.finishLoading();
+    Texture_registry::instance().printStatistics();
+    Texture_arrays::instance().build(); // Every texture is on the GPU by now, so they can be sorted into their arrays
+    Texture_arrays::instance().printStatistics();
+    Geometry_arena::printStatistics();
+    scene.buildOccluders();
+    scene.buildGrass();
+
+    scene.bindProgram("basic", basicshader, &depthbasicshader, &gbufferbasicshader);
+    scene.bindProgram("vegetation", vegetationshader, &depthvegetationshader, &gbuffervegetationshader);
+    scene.bindProgram("grass", grassshader, &depthgrassshader, &gbuffergrassshader);
+    scene.bindProgram("coloredlight", coloredlightshader);
+
+    // The fireflies are the only entities animated from here, every other entity with a light= offset is a lamp post.
+    int fireflies[2] = { scene.findEntity("firefly_1"), scene.findEntity("firefly_2") };
+    int cameraanchor = scene.findEntity("camera"); // The moon hangs off of it
+    if(fireflies[0] == SCENE_NO_PARENT || fireflies[1] == SCENE_NO_PARENT)
     {
-        0.0f, 180.0f, 0.0f, -90.0f, 90.0f, -90.0f, 90.0f, -90.0f, 180.0f, 180.0f, 180.0f, 180.0f, 0.0f,
-        0.0f, 0.0f, -90.0f, -90.0f, 180.0f, 0.0f, 180.0f, 0.0f, 90.0f, 90.0f, 0.0f, 180.0f, 0.0f, 180.0f,
-        180.0f, 180.0f, 180.0f, 0.0f, 0.0f, 0.0f, 180.0f, 0.0f, 180.0f, 0.0f, -90.0f, -90.0f, 90.0f, 90.0f
-    };
+        std::cout << "The scene has no firefly_1 and firefly_2 entities" << std::endl;
+        glfwTerminate();
+        return -3;
+    }
 
-    glm::vec3 stop_signs_translation[5] =
+    std::vector<unsigned int> lamplights;
+    for(unsigned int i = 0; i < scene.entitynames.size(); i++)
+        if(scene.haslight[i] && (int) i != fireflies[0] && (int) i != fireflies[1])
+            lamplights.push_back(i);
+
+    // Every lit program reads its lights from the same two buffers. The point light list holds the 2 fireflies and the lamp posts for basicshader,
+    // followed by the 2 fireflies again with the softer falloff the vegetation has always used for them.
+    const unsigned int lamplightcount = lamplights.size();
+    Light_buffer lightbuffer;
+    lightbuffer.create();
+    lightbuffer.pointlights.resize(2 + lamplightcount + 2);
+    Light_buffer::setPointLightRange(basicshader, 0, 2 + lamplightcount);
+    Light_buffer::setPointLightRange(vegetationshader, 2 + lamplightcount, 2);
+    Light_buffer::setPointLightRange(grassshader, 2 + lamplightcount, 2);
+
+    // The lamp posts never move, so their light is baked into the vertices of the bake=1 entities once, with shadows, and the basic program
+    // only adds them at runtime for everything else. The bake sees the lamps the way the loop below fills them in, just in world space.
+    const glm::vec3 lightcolor = glm::vec3(1.0f, 1.0f, 0.85f);
+    scene.updateTransforms(); // lightPosition() reads the world matrices
+    std::vector<point_light_std430> bakedlamps(lamplightcount);
+    for(unsigned int i = 0; i < lamplightcount; i++)
     {
-        glm::vec3(26.38f,  1.63f, -20.63f),
-        glm::vec3(38.74f,  1.63f, -30.63f),
-        glm::vec3(-65.51f, 1.63f, 21.13f),
-        glm::vec3(38.73f,  1.63f, 21.34f),
-        glm::vec3(-53.17f, 1.63f, -20.92f)
-    };
-
-    glm::vec3 ext_build_5_translation = glm::vec3(58.0f, 0.25f, 0.0f);
-    glm::vec3 ext_build_1_translation = glm::vec3(58.0f, 0.25f, -54.09f);
-    glm::vec3 ext_build_4_translation = glm::vec3(-62.19f, 0.25f, -53.26f);
-    glm::vec3 ext_build_3_translation = glm::vec3(-35.14f, 0.25f, 55.49f);
-    glm::vec3 ext_build_2_translation = glm::vec3( 53.71f, -1.87f, 53.85f);
-
-    glm::vec3 lightcube_positions[2] =
-    {
-        glm::vec3(-24.50f, 1.25f, -40.05f),
-        glm::vec3(-17.0f, 5.75f, -55.25f)
-    };
+        bakedlamps[i].position             = scene.lightPosition(lamplights[i]);
+        bakedlamps[i].ambientstrength      = glm::vec3(0.0f);
+        bakedlamps[i].diffusestrength      = lightcolor * 0.95f;
+        bakedlamps[i].specularstrength     = lightcolor;
+        bakedlamps[i].constantattenuation  = 1.0f;
+        bakedlamps[i].linearattenuation    = 0.09f;
+        bakedlamps[i].quadraticattenuation = 0.032f;
+    }
+    scene.bakeLighting(bakedlamps, rebakelighting);
+    Light_buffer::setBakedLightRange(basicshader, 2, lamplightcount);
+
+    // The deferred lighting pass shades the texels of both programs, each with its own range of the same point light list.
+    Deferred_renderer deferredrenderer;
+    deferredrenderer.create(deferredlightingshader);
+    deferredrenderer.setPointLightRange(DEFERRED_LIGHT_SET_BASIC, 0, 2 + lamplightcount);
+    deferredrenderer.setPointLightRange(DEFERRED_LIGHT_SET_VEGETATION, 2 + lamplightcount, 2);
+    Light_buffer::setBakedLightRange(deferredlightingshader, 2, lamplightcount);
+
+    Light_clusters lightclusters; // Bins those point lights per screen tile and depth slice, the fragment shaders only loop over their own cluster's lights
+    lightclusters.create();
+
+    unsigned long long framecount = 0;
+    float lasttitleupdate = 0.0f;
+
+    // Headless runs fly the path (or the replay) once unless told otherwise, on simulated time that moves a fixed step per frame, so every run sees the same frames.
+    const float scriptduration = replaying ? inputreplay.duration() : camerapath.duration();
+    const unsigned int benchmarkframes = benchmarksettings.frames > 0 ? benchmarksettings.frames : (unsigned int) (scriptduration / benchmarksettings.timestep) + 1;
+    Headless_benchmark benchmark;
+    if(headless && !benchmark.create(benchmarksettings, benchmarkframes))
+        return -4;
+
+    if(replaying)
+        inputreplay.start(cam);
+    else if(!recordpath.empty() && !headless)
+        inputrecorder.open(recordpath, cam, glfwGetTime());
+
+    // The fireflies and the camera's position move in fixed simulation steps, frames draw them in between their last two steps.
+    Simulation_clock simulationclock;
+    simulated_value<glm::vec3> cameraposition, fireflypositions[2];
+    cameraposition.reset(cam.position);
+    fireflypositions[0].reset(scene.translations[fireflies[0]]);
+    fireflypositions[1].reset(scene.translations[fireflies[1]]);
 
     // Main Render loop
-    while(!glfwWindowShouldClose(lightingWindow))
+    while(headless ? framecount < benchmarkframes : !glfwWindowShouldClose(lightingWindow))
     {
-        currentframetime  = glfwGetTime();
-        framedeltatime    = currentframetime - lastframerendered;
+        Frame_profiler &profiler = Frame_profiler::instance();
+        profiler.beginFrame();
+        if(headless)
+            benchmark.beginFrame(framecount);
+        currentframetime  = fixedstep ? framecount * benchmarksettings.timestep : glfwGetTime();
+        framedeltatime    = fixedstep ? benchmarksettings.timestep : currentframetime - lastframerendered; // Exact, so a 1/60 timestep is always one simulation step
         lastframerendered = currentframetime;
 
         glClearColor(0.1, 0.1, 0.1, 1.0);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        inputPolling(lightingWindow);
+        unsigned int profilezone = profiler.beginZone("Input polling", false);
+        unsigned int keys = 0; // Held through every simulation step of this frame, mouse look is applied right away
+        if(replaying)
+        {
+            if(lightingWindow && (glfwGetKey(lightingWindow, GLFW_KEY_ESCAPE) == GLFW_PRESS || inputreplay.finished()))
+                glfwSetWindowShouldClose(lightingWindow, true);
+            keys = inputreplay.advance(cam, currentframetime);
+        }
+        else if(!headless)
+            keys = inputPolling(lightingWindow);
+        profiler.endZone(profilezone);
 
-        viewMatrix = cam.getViewMatrix();
-        modelMatrix = glm::mat4(1.0f);
-        projectionMatrix = glm::perspective(glm::radians(cam.zoom), (float) windowwidth / (float) windowheight, 0.1f, 5000.0f);
 
+        profilezone = profiler.beginZone("Animation and transforms", false);
+        simulationclock.beginFrame(framedeltatime);
+        while(simulationclock.nextStep())
+        {
+            const float step = simulationclock.stepSeconds();
+            const double simulatedtime = simulationclock.time();
+
+            cameraposition.beginStep();
+            applyKeys(keys, step);
+            cameraposition.current = cam.position;
+
+            //animates the fireflies in the grass section, these offsets are per 60Hz step
+            fireflypositions[0].beginStep();
+            fireflypositions[0].current.x -= 0.8*sin(simulatedtime);
+            fireflypositions[0].current.y += 0.10*sin(simulatedtime*6);
+
+            fireflypositions[1].beginStep();
+            fireflypositions[1].current.x -= 0.5*sin(simulatedtime*1);
+            fireflypositions[1].current.y += 0.3*sin(simulatedtime*3);
+            fireflypositions[1].current.z -= 0.5*cos(simulatedtime*1);
+        }
 
-        //animates the fireflies in the grass section
-        lightcube_positions[0].x -= 0.8*sin(glfwGetTime());
-        lightcube_positions[0].y += 0.10*sin(glfwGetTime()*6);
+        if(headless && !replaying)
+        { // The path is already a smooth function of time, it places the camera directly
+            camerapath.apply(cam, currentframetime);
+            cameraposition.reset(cam.position);
+        }
+        if(replaying)
+            inputreplay.compareCamera(cam);
+        inputrecorder.recordCamera(currentframetime, cam); // Only once it changed, after the mouse events of the last poll and this frame's movement
+
+        const float alpha = simulationclock.alpha();
+        Camera_Object viewcam = cam; // Where the camera gets drawn from, between its last two simulated positions
+        viewcam.position = cameraposition.interpolated(alpha);
+        scene.setTranslation(fireflies[0], fireflypositions[0].interpolated(alpha));
+        scene.setTranslation(fireflies[1], fireflypositions[1].interpolated(alpha));
+
+        if(cameraanchor != SCENE_NO_PARENT)
+            scene.setTranslation(cameraanchor, viewcam.position); // Makes the moon seem "Infinitely far away" and not be affected by the player's position
 
-        lightcube_positions[1].x -= 0.5*sin(glfwGetTime()*1);
-        lightcube_positions[1].y += 0.3*sin(glfwGetTime()*3);
-        lightcube_positions[1].z -= 0.5*cos(glfwGetTime()*1);
+        scene.updateTransforms(); // Only the fireflies and whatever hangs off the camera get recomputed
+        profiler.endZone(profilezone);
 
-        glm::vec3 lightcolor = glm::vec3(1.0f, 1.0f, 0.85f);
+        viewMatrix = viewcam.getViewMatrix();
+        projectionMatrix = glm::perspective(glm::radians(viewcam.zoom), (float) framebufferwidth / (float) framebufferheight, 0.1f, 5000.0f);
+        Model_data::setRenderView(viewcam.position, projectionMatrix * viewMatrix, projectionMatrix, framebufferheight); // Every renderModel() call below culls its meshes and picks their detail level from this
+
+        profilezone = profiler.beginZone("Lights and clusters", true);
 
         glm::vec3 diffusecolor = glm::vec3(1.0f);
         glm::vec3 ambientcolor = glm::vec3(1.0f);
@@ -292,6 +429,45 @@ int main ()
         ambientcolor = lightcolor * glm::vec3(0.0f, 0.1f, 0.06f); // Decreases the ambient strength to 15% of its total strength
         diffusecolor = lightcolor * glm::vec3(0.0f, 0.509f, 0.509f); // Decreases the diffuse strength to 55% of its total strength
 
+        // Lights are written once here for every program. Point lights are in view space, like the fragment positions they're shaded against.
+        scene_lights_std140 &scenelights = lightbuffer.scenelights;
+        scenelights.dlight.direction        = glm::vec3(0.2f, 1.0f, 0.1f); // Directional Light
+        scenelights.dlight.ambientstrength  = lightcolor * 0.10f;
+        scenelights.dlight.diffusestrength  = lightcolor * 0.10f;
+        scenelights.dlight.specularstrength = lightcolor;
+
+        scenelights.slight[0].position         = viewcam.position; // Spotlight (Flashlight coming from the camera's position)
+        scenelights.slight[0].direction        = viewcam.front;
+        scenelights.slight[0].coneinnercutoff  = glm::cos(glm::radians(12.5f));
+        scenelights.slight[0].ambientstrength  = glm::vec3(0.0f);
+        scenelights.slight[0].diffusestrength  = lightcolor * 0.55f;
+        scenelights.slight[0].specularstrength = lightcolor;
+
+        for(unsigned int i = 0; i < lightbuffer.pointlights.size(); i++)
+        {
+            point_light_std430 &pointlight = lightbuffer.pointlights[i];
+            bool firefly = i < 2 || i >= 2 + lamplightcount;
+            glm::vec3 worldposition = scene.lightPosition(firefly ? fireflies[i < 2 ? i : i - (2 + lamplightcount)] : lamplights[i - 2]);
+
+            pointlight.position             = glm::vec3(viewMatrix * glm::vec4(worldposition, 1.0f)); // Point (Omnidirectional) Light
+            pointlight.ambientstrength      = glm::vec3(0.0f);
+            pointlight.diffusestrength      = lightcolor * (i < 2 + lamplightcount ? 0.95f : 1.0f);
+            pointlight.specularstrength     = lightcolor;
+            pointlight.constantattenuation  = 1.0f;
+            pointlight.linearattenuation    = 0.09f;
+            pointlight.quadraticattenuation = 0.032f;
+        }
+        lightbuffer.pointlights[2 + lamplightcount].linearattenuation    = 0.04f; // The grass firefly reaches further on the vegetation
+        lightbuffer.pointlights[2 + lamplightcount].quadraticattenuation = 0.007f;
+        lightbuffer.upload();
+
+        lightclusters.setProjection(projectionMatrix, 0.1f, 5000.0f, framebufferwidth, framebufferheight); // Tiles in framebuffer pixels, like gl_FragCoord
+        lightclusters.assignLights(lightbuffer.pointlights);
+        lightclusters.upload();
+        profiler.endZone(profilezone);
+
+        // Camera, material colors and wind time are the same for every draw, the per draw uniforms are set by the scene from each entity's material.
+        profilezone = profiler.beginZone("Uniform setup", false);
         basicshader.useShader();
 
         basicshader.setVec3vect("material.ambientlight", ambientcolor);
@@ -299,78 +475,9 @@ int main ()
         basicshader.setVec3vect("material.specularlight", specularcolor);
         basicshader.setFloat("material.shininessval", 1.0f);
 
-        basicshader.setVec3vect("dlight.ambientstrength",  lightcolor * 0.10f);
-        basicshader.setVec3vect("dlight.diffusestrength",  lightcolor * 0.10f);
-        basicshader.setVec3vect("dlight.specularstrength", lightcolor);
-
-        basicshader.setVec3vect("dlight.direction", glm::vec3(0.2f, 1.0f, 0.1f) ); // Directional Light
-
-        basicshader.setVec3vect("olight[0].position", glm::vec3(viewMatrix * glm::vec4(lightcube_positions[0], 1.0f) ) ); // Point (Omnidirectional) Light
-        basicshader.setVec3vect("olight[0].diffusestrength",  lightcolor * 0.95f);
-        basicshader.setVec3vect("olight[0].specularstrength", lightcolor);
-        basicshader.setFloat("olight[0].constantattenuation",  1.0f);
-        basicshader.setFloat("olight[0].linearattenuation",    0.09f);
-        basicshader.setFloat("olight[0].quadraticattenuation", 0.032f);
-        basicshader.setVec3vect("olight[1].position", glm::vec3(viewMatrix * glm::vec4(lightcube_positions[1], 1.0f) ) ); // Point (Omnidirectional) Light
-        basicshader.setVec3vect("olight[1].diffusestrength",  lightcolor * 0.95f);
-        basicshader.setVec3vect("olight[1].specularstrength", lightcolor);
-        basicshader.setFloat("olight[1].constantattenuation",  1.0f);
-        basicshader.setFloat("olight[1].linearattenuation",    0.09f);
-        basicshader.setFloat("olight[1].quadraticattenuation", 0.032f);
-
-
-        for(int i = 0; i < 42; i++) // Renders 42 extra point lights in order to destroy the iGPU, localized on the map's lamp posts.
-        {
-            std::stringstream olightstr;
-
-            olightstr  << "olight[" << i+2 << "].position" ;
-            if(lamp_posts_rotation[i] == 0.0f)
-                basicshader.setVec3vect( (const std::string&) olightstr.str(), glm::vec3(viewMatrix * glm::vec4(lamp_posts_translation[i] + glm::vec3(-0.8f, 2.0f, 0.0f), 1.0f) ) );
-
-            else if (lamp_posts_rotation[i] == 90.0f)
-                basicshader.setVec3vect( (const std::string&) olightstr.str(), glm::vec3(viewMatrix * glm::vec4(lamp_posts_translation[i] + glm::vec3(0.0f, 2.0f, -0.8f), 1.0f) ) );
-
-            else if (lamp_posts_rotation[i] == -90.0f)
-                basicshader.setVec3vect( (const std::string&) olightstr.str(), glm::vec3(viewMatrix * glm::vec4(lamp_posts_translation[i] + glm::vec3(0.0f, 2.0f, 0.8f), 1.0f) ) );
-
-            else if (lamp_posts_rotation[i] == 180.0f)
-                basicshader.setVec3vect( (const std::string&) olightstr.str(), glm::vec3(viewMatrix * glm::vec4(lamp_posts_translation[i] + glm::vec3(0.8f, 2.0f, 0.0f), 1.0f) ) );
-
-
-            olightstr.str("");
-            olightstr  << "olight[" << i+2 << "].diffusestrength" ;
-            basicshader.setVec3vect( (const std::string&) olightstr.str(),  lightcolor * 0.95f);
-
-            olightstr.str("");
-            olightstr  << "olight[" << i+2 << "].specularstrength" ;
-            basicshader.setVec3vect( (const std::string&) olightstr.str(), lightcolor);
-
-            olightstr.str("");
-            olightstr  << "olight[" << i+2 << "].constantattenuation" ;
-            basicshader.setFloat( (const std::string&) olightstr.str(), 1.0f);
-
-            olightstr.str("");
-            olightstr  << "olight[" << i+2 << "].linearattenuation" ;
-            basicshader.setFloat( (const std::string&) olightstr.str(), 0.09f);
-
-            olightstr.str("");
-            olightstr  << "olight[" << i+2 << "].quadraticattenuation" ;
-            basicshader.setFloat( (const std::string&) olightstr.str(), 0.032f);
-        }
-
-        basicshader.setVec3vect("slight[0].diffusestrength",  lightcolor * 0.55f);
-        basicshader.setVec3vect("slight[0].specularstrength", lightcolor);
-        basicshader.setMat4("slight[0].viewmatrix", viewMatrix); // Spotlight (Flashlight coming from the camera's position)
-        basicshader.setVec3vect("slight[0].position", cam.position); // Spotlight (Flashlight coming from the camera's position)
-        basicshader.setVec3vect("slight[0].direction", cam.front); // Spotlight (Flashlight coming from the camera's position)
-        basicshader.setFloat("slight[0].coneinnercutoff", glm::cos(glm::radians(12.5f)));
-
-
         basicshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
         basicshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-        basicshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-        basicshader.setMat4("modelmatrix", modelMatrix);
-        basicshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
+        basicshader.setMat4("projectionmatrix", projectionMatrix);
 
 
         vegetationshader.useShader();
@@ -380,360 +487,195 @@ int main ()
         vegetationshader.setVec3vect("material.specularlight", specularcolor);
         vegetationshader.setFloat("material.shininessval", 1.0f);
 
-        vegetationshader.setVec3vect("dlight.ambientstrength",  lightcolor * 0.10f);
-        vegetationshader.setVec3vect("dlight.diffusestrength",  lightcolor * 0.10f);
-        vegetationshader.setVec3vect("dlight.specularstrength", lightcolor);
-
-        vegetationshader.setVec3vect("dlight.direction", glm::vec3(0.2f, 1.0f, 0.1f) ); // Directional Light
-
-
-        vegetationshader.setVec3vect("olight[0].position", glm::vec3(viewMatrix * glm::vec4(lightcube_positions[0], 1.0f) ) ); // Point (Omnidirectional) Light
-        vegetationshader.setVec3vect("olight[0].diffusestrength",  lightcolor * 1.0f);
-        vegetationshader.setVec3vect("olight[0].specularstrength", lightcolor);
-        vegetationshader.setFloat("olight[0].constantattenuation",  1.0f);
-        vegetationshader.setFloat("olight[0].linearattenuation",    0.04f);
-        vegetationshader.setFloat("olight[0].quadraticattenuation", 0.007f);
-        vegetationshader.setVec3vect("olight[1].position", glm::vec3(viewMatrix * glm::vec4(lightcube_positions[1], 1.0f) ) ); // Point (Omnidirectional) Light
-        vegetationshader.setVec3vect("olight[1].diffusestrength",  lightcolor * 1.0f);
-        vegetationshader.setVec3vect("olight[1].specularstrength", lightcolor);
-        vegetationshader.setFloat("olight[1].constantattenuation",  1.0f);
-        vegetationshader.setFloat("olight[1].linearattenuation",    0.09f);
-        vegetationshader.setFloat("olight[1].quadraticattenuation", 0.032f);
-        vegetationshader.setVec3vect("olight[1].position", glm::vec3(viewMatrix * glm::vec4(lightcube_positions[1], 1.0f) ) ); // Point (Omnidirectional) Light
-        vegetationshader.setVec3vect("olight[1].diffusestrength",  lightcolor * 1.0f);
-        vegetationshader.setVec3vect("olight[1].specularstrength", lightcolor);
-        vegetationshader.setFloat("olight[1].constantattenuation",  1.0f);
-        vegetationshader.setFloat("olight[1].linearattenuation",    0.09f);
-        vegetationshader.setFloat("olight[1].quadraticattenuation", 0.032f);
-
-        vegetationshader.setVec3vect("slight[0].diffusestrength",  lightcolor * 0.55f);
-        vegetationshader.setVec3vect("slight[0].specularstrength", lightcolor);
-        vegetationshader.setMat4("slight[0].viewmatrix", viewMatrix); // Spotlight (Flashlight coming from the camera's position)
-        vegetationshader.setVec3vect("slight[0].position", cam.position); // Spotlight (Flashlight coming from the camera's position)
-        vegetationshader.setVec3vect("slight[0].direction", cam.front); // Spotlight (Flashlight coming from the camera's position)
-        vegetationshader.setFloat("slight[0].coneinnercutoff", glm::cos(glm::radians(12.5f)));
-        vegetationshader.setFloat("runtime", glfwGetTime());
-        vegetationshader.setFloat("forcex", 1.0f);
-        vegetationshader.setFloat("forcey", 0.4f);
-        vegetationshader.setFloat("forcez", 0.4f);
-
-        vegetationshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
-        vegetationshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-        vegetationshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-        vegetationshader.setMat4("modelmatrix", modelMatrix);
-        vegetationshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
+        float runtime = currentframetime; // The twins of the vegetation and grass programs have to sway by the exact same amount
+        vegetationshader.setFloat("runtime", runtime);
 
-        basicshader.useShader();
-
-        terrain.renderModel(basicshader);
-
-        vegetationshader.useShader();
-
-        vegetationshader.setFloat("forcex", 0.1f);
-        vegetationshader.setFloat("forcey", 0.0f);
-        vegetationshader.setFloat("forcez", 0.0f);
-        vegetationshader.setBool("emit", true);
-
-        modelMatrix = glm::mat4(1.0f);
-        modelMatrix = glm::translate(modelMatrix, grass_types_translation[0]);
-
-
-        vegetationshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
-        vegetationshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-        vegetationshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-        vegetationshader.setMat4("modelmatrix", modelMatrix);
-        vegetationshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
-
-        grass_1.renderModel(vegetationshader);
-
-
-
-        modelMatrix = glm::mat4(1.0f);
-        modelMatrix = glm::translate(modelMatrix, grass_types_translation[1]);
-
-
-        vegetationshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
+        vegetationshader.setMat4("viewmatrix", viewMatrix);
         vegetationshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-        vegetationshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-        vegetationshader.setMat4("modelmatrix", modelMatrix);
-        vegetationshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
-        vegetationshader.setBool("emit", false);
+        vegetationshader.setMat4("projectionmatrix", projectionMatrix);
 
-        grass_2.renderModel(vegetationshader);
 
+        grassshader.setFloat("material.shininessval", 1.0f);
+        grassshader.setFloat("runtime", runtime);
+        grassshader.setMat4("viewmatrix", viewMatrix);
+        grassshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
+        grassshader.setMat4("projectionmatrix", projectionMatrix);
 
-        modelMatrix = glm::mat4(1.0f);
-        modelMatrix = glm::translate(modelMatrix, grass_types_translation[2]);
 
-        vegetationshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
-        vegetationshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-        vegetationshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-        vegetationshader.setMat4("modelmatrix", modelMatrix);
-        vegetationshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
+        depthbasicshader.setMat4("viewmatrix", viewMatrix);
+        depthbasicshader.setMat4("projectionmatrix", projectionMatrix);
 
-        grass_small.renderModel(vegetationshader);
+        depthvegetationshader.setFloat("runtime", runtime);
+        depthvegetationshader.setMat4("viewmatrix", viewMatrix);
+        depthvegetationshader.setMat4("projectionmatrix", projectionMatrix);
 
-        modelMatrix = glm::mat4(1.0f);
-        modelMatrix = glm::translate(modelMatrix, shrubs_translation);
-        modelMatrix = glm::rotate(modelMatrix, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        depthgrassshader.setFloat("runtime", runtime);
+        depthgrassshader.setMat4("viewmatrix", viewMatrix);
+        depthgrassshader.setMat4("projectionmatrix", projectionMatrix);
 
-        vegetationshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
-        vegetationshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-        vegetationshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-        vegetationshader.setMat4("modelmatrix", modelMatrix);
-        vegetationshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
+        gbufferbasicshader.setMat4("viewmatrix", viewMatrix);
+        gbufferbasicshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
+        gbufferbasicshader.setMat4("projectionmatrix", projectionMatrix);
 
-        shrubs.renderModel(vegetationshader);
+        gbuffervegetationshader.setFloat("runtime", runtime);
+        gbuffervegetationshader.setMat4("viewmatrix", viewMatrix);
+        gbuffervegetationshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
+        gbuffervegetationshader.setMat4("projectionmatrix", projectionMatrix);
 
-        basicshader.useShader();
+        gbuffergrassshader.setFloat("runtime", runtime);
+        gbuffergrassshader.setMat4("viewmatrix", viewMatrix);
+        gbuffergrassshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
+        gbuffergrassshader.setMat4("projectionmatrix", projectionMatrix);
 
-        modelMatrix = glm::mat4(1.0f);
-        modelMatrix = glm::translate(modelMatrix, moon_translation + cam.position); // Makes the moon seem "Infinitely far away" and not be affected by the player's position
+        deferredlightingshader.setFloat("material.shininessval", 1.0f);
+        deferredlightingshader.setMat4("inverseprojectionmatrix", glm::inverse(projectionMatrix)); // Back from the depth buffer to view space
 
-        basicshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
-        basicshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-        basicshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-        basicshader.setMat4("modelmatrix", modelMatrix);
-        basicshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
-        basicshader.setBool("emit", true);
-        basicshader.setFloat("emitmul", 1.8f);
 
-        moon.renderModel(basicshader);
+        coloredlightshader.useShader();
 
-        modelMatrix = glm::mat4(1.0f);
+        coloredlightshader.setMat4("projectionmatrix", projectionMatrix);
+        coloredlightshader.setMat4("viewmatrix", viewMatrix);
+        coloredlightshader.setVec3vect("lightcolor", lightcolor);
+        profiler.endZone(profilezone);
 
-        basicshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
-        basicshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-        basicshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-        basicshader.setMat4("modelmatrix", modelMatrix);
-        basicshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
-        basicshader.setFloat("emitmul", 1.0f);
-
-        skybox.renderModel(basicshader);
-
-
-
-        modelMatrix = glm::mat4(1.0f);
-        modelMatrix = glm::translate(modelMatrix, tree_and_leaves_translation[0]);
-
-
-        basicshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
-        basicshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-        basicshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-        basicshader.setMat4("modelmatrix", modelMatrix);
-        basicshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
-        basicshader.setBool("emit", false);
-
-        big_tree.renderModel(basicshader);
-
-
-
-        vegetationshader.useShader();
-
-        modelMatrix = glm::mat4(1.0f);
-        modelMatrix = glm::translate(modelMatrix, tree_and_leaves_translation[1]);
-
-        vegetationshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
-        vegetationshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-        vegetationshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-        vegetationshader.setMat4("modelmatrix", modelMatrix);
-        vegetationshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
-        vegetationshader.setFloat("forcex", 1.0f);
-        vegetationshader.setFloat("forcey", 0.4f);
-        vegetationshader.setFloat("forcez", 0.4f);
-
-        tree_leaves.renderModel(vegetationshader);
-
-
-        for(int i = 0; i < 4; i++) // Renders the maple trees and their leaves.
-        {
-            basicshader.useShader();
-
-            modelMatrix = glm::mat4(1.0f);
-            modelMatrix = glm::translate(modelMatrix, mapletree_and_leaves_translation[i]);
-            modelMatrix = glm::rotate(modelMatrix, glm::radians(i*90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-
-            basicshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
-            basicshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-            basicshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-            basicshader.setMat4("modelmatrix", modelMatrix);
-            basicshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
-
-            maple_tree.renderModel(basicshader);
-
-            vegetationshader.useShader();
-
-            modelMatrix = glm::mat4(1.0f);
-            modelMatrix = glm::translate(modelMatrix, mapletree_and_leaves_translation[i]);
-            modelMatrix = glm::rotate(modelMatrix, glm::radians(i*90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-
-            vegetationshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
-            vegetationshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-            vegetationshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-            vegetationshader.setMat4("modelmatrix", modelMatrix);
-            vegetationshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
-
-            maple_tree_leaves.renderModel(vegetationshader);
-        }
-
-        basicshader.useShader();
-
-        modelMatrix = glm::mat4(1.0f);
-        modelMatrix = glm::translate(modelMatrix, plant_holder_translation);
-
-
-        basicshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
-        basicshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-        basicshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-        basicshader.setMat4("modelmatrix", modelMatrix);
-        basicshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
-
-        plant_holder.renderModel(basicshader);
-
-        for(int i = 0; i < 42; i++) // Renders the lamp posts spread throughout the scene
-        {
-            modelMatrix = glm::mat4(1.0f);
-            modelMatrix = glm::translate(modelMatrix, lamp_posts_translation[i]);
-            modelMatrix = glm::rotate(modelMatrix, glm::radians(lamp_posts_rotation[i]), glm::vec3(0.0f, 1.0f, 0.0f));
-
-
-            basicshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
-            basicshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-            basicshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-            basicshader.setMat4("modelmatrix", modelMatrix);
-            basicshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
-
-            lamp_post.renderModel(basicshader);
-        }
-
-
-        for(int i = 0; i < 5; i++) // Renders the stop signs
-        {
-            modelMatrix = glm::mat4(1.0f);
-            modelMatrix = glm::translate(modelMatrix, stop_signs_translation[i]);
-            modelMatrix = glm::rotate(modelMatrix, glm::radians(i*90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        profilezone = profiler.beginZone("Scene render", true);
+        scene.setDepthPrepass(depthprepass);
+        scene.setOcclusionCulling(occlusionculling);
+        scene.setDeferred(deferredshading ? &deferredrenderer : nullptr);
+        scene.render();
+        profiler.endZone(profilezone);
 
+        //std::cout << "Cam Pos: X " << cam.position.x << " | Y " << cam.position.y << " | Z " << cam.position.z << std::endl;
 
-            basicshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
-            basicshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-            basicshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-            basicshader.setMat4("modelmatrix", modelMatrix);
-            basicshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
 
-            stop_sign.renderModel(basicshader);
+        if(lightingWindow && currentframetime - lasttitleupdate >= 1.0f)
+        { // Culling, LOD and render queue figures of the frame just drawn, refreshed once a second
+            const render_view &view = Model_data::renderView();
+            const render_queue_stats &queuestats = scene.renderQueue().stats();
+            double framemilliseconds = profiler.averageFrameMilliseconds(); // Over the profiler's ring, a few seconds
+            char frametime[64];
+            std::snprintf(frametime, sizeof(frametime), "%.0f fps (%.2f ms), ", framemilliseconds > 0.0 ? 1000.0 / framemilliseconds : 0.0, framemilliseconds);
+            std::string windowtitle = "OpenGL4.3: CG-Final | " + std::string(frametime) + std::to_string(view.meshesvisible) + " meshes drawn, " + std::to_string(view.meshesculled) + " culled, " + std::to_string(view.meshesoccluded) + " occluded, "
+                                    + std::to_string(view.trianglesdrawn) + " triangles, " + std::to_string(scene.grassBladesDrawn()) + " grass blades, " + std::to_string(queuestats.changes()) + " state changes ("
+                                    + std::to_string((int) queuestats.unsortedChanges() - (int) queuestats.changes()) + " saved by sorting), "
+                                    + std::to_string(queuestats.drawcalls) + " draw calls, " + std::to_string(queuestats.fragmentsshaded) + " fragments shaded";
+            windowtitle += queuestats.deferred ? ", deferred" : ", forward";
+            if(queuestats.depthprepass)
+                windowtitle += " (" + std::to_string(queuestats.fragmentsprepassed) + " without the depth pre-pass)";
+            glfwSetWindowTitle(lightingWindow, windowtitle.c_str());
+            lasttitleupdate = currentframetime;
         }
 
-
-            modelMatrix = glm::mat4(1.0f);
-            modelMatrix = glm::translate(modelMatrix, ext_build_5_translation);
-
-            basicshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
-            basicshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-            basicshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-            basicshader.setMat4("modelmatrix", modelMatrix);
-            basicshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
-
-            ext_build_5.renderModel(basicshader);
-
-            modelMatrix = glm::mat4(1.0f);
-            modelMatrix = glm::translate(modelMatrix, ext_build_4_translation);
-
-            basicshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
-            basicshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-            basicshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-            basicshader.setMat4("modelmatrix", modelMatrix);
-            basicshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
-
-            ext_build_4.renderModel(basicshader);
-
-            modelMatrix = glm::mat4(1.0f);
-            modelMatrix = glm::translate(modelMatrix, ext_build_1_translation);
-
-            basicshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
-            basicshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-            basicshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-            basicshader.setMat4("modelmatrix", modelMatrix);
-            basicshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
-
-            ext_build_1.renderModel(basicshader);
-
-            modelMatrix = glm::mat4(1.0f);
-            modelMatrix = glm::translate(modelMatrix, ext_build_3_translation);
-
-            basicshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
-            basicshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-            basicshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-            basicshader.setMat4("modelmatrix", modelMatrix);
-            basicshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
-
-            ext_build_3.renderModel(basicshader);
-
-            modelMatrix = glm::mat4(1.0f);
-            modelMatrix = glm::translate(modelMatrix, ext_build_2_translation);
-
-            basicshader.setMat4("viewmatrix", viewMatrix); // Gets the camera's position in order to calculate lighting normals and fragments according to it.
-            basicshader.setMat4("transinvviewmatrix", glm::transpose(glm::inverse(viewMatrix)));
-            basicshader.setMat4("projectionmatrix", projectionMatrix); // Both of those matrices can be put inside the for() render loop, but are not necessary
-            basicshader.setMat4("modelmatrix", modelMatrix);
-            basicshader.setMat4("transinvmodelmatrix", glm::transpose(glm::inverse(modelMatrix)));
-
-            ext_build_2.renderModel(basicshader);
-
-
-
-        for(int i = 0; i < 2; i ++) // renders the little "fireflies" near the grass section
+        profilezone = profiler.beginZone("Buffer swap", false); // Mostly waiting on vsync
+        if(headless)
+            benchmark.endFrame(framecount);
+        else
         {
-            modelMatrix = glm::mat4(1.0f);
-            modelMatrix = glm::translate(modelMatrix, lightcube_positions[i]);
-            modelMatrix = glm::scale(modelMatrix, glm::vec3(0.075f));
-
-            coloredlightshader.useShader();
-
-            coloredlightshader.setMat4("projectionmatrix", projectionMatrix);
-            coloredlightshader.setMat4("viewmatrix", viewMatrix);
-            coloredlightshader.setMat4("modelmatrix", modelMatrix);
-            coloredlightshader.setVec3vect("lightcolor", lightcolor);
-
-            lightcube.renderModel(coloredlightshader);
+            glfwSwapBuffers(lightingWindow);
+            glfwPollEvents();
         }
-
-        //std::cout << "Cam Pos: X " << cam.position.x << " | Y " << cam.position.y << " | Z " << cam.position.z << std::endl;
-
-
-        glfwSwapBuffers(lightingWindow);
-        glfwPollEvents();
+        profiler.endZone(profilezone);
+        profiler.endFrame();
+        framecount++;
     }
 
+    if(headless)
+        benchmark.printStatistics();
+    if(replaying)
+        inputreplay.printStatistics(cam);
+    inputrecorder.close();
+    Shader::printUniformStatistics(framecount);
+    scene.renderQueue().printStatistics(framecount);
+    scene.occlusionCuller().printStatistics();
+    Frame_profiler::instance().printSummary("", PROFILER_TOP_ZONES, true);
+    Frame_profiler::instance().printSummary("model ", PROFILER_TOP_ZONES);
+    if(!tracepath.empty())
+        Frame_profiler::instance().exportChromeTrace(tracepath);
+
     //OpenGL cleanup, and Window termination.
+    scene.releaseTextures(); // Textures are shared through the registry, so they're only freed once the last model using them lets go.
+    Texture_arrays::instance().destroy();
+    Geometry_arena::destroyAll();
+
+    benchmark.destroy();
+    Frame_profiler::instance().destroy();
+    deferredrenderer.destroy();
+    lightclusters.destroy();
+    lightbuffer.destroy();
     glDeleteShader(vegetationshader.shader_id);
     glDeleteShader(coloredlightshader.shader_id);
     glDeleteShader(basicshader.shader_id);
+    glDeleteShader(grassshader.shader_id);
+    glDeleteShader(depthvegetationshader.shader_id);
+    glDeleteShader(depthbasicshader.shader_id);
+    glDeleteShader(depthgrassshader.shader_id);
+    glDeleteShader(gbuffervegetationshader.shader_id);
+    glDeleteShader(gbufferbasicshader.shader_id);
+    glDeleteShader(gbuffergrassshader.shader_id);
+    glDeleteShader(deferredlightingshader.shader_id);
+    headlesscontext.destroy();
     glfwTerminate();
     return 0;
 }
 
 
-void inputPolling(GLFWwindow *window)
-{
-    bool running = false, crouching = false;
-
+unsigned int inputPolling(GLFWwindow *window)
+{ // Only reads and logs the keys, they're applied once per simulation step
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
-    if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
+    unsigned int keys = pollKeys(window);
+    inputrecorder.recordFrame(currentframetime, framedeltatime, keys);
+    return keys;
+}
+
+
+unsigned int pollKeys(GLFWwindow *window)
+{ // The live key state, in the same form the input log stores it
+    const int glfwkeys[9] = { GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_LEFT_SHIFT, GLFW_KEY_LEFT_CONTROL, GLFW_KEY_P, GLFW_KEY_O, GLFW_KEY_G };
+    const unsigned int inputkeys[9] = { INPUT_KEY_FORWARD, INPUT_KEY_BACKWARDS, INPUT_KEY_LEFT, INPUT_KEY_RIGHT, INPUT_KEY_RUN, INPUT_KEY_CROUCH, INPUT_KEY_PREPASS, INPUT_KEY_OCCLUSION, INPUT_KEY_DEFERRED };
+
+    unsigned int keys = 0;
+    for(int i = 0; i < 9; i++)
+        if(glfwGetKey(window, glfwkeys[i]) == GLFW_PRESS)
+            keys |= inputkeys[i];
+    return keys;
+}
+
+
+void applyKeys(unsigned int keys, float deltatime)
+{ // Whether the keys come from the keyboard or an input log, they move the camera and flip the toggles the same way
+    bool running = false, crouching = false;
+
+    bool prepasskey = keys & INPUT_KEY_PREPASS;
+    if(prepasskey && !prepasskeyheld) // Once per press, not once per frame the key stays down
+        depthprepass = !depthprepass;
+    prepasskeyheld = prepasskey;
+
+    bool occlusionkey = keys & INPUT_KEY_OCCLUSION;
+    if(occlusionkey && !occlusionkeyheld)
+        occlusionculling = !occlusionculling;
+    occlusionkeyheld = occlusionkey;
+
+    bool deferredkey = keys & INPUT_KEY_DEFERRED;
+    if(deferredkey && !deferredkeyheld)
+        deferredshading = !deferredshading;
+    deferredkeyheld = deferredkey;
+
+    if (keys & INPUT_KEY_RUN)
         running = true;
 
-    else if(glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
+    else if(keys & INPUT_KEY_CROUCH)
         crouching = true;
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        cam.checkKeyboardPresses(MOVE_FORWARD, running, crouching, framedeltatime);
-    else if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        cam.checkKeyboardPresses(MOVE_BACKWARDS, running, crouching, framedeltatime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        cam.checkKeyboardPresses(MOVE_LEFT, running, crouching, framedeltatime);
-    else if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        cam.checkKeyboardPresses(MOVE_RIGHT, running, crouching, framedeltatime);
+    if (keys & INPUT_KEY_FORWARD)
+        cam.checkKeyboardPresses(MOVE_FORWARD, running, crouching, deltatime);
+    else if (keys & INPUT_KEY_BACKWARDS)
+        cam.checkKeyboardPresses(MOVE_BACKWARDS, running, crouching, deltatime);
+    if (keys & INPUT_KEY_LEFT)
+        cam.checkKeyboardPresses(MOVE_LEFT, running, crouching, deltatime);
+    else if (keys & INPUT_KEY_RIGHT)
+        cam.checkKeyboardPresses(MOVE_RIGHT, running, crouching, deltatime);
 }
 
 
@@ -751,16 +693,27 @@ void mousePolling(GLFWwindow *window, double xposition, double yposition)
     mouselastxposition = xposition;
     mouselastyposition = yposition;
 
+    if(inputreplay.replaying()) // The log is steering
+        return;
+    inputrecorder.recordMouse(glfwGetTime(), mousexoffset, mouseyoffset);
     cam.checkMouseMovement(mousexoffset, mouseyoffset);
 }
 
 
 void mouseWheelPolling(GLFWwindow* window, double xoffset, double yoffset)
 {
+    if(inputreplay.replaying())
+        return;
+    inputrecorder.recordScroll(glfwGetTime(), yoffset);
     cam.checkMouseWheel(yoffset);
 }
 
 void resizewin(GLFWwindow* window, int width, int height)
-{
+{ // Minimizing reports 0x0, the last real size is kept so the projection's aspect never divides by zero
+    if(width <= 0 || height <= 0)
+        return;
+
+    framebufferwidth  = width;
+    framebufferheight = height;
     glViewport(0, 0, width, height);
 }
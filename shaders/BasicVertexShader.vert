@@ -4,6 +4,10 @@ layout (location = 1) in vec3 attributenormals;
 layout (location = 2) in vec2 attribtexcoords;
 layout (location = 3) in vec2 attribtangent;
 layout (location = 4) in vec2 attribbitangent;
+layout (location = 5) in mat4 instancemodelmatrix;  // Per instance, locations 5 to 8, streamed by Render_queue for every draw
+layout (location = 9) in mat3 instancenormalmatrix; // Per instance, locations 9 to 11
+layout (location = 12) in uint instancedrawindex;   // Which DrawData element belongs to the draw this instance came from
+layout (location = 13) in uint instancebakedoffset; // Start of the instance's block in BakedLighting, all bits set (INSTANCE_NOT_BAKED) when it has none
 
 out vec3 diromnifragmentposition;
 out vec3 spotfragmentposition;
@@ -11,21 +15,66 @@ out vec3 directionalspotnormals;
 out vec3 omninormals;
 
 out vec2 texturecoord;
+flat out uint drawindex; // Lets the fragment shader find the draw's textures in DrawData
+flat out uint lightsbaked; // Non zero when bakedlight already holds the baked lights, the fragment shader then skips them
+out vec3 bakedlight;
+invariant gl_Position; // The depth pre-pass links this same shader into another program, GL_EQUAL needs both to land on the exact same depth
+
+struct DrawData // Laid out to match draw_data_std430 in tools/Render_queue.hpp
+{
+    vec3 positiondecodemin;
+    uint packedvertices; // Packed meshes store quantized positions and octahedral normals (see tools/Vertex_packing.hpp)
+    vec3 positiondecodeextent;
+    int bakedvertexbias; // Added to gl_VertexID to find the vertex inside an instance's BakedLighting block
+    uvec4 materialtextures;
+};
+
+layout (std430, binding = 4) readonly buffer DrawRecords // DRAW_DATA_BINDING, one element per mesh drawn this frame
+{
+    DrawData drawdata[];
+};
+
+layout (std430, binding = 5) readonly buffer BakedLighting // BAKED_LIGHTING_BINDING, the diffuse light of the static lights per vertex, RGB as half floats (see tools/Light_baker.hpp)
+{
+    uvec2 bakedlighting[];
+};
 
-uniform mat4 modelmatrix;
 uniform mat4 viewmatrix;
 uniform mat4 projectionmatrix;
-uniform mat4 transinvmodelmatrix;
 uniform mat4 transinvviewmatrix;
 
+vec3 octDecode(vec2 encoded)
+{
+    vec3 decoded = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-decoded.z, 0.0f);
+    decoded.x += decoded.x >= 0.0f ? -fold : fold;
+    decoded.y += decoded.y >= 0.0f ? -fold : fold;
+    return normalize(decoded);
+}
+
 void main()
 {
-    spotfragmentposition = vec3(modelmatrix * vec4(attributepos, 1.0f));
-    diromnifragmentposition = vec3(viewmatrix * modelmatrix * vec4(attributepos, 1.0f));
+    DrawData draw = drawdata[instancedrawindex];
+    vec3 vertexpos = draw.positiondecodemin + attributepos * draw.positiondecodeextent;
+    vec3 vertexnormals = draw.packedvertices != 0u ? octDecode(attributenormals.xy) : attributenormals;
+    mat4 objectmatrix = instancemodelmatrix;
+    mat3 normalmatrix = instancenormalmatrix;
+
+    spotfragmentposition = vec3(objectmatrix * vec4(vertexpos, 1.0f));
+    diromnifragmentposition = vec3(viewmatrix * objectmatrix * vec4(vertexpos, 1.0f));
+
+    directionalspotnormals = normalmatrix * vertexnormals;
+    omninormals = mat3(transinvviewmatrix) * normalmatrix * vertexnormals; // Here we need the transposed inverse view matrix because the light source is a point in a near space, not coming from the camera or an infinitely far distance.
 
-    directionalspotnormals = mat3(transinvmodelmatrix) * attributenormals;
-    omninormals = mat3(transinvviewmatrix) * mat3(transinvmodelmatrix) * attributenormals; // Here we need the transposed inverse view matrix because the light source is a point in a near space, not coming from the camera or an infinitely far distance.
+    lightsbaked = instancebakedoffset != 0xFFFFFFFFu ? 1u : 0u;
+    bakedlight = vec3(0.0f);
+    if(lightsbaked != 0u)
+    { // gl_VertexID already includes the arena's basevertex, the bias swaps it for the mesh's place among the model's vertices
+        uvec2 packedlight = bakedlighting[int(instancebakedoffset) + draw.bakedvertexbias + gl_VertexID];
+        bakedlight = vec3(unpackHalf2x16(packedlight.x), unpackHalf2x16(packedlight.y).x);
+    }
 
     texturecoord = attribtexcoords;
-    gl_Position = projectionmatrix * viewmatrix * modelmatrix * vec4(attributepos, 1.0f);
+    drawindex = instancedrawindex;
+    gl_Position = projectionmatrix * viewmatrix * objectmatrix * vec4(vertexpos, 1.0f);
 }
@@ -0,0 +1,115 @@
+#version 430 core
+// The deferred path's lighting pass. Every pixel the G-buffer covers gets the point lights of its cluster, picked and summed the same way
+// the forward programs do it, on top of the lighting the G-buffer fragment shaders already left in GBUFFER_LIGHTING.
+struct shader_material
+{
+    float shininessval;
+};
+
+struct OmniLight // Laid out to match point_light_std430 in tools/Light_buffer.hpp
+{
+    vec3 position;
+    float constantattenuation;
+    vec3 ambientstrength;
+    float linearattenuation;
+    vec3 diffusestrength;
+    float quadraticattenuation;
+    vec3 specularstrength;
+};
+
+#define DEFERRED_LIGHT_SETS 2
+
+in vec2 screencoord;
+
+uniform shader_material material;
+uniform sampler2D gbufferalbedo;   // Units 0 to 4, see Deferred_renderer::create()
+uniform sampler2D gbuffernormal;
+uniform sampler2D gbufferspecular;
+uniform sampler2D gbufferlighting;
+uniform sampler2D gbufferdepth;
+uniform mat4 inverseprojectionmatrix;
+
+layout (std430, binding = 1) readonly buffer PointLights // POINT_LIGHTS_BINDING, as many lights as the scene has
+{
+    OmniLight olight[];
+};
+
+layout (std430, binding = 2) readonly buffer LightClusters // LIGHT_CLUSTERS_BINDING, built by Light_clusters every frame
+{
+    uvec4 clustergrid;     // Cluster counts in x, y and z
+    vec4  clusterscale;    // Pixels per tile in x and y, scale and bias from log(view depth) to the depth slice
+    uvec2 clusterranges[]; // Offset into clusterlightindices and light count of every cluster
+};
+
+layout (std430, binding = 3) readonly buffer LightClusterIndices // LIGHT_CLUSTER_INDICES_BINDING
+{
+    uint clusterlightindices[];
+};
+
+uniform int pointlightfirst[DEFERRED_LIGHT_SETS]; // One slice of PointLights per light set, see Deferred_renderer::setPointLightRange()
+uniform int pointlightcount[DEFERRED_LIGHT_SETS];
+uniform int bakedlightfirst = 0; // Skipped for texels the G-buffer marked as baked, see Light_buffer::setBakedLightRange()
+uniform int bakedlightcount = 0;
+
+out vec4 fragmentColor;
+
+vec4 diffusetexel, speculartexel;
+
+vec3 calculateOmniLight(OmniLight lightobj, vec3 omninormals, vec3 fragmentposition);
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gbufferdepth, texel, 0).r;
+    if(depth >= 1.0f) // Nothing was drawn here, the clear color stays
+        discard;
+
+    vec4 normalflags = texelFetch(gbuffernormal, texel, 0);
+    diffusetexel  = texelFetch(gbufferalbedo, texel, 0);
+    speculartexel = texelFetch(gbufferspecular, texel, 0);
+    vec3 resultantlighting = texelFetch(gbufferlighting, texel, 0).rgb;
+
+    vec4 viewposition = inverseprojectionmatrix * vec4(vec3(screencoord, depth) * 2.0f - 1.0f, 1.0f);
+    vec3 fragmentposition = viewposition.xyz / viewposition.w;
+
+    uint flags = uint(normalflags.w + 0.5f);
+    uint lightset = flags & 1u;
+    bool lightsbaked = (flags & 2u) != 0u;
+    int first = pointlightfirst[lightset], count = pointlightcount[lightset];
+
+    uvec3 cluster = uvec3(min(uvec2(gl_FragCoord.xy / clusterscale.xy), clustergrid.xy - 1u),
+                          uint(clamp(log(max(-fragmentposition.z, 1e-4f)) * clusterscale.z + clusterscale.w, 0.0f, float(clustergrid.z - 1u))));
+    uvec2 clusterrange = clusterranges[cluster.x + clustergrid.x * (cluster.y + clustergrid.y * cluster.z)];
+
+    for(uint j = 0u; j < clusterrange.y; j++)
+    {
+        int i = int(clusterlightindices[clusterrange.x + j]);
+        bool baked = lightsbaked && i >= bakedlightfirst && i < bakedlightfirst + bakedlightcount;
+        if(i >= first && i < first + count && !baked)
+            resultantlighting += calculateOmniLight(olight[i], normalflags.xyz, fragmentposition);
+    }
+
+    fragmentColor = vec4(resultantlighting, 1.0);
+    gl_FragDepth = depth;
+}
+
+vec3 calculateOmniLight(OmniLight lightobj, vec3 omninormals, vec3 fragmentposition)
+{ // The forward programs'
+    float lightdist = length(lightobj.position - fragmentposition);
+    float lightattenuation = 1.0/(lightobj.constantattenuation + lightobj.linearattenuation * lightdist + lightobj.quadraticattenuation * (lightdist * lightdist));
+
+    vec3 normalized = normalize(omninormals);
+    vec3 lightdirection = normalize(lightobj.position - fragmentposition);
+    float diffuselightvalue = max(dot(normalized, lightdirection), 0.0);
+    vec3 diffuse_texture1 = vec3(diffusetexel) * lightobj.diffusestrength * diffuselightvalue;
+
+    vec3 viewdirection = normalize(-fragmentposition);
+    vec3 reflectdirection = reflect(-lightdirection, normalized);
+    float specularlightvalue = pow(max(dot(viewdirection, reflectdirection), 0.0), material.shininessval);
+    vec3 specular_texture1 = specularlightvalue * vec3(speculartexel) * lightobj.specularstrength;
+
+    diffuse_texture1 *= lightattenuation;
+    specular_texture1 *= lightattenuation;
+
+    return (diffuse_texture1 + specular_texture1);
+}
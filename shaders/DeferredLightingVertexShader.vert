@@ -0,0 +1,9 @@
+#version 430 core
+// One triangle that covers the whole screen, made from gl_VertexID alone (see Deferred_renderer::lightingPass()).
+out vec2 screencoord;
+
+void main()
+{
+    screencoord = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(screencoord * 2.0f - 1.0f, 0.0f, 1.0f);
+}
@@ -0,0 +1,51 @@
+#version 430 core
+// Linked with the Basic, Vegetation and Grass vertex shaders for the depth pre-pass (see Render_queue::setDepthProgram()). No color is written,
+// all this does is throw away the same fragments the shading programs would, so the depth left behind is exactly theirs.
+struct DrawData // Laid out to match draw_data_std430 in tools/Render_queue.hpp
+{
+    vec3 positiondecodemin;
+    uint packedvertices;
+    vec3 positiondecodeextent;
+    int bakedvertexbias;
+    uvec4 materialtextures;
+};
+
+in vec2 texturecoord;
+flat in uint drawindex;
+
+uniform sampler2DArray materialarrays[12]; // MATERIAL_TEXTURE_ARRAYS
+layout (std430, binding = 4) readonly buffer DrawRecords // DRAW_DATA_BINDING
+{
+    DrawData drawdata[];
+};
+
+vec4 sampleMaterialTexture(uvec2 arraytexture, vec2 coordinates);
+
+void main()
+{
+    if(sampleMaterialTexture(drawdata[drawindex].materialtextures.xy, texturecoord).a < 0.18) // Same cutoff as the shading programs
+        discard;
+}
+
+vec4 sampleMaterialTexture(uvec2 arraytexture, vec2 coordinates)
+{
+    // Same as in the shading programs, the derivatives are taken before the non uniform switch.
+    vec2 uvdx = dFdx(coordinates), uvdy = dFdy(coordinates);
+    vec3 coord = vec3(coordinates, float(arraytexture.y));
+    switch(arraytexture.x)
+    {
+        case 0u: return textureGrad(materialarrays[0], coord, uvdx, uvdy);
+        case 1u: return textureGrad(materialarrays[1], coord, uvdx, uvdy);
+        case 2u: return textureGrad(materialarrays[2], coord, uvdx, uvdy);
+        case 3u: return textureGrad(materialarrays[3], coord, uvdx, uvdy);
+        case 4u: return textureGrad(materialarrays[4], coord, uvdx, uvdy);
+        case 5u: return textureGrad(materialarrays[5], coord, uvdx, uvdy);
+        case 6u: return textureGrad(materialarrays[6], coord, uvdx, uvdy);
+        case 7u: return textureGrad(materialarrays[7], coord, uvdx, uvdy);
+        case 8u: return textureGrad(materialarrays[8], coord, uvdx, uvdy);
+        case 9u: return textureGrad(materialarrays[9], coord, uvdx, uvdy);
+        case 10u: return textureGrad(materialarrays[10], coord, uvdx, uvdy);
+        case 11u: return textureGrad(materialarrays[11], coord, uvdx, uvdy);
+    }
+    return vec4(1.0f); // TEXTURE_NO_ARRAY
+}
@@ -0,0 +1,78 @@
+#version 430 core
+// Grass_field's blades. Linked with the vegetation fragment shaders and the depth pre-pass one, so they're lit, alpha tested and deferred like any vegetation.
+layout (location = 0) in vec3 attributepos;
+layout (location = 1) in vec3 attributenormals;
+layout (location = 2) in vec2 attribtexcoords;
+layout (location = 5) in mat4 instancemodelmatrix;  // Per blade: root, rotation around y and size, see Grass_field::bladeInstance()
+layout (location = 9) in mat3 instancenormalmatrix;
+layout (location = 12) in uint instancedrawindex;
+layout (location = 14) in float instancewindphase;  // Per blade, so neighbours don't sway in lockstep
+
+out vec3 diromnifragmentposition;
+out vec3 spotfragmentposition;
+out vec3 directionalspotnormals;
+out vec3 omninormals;
+
+out vec2 texturecoord;
+flat out uint drawindex;
+invariant gl_Position; // Shared with the depth pre-pass and G-buffer programs, GL_EQUAL needs all of them to land on the exact same depth
+
+struct DrawData // Laid out to match draw_data_std430 in tools/Render_queue.hpp
+{
+    vec3 positiondecodemin;
+    uint packedvertices;
+    vec3 positiondecodeextent;
+    int bakedvertexbias;
+    uvec4 materialtextures;
+};
+
+layout (std430, binding = 4) readonly buffer DrawRecords // DRAW_DATA_BINDING
+{
+    DrawData drawdata[];
+};
+
+uniform mat4 viewmatrix;
+uniform mat4 projectionmatrix;
+uniform mat4 transinvviewmatrix;
+
+uniform float runtime;
+
+uniform float grass_sway_speed = 1.8f;
+uniform float grass_gust_scale = 0.15f; // Radians of phase per world unit, gusts roll across the field instead of every blade moving at once
+uniform float forcex = 0.3f; // The material's wind=, how far the tip of a blade one unit tall moves along x and z
+uniform float forcey = 0.0f;
+uniform float forcez = 0.1f;
+
+vec3 octDecode(vec2 encoded)
+{
+    vec3 decoded = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-decoded.z, 0.0f);
+    decoded.x += decoded.x >= 0.0f ? -fold : fold;
+    decoded.y += decoded.y >= 0.0f ? -fold : fold;
+    return normalize(decoded);
+}
+
+void main()
+{
+    DrawData draw = drawdata[instancedrawindex];
+    vec3 vertexpos = draw.positiondecodemin + attributepos * draw.positiondecodeextent;
+    vec3 vertexnormals = draw.packedvertices != 0u ? octDecode(attributenormals.xy) : attributenormals;
+
+    // Bent in world space, by how far up the blade the vertex is squared, so the root stays planted and the tip moves the most.
+    vec3 worldposition = vec3(instancemodelmatrix * vec4(vertexpos, 1.0f));
+    vec3 root = vec3(instancemodelmatrix[3]);
+    float bladeheight = length(vec3(instancemodelmatrix[2])); // Depth is scaled by the blade's full height, its y axis also by how far it has faded in
+    float wave = runtime * grass_sway_speed + dot(root.xz, vec2(1.0f, 0.6f)) * grass_gust_scale + instancewindphase;
+    float sway = 0.75f * sin(wave) + 0.25f * sin(wave * 2.3f + instancewindphase);
+    worldposition += vec3(forcex, forcey, forcez) * (sway * vertexpos.y * vertexpos.y * bladeheight);
+
+    spotfragmentposition = worldposition;
+    diromnifragmentposition = vec3(viewmatrix * vec4(worldposition, 1.0f));
+
+    directionalspotnormals = instancenormalmatrix * vertexnormals;
+    omninormals = mat3(transinvviewmatrix) * directionalspotnormals;
+
+    texturecoord = attribtexcoords;
+    drawindex = instancedrawindex;
+    gl_Position = projectionmatrix * viewmatrix * vec4(worldposition, 1.0f);
+}
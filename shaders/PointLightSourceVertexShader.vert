@@ -1,11 +1,27 @@
 #version 430 core
 layout (location = 0) in vec3 attributePos;
+layout (location = 5) in mat4 instancemodelmatrix; // Per instance, locations 5 to 8, streamed by Render_queue for every draw
+layout (location = 12) in uint instancedrawindex;
+
+struct DrawData // Laid out to match draw_data_std430 in tools/Render_queue.hpp
+{
+    vec3 positiondecodemin; // Identity unless the mesh was uploaded packed, see tools/Vertex_packing.hpp
+    uint packedvertices;
+    vec3 positiondecodeextent;
+    int bakedvertexbias;
+    uvec4 materialtextures;
+};
+
+layout (std430, binding = 4) readonly buffer DrawRecords // DRAW_DATA_BINDING
+{
+    DrawData drawdata[];
+};
 
-uniform mat4 modelmatrix;
 uniform mat4 viewmatrix;
 uniform mat4 projectionmatrix;
 
 void main()
 {
-    gl_Position = projectionmatrix * viewmatrix * modelmatrix * vec4(attributePos, 1.0f);
+    DrawData draw = drawdata[instancedrawindex];
+    gl_Position = projectionmatrix * viewmatrix * instancemodelmatrix * vec4(draw.positiondecodemin + attributePos * draw.positiondecodeextent, 1.0f);
 }
@@ -2,23 +2,15 @@
 struct shader_material
 {
     float shininessval;
-    sampler2D diffuse_texture1;
-    sampler2D diffuse_texture2;
-    sampler2D diffuse_texture3;
-    sampler2D diffuse_texture4;
-    sampler2D specular_texture1;
-    sampler2D specular_texture2;
-    sampler2D specular_texture3;
-    sampler2D specular_texture4;
-    sampler2D height_texture1;
-    sampler2D height_texture2;
-    sampler2D height_texture3;
-    sampler2D height_texture4;
-    sampler2D normal_texture1;
-    sampler2D normal_texture2;
-    sampler2D normal_texture3;
-    sampler2D normal_texture4;
-    sampler2D emissionmap;
+};
+
+struct DrawData // Laid out to match draw_data_std430 in tools/Render_queue.hpp
+{
+    vec3 positiondecodemin;
+    uint packedvertices;
+    vec3 positiondecodeextent;
+    int bakedvertexbias;
+    uvec4 materialtextures; // Array and layer of the diffuse texture, then of the specular one (see tools/Texture_arrays.hpp)
 };
 
 struct shader_light
@@ -37,15 +29,14 @@ struct DirectionalLight
     vec3 specularstrength;
 };
 
-struct OmniLight
+struct OmniLight // Laid out to match point_light_std430 in tools/Light_buffer.hpp
 {
-    float constantattenuation;
-    float linearattenuation;
-    float quadraticattenuation;
-
     vec3 position;
+    float constantattenuation;
     vec3 ambientstrength;
+    float linearattenuation;
     vec3 diffusestrength;
+    float quadraticattenuation;
     vec3 specularstrength;
 };
 
@@ -60,7 +51,6 @@ struct SpotLight
     vec3 specularstrength;
 };
 
-#define POINT_LIGHTS 2
 #define SPOT_LIGHTS 1
 
 in vec2 texturecoord;
@@ -68,33 +58,76 @@ in vec3 diromnifragmentposition;
 in vec3 spotfragmentposition;
 in vec3 directionalspotnormals;
 in vec3 omninormals;
+flat in uint drawindex;
 
 uniform shader_material material;
-uniform DirectionalLight dlight;
-uniform OmniLight olight[POINT_LIGHTS];
-uniform SpotLight slight[SPOT_LIGHTS];
+uniform sampler2DArray materialarrays[12]; // MATERIAL_TEXTURE_ARRAYS, array i is bound to unit i once for the whole frame
+layout (std140, binding = 0) uniform SceneLights // SCENE_LIGHTS_BINDING, filled by Light_buffer
+{
+    DirectionalLight dlight;
+    SpotLight slight[SPOT_LIGHTS];
+};
+
+layout (std430, binding = 1) readonly buffer PointLights // POINT_LIGHTS_BINDING, as many lights as the scene has
+{
+    OmniLight olight[];
+};
+
+layout (std430, binding = 2) readonly buffer LightClusters // LIGHT_CLUSTERS_BINDING, built by Light_clusters every frame
+{
+    uvec4 clustergrid;     // Cluster counts in x, y and z
+    vec4  clusterscale;    // Pixels per tile in x and y, scale and bias from log(view depth) to the depth slice
+    uvec2 clusterranges[]; // Offset into clusterlightindices and light count of every cluster
+};
+
+layout (std430, binding = 3) readonly buffer LightClusterIndices // LIGHT_CLUSTER_INDICES_BINDING
+{
+    uint clusterlightindices[];
+};
+
+layout (std430, binding = 4) readonly buffer DrawRecords // DRAW_DATA_BINDING
+{
+    DrawData drawdata[];
+};
+
+uniform int pointlightfirst = 0; // The slice of PointLights this program shades with, see Light_buffer::setPointLightRange()
+uniform int pointlightcount = 0;
 uniform bool emit = false;
 
 
 out vec4 fragmentColor;
 
+vec4 diffusetexel, speculartexel; // Sampled once in main(), every light reads them from here
+
 
 vec3 calculateDirectionalLight(DirectionalLight lightobj, vec3 directionalnormals, vec3 fragmentposition);
 vec3 calculateOmniLight(OmniLight lightobj, vec3 omninormals, vec3 fragmentposition);
 vec3 calculateSpotLight(SpotLight lightobj, vec3 spotnormals, vec3 fragmentposition);
+vec4 sampleMaterialTexture(uvec2 arraytexture, vec2 coordinates);
 
 void main()
 {
-    vec3 resultantlighting;
+    diffusetexel  = sampleMaterialTexture(drawdata[drawindex].materialtextures.xy, texturecoord);
+    speculartexel = sampleMaterialTexture(drawdata[drawindex].materialtextures.zw, texturecoord);
+
+    vec3 resultantlighting = vec3(0.0f);
     resultantlighting += calculateDirectionalLight(dlight, directionalspotnormals, diromnifragmentposition);
     int i = 0;
 
-    if(texture(material.diffuse_texture1, texturecoord).a < 0.18) // Checks if the texture has transparency(alpha channel), and if it is, discards fragments less opaque than 0.18(18%)
+    if(diffusetexel.a < 0.18) // Checks if the texture has transparency(alpha channel), and if it is, discards fragments less opaque than 0.18(18%)
         discard;
 
-    //if(POINT_LIGHTS > 0)
-    for(i = 0; i < POINT_LIGHTS; i++)
-        resultantlighting += calculateOmniLight(olight[i], omninormals, diromnifragmentposition);
+    // Only the lights binned into this fragment's cluster can reach it, the rest would add less than one 8 bit step.
+    uvec3 cluster = uvec3(min(uvec2(gl_FragCoord.xy / clusterscale.xy), clustergrid.xy - 1u),
+                          uint(clamp(log(max(-diromnifragmentposition.z, 1e-4f)) * clusterscale.z + clusterscale.w, 0.0f, float(clustergrid.z - 1u))));
+    uvec2 clusterrange = clusterranges[cluster.x + clustergrid.x * (cluster.y + clustergrid.y * cluster.z)];
+
+    for(uint j = 0u; j < clusterrange.y; j++)
+    {
+        i = int(clusterlightindices[clusterrange.x + j]);
+        if(i >= pointlightfirst && i < pointlightfirst + pointlightcount)
+            resultantlighting += calculateOmniLight(olight[i], omninormals, diromnifragmentposition);
+    }
 
     //for(i = 0; i < SPOT_LIGHTS; i++)
     //    resultantlighting += calculateSpotLight(slight[i], directionalspotnormals, spotfragmentposition);
@@ -105,7 +138,7 @@ void main()
 
     if(emit)
     {
-        vec3 emissionmap = texture(material.emissionmap, texturecoord).rgb;
+        vec3 emissionmap = diffusetexel.rgb; // No mesh has an emission map, its sampler always read unit 0, where the diffuse texture is bound
         resultantlighting += emissionmap;
         fragmentColor = vec4(resultantlighting, 1.0);
     }
@@ -116,17 +149,17 @@ void main()
 
 vec3 calculateDirectionalLight(DirectionalLight lightobj, vec3 directionalnormals, vec3 fragmentposition)
 {
-    vec3 ambientlight = vec3(texture(material.diffuse_texture1, texturecoord)) * lightobj.ambientstrength; // The first float value is the strength of the ambient light
+    vec3 ambientlight = vec3(diffusetexel) * lightobj.ambientstrength; // The first float value is the strength of the ambient light
 
     vec3 normalized = normalize(directionalnormals);
     vec3 lightdirection = normalize(lightobj.direction);
     float diffuselightvalue = max(dot(normalized, lightdirection), 0.0);
-    vec3 diffusemap = vec3(texture(material.diffuse_texture1, texturecoord)) * lightobj.diffusestrength * diffuselightvalue;
+    vec3 diffusemap = vec3(diffusetexel) * lightobj.diffusestrength * diffuselightvalue;
 
     vec3 viewdirection = normalize(-fragmentposition);
     vec3 reflectdirection = reflect(-lightdirection, normalized);
     float specularlightvalue = pow(max(dot(viewdirection, reflectdirection), 0.0), material.shininessval);
-    vec3 specularmap = specularlightvalue * vec3(texture(material.specular_texture1, texturecoord)) * lightobj.specularstrength; // The first float value is the general strength of the diffuse light
+    vec3 specularmap = specularlightvalue * vec3(speculartexel) * lightobj.specularstrength; // The first float value is the general strength of the diffuse light
 
     // Returns a vec3, so the parenthesis are needed, and only the directional light has an ambient value, to prevent it from adding with other lights and giving maximum lighting if there are too many lights
     return 2*(ambientlight + diffusemap);// + specularmap); Specularmap is glitchy, so it was removed from the directional light calculations
@@ -140,12 +173,12 @@ vec3 calculateOmniLight(OmniLight lightobj, vec3 omninormals, vec3 fragmentposit
     vec3 normalized = normalize(omninormals);
     vec3 lightdirection = normalize(lightobj.position - fragmentposition);
     float diffuselightvalue = max(dot(normalized, lightdirection), 0.0);
-    vec3 diffuse_texture1 = vec3(texture(material.diffuse_texture1, texturecoord)) * lightobj.diffusestrength * diffuselightvalue;
+    vec3 diffuse_texture1 = vec3(diffusetexel) * lightobj.diffusestrength * diffuselightvalue;
 
     vec3 viewdirection = normalize(-fragmentposition);
     vec3 reflectdirection = reflect(-lightdirection, normalized);
     float specularlightvalue = pow(max(dot(viewdirection, reflectdirection), 0.0), material.shininessval);
-    vec3 specular_texture1 = specularlightvalue * vec3(texture(material.specular_texture1, texturecoord)) * lightobj.specularstrength; // The first float value is the general strength of the diffuse light
+    vec3 specular_texture1 = specularlightvalue * vec3(speculartexel) * lightobj.specularstrength; // The first float value is the general strength of the diffuse light
 
     diffuse_texture1 *= lightattenuation;
     specular_texture1 *= lightattenuation;
@@ -158,12 +191,12 @@ vec3 calculateSpotLight(SpotLight lightobj, vec3 spotnormals, vec3 fragmentposit
     vec3 normalized = normalize(spotnormals);
     vec3 lightdirection = normalize(lightobj.position - fragmentposition);
     float diffuselightvalue = max(dot(normalized, lightdirection), 0.0f);
-    vec3 diffuse_texture1 = vec3(texture(material.diffuse_texture1, texturecoord)) * lightobj.diffusestrength * diffuselightvalue;
+    vec3 diffuse_texture1 = vec3(diffusetexel) * lightobj.diffusestrength * diffuselightvalue;
 
     vec3 viewdirection = normalize(-fragmentposition);
     vec3 reflectdirection = reflect(-lightdirection, normalized);
     float specularlightvalue = pow(max(dot(viewdirection, reflectdirection), 0.0f), material.shininessval);
-    vec3 specular_texture1 = specularlightvalue * vec3(texture(material.specular_texture1, texturecoord)) * lightobj.specularstrength; // The first float value is the general strength of the diffuse light
+    vec3 specular_texture1 = specularlightvalue * vec3(speculartexel) * lightobj.specularstrength; // The first float value is the general strength of the diffuse light
 
     float thetaval = dot(lightdirection, normalize(-lightobj.direction));
     float gammaval = lightobj.coneinnercutoff - (lightobj.coneinnercutoff*0.995f); // The closer the last multiplying float is to 1, the sharper the borders of the spotlight's light cone will be
@@ -171,3 +204,27 @@ vec3 calculateSpotLight(SpotLight lightobj, vec3 spotnormals, vec3 fragmentposit
 
     return (diffuse_texture1*spotlightintensity + specular_texture1*spotlightintensity);
 }
+
+vec4 sampleMaterialTexture(uvec2 arraytexture, vec2 coordinates)
+{
+    // Draws of one multi-draw can use different arrays, so the index isn't uniform and each sampler has to be picked with a constant.
+    // Implicit derivatives are undefined inside that kind of branch, they're taken up front and passed along instead.
+    vec2 uvdx = dFdx(coordinates), uvdy = dFdy(coordinates);
+    vec3 coord = vec3(coordinates, float(arraytexture.y));
+    switch(arraytexture.x)
+    {
+        case 0u: return textureGrad(materialarrays[0], coord, uvdx, uvdy);
+        case 1u: return textureGrad(materialarrays[1], coord, uvdx, uvdy);
+        case 2u: return textureGrad(materialarrays[2], coord, uvdx, uvdy);
+        case 3u: return textureGrad(materialarrays[3], coord, uvdx, uvdy);
+        case 4u: return textureGrad(materialarrays[4], coord, uvdx, uvdy);
+        case 5u: return textureGrad(materialarrays[5], coord, uvdx, uvdy);
+        case 6u: return textureGrad(materialarrays[6], coord, uvdx, uvdy);
+        case 7u: return textureGrad(materialarrays[7], coord, uvdx, uvdy);
+        case 8u: return textureGrad(materialarrays[8], coord, uvdx, uvdy);
+        case 9u: return textureGrad(materialarrays[9], coord, uvdx, uvdy);
+        case 10u: return textureGrad(materialarrays[10], coord, uvdx, uvdy);
+        case 11u: return textureGrad(materialarrays[11], coord, uvdx, uvdy);
+    }
+    return vec4(1.0f); // TEXTURE_NO_ARRAY, the mesh has no texture of that kind
+}
@@ -0,0 +1,116 @@
+#version 430 core
+// Linked with the Vegetation and Grass vertex shaders for the deferred path, see BasicGbufferFragmentShader. Vegetation has no baked lighting and
+// its emission ignores emitmul, like in its forward program.
+struct DrawData // Laid out to match draw_data_std430 in tools/Render_queue.hpp
+{
+    vec3 positiondecodemin;
+    uint packedvertices;
+    vec3 positiondecodeextent;
+    int bakedvertexbias;
+    uvec4 materialtextures; // Array and layer of the diffuse texture, then of the specular one (see tools/Texture_arrays.hpp)
+};
+
+struct DirectionalLight
+{
+    vec3 direction;
+    vec3 ambientstrength;
+    vec3 diffusestrength;
+    vec3 specularstrength;
+};
+
+struct SpotLight
+{
+    vec3 position;
+    vec3 direction;
+
+    float coneinnercutoff;
+    vec3 ambientstrength;
+    vec3 diffusestrength;
+    vec3 specularstrength;
+};
+
+#define SPOT_LIGHTS 1
+#define LIGHT_SET 1u // DEFERRED_LIGHT_SET_VEGETATION, the fireflies with the vegetation's own falloff
+
+in vec2 texturecoord;
+in vec3 diromnifragmentposition;
+in vec3 directionalspotnormals;
+in vec3 omninormals;
+flat in uint drawindex;
+
+uniform sampler2DArray materialarrays[12]; // MATERIAL_TEXTURE_ARRAYS, array i is bound to unit i once for the whole frame
+layout (std140, binding = 0) uniform SceneLights // SCENE_LIGHTS_BINDING, filled by Light_buffer
+{
+    DirectionalLight dlight;
+    SpotLight slight[SPOT_LIGHTS];
+};
+
+layout (std430, binding = 4) readonly buffer DrawRecords // DRAW_DATA_BINDING
+{
+    DrawData drawdata[];
+};
+
+uniform bool emit = false;
+
+layout (location = 0) out vec4 gbufferalbedo;   // GBUFFER_ALBEDO
+layout (location = 1) out vec4 gbuffernormal;   // GBUFFER_NORMAL, w holds the light set
+layout (location = 2) out vec4 gbufferspecular; // GBUFFER_SPECULAR
+layout (location = 3) out vec4 gbufferlighting; // GBUFFER_LIGHTING
+
+vec4 diffusetexel, speculartexel;
+
+vec3 calculateDirectionalLight(DirectionalLight lightobj, vec3 directionalnormals);
+vec4 sampleMaterialTexture(uvec2 arraytexture, vec2 coordinates);
+
+void main()
+{
+    diffusetexel  = sampleMaterialTexture(drawdata[drawindex].materialtextures.xy, texturecoord);
+    speculartexel = sampleMaterialTexture(drawdata[drawindex].materialtextures.zw, texturecoord);
+
+    if(diffusetexel.a < 0.18) // Same cutoff as the forward program
+        discard;
+
+    vec3 resultantlighting = calculateDirectionalLight(dlight, directionalspotnormals);
+    if(emit)
+        resultantlighting += diffusetexel.rgb;
+
+    gbufferalbedo   = vec4(diffusetexel.rgb, 1.0f);
+    gbuffernormal   = vec4(normalize(omninormals), float(LIGHT_SET));
+    gbufferspecular = vec4(speculartexel.rgb, 1.0f);
+    gbufferlighting = vec4(resultantlighting, 1.0f);
+}
+
+vec3 calculateDirectionalLight(DirectionalLight lightobj, vec3 directionalnormals)
+{ // The forward program's, which leaves out its specular term
+    vec3 ambientlight = vec3(diffusetexel) * lightobj.ambientstrength;
+
+    vec3 normalized = normalize(directionalnormals);
+    vec3 lightdirection = normalize(lightobj.direction);
+    float diffuselightvalue = max(dot(normalized, lightdirection), 0.0);
+    vec3 diffusemap = vec3(diffusetexel) * lightobj.diffusestrength * diffuselightvalue;
+
+    return 2*(ambientlight + diffusemap);
+}
+
+vec4 sampleMaterialTexture(uvec2 arraytexture, vec2 coordinates)
+{
+    // Same as in the shading programs, the derivatives are taken before the non uniform switch.
+    vec2 uvdx = dFdx(coordinates), uvdy = dFdy(coordinates);
+    vec3 coord = vec3(coordinates, float(arraytexture.y));
+    switch(arraytexture.x)
+    {
+        case 0u: return textureGrad(materialarrays[0], coord, uvdx, uvdy);
+        case 1u: return textureGrad(materialarrays[1], coord, uvdx, uvdy);
+        case 2u: return textureGrad(materialarrays[2], coord, uvdx, uvdy);
+        case 3u: return textureGrad(materialarrays[3], coord, uvdx, uvdy);
+        case 4u: return textureGrad(materialarrays[4], coord, uvdx, uvdy);
+        case 5u: return textureGrad(materialarrays[5], coord, uvdx, uvdy);
+        case 6u: return textureGrad(materialarrays[6], coord, uvdx, uvdy);
+        case 7u: return textureGrad(materialarrays[7], coord, uvdx, uvdy);
+        case 8u: return textureGrad(materialarrays[8], coord, uvdx, uvdy);
+        case 9u: return textureGrad(materialarrays[9], coord, uvdx, uvdy);
+        case 10u: return textureGrad(materialarrays[10], coord, uvdx, uvdy);
+        case 11u: return textureGrad(materialarrays[11], coord, uvdx, uvdy);
+    }
+    return vec4(1.0f); // TEXTURE_NO_ARRAY
+}
@@ -4,6 +4,9 @@ layout (location = 1) in vec3 attributenormals;
 layout (location = 2) in vec2 attribtexcoords;
 layout (location = 3) in vec2 attribtangent;
 layout (location = 4) in vec2 attribbitangent;
+layout (location = 5) in mat4 instancemodelmatrix;  // Per instance, locations 5 to 8, streamed by Render_queue for every draw
+layout (location = 9) in mat3 instancenormalmatrix; // Per instance, locations 9 to 11
+layout (location = 12) in uint instancedrawindex;   // Which DrawData element belongs to the draw this instance came from
 
 out vec3 diromnifragmentposition;
 out vec3 spotfragmentposition;
@@ -11,11 +14,25 @@ out vec3 directionalspotnormals;
 out vec3 omninormals;
 
 out vec2 texturecoord;
+flat out uint drawindex; // Lets the fragment shader find the draw's textures in DrawData
+invariant gl_Position; // The depth pre-pass links this same shader into another program, GL_EQUAL needs both to land on the exact same depth
+
+struct DrawData // Laid out to match draw_data_std430 in tools/Render_queue.hpp
+{
+    vec3 positiondecodemin;
+    uint packedvertices; // Packed meshes store quantized positions and octahedral normals (see tools/Vertex_packing.hpp)
+    vec3 positiondecodeextent;
+    int bakedvertexbias;
+    uvec4 materialtextures;
+};
+
+layout (std430, binding = 4) readonly buffer DrawRecords // DRAW_DATA_BINDING, one element per mesh drawn this frame
+{
+    DrawData drawdata[];
+};
 
-uniform mat4 modelmatrix;
 uniform mat4 viewmatrix;
 uniform mat4 projectionmatrix;
-uniform mat4 transinvmodelmatrix;
 uniform mat4 transinvviewmatrix;
 
 uniform float runtime;
@@ -26,19 +43,35 @@ uniform float forcex = 1.0f;
 uniform float forcey = 0.4f;
 uniform float forcez = 0.4f;
 
+vec3 octDecode(vec2 encoded)
+{
+    vec3 decoded = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-decoded.z, 0.0f);
+    decoded.x += decoded.x >= 0.0f ? -fold : fold;
+    decoded.y += decoded.y >= 0.0f ? -fold : fold;
+    return normalize(decoded);
+}
+
 void main()
 {
-    spotfragmentposition = vec3(modelmatrix * vec4(attributepos, 1.0f));
-    diromnifragmentposition = vec3(viewmatrix * modelmatrix * vec4(attributepos, 1.0f));
+    DrawData draw = drawdata[instancedrawindex];
+    vec3 vertexpos = draw.positiondecodemin + attributepos * draw.positiondecodeextent;
+    vec3 vertexnormals = draw.packedvertices != 0u ? octDecode(attributenormals.xy) : attributenormals;
+    mat4 objectmatrix = instancemodelmatrix;
+    mat3 normalmatrix = instancenormalmatrix;
+
+    spotfragmentposition = vec3(objectmatrix * vec4(vertexpos, 1.0f));
+    diromnifragmentposition = vec3(viewmatrix * objectmatrix * vec4(vertexpos, 1.0f));
 
-    directionalspotnormals = mat3(transinvmodelmatrix) * attributenormals;
-    omninormals = mat3(transinvviewmatrix) * mat3(transinvmodelmatrix) * attributenormals; // Here we need the transposed inverse view matrix because the light source is a point in a near space, not coming from the camera or an infinitely far distance.
+    directionalspotnormals = normalmatrix * vertexnormals;
+    omninormals = mat3(transinvviewmatrix) * normalmatrix * vertexnormals; // Here we need the transposed inverse view matrix because the light source is a point in a near space, not coming from the camera or an infinitely far distance.
 
     texturecoord = attribtexcoords;
-    vec3 attrib = attributepos;
+    drawindex = instancedrawindex;
+    vec3 attrib = vertexpos;
     attrib.x += sin(attrib.x * veg_move_length * 1.15f + runtime * veg_move_speed) * forcex;
     attrib.y += sin(attrib.y * veg_move_length + runtime * veg_move_speed * 1.27f) * forcey;
     attrib.z += sin(attrib.z * veg_move_length * 0.76f + runtime * veg_move_speed * 1.40f) * forcez;
 
-    gl_Position = projectionmatrix * viewmatrix * modelmatrix * vec4(attrib, 1.0f);
+    gl_Position = projectionmatrix * viewmatrix * objectmatrix * vec4(attrib, 1.0f);
 }
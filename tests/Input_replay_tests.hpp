@@ -0,0 +1,93 @@
+#ifndef INPUT_REPLAY_TESTS_H
+#define INPUT_REPLAY_TESTS_H
+
+#include "Test_check.hpp"
+#include "../tools/Input_recorder.hpp"
+
+#include <vector>
+#include <string>
+#include <cstdio>
+
+namespace Input_replay_tests
+{
+    const char *const LOG_PATH = "input_replay_tests.log"; // Written into the working directory and removed again
+
+    inline bool recordLog(const std::vector<unsigned int> &framekeys, float framerate)
+    { // One frame record per entry, at framerate and half a frame off the replay's steps, with the camera standing still
+        Camera_Object camera;
+        camera.setPose(glm::vec3(0.0f), CAMERAYAW, CAMERAPITCH); // The constructor leaves yaw and pitch unset, and they go into the log
+        Input_recorder recorder;
+        if(!recorder.open(LOG_PATH, camera, 0.0))
+            return false;
+        for(unsigned int i = 0; i < framekeys.size(); i++)
+            recorder.recordFrame((i + 0.5) / framerate, 1.0f / framerate, framekeys[i]);
+        recorder.close();
+        return true;
+    }
+
+    inline std::vector<unsigned int> replaySteps(float timestep)
+    { // What advance() hands back at every call, one call every timestep. That's main() with one simulation step per rendered frame, as with a
+      // --timestep equal to SIMULATION_STEP, where every call's keys drive exactly one step.
+        Camera_Object camera;
+        camera.setPose(glm::vec3(0.0f), CAMERAYAW, CAMERAPITCH);
+        Input_replay replay;
+        std::vector<unsigned int> stepkeys;
+        if(!replay.load(LOG_PATH))
+            return stepkeys;
+        replay.start(camera);
+        for(unsigned int step = 1; !replay.finished(); step++)
+            stepkeys.push_back(replay.advance(camera, step * timestep));
+        return stepkeys;
+    }
+
+    inline unsigned int presses(const std::vector<unsigned int> &stepkeys, unsigned int key)
+    { // Counted like applyKeys() flips its toggles, once per step the key goes down in
+        unsigned int count = 0;
+        bool held = false;
+        for(unsigned int i = 0; i < stepkeys.size(); i++)
+        {
+            bool down = (stepkeys[i] & key) != 0;
+            count += down && !held ? 1 : 0;
+            held = down;
+        }
+        return count;
+    }
+
+    inline void singleFrameTap()
+    { // Recorded at 144Hz, replayed at 60Hz: a toggle held for one recorded frame falls between two steps and must still show in one of them
+        std::vector<unsigned int> framekeys(60, INPUT_KEY_FORWARD);
+        framekeys[10] |= INPUT_KEY_PREPASS;
+        framekeys[30] |= INPUT_KEY_OCCLUSION;
+        framekeys[31] |= INPUT_KEY_OCCLUSION;
+        TEST_CHECK(recordLog(framekeys, 144.0f));
+
+        std::vector<unsigned int> stepkeys = replaySteps(1.0f / 60.0f);
+        TEST_CHECK(stepkeys.size() == 25);
+        TEST_CHECK(presses(stepkeys, INPUT_KEY_PREPASS) == 1);
+        TEST_CHECK(presses(stepkeys, INPUT_KEY_OCCLUSION) == 1); // Two recorded frames in a row are still one press
+        TEST_CHECK(presses(stepkeys, INPUT_KEY_DEFERRED) == 0);
+        std::remove(LOG_PATH);
+    }
+
+    inline void keysHeldBetweenFrames()
+    { // Replayed faster than recorded, the steps that get no frame record of their own keep the keys of the last one, until the log ends
+        std::vector<unsigned int> framekeys(20, INPUT_KEY_FORWARD | INPUT_KEY_RUN);
+        framekeys[5] = INPUT_KEY_LEFT;
+        TEST_CHECK(recordLog(framekeys, 24.0f));
+
+        std::vector<unsigned int> stepkeys = replaySteps(1.0f / 100.0f);
+        TEST_CHECK(stepkeys.size() == 82);
+        unsigned int forwardsteps = 0, leftsteps = 0;
+        for(unsigned int i = 0; i + 1 < stepkeys.size(); i++)
+        {
+            forwardsteps += (stepkeys[i] & INPUT_KEY_FORWARD) ? 1 : 0;
+            leftsteps += stepkeys[i] == INPUT_KEY_LEFT ? 1 : 0;
+        }
+        TEST_CHECK(forwardsteps == 74); // The first two steps come before the first recorded frame
+        TEST_CHECK(leftsteps == 5);
+        TEST_CHECK(stepkeys.back() == 0);
+        std::remove(LOG_PATH);
+    }
+}
+
+#endif
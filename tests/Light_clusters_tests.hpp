@@ -0,0 +1,164 @@
+#ifndef LIGHT_CLUSTERS_TESTS_H
+#define LIGHT_CLUSTERS_TESTS_H
+
+#include "Test_check.hpp"
+#include "../deps/glm/gtc/matrix_transform.hpp"
+#include "../tools/Light_clusters.hpp"
+
+#include <vector>
+#include <random>
+#include <cmath>
+
+namespace Light_clusters_tests
+{
+    const float NEAR_PLANE = 0.1f, FAR_PLANE = 5000.0f; // Same planes as main()
+
+    inline point_light_std430 darkLight()
+    { // glm leaves vectors uninitialized
+        point_light_std430 light;
+        light.position = light.ambientstrength = light.diffusestrength = light.specularstrength = glm::vec3(0.0f);
+        return light;
+    }
+
+    inline std::vector<point_light_std430> streetLights(unsigned int count)
+    { // View space lights with the lamp posts' attenuation, some behind the camera or straddling the near plane, plus one reaching as far as the grass firefly
+        std::mt19937 generator(1234);
+        std::uniform_real_distribution<float> spreadx(-40.0f, 40.0f), spready(-3.0f, 8.0f), spreadz(-90.0f, 4.0f), strength(0.3f, 1.0f);
+        std::vector<point_light_std430> lights(count, darkLight());
+        for(unsigned int i = 0; i < count; i++)
+        {
+            lights[i].position = glm::vec3(spreadx(generator), spready(generator), spreadz(generator));
+            lights[i].diffusestrength  = glm::vec3(strength(generator), strength(generator), strength(generator));
+            lights[i].specularstrength = lights[i].diffusestrength * 0.5f;
+            lights[i].linearattenuation    = 0.09f;
+            lights[i].quadraticattenuation = 0.032f;
+        }
+        lights[0].linearattenuation    = 0.04f;
+        lights[0].quadraticattenuation = 0.007f;
+        return lights;
+    }
+
+    inline unsigned int missingLights(const Light_clusters &clusters, const std::vector<point_light_std430> &lights, const glm::mat4 &projection,
+                                      const glm::vec2 &viewport, unsigned int samplecount, unsigned int &reachedlights)
+    {   // CPU reference: throws random fragments into the view frustum, finds every light within reach of each by brute force, and counts the ones
+        // missing from the fragment's cluster. Half of the samples go near the lights themselves, uniform ones would almost never land inside a small light's reach.
+        std::mt19937 generator(4321);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        glm::mat4 inverseprojection = glm::inverse(projection);
+        unsigned int failures = 0;
+        reachedlights = 0;
+
+        for(unsigned int sample = 0; sample < samplecount; sample++)
+        {
+            glm::vec2 pixel;
+            float viewdepth;
+            if(sample % 2 == 0)
+            {
+                pixel = glm::vec2(unit(generator), unit(generator)) * viewport;
+                viewdepth = NEAR_PLANE * std::pow(FAR_PLANE / NEAR_PLANE, unit(generator));
+            }
+            else
+            {
+                unsigned int light = sample / 2 % lights.size();
+                glm::vec3 target = lights[light].position + (glm::vec3(unit(generator), unit(generator), unit(generator)) * 2.0f - 1.0f) * clusters.lightradii[light];
+                glm::vec4 clip = projection * glm::vec4(target, 1.0f);
+                if(clip.w <= 0.0f || -target.z < NEAR_PLANE || -target.z > FAR_PLANE)
+                    continue;
+                pixel = (glm::vec2(clip) / clip.w * 0.5f + 0.5f) * viewport;
+                if(pixel.x < 0.0f || pixel.y < 0.0f || pixel.x >= viewport.x || pixel.y >= viewport.y)
+                    continue;
+                viewdepth = -target.z;
+            }
+
+            glm::vec4 raypoint = inverseprojection * glm::vec4(pixel / viewport * 2.0f - 1.0f, 1.0f, 1.0f);
+            glm::vec3 raydirection = glm::vec3(raypoint) / raypoint.w;
+            glm::vec3 fragmentposition = raydirection / -raydirection.z * viewdepth;
+
+            const glm::uvec2 &range = clusters.clusterranges[clusters.clusterForFragment(pixel.x, pixel.y, viewdepth)];
+            for(unsigned int light = 0; light < lights.size(); light++)
+            {
+                if(glm::length(lights[light].position - fragmentposition) >= clusters.lightradii[light])
+                    continue;
+
+                reachedlights++;
+                bool listed = false;
+                for(unsigned int i = range.x; i < range.x + range.y && !listed; i++)
+                    listed = clusters.clusterlights[i] == light;
+                failures += listed ? 0 : 1;
+            }
+        }
+        return failures;
+    }
+
+    inline void influenceRadius()
+    {
+        point_light_std430 lamp = darkLight();
+        lamp.diffusestrength  = glm::vec3(0.95f);
+        lamp.specularstrength = glm::vec3(0.5f, 0.2f, 0.1f);
+        lamp.linearattenuation    = 0.09f;
+        lamp.quadraticattenuation = 0.032f;
+        float radius = Light_clusters::influenceRadius(lamp);
+        float attenuation = 1.0f / (lamp.constantattenuation + lamp.linearattenuation * radius + lamp.quadraticattenuation * radius * radius);
+        TEST_CHECK(std::fabs(attenuation * 1.45f - LIGHT_CULL_THRESHOLD) < 1e-5f); // Brightest channel, diffuse plus specular
+
+        point_light_std430 dark = darkLight();
+        TEST_CHECK(Light_clusters::influenceRadius(dark) == 0.0f);
+
+        point_light_std430 nofalloff = darkLight();
+        nofalloff.diffusestrength = glm::vec3(1.0f);
+        TEST_CHECK(Light_clusters::influenceRadius(nofalloff) >= 1e30f);
+    }
+
+    inline void conservativeBinning()
+    { // Every light bright enough to show on a fragment must be in that fragment's cluster, or it shows up as a hard seam
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1280.0f / 720.0f, NEAR_PLANE, FAR_PLANE);
+        std::vector<point_light_std430> lights = streetLights(46);
+        Light_clusters clusters;
+        clusters.setProjection(projection, NEAR_PLANE, FAR_PLANE, 1280.0f, 720.0f);
+        clusters.assignLights(lights);
+
+        unsigned int reachedlights = 0;
+        TEST_CHECK(missingLights(clusters, lights, projection, glm::vec2(1280.0f, 720.0f), 200000, reachedlights) == 0);
+        TEST_CHECK(reachedlights > 10000); // Otherwise the samples missed the lights and nothing was tested
+    }
+
+    inline void resizedViewport()
+    { // The tiles have to follow the framebuffer, gl_FragCoord in the shaders is in its pixels
+        std::vector<point_light_std430> lights = streetLights(46);
+        Light_clusters clusters;
+        clusters.setProjection(glm::perspective(glm::radians(45.0f), 1280.0f / 720.0f, NEAR_PLANE, FAR_PLANE), NEAR_PLANE, FAR_PLANE, 1280.0f, 720.0f);
+        clusters.assignLights(lights);
+        TEST_CHECK(clusters.clusterForFragment(1279.5f, 719.5f, 1.0f) % (LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y) == LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y - 1);
+
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1000.0f / 900.0f, NEAR_PLANE, FAR_PLANE);
+        clusters.setProjection(projection, NEAR_PLANE, FAR_PLANE, 1000.0f, 900.0f);
+        clusters.assignLights(lights);
+        TEST_CHECK(clusters.clusterForFragment(999.5f, 899.5f, 1.0f) % (LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y) == LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y - 1);
+        TEST_CHECK(clusters.clusterForFragment(999.5f, 0.5f, 1.0f) % LIGHT_CLUSTERS_X == LIGHT_CLUSTERS_X - 1);
+
+        unsigned int reachedlights = 0;
+        TEST_CHECK(missingLights(clusters, lights, projection, glm::vec2(1000.0f, 900.0f), 100000, reachedlights) == 0);
+        TEST_CHECK(reachedlights > 0);
+    }
+
+    inline void lightsOutOfView()
+    { // Behind the camera and past the far plane, the lists stay empty
+        std::vector<point_light_std430> lights(2, darkLight());
+        lights[0].position = glm::vec3(0.0f, 0.0f, 200.0f);
+        lights[1].position = glm::vec3(0.0f, 0.0f, -6000.0f);
+        for(unsigned int i = 0; i < lights.size(); i++)
+        {
+            lights[i].diffusestrength = glm::vec3(1.0f);
+            lights[i].linearattenuation    = 0.09f;
+            lights[i].quadraticattenuation = 0.032f;
+        }
+
+        Light_clusters clusters;
+        clusters.setProjection(glm::perspective(glm::radians(45.0f), 1280.0f / 720.0f, NEAR_PLANE, FAR_PLANE), NEAR_PLANE, FAR_PLANE, 1280.0f, 720.0f);
+        clusters.assignLights(lights);
+        TEST_CHECK(clusters.clusterlights.empty());
+        TEST_CHECK(clusters.clusterranges.size() == LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z);
+    }
+}
+
+#endif
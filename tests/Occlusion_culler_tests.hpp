@@ -0,0 +1,313 @@
+#ifndef OCCLUSION_CULLER_TESTS_H
+#define OCCLUSION_CULLER_TESTS_H
+
+#include "Test_check.hpp"
+#include "../deps/glm/gtc/matrix_transform.hpp"
+#include "../tools/Occlusion_culler.hpp"
+#include "../tools/Occlusion_benchmark.hpp"
+
+#include <vector>
+#include <random>
+#include <cmath>
+
+namespace Occlusion_culler_tests
+{
+    inline glm::mat4 pixelProjection()
+    { // Orthographic, one world unit per buffer pixel: buffer x = world x + 128, buffer y = world y + 64, looking down -z from the origin
+        return glm::ortho(-0.5f * OCCLUSION_BUFFER_WIDTH, 0.5f * OCCLUSION_BUFFER_WIDTH, -0.5f * OCCLUSION_BUFFER_HEIGHT, 0.5f * OCCLUSION_BUFFER_HEIGHT, 0.1f, 100.0f);
+    }
+
+    inline void appendWall(float minx, float miny, float maxx, float maxy, float z, std::vector<glm::vec3> &positions, std::vector<unsigned int> &indices)
+    { // Facing the camera
+        unsigned int first = positions.size();
+        positions.push_back(glm::vec3(minx, miny, z));
+        positions.push_back(glm::vec3(maxx, miny, z));
+        positions.push_back(glm::vec3(maxx, maxy, z));
+        positions.push_back(glm::vec3(minx, maxy, z));
+        unsigned int quad[6] = { 0, 1, 2, 0, 2, 3 };
+        for(int i = 0; i < 6; i++)
+            indices.push_back(first + quad[i]);
+    }
+
+    inline void rasterizeWalls(Occlusion_culler &culler, const glm::mat4 &viewprojection, const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices)
+    {
+        culler.beginFrame(viewprojection);
+        culler.addOccluder(positions.data(), positions.size(), indices.data(), indices.size(), glm::mat4(1.0f));
+        culler.rasterize();
+    }
+
+    inline std::vector<glm::vec3> randomTriangles(unsigned int count, unsigned int seed)
+    { // Counter clockwise on screen under pixelProjection(), anywhere from slivers to most of the buffer, partly off its edges
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> spreadx(-160.0f, 160.0f), spready(-80.0f, 80.0f), spreaddepth(-90.0f, -1.0f), size(0.3f, 60.0f);
+        std::vector<glm::vec3> corners;
+        for(unsigned int i = 0; i < count; i++)
+        {
+            glm::vec3 a(spreadx(generator), spready(generator), spreaddepth(generator));
+            float extent = size(generator);
+            glm::vec3 b = a + glm::vec3(extent * (spreadx(generator) / 160.0f), extent * (spready(generator) / 80.0f), spreaddepth(generator) * 0.1f);
+            glm::vec3 c = a + glm::vec3(extent * (spreadx(generator) / 160.0f), extent * (spready(generator) / 80.0f), spreaddepth(generator) * 0.1f);
+            if((b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y) < 0.0f)
+                std::swap(b, c);
+            corners.push_back(a);
+            corners.push_back(b);
+            corners.push_back(c);
+        }
+        return corners;
+    }
+
+    inline void pyramidLevelSelection()
+    { // The chosen level must put the rectangle on at most 2x2 texels, and the one below it must not
+        Occlusion_culler culler;
+        TEST_CHECK(culler.pyramidLevels() == 9); // 256x128 down to 1x1
+        TEST_CHECK(culler.pyramidSize(8) == glm::uvec2(1, 1));
+        TEST_CHECK(culler.pyramidLevel(5, 5, 5, 5) == 0);
+        TEST_CHECK(culler.pyramidLevel(4, 4, 5, 5) == 0);
+        TEST_CHECK(culler.pyramidLevel(5, 5, 6, 6) == 0); // Two texels that straddle a level 1 texel border still fit at level 0
+        TEST_CHECK(culler.pyramidLevel(5, 5, 7, 5) == 1);
+        TEST_CHECK(culler.pyramidLevel(0, 0, OCCLUSION_BUFFER_WIDTH - 1, OCCLUSION_BUFFER_HEIGHT - 1) == 7);
+
+        std::mt19937 generator(7);
+        std::uniform_int_distribution<int> columns(0, OCCLUSION_BUFFER_WIDTH - 1), rows(0, OCCLUSION_BUFFER_HEIGHT - 1);
+        unsigned int wrong = 0;
+        for(int i = 0; i < 20000; i++)
+        {
+            int x0 = columns(generator), x1 = columns(generator), y0 = rows(generator), y1 = rows(generator);
+            if(x1 < x0)
+                std::swap(x0, x1);
+            if(y1 < y0)
+                std::swap(y0, y1);
+            unsigned int level = culler.pyramidLevel(x0, y0, x1, y1);
+            bool fits = (x1 >> level) - (x0 >> level) <= 1 && (y1 >> level) - (y0 >> level) <= 1;
+            bool finerfits = level > 0 && (x1 >> (level - 1)) - (x0 >> (level - 1)) <= 1 && (y1 >> (level - 1)) - (y0 >> (level - 1)) <= 1;
+            wrong += fits && !finerfits ? 0 : 1;
+        }
+        TEST_CHECK(wrong == 0);
+    }
+
+    inline void pyramidHoldsFarthestDepth()
+    { // Every texel is the max of the (edge clamped) 2x2 texels under it, so one uncovered pixel keeps everything above it at the far plane
+        std::vector<glm::vec3> corners = randomTriangles(300, 11);
+        std::vector<unsigned int> indices(corners.size());
+        for(unsigned int i = 0; i < indices.size(); i++)
+            indices[i] = i;
+
+        Occlusion_culler culler;
+        rasterizeWalls(culler, pixelProjection(), corners, indices);
+        unsigned int wrong = 0;
+        for(unsigned int level = 1; level < culler.pyramidLevels(); level++)
+        {
+            const std::vector<float> &source = culler.depthBuffer(level - 1), &destination = culler.depthBuffer(level);
+            glm::uvec2 sourcesize = culler.pyramidSize(level - 1), size = culler.pyramidSize(level);
+            for(unsigned int y = 0; y < size.y; y++)
+                for(unsigned int x = 0; x < size.x; x++)
+                {
+                    float farthest = 0.0f;
+                    for(unsigned int k = 0; k < 4; k++)
+                        farthest = std::max(farthest, source[std::min(y * 2 + k / 2, sourcesize.y - 1) * sourcesize.x + std::min(x * 2 + k % 2, sourcesize.x - 1)]);
+                    wrong += destination[y * size.x + x] == farthest ? 0 : 1;
+                }
+        }
+        TEST_CHECK(wrong == 0);
+
+        // Two walls with a two pixel gap between them, a wide box behind them still shows through it at whatever level it's tested on
+        std::vector<glm::vec3> positions;
+        std::vector<unsigned int> wallindices;
+        appendWall(-128.0f, -64.0f, 9.0f, 64.0f, -10.0f, positions, wallindices);
+        appendWall(11.0f, -64.0f, 128.0f, 64.0f, -10.0f, positions, wallindices);
+        rasterizeWalls(culler, pixelProjection(), positions, wallindices);
+        TEST_CHECK(culler.boxVisible(glm::vec3(0.0f, 0.0f, -30.0f), glm::vec3(100.0f, 50.0f, 1.0f)));
+        TEST_CHECK(!culler.boxVisible(glm::vec3(-70.0f, 0.0f, -30.0f), glm::vec3(42.0f, 50.0f, 1.0f))); // Tested on texels over pixels 0 to 127
+        TEST_CHECK(!culler.boxVisible(glm::vec3(82.0f, 0.0f, -30.0f), glm::vec3(18.0f, 50.0f, 1.0f)));  // 192 to 255
+        TEST_CHECK(culler.boxVisible(glm::vec3(0.0f, 0.0f, -5.0f), glm::vec3(40.0f, 50.0f, 1.0f))); // In front of the walls
+    }
+
+    inline void silhouetteSliver()
+    {   // The documented limit of covering pixels by their center. The wall's right edge sits at buffer x 128 + fraction. A small box behind it that
+        // pokes out by less than the rest of that pixel is culled although a sliver of it shows, once the pixel's center is under the wall.
+        // One that reaches a full buffer pixel past the edge never is. The boxes stay within 2x2 pixels, so they are tested on the buffer itself.
+        for(int step = 1; step < 10; step++)
+        {
+            if(step == 5)
+                continue; // The edge right on the pixel's center
+            float fraction = step * 0.1f;
+            std::vector<glm::vec3> positions;
+            std::vector<unsigned int> indices;
+            appendWall(-128.0f, -64.0f, fraction, 64.0f, -10.0f, positions, indices);
+            Occlusion_culler culler;
+            rasterizeWalls(culler, pixelProjection(), positions, indices);
+
+            float sliverright = fraction + (1.0f - fraction) * 0.5f; // Past the edge, still inside pixel 128
+            bool sliverculled = !culler.boxVisible(glm::vec3((sliverright - 0.8f) * 0.5f, 0.0f, -30.0f), glm::vec3((sliverright + 0.8f) * 0.5f, 0.8f, 1.0f));
+            TEST_CHECK(sliverculled == (step > 5));
+            float pixelright = fraction + 1.0f;
+            TEST_CHECK(culler.boxVisible(glm::vec3((pixelright - 0.8f) * 0.5f, 0.0f, -30.0f), glm::vec3((pixelright + 0.8f) * 0.5f, 0.8f, 1.0f)));
+            TEST_CHECK(!culler.boxVisible(glm::vec3((fraction - 0.9f) * 0.5f - 0.1f, 0.0f, -30.0f), glm::vec3(0.3f, 0.8f, 1.0f))); // Fully behind it
+        }
+    }
+
+    inline void nearPlane()
+    {
+        glm::mat4 viewprojection = glm::perspective(glm::radians(60.0f), 2.0f, 0.1f, 500.0f);
+        std::vector<glm::vec3> positions;
+        std::vector<unsigned int> indices;
+        appendWall(-50.0f, -20.0f, 50.0f, 20.0f, -10.0f, positions, indices);
+        Occlusion_culler culler;
+        rasterizeWalls(culler, viewprojection, positions, indices);
+        TEST_CHECK(culler.stats().triangles == 2);
+        TEST_CHECK(!culler.boxVisible(glm::vec3(0.0f, 0.0f, -30.0f), glm::vec3(1.0f)));
+
+        // Boxes around or behind the camera are never culled, even when the part in front of it is hidden
+        TEST_CHECK(culler.boxVisible(glm::vec3(0.0f), glm::vec3(1.0f)));
+        TEST_CHECK(culler.boxVisible(glm::vec3(0.0f, 0.0f, -15.0f), glm::vec3(1.0f, 1.0f, 15.0f)));
+        TEST_CHECK(culler.boxVisible(glm::vec3(0.0f, 0.0f, 20.0f), glm::vec3(1.0f)));
+
+        // An occluder triangle reaching behind the camera is dropped rather than clipped, it can't hide anything
+        glm::vec3 straddling[3] = { glm::vec3(-50.0f, -20.0f, -10.0f), glm::vec3(50.0f, -20.0f, -10.0f), glm::vec3(0.0f, 20.0f, 5.0f) };
+        unsigned int triangle[3] = { 0, 1, 2 };
+        culler.beginFrame(viewprojection);
+        culler.addOccluder(straddling, 3, triangle, 3, glm::mat4(1.0f));
+        culler.rasterize();
+        TEST_CHECK(culler.stats().triangles == 0);
+        TEST_CHECK(culler.boxVisible(glm::vec3(0.0f, 0.0f, -30.0f), glm::vec3(1.0f)));
+    }
+
+    inline void bandsMatchReference()
+    {   // The banded, threaded rasterizer against a plain per pixel one written here, with walls whose edges sit on band borders and thin triangles
+        // one row high right across them. Pixels whose center lies within rounding of an edge are left out, either answer is fine there.
+        std::vector<glm::vec3> corners = randomTriangles(200, 23);
+        const float bandrows = OCCLUSION_BUFFER_HEIGHT / OCCLUSION_BANDS;
+        for(unsigned int band = 1; band < OCCLUSION_BANDS; band++)
+        {
+            float bordery = band * bandrows - 0.5f * OCCLUSION_BUFFER_HEIGHT;
+            glm::vec3 thin[3] = { glm::vec3(-100.0f + band * 10.0f, bordery - 0.6f, -5.0f), glm::vec3(100.0f, bordery - 0.6f, -5.0f), glm::vec3(0.0f, bordery + 0.6f, -5.0f) };
+            corners.insert(corners.end(), thin, thin + 3);
+        }
+        std::vector<unsigned int> indices(corners.size());
+        for(unsigned int i = 0; i < indices.size(); i++)
+            indices[i] = i;
+        appendWall(-128.0f, -bandrows, -60.0f, bandrows, -95.0f, corners, indices);
+
+        Occlusion_culler culler;
+        glm::mat4 viewprojection = pixelProjection();
+        rasterizeWalls(culler, viewprojection, corners, indices);
+
+        std::vector<float> reference(OCCLUSION_BUFFER_WIDTH * OCCLUSION_BUFFER_HEIGHT, 1.0f);
+        std::vector<unsigned char> ambiguous(reference.size(), 0);
+        for(unsigned int i = 0; i + 2 < indices.size(); i += 3)
+        {
+            glm::vec3 v[3];
+            for(int k = 0; k < 3; k++)
+            {
+                glm::vec4 clip = viewprojection * glm::vec4(corners[indices[i + k]], 1.0f);
+                v[k] = glm::vec3((clip.x / clip.w * 0.5f + 0.5f) * OCCLUSION_BUFFER_WIDTH, (clip.y / clip.w * 0.5f + 0.5f) * OCCLUSION_BUFFER_HEIGHT, clip.z / clip.w * 0.5f + 0.5f);
+            }
+            float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+            if(area <= 0.0f)
+                continue;
+
+            for(unsigned int y = 0; y < OCCLUSION_BUFFER_HEIGHT; y++)
+                for(unsigned int x = 0; x < OCCLUSION_BUFFER_WIDTH; x++)
+                {
+                    glm::vec2 pixel(x + 0.5f, y + 0.5f);
+                    float weights[3];
+                    bool inside = true, nearedge = false;
+                    for(int e = 0; e < 3; e++)
+                    {
+                        const glm::vec3 &from = v[(e + 1) % 3], &to = v[(e + 2) % 3];
+                        weights[e] = ((to.x - from.x) * (pixel.y - from.y) - (to.y - from.y) * (pixel.x - from.x)) / area;
+                        inside = inside && weights[e] >= 0.0f;
+                        nearedge = nearedge || std::fabs(weights[e] * area) < 1e-3f;
+                    }
+                    if(nearedge)
+                        ambiguous[y * OCCLUSION_BUFFER_WIDTH + x] = 1;
+                    else if(inside)
+                    {
+                        float depth = weights[0] * v[0].z + weights[1] * v[1].z + weights[2] * v[2].z;
+                        reference[y * OCCLUSION_BUFFER_WIDTH + x] = std::min(reference[y * OCCLUSION_BUFFER_WIDTH + x], depth);
+                    }
+                }
+        }
+
+        const std::vector<float> &depths = culler.depthBuffer();
+        unsigned int wrong = 0, compared = 0, covered = 0;
+        for(unsigned int i = 0; i < depths.size(); i++)
+        {
+            if(ambiguous[i])
+                continue;
+            compared++;
+            covered += reference[i] < 1.0f ? 1 : 0;
+            wrong += std::fabs(depths[i] - reference[i]) <= 1e-4f ? 0 : 1;
+        }
+        TEST_CHECK(wrong == 0);
+        TEST_CHECK(compared > depths.size() * 9 / 10 && covered > compared / 4);
+
+        for(unsigned int band = 1; band < OCCLUSION_BANDS; band++)
+        { // The thin triangles' rows on both sides of each border
+            unsigned int bordery = band * (unsigned int) bandrows;
+            TEST_CHECK(depths[(bordery - 1) * OCCLUSION_BUFFER_WIDTH + 128] < 1.0f && depths[bordery * OCCLUSION_BUFFER_WIDTH + 128] < 1.0f);
+        }
+    }
+
+    inline void simdMatchesScalar()
+    { // Bit for bit, both rasterizers evaluate the same expressions in the same order
+        std::vector<glm::vec3> corners = randomTriangles(500, 31);
+        std::vector<unsigned int> indices(corners.size());
+        for(unsigned int i = 0; i < indices.size(); i++)
+            indices[i] = i;
+
+        glm::mat4 viewprojection = glm::perspective(glm::radians(60.0f), 2.0f, 0.1f, 500.0f);
+        Occlusion_culler simd, scalar;
+        scalar.setSimd(false);
+        for(int view = 0; view < 2; view++)
+        {
+            const glm::mat4 &matrix = view == 0 ? pixelProjection() : viewprojection;
+            rasterizeWalls(simd, matrix, corners, indices);
+            rasterizeWalls(scalar, matrix, corners, indices);
+            unsigned int different = 0;
+            for(unsigned int level = 0; level < simd.pyramidLevels(); level++)
+                for(unsigned int i = 0; i < simd.depthBuffer(level).size(); i++)
+                    different += simd.depthBuffer(level)[i] == scalar.depthBuffer(level)[i] ? 0 : 1;
+            TEST_CHECK(different == 0);
+            TEST_CHECK(simd.stats().triangles > 0);
+        }
+    }
+
+    struct test_vertex
+    {
+        glm::vec3 vert_pos;
+    };
+
+    inline void occluderDetailLevel()
+    {
+        std::vector<mesh_lod> lods(4);
+        float errors[4] = { 0.0f, 0.02f, 0.08f, 0.4f };
+        for(unsigned int i = 0; i < lods.size(); i++)
+            lods[i].error = errors[i];
+        TEST_CHECK(Occlusion_culler::occluderLevel(lods) == 2); // Coarsest under OCCLUDER_MAX_LOD_ERROR
+        TEST_CHECK(Occlusion_culler::occluderLevel(lods, 1.0f) == 3);
+        TEST_CHECK(Occlusion_culler::occluderLevel(lods, 0.01f) == 0);
+        TEST_CHECK(Occlusion_culler::occluderLevel(std::vector<mesh_lod>(1)) == 0);
+
+        // Level 1 of a 6 vertex mesh only uses vertices 5, 2 and 4, they come out compacted in that order
+        std::vector<test_vertex> vertices(6);
+        for(unsigned int i = 0; i < vertices.size(); i++)
+            vertices[i].vert_pos = glm::vec3((float) i, 0.0f, 0.0f);
+        std::vector<unsigned int> indices = { 0, 1, 2, 2, 3, 4, 5, 2, 4, 4, 2, 5 };
+        mesh_lod coarse;
+        coarse.indexoffset = 6;
+        coarse.indexcount  = 6;
+        std::vector<glm::vec3> positions;
+        std::vector<unsigned int> occluderindices;
+        Occlusion_culler::gatherOccluder(vertices, indices, coarse, positions, occluderindices);
+        TEST_CHECK(positions.size() == 3 && positions[0].x == 5.0f && positions[1].x == 2.0f && positions[2].x == 4.0f);
+        TEST_CHECK(occluderindices == std::vector<unsigned int>({ 0, 1, 2, 2, 1, 0 }));
+    }
+
+    inline void benchmarkScene()
+    { // The known answers --bench-occlusion starts with
+        TEST_CHECK(Occlusion_benchmark::run(0) == 0);
+    }
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+#include <iostream>
+
+class Test_check
+{   // The bare minimum the unit tests need: TEST_CHECK() counts a check and prints the ones that fail, run() names the test they belong to.
+    // Tests are plain functions in a namespace per tool, see run_tests.cpp.
+    public:
+        static Test_check &instance()
+        {
+            static Test_check checks;
+            return checks;
+        }
+
+        void run(const char *testname, void (*test)())
+        {
+            unsigned int failedbefore = failures;
+            currenttest = testname;
+            test();
+            testsrun++;
+            if(failures != failedbefore)
+                testsfailed++;
+            std::cout << (failures == failedbefore ? "[ OK ]   " : "[ FAIL ] ") << testname << std::endl;
+        }
+
+        bool check(bool passed, const char *expression, const char *file, int line)
+        {
+            checks++;
+            if(!passed)
+            {
+                failures++;
+                std::cout << "TEST_ERROR: " << file << ":" << line << " in " << currenttest << ": " << expression << std::endl;
+            }
+            return passed;
+        }
+
+        int summary() const
+        { // The process exit code, 0 when everything passed
+            std::cout << testsrun - testsfailed << " of " << testsrun << " tests passed, " << checks - failures << " of " << checks << " checks" << std::endl;
+            return testsfailed == 0 ? 0 : 1;
+        }
+
+    private:
+        const char *currenttest = "";
+        unsigned int testsrun = 0, testsfailed = 0;
+        unsigned int checks = 0, failures = 0;
+};
+
+#define TEST_CHECK(expression) Test_check::instance().check((expression), #expression, __FILE__, __LINE__)
+
+#endif
@@ -0,0 +1,33 @@
+/*
+# Unit tests of the parts of the renderer that run on the CPU alone. Needs no window or GL context, only the GL function
+# declarations the headers pull in. Built by the Tests target of CG-Final.cbp, see the README.
+*/
+
+#include "Test_check.hpp"
+#include "Input_replay_tests.hpp"
+#include "Light_clusters_tests.hpp"
+#include "Occlusion_culler_tests.hpp"
+
+int main()
+{
+    Test_check &tests = Test_check::instance();
+
+    tests.run("Input replay: a key tapped for one recorded frame reaches a step", Input_replay_tests::singleFrameTap);
+    tests.run("Input replay: keys stay held between recorded frames", Input_replay_tests::keysHeldBetweenFrames);
+
+    tests.run("Light clusters: influence radius", Light_clusters_tests::influenceRadius);
+    tests.run("Light clusters: every light within reach is in its fragment's cluster", Light_clusters_tests::conservativeBinning);
+    tests.run("Light clusters: tiles follow a resized viewport", Light_clusters_tests::resizedViewport);
+    tests.run("Light clusters: lights behind the camera and past the far plane", Light_clusters_tests::lightsOutOfView);
+
+    tests.run("Occlusion culler: pyramid level selection", Occlusion_culler_tests::pyramidLevelSelection);
+    tests.run("Occlusion culler: pyramid texels hold the farthest depth under them", Occlusion_culler_tests::pyramidHoldsFarthestDepth);
+    tests.run("Occlusion culler: slivers along a silhouette", Occlusion_culler_tests::silhouetteSliver);
+    tests.run("Occlusion culler: boxes and occluders crossing the near plane", Occlusion_culler_tests::nearPlane);
+    tests.run("Occlusion culler: banded rasterization matches a per pixel reference", Occlusion_culler_tests::bandsMatchReference);
+    tests.run("Occlusion culler: SSE and scalar rasterizers agree", Occlusion_culler_tests::simdMatchesScalar);
+    tests.run("Occlusion culler: occluder detail level and vertex compaction", Occlusion_culler_tests::occluderDetailLevel);
+    tests.run("Occlusion culler: benchmark scene known answers", Occlusion_culler_tests::benchmarkScene);
+
+    return tests.summary();
+}
@@ -0,0 +1,110 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include "../deps/glm/glm.hpp"
+#include "camera_object.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+struct camera_keyframe
+{
+    float time; // Seconds from the start of the path, increasing
+    glm::vec3 position;
+    float yaw, pitch; // Degrees, same convention as Camera_Object
+};
+
+class Camera_path
+{ // A scripted flight for the headless benchmark. Positions follow a Catmull-Rom spline through the keyframes, yaw and pitch are eased linearly
+  // between them. Sampling only depends on the time passed in, so the same time always gives the same camera.
+    public:
+        std::vector<camera_keyframe> keyframes;
+
+        bool load(const std::string &pathfile)
+        { // "key <time> <x> <y> <z> <yaw> <pitch>" per line, # starts a comment. See scenes/flythrough.path.
+            std::ifstream file(pathfile);
+            if(!file)
+            {
+                std::cout << "CAMERA_PATH_NOT_FOUND: " << pathfile << std::endl;
+                return false;
+            }
+
+            keyframes.clear();
+            std::string line;
+            unsigned int linenumber = 0;
+            while(std::getline(file, line))
+            {
+                linenumber++;
+                std::string::size_type comment = line.find('#');
+                if(comment != std::string::npos)
+                    line.erase(comment);
+
+                std::istringstream tokens(line);
+                std::string command;
+                if(!(tokens >> command))
+                    continue;
+
+                camera_keyframe keyframe;
+                if(command != "key" || !(tokens >> keyframe.time >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z >> keyframe.yaw >> keyframe.pitch)
+                   || (!keyframes.empty() && keyframe.time <= keyframes.back().time))
+                {
+                    std::cout << "CAMERA_PATH_ERROR: " << pathfile << ":" << linenumber << ": " << line << std::endl;
+                    return false;
+                }
+                keyframes.push_back(keyframe);
+            }
+
+            if(keyframes.empty())
+            {
+                std::cout << "CAMERA_PATH_ERROR: " << pathfile << " has no keyframes" << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        float duration() const
+        {
+            return keyframes.empty() ? 0.0f : keyframes.back().time;
+        }
+
+        void apply(Camera_Object &camera, float time) const
+        { // Holds the first and last keyframes outside of the path's time range
+            if(keyframes.empty())
+                return;
+            if(time <= keyframes.front().time || keyframes.size() == 1)
+            {
+                camera.setPose(keyframes.front().position, keyframes.front().yaw, keyframes.front().pitch);
+                return;
+            }
+            if(time >= keyframes.back().time)
+            {
+                camera.setPose(keyframes.back().position, keyframes.back().yaw, keyframes.back().pitch);
+                return;
+            }
+
+            unsigned int segment = 0;
+            while(keyframes[segment + 1].time <= time)
+                segment++;
+
+            const camera_keyframe &from = keyframes[segment], &to = keyframes[segment + 1];
+            const camera_keyframe &before = keyframes[segment > 0 ? segment - 1 : segment];
+            const camera_keyframe &after  = keyframes[segment + 2 < keyframes.size() ? segment + 2 : segment + 1];
+            float t = (time - from.time) / (to.time - from.time);
+
+            glm::vec3 position = catmullRom(before.position, from.position, to.position, after.position, t);
+            float eased = t * t * (3.0f - 2.0f * t); // Turns start and stop gently instead of snapping at every keyframe
+            camera.setPose(position, glm::mix(from.yaw, to.yaw, eased), glm::mix(from.pitch, to.pitch, eased));
+        }
+
+    private:
+        static glm::vec3 catmullRom(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2, const glm::vec3 &p3, float t)
+        {
+            float t2 = t * t, t3 = t2 * t;
+            return 0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+        }
+};
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef DEFERRED_RENDERER_H
+#define DEFERRED_RENDERER_H
+
+#include "../deps/GLADLibs/include/glad/glad.h"
+#include "../deps/glm/glm.hpp"
+#include "shader_compiler.h"
+
+#include <string>
+#include <iostream>
+
+// Color attachments of the G-buffer, in the order the G-buffer fragment shaders write them.
+const unsigned int GBUFFER_ALBEDO   = 0; // RGBA8, the diffuse texel
+const unsigned int GBUFFER_NORMAL   = 1; // RGBA16F, view space normal and the surface flags (light set, baked lighting) in w
+const unsigned int GBUFFER_SPECULAR = 2; // RGBA8, the specular texel
+const unsigned int GBUFFER_LIGHTING = 3; // RGBA16F, everything but the point lights: the directional light, emission and baked lighting
+const unsigned int GBUFFER_TARGETS  = 4;
+
+// Which point light range a G-buffer texel is lit with, written by the G-buffer fragment shaders and picked in the lighting pass.
+const unsigned int DEFERRED_LIGHT_SET_BASIC      = 0;
+const unsigned int DEFERRED_LIGHT_SET_VEGETATION = 1;
+const unsigned int DEFERRED_LIGHT_SETS           = 2;
+
+class Deferred_renderer
+{   // The other way of lighting the scene. Render_queue draws every program that has a G-buffer twin (see Render_queue::setGbufferProgram())
+    // into these targets instead of shading it, then lightingPass() shades each covered pixel once, looping over its light cluster's point lights
+    // the same way the forward programs do. Overdraw then only costs G-buffer writes, not lighting. Programs without a twin are drawn forward
+    // afterwards, against the depth the lighting pass wrote back. Blended materials end up alpha tested, like under the depth pre-pass.
+    public:
+        void create(Shader &deferredlightingshader)
+        {   // Needs the GL context. The targets follow the viewport, they're (re)allocated by the first beginGeometry() at a new size.
+            lightingshader = &deferredlightingshader;
+            glGenFramebuffers(1, &framebuffer);
+            glGenVertexArrays(1, &emptyvao); // The lighting pass makes its fullscreen triangle out of gl_VertexID, but core profile draws still need a VAO
+
+            const char *samplers[GBUFFER_TARGETS] = { "gbufferalbedo", "gbuffernormal", "gbufferspecular", "gbufferlighting" };
+            for(unsigned int i = 0; i < GBUFFER_TARGETS; i++)
+                lightingshader->setInt(samplers[i], i);
+            lightingshader->setInt("gbufferdepth", GBUFFER_TARGETS);
+        }
+
+        void setPointLightRange(unsigned int lightset, unsigned int firstlight, unsigned int lightcount)
+        { // Light_buffer::setPointLightRange() for the lighting pass, which serves every program's texels and so keeps one range per light set
+            lightingshader->setInt("pointlightfirst[" + std::to_string(lightset) + "]", firstlight);
+            lightingshader->setInt("pointlightcount[" + std::to_string(lightset) + "]", lightcount);
+        }
+
+        void beginGeometry()
+        { // Remembers what was bound for drawing, lightingPass() goes back to it
+            glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &outputframebuffer);
+            GLint viewport[4];
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            if(viewport[2] != width || viewport[3] != height)
+                allocateTargets(viewport[2], viewport[3]);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            const GLfloat zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for(unsigned int i = 0; i < GBUFFER_TARGETS; i++)
+                glClearBufferfv(GL_COLOR, i, zero);
+            glDepthMask(GL_TRUE);
+            glClear(GL_DEPTH_BUFFER_BIT);
+        }
+
+        void lightingPass()
+        { // Writes the G-buffer's depth into the output along with the color, so whatever is drawn forward afterwards is hidden behind it correctly
+            glBindFramebuffer(GL_FRAMEBUFFER, outputframebuffer);
+            for(unsigned int i = 0; i < GBUFFER_TARGETS; i++)
+            {
+                glActiveTexture(GL_TEXTURE0 + i);
+                glBindTexture(GL_TEXTURE_2D, targets[i]);
+            }
+            glActiveTexture(GL_TEXTURE0 + GBUFFER_TARGETS);
+            glBindTexture(GL_TEXTURE_2D, depthtexture);
+
+            lightingshader->useShader();
+            glDisable(GL_BLEND);
+            glDepthFunc(GL_ALWAYS); // Depth writes need the test on
+            glDepthMask(GL_TRUE);
+            glBindVertexArray(emptyvao);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glBindVertexArray(0);
+            glDepthFunc(GL_LESS);
+        }
+
+        void destroy()
+        {
+            releaseTargets();
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteVertexArrays(1, &emptyvao);
+            framebuffer = emptyvao = 0;
+        }
+
+    private:
+        Shader *lightingshader = nullptr;
+        unsigned int framebuffer = 0, emptyvao = 0;
+        unsigned int targets[GBUFFER_TARGETS] = {0, 0, 0, 0};
+        unsigned int depthtexture = 0;
+        GLint outputframebuffer = 0;
+        GLint width = 0, height = 0;
+
+        void allocateTargets(GLint newwidth, GLint newheight)
+        {
+            releaseTargets();
+            width = newwidth;
+            height = newheight;
+
+            const GLenum formats[GBUFFER_TARGETS] = { GL_RGBA8, GL_RGBA16F, GL_RGBA8, GL_RGBA16F };
+            GLenum drawbuffers[GBUFFER_TARGETS];
+            glGenTextures(GBUFFER_TARGETS, targets);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            for(unsigned int i = 0; i < GBUFFER_TARGETS; i++)
+            { // Read with texelFetch() only, one texel per pixel, so no filtering and no mips
+                glBindTexture(GL_TEXTURE_2D, targets[i]);
+                glTexStorage2D(GL_TEXTURE_2D, 1, formats[i], width, height);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, targets[i], 0);
+                drawbuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+            }
+
+            glGenTextures(1, &depthtexture);
+            glBindTexture(GL_TEXTURE_2D, depthtexture);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthtexture, 0);
+            glBindTexture(GL_TEXTURE_2D, 0);
+
+            glDrawBuffers(GBUFFER_TARGETS, drawbuffers);
+            if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "DEFERRED_RENDERER_ERROR: The " << width << "x" << height << " G-buffer is incomplete" << std::endl;
+            glBindFramebuffer(GL_FRAMEBUFFER, outputframebuffer);
+        }
+
+        void releaseTargets()
+        {
+            if(width == 0)
+                return;
+            glDeleteTextures(GBUFFER_TARGETS, targets);
+            glDeleteTextures(1, &depthtexture);
+            width = height = 0;
+        }
+};
+
+#endif
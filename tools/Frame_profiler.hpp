@@ -0,0 +1,333 @@
+#ifndef FRAME_PROFILER_H
+#define FRAME_PROFILER_H
+
+#include "../deps/GLADLibs/include/glad/glad.h"
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+const unsigned int PROFILER_HISTORY_FRAMES = 240; // Frames kept in the ring, what the trace export and the summaries cover
+const unsigned int PROFILER_GPU_LATENCY    = 4;   // Frames a GPU zone waits before its timestamps are read back, so reading them never stalls
+const unsigned int PROFILER_TOP_ZONES      = 10;
+
+struct profile_zone_record
+{
+    const char *name; // Must outlive the ring, string literals or names owned by whoever opened the zone
+    unsigned int depth; // How many zones were open around it
+    double cpubegin, cpuend; // Microseconds since the profiler was created
+    bool gpu;
+    unsigned int firstquery; // Into the frame's queries, the zone's begin and end timestamps
+    double gpubegin, gpuend; // Microseconds on the same timeline as the CPU, negative until read back
+};
+
+struct profile_frame
+{
+    unsigned long long number = 0;
+    double cpubegin = 0.0, cpuend = 0.0;
+    std::vector<profile_zone_record> zones;
+    std::vector<unsigned int> queries; // GL_TIMESTAMP queries, made as needed and reused every time the ring comes back to this slot
+    unsigned int usedqueries = 0;
+    unsigned int lastquery = 0; // The slot of the timestamp issued last, a parent zone's end comes after its children's even though its slot is lower
+    bool complete = false, gpuresolved = true;
+};
+
+class Frame_profiler
+{   // Scoped CPU zones, optionally paired with GPU timestamps, recorded into a ring of the last PROFILER_HISTORY_FRAMES frames.
+    // GPU zones use glQueryCounter(GL_TIMESTAMP) rather than GL_TIME_ELAPSED so they can nest, which an elapsed query can't.
+    public:
+        static Frame_profiler &instance()
+        {
+            static Frame_profiler profiler;
+            return profiler;
+        }
+
+        void beginFrame()
+        {
+            if(!calibrated)
+            { // Puts the GPU clock on the CPU timeline once, both are read back to back
+                GLint64 gpunow = 0;
+                glGetInteger64v(GL_TIMESTAMP, &gpunow);
+                gpuoffset = now() - gpunow / 1000.0;
+                calibrated = true;
+            }
+            if(framenumber >= PROFILER_GPU_LATENCY)
+                resolveUpTo(framenumber - PROFILER_GPU_LATENCY, false);
+            if(framenumber >= PROFILER_HISTORY_FRAMES) // The slot about to be reused, only waits if the GPU is a whole ring behind
+                resolveUpTo(framenumber - PROFILER_HISTORY_FRAMES + 1, true);
+
+            profile_frame &frame = frames[framenumber % PROFILER_HISTORY_FRAMES];
+            frame.number = framenumber;
+            frame.zones.clear();
+            frame.usedqueries = 0;
+            frame.lastquery = 0;
+            frame.complete = false;
+            frame.gpuresolved = false;
+            frame.cpubegin = now();
+            openzones.clear();
+            inframe = true;
+        }
+
+        void endFrame()
+        {
+            if(!inframe)
+                return;
+
+            profile_frame &frame = frames[framenumber % PROFILER_HISTORY_FRAMES];
+            frame.cpuend = now();
+            frame.complete = true;
+            framenumber++;
+            inframe = false;
+        }
+
+        unsigned int beginZone(const char *name, bool gpu)
+        {
+            if(!inframe)
+                return NO_ZONE;
+
+            profile_frame &frame = frames[framenumber % PROFILER_HISTORY_FRAMES];
+            profile_zone_record zone;
+            zone.name  = name;
+            zone.depth = openzones.size();
+            zone.cpubegin = now();
+            zone.cpuend   = zone.cpubegin;
+            zone.gpu = gpu;
+            zone.firstquery = 0;
+            zone.gpubegin = zone.gpuend = -1.0;
+            if(gpu)
+            {
+                if(frame.usedqueries + 2 > frame.queries.size())
+                {
+                    unsigned int first = frame.queries.size();
+                    frame.queries.resize(first + 16);
+                    glGenQueries(16, &frame.queries[first]);
+                }
+                zone.firstquery = frame.usedqueries;
+                frame.usedqueries += 2;
+                glQueryCounter(frame.queries[zone.firstquery], GL_TIMESTAMP);
+                frame.lastquery = zone.firstquery;
+            }
+
+            frame.zones.push_back(zone);
+            openzones.push_back(frame.zones.size() - 1);
+            return frame.zones.size() - 1;
+        }
+
+        void endZone(unsigned int zoneindex)
+        {
+            if(!inframe || zoneindex == NO_ZONE)
+                return;
+
+            profile_frame &frame = frames[framenumber % PROFILER_HISTORY_FRAMES];
+            profile_zone_record &zone = frame.zones[zoneindex];
+            zone.cpuend = now();
+            if(zone.gpu)
+            {
+                glQueryCounter(frame.queries[zone.firstquery + 1], GL_TIMESTAMP);
+                frame.lastquery = zone.firstquery + 1;
+            }
+            if(!openzones.empty())
+                openzones.pop_back();
+        }
+
+        double averageFrameMilliseconds() const
+        { // CPU side, begin to end of every complete frame in the ring
+            double total = 0.0;
+            unsigned int count = 0;
+            for(unsigned int i = 0; i < PROFILER_HISTORY_FRAMES; i++)
+            {
+                if(!frames[i].complete)
+                    continue;
+                total += frames[i].cpuend - frames[i].cpubegin;
+                count++;
+            }
+            return count > 0 ? total / count / 1000.0 : 0.0;
+        }
+
+        bool exportChromeTrace(const std::string &tracepath)
+        {   // chrome://tracing or ui.perfetto.dev JSON. CPU zones on thread 0, GPU zones on thread 1, oldest frame first.
+            resolveUpTo(framenumber, true);
+            std::ofstream trace(tracepath);
+            if(!trace)
+            {
+                std::cout << "PROFILER_TRACE_NOT_WRITTEN: " << tracepath << std::endl;
+                return false;
+            }
+
+            trace << "{\"traceEvents\":[\n";
+            trace << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+            trace << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"GPU\"}}";
+            for(unsigned long long number = framenumber > PROFILER_HISTORY_FRAMES ? framenumber - PROFILER_HISTORY_FRAMES : 0; number < framenumber; number++)
+            {
+                const profile_frame &frame = frames[number % PROFILER_HISTORY_FRAMES];
+                if(!frame.complete)
+                    continue;
+
+                writeEvent(trace, "Frame " + std::to_string(frame.number), 0, frame.cpubegin, frame.cpuend);
+                for(unsigned int i = 0; i < frame.zones.size(); i++)
+                {
+                    const profile_zone_record &zone = frame.zones[i];
+                    writeEvent(trace, zone.name, 0, zone.cpubegin, zone.cpuend);
+                    if(zone.gpu && zone.gpubegin >= 0.0)
+                        writeEvent(trace, zone.name, 1, zone.gpubegin, zone.gpuend);
+                }
+            }
+            trace << "\n]}\n";
+            std::cout << "Profiler: wrote the last " << std::min(framenumber, (unsigned long long) PROFILER_HISTORY_FRAMES) << " frames to " << tracepath << std::endl;
+            return true;
+        }
+
+        void printSummary(const std::string &prefix, unsigned int topcount, bool toplevelonly = false)
+        {   // The topcount costliest zones whose name starts with prefix, averaged per frame over the ring. A zone opened several times a frame adds up.
+            // toplevelonly leaves out zones nested in another, so what's printed doesn't count any time twice.
+            resolveUpTo(framenumber, true);
+            std::vector<zone_total> totals;
+            unsigned int framecount = 0;
+            for(unsigned int i = 0; i < PROFILER_HISTORY_FRAMES; i++)
+            {
+                const profile_frame &frame = frames[i];
+                if(!frame.complete)
+                    continue;
+
+                framecount++;
+                for(unsigned int j = 0; j < frame.zones.size(); j++)
+                {
+                    const profile_zone_record &zone = frame.zones[j];
+                    if((toplevelonly && zone.depth > 0) || std::string(zone.name).compare(0, prefix.size(), prefix) != 0)
+                        continue;
+
+                    unsigned int k = 0;
+                    while(k < totals.size() && totals[k].name != zone.name)
+                        k++;
+                    if(k == totals.size())
+                    {
+                        totals.push_back(zone_total());
+                        totals.back().name = zone.name;
+                    }
+                    totals[k].cpu += zone.cpuend - zone.cpubegin;
+                    if(zone.gpu && zone.gpubegin >= 0.0)
+                    {
+                        totals[k].gpu += zone.gpuend - zone.gpubegin;
+                        totals[k].gpuframes++;
+                    }
+                }
+            }
+            if(framecount == 0 || totals.empty())
+                return;
+
+            std::sort(totals.begin(), totals.end(), [](const zone_total &first, const zone_total &second) { return first.cpu + first.gpu > second.cpu + second.gpu; });
+            std::cout << "Profiler, costliest " << (prefix.empty() ? std::string("zones") : "\"" + prefix + "\" zones") << " per frame over the last " << framecount << " frames:" << std::endl;
+            for(unsigned int i = 0; i < totals.size() && i < topcount; i++)
+            {
+                std::cout << "  " << totals[i].name << ": " << totals[i].cpu / framecount / 1000.0 << " ms CPU";
+                if(totals[i].gpuframes > 0)
+                    std::cout << ", " << totals[i].gpu / totals[i].gpuframes / 1000.0 << " ms GPU";
+                std::cout << std::endl;
+            }
+        }
+
+        void destroy()
+        {
+            for(unsigned int i = 0; i < PROFILER_HISTORY_FRAMES; i++)
+            {
+                if(!frames[i].queries.empty())
+                    glDeleteQueries(frames[i].queries.size(), frames[i].queries.data());
+                frames[i] = profile_frame();
+            }
+            calibrated = false;
+        }
+
+    private:
+        static const unsigned int NO_ZONE = 0xFFFFFFFFu;
+
+        struct zone_total
+        {
+            std::string name;
+            double cpu = 0.0, gpu = 0.0;
+            unsigned int gpuframes = 0;
+        };
+
+        std::vector<profile_frame> frames;
+        std::vector<unsigned int> openzones;
+        unsigned long long framenumber = 0, resolvednumber = 0; // Every frame before resolvednumber has had its GPU zones read back
+        std::chrono::steady_clock::time_point start;
+        double gpuoffset = 0.0;
+        bool calibrated = false, inframe = false;
+
+        Frame_profiler() : frames(PROFILER_HISTORY_FRAMES), start(std::chrono::steady_clock::now()) {}
+
+        double now() const
+        {
+            return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        void resolveUpTo(unsigned long long last, bool wait)
+        { // Every frame before last, in order, stopping at the first one the GPU hasn't finished unless told to wait for it
+            for(; resolvednumber < last; resolvednumber++)
+                if(!resolveFrame(frames[resolvednumber % PROFILER_HISTORY_FRAMES], wait))
+                    return;
+        }
+
+        bool resolveFrame(profile_frame &frame, bool wait)
+        {
+            if(frame.gpuresolved)
+                return true;
+
+            if(!wait && frame.usedqueries > 0)
+            { // Timestamps land in the order they were issued, once the last one is in so are the rest
+                GLuint available = 0;
+                glGetQueryObjectuiv(frame.queries[frame.lastquery], GL_QUERY_RESULT_AVAILABLE, &available);
+                if(!available)
+                    return false;
+            }
+
+            for(unsigned int i = 0; i < frame.zones.size(); i++)
+            {
+                profile_zone_record &zone = frame.zones[i];
+                if(!zone.gpu)
+                    continue;
+
+                GLuint64 begin = 0, end = 0;
+                glGetQueryObjectui64v(frame.queries[zone.firstquery], GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(frame.queries[zone.firstquery + 1], GL_QUERY_RESULT, &end);
+                zone.gpubegin = begin / 1000.0 + gpuoffset;
+                zone.gpuend   = end / 1000.0 + gpuoffset;
+            }
+            frame.gpuresolved = true;
+            return true;
+        }
+
+        static void writeEvent(std::ofstream &trace, const std::string &name, int thread, double begin, double end)
+        {
+            std::string escapedname;
+            for(unsigned int i = 0; i < name.size(); i++)
+            { // Zone names are free text such as model paths, quotes and backslashes get escaped and control characters, which JSON strings can't hold, become spaces
+                if(name[i] == '"' || name[i] == '\\')
+                    escapedname += '\\';
+                escapedname += (unsigned char) name[i] < 0x20 ? ' ' : name[i];
+            }
+            trace << ",\n{\"name\":\"" << escapedname << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << thread << ",\"ts\":" << std::fixed << begin << ",\"dur\":" << end - begin << "}";
+        }
+};
+
+class Profile_zone
+{   // Times the scope it's declared in. gpu also brackets the GL commands issued inside it with timestamps.
+    public:
+        Profile_zone(const char *name, bool gpu = false) : zoneindex(Frame_profiler::instance().beginZone(name, gpu)) {}
+
+        ~Profile_zone()
+        {
+            Frame_profiler::instance().endZone(zoneindex);
+        }
+
+        Profile_zone(const Profile_zone&) = delete;
+        Profile_zone &operator=(const Profile_zone&) = delete;
+
+    private:
+        unsigned int zoneindex;
+};
+
+#endif
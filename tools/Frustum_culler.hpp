@@ -0,0 +1,144 @@
+#ifndef FRUSTUM_CULLER_H
+#define FRUSTUM_CULLER_H
+
+#include "../deps/glm/glm.hpp"
+
+#include <vector>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_CULLER_SSE 1
+#endif
+
+struct camera_frustum
+{ // Six inward facing planes (xyz normal, w distance), a point p is inside a plane when dot(xyz, p) + w >= 0.
+    glm::vec4 planes[6];
+
+    static camera_frustum fromMatrix(const glm::mat4 &viewprojection)
+    { // Gribb and Hartmann, every plane is the last row of the matrix plus or minus one of the others.
+        camera_frustum frustum;
+        glm::vec4 rows[4];
+        for(int row = 0; row < 4; row++)
+            rows[row] = glm::vec4(viewprojection[0][row], viewprojection[1][row], viewprojection[2][row], viewprojection[3][row]);
+
+        frustum.planes[0] = rows[3] + rows[0]; // Left
+        frustum.planes[1] = rows[3] - rows[0]; // Right
+        frustum.planes[2] = rows[3] + rows[1]; // Bottom
+        frustum.planes[3] = rows[3] - rows[1]; // Top
+        frustum.planes[4] = rows[3] + rows[2]; // Near
+        frustum.planes[5] = rows[3] - rows[2]; // Far
+
+        for(int plane = 0; plane < 6; plane++)
+            frustum.planes[plane] /= glm::length(glm::vec3(frustum.planes[plane]));
+        return frustum;
+    }
+};
+
+struct culling_bounds_soa
+{ // World space boxes as center and half extent, one array per component so four of them load straight into a SIMD register.
+    std::vector<float> centerx, centery, centerz;
+    std::vector<float> extentx, extenty, extentz;
+    unsigned int count = 0;
+
+    void clear()
+    {
+        centerx.clear(); centery.clear(); centerz.clear();
+        extentx.clear(); extenty.clear(); extentz.clear();
+        count = 0;
+    }
+
+    void push(const glm::vec3 &center, const glm::vec3 &extent)
+    {
+        centerx.push_back(center.x); centery.push_back(center.y); centerz.push_back(center.z);
+        extentx.push_back(extent.x); extenty.push_back(extent.y); extentz.push_back(extent.z);
+        count++;
+    }
+
+    void pushTransformed(const glm::vec3 &localmin, const glm::vec3 &localmax, const glm::mat4 &modelmatrix)
+    { // Arvo's method, the box around the transformed box is the transformed center with the extent run through the absolute rotation and scale.
+        glm::vec3 localcenter = (localmin + localmax) * 0.5f, localextent = (localmax - localmin) * 0.5f;
+        glm::vec3 center = glm::vec3(modelmatrix * glm::vec4(localcenter, 1.0f));
+        glm::vec3 extent;
+        for(int axis = 0; axis < 3; axis++)
+            extent[axis] = std::fabs(modelmatrix[0][axis]) * localextent.x + std::fabs(modelmatrix[1][axis]) * localextent.y + std::fabs(modelmatrix[2][axis]) * localextent.z;
+        push(center, extent);
+    }
+
+    void padToBatch()
+    { // Fills up the last batch of four with empty boxes, their results are never read.
+        while(centerx.size() % 4 != 0)
+        {
+            centerx.push_back(0.0f); centery.push_back(0.0f); centerz.push_back(0.0f);
+            extentx.push_back(0.0f); extenty.push_back(0.0f); extentz.push_back(0.0f);
+        }
+    }
+};
+
+namespace Frustum_culler
+{
+    inline bool boxVisible(const camera_frustum &frustum, const glm::vec3 &center, const glm::vec3 &extent)
+    { // Scalar reference, a box is out as soon as it lies fully behind any one plane.
+        for(int plane = 0; plane < 6; plane++)
+        {
+            const glm::vec4 &p = frustum.planes[plane];
+            float distance = p.x * center.x + p.y * center.y + p.z * center.z + p.w;
+            float radius   = std::fabs(p.x) * extent.x + std::fabs(p.y) * extent.y + std::fabs(p.z) * extent.z;
+            if(distance < -radius)
+                return false;
+        }
+        return true;
+    }
+
+    inline unsigned int cullBounds(const camera_frustum &frustum, culling_bounds_soa &bounds, std::vector<unsigned char> &visible)
+    {   // Tests four boxes per iteration against all six planes. Writes 1 or 0 per box into visible and returns how many passed.
+        visible.resize(bounds.count);
+        unsigned int visiblecount = 0;
+
+#ifdef FRUSTUM_CULLER_SSE
+        bounds.padToBatch();
+        __m128 signmask = _mm_set1_ps(-0.0f);
+        __m128 planex[6], planey[6], planez[6], planew[6], absx[6], absy[6], absz[6];
+        for(int plane = 0; plane < 6; plane++)
+        {
+            planex[plane] = _mm_set1_ps(frustum.planes[plane].x);
+            planey[plane] = _mm_set1_ps(frustum.planes[plane].y);
+            planez[plane] = _mm_set1_ps(frustum.planes[plane].z);
+            planew[plane] = _mm_set1_ps(frustum.planes[plane].w);
+            absx[plane] = _mm_andnot_ps(signmask, planex[plane]);
+            absy[plane] = _mm_andnot_ps(signmask, planey[plane]);
+            absz[plane] = _mm_andnot_ps(signmask, planez[plane]);
+        }
+
+        for(unsigned int first = 0; first < bounds.count; first += 4)
+        {
+            __m128 cx = _mm_loadu_ps(&bounds.centerx[first]), cy = _mm_loadu_ps(&bounds.centery[first]), cz = _mm_loadu_ps(&bounds.centerz[first]);
+            __m128 ex = _mm_loadu_ps(&bounds.extentx[first]), ey = _mm_loadu_ps(&bounds.extenty[first]), ez = _mm_loadu_ps(&bounds.extentz[first]);
+            __m128 outside = _mm_setzero_ps();
+
+            for(int plane = 0; plane < 6; plane++)
+            {
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planex[plane], cx), _mm_mul_ps(planey[plane], cy)), _mm_add_ps(_mm_mul_ps(planez[plane], cz), planew[plane]));
+                __m128 radius   = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absx[plane], ex), _mm_mul_ps(absy[plane], ey)), _mm_mul_ps(absz[plane], ez));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+            }
+
+            int outsidemask = _mm_movemask_ps(outside);
+            for(unsigned int lane = 0; lane < 4 && first + lane < bounds.count; lane++)
+            {
+                visible[first + lane] = (outsidemask >> lane) & 1 ? 0 : 1;
+                visiblecount += visible[first + lane];
+            }
+        }
+#else
+        for(unsigned int i = 0; i < bounds.count; i++)
+        {
+            visible[i] = boxVisible(frustum, glm::vec3(bounds.centerx[i], bounds.centery[i], bounds.centerz[i]), glm::vec3(bounds.extentx[i], bounds.extenty[i], bounds.extentz[i])) ? 1 : 0;
+            visiblecount += visible[i];
+        }
+#endif
+        return visiblecount;
+    }
+}
+
+#endif
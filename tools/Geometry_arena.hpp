@@ -0,0 +1,187 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include "../deps/GLADLibs/include/glad/glad.h"
+#include "../deps/glm/glm.hpp"
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <iostream>
+
+// Vertex buffer binding points of every arena VAO, the attributes are tied to them with glVertexAttribBinding.
+const unsigned int VERTEX_BUFFER_BINDING   = 0;
+const unsigned int INSTANCE_BUFFER_BINDING = 1; // Rebound by Render_queue to its own instance stream
+
+const unsigned int INSTANCE_NOT_BAKED = 0xFFFFFFFFu; // instance_bakedoffset of copies that get all of their lighting at runtime
+
+struct instance_data
+{ // Per instance vertex attributes read by the vertex shaders, locations 5 to 8, 9 to 11, 12, 13 and 14.
+    glm::mat4 instance_modelmatrix;
+    glm::mat3 instance_normalmatrix; // Transposed inverse of the model matrix, computed once on the CPU instead of per vertex
+    unsigned int instance_drawindex; // Element of the DrawData storage buffer holding the vertex decode of the mesh this instance draws
+    unsigned int instance_bakedoffset = INSTANCE_NOT_BAKED; // Where this copy's block of per vertex lighting starts in the BakedLighting buffer, see Light_baker
+    float instance_windphase = 0.0f; // Offsets the sway of Grass_field's blades, only the grass vertex shader reads it
+};
+
+const unsigned int INSTANCE_MODELMATRIX_LOCATION  = 5;
+const unsigned int INSTANCE_NORMALMATRIX_LOCATION = 9;
+const unsigned int INSTANCE_DRAWINDEX_LOCATION    = 12;
+const unsigned int INSTANCE_BAKEDOFFSET_LOCATION  = 13;
+const unsigned int INSTANCE_WINDPHASE_LOCATION    = 14;
+
+// Starting sizes of an arena's buffers, both double whenever a mesh doesn't fit.
+const unsigned int ARENA_INITIAL_VERTEX_BYTES = 4 * 1024 * 1024;
+const unsigned int ARENA_INITIAL_INDEX_BYTES  = 2 * 1024 * 1024;
+
+struct geometry_range
+{ // Where a mesh ended up inside its arena, in vertices and indices respectively.
+    unsigned int basevertex = 0, firstindex = 0;
+};
+
+class Geometry_arena
+{   // One VAO, vertex buffer and index buffer shared by every static mesh with the same vertex layout and index type, so drawing any of them
+    // never needs more than the one VAO bind, and a whole run of them can go out as a single glMultiDrawElementsIndirect.
+    public:
+        unsigned int VAO = 0;
+        unsigned int vertexstride;
+        GLenum indextype;
+
+        static Geometry_arena &forLayout(unsigned int vertexstride, GLenum indextype, void (*setupattributes)())
+        {   // Main thread only. setupattributes is called with the new VAO bound the first time a layout shows up, and must tie its attributes to VERTEX_BUFFER_BINDING.
+            std::vector<std::unique_ptr<Geometry_arena> > &allarenas = arenas();
+            for(unsigned int i = 0; i < allarenas.size(); i++)
+                if(allarenas[i]->vertexstride == vertexstride && allarenas[i]->indextype == indextype)
+                    return *allarenas[i];
+
+            allarenas.push_back(std::unique_ptr<Geometry_arena>(new Geometry_arena(vertexstride, indextype, setupattributes)));
+            return *allarenas.back();
+        }
+
+        geometry_range append(const void *vertices, unsigned int vertexcount, const void *indices, unsigned int indexcount)
+        { // indices stay relative to the mesh's own vertices, the returned basevertex is added back by the draw.
+            geometry_range range;
+            range.basevertex = vertexbytes / vertexstride;
+            range.firstindex = indexbytes / indexSize();
+
+            size_t newvertexbytes = (size_t) vertexcount * vertexstride, newindexbytes = (size_t) indexcount * indexSize();
+            bool grown = reserve(vertexbuffer, vertexcapacity, vertexbytes, vertexbytes + newvertexbytes, ARENA_INITIAL_VERTEX_BYTES);
+            grown = reserve(indexbuffer, indexcapacity, indexbytes, indexbytes + newindexbytes, ARENA_INITIAL_INDEX_BYTES) || grown;
+            if(grown)
+            { // Either buffer may have been replaced, so the VAO is pointed at whatever is current
+                glBindVertexArray(VAO);
+                glBindVertexBuffer(VERTEX_BUFFER_BINDING, vertexbuffer, 0, vertexstride);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer);
+                glBindVertexArray(0);
+            }
+
+            glBindBuffer(GL_COPY_WRITE_BUFFER, vertexbuffer);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, vertexbytes, newvertexbytes, vertices);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, indexbuffer);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, indexbytes, newindexbytes, indices);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+            vertexbytes += newvertexbytes;
+            indexbytes  += newindexbytes;
+            meshcount++;
+            return range;
+        }
+
+        size_t indexSize() const
+        {
+            return indextype == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+        }
+
+        static void printStatistics()
+        {
+            std::vector<std::unique_ptr<Geometry_arena> > &allarenas = arenas();
+            for(unsigned int i = 0; i < allarenas.size(); i++)
+                std::cout << "Geometry arena " << i << ": " << allarenas[i]->meshcount << " meshes, " << allarenas[i]->vertexbytes / allarenas[i]->vertexstride << " vertices ("
+                          << allarenas[i]->vertexstride << " bytes each), " << allarenas[i]->indexbytes / allarenas[i]->indexSize() << " indices ("
+                          << allarenas[i]->indexSize() * 8 << " bit)" << std::endl;
+        }
+
+        static void destroyAll()
+        {
+            std::vector<std::unique_ptr<Geometry_arena> > &allarenas = arenas();
+            for(unsigned int i = 0; i < allarenas.size(); i++)
+            {
+                glDeleteVertexArrays(1, &allarenas[i]->VAO);
+                glDeleteBuffers(1, &allarenas[i]->vertexbuffer);
+                glDeleteBuffers(1, &allarenas[i]->indexbuffer);
+            }
+            allarenas.clear();
+        }
+
+    private:
+        unsigned int vertexbuffer = 0, indexbuffer = 0;
+        size_t vertexbytes = 0, indexbytes = 0, vertexcapacity = 0, indexcapacity = 0;
+        unsigned int meshcount = 0;
+
+        Geometry_arena(unsigned int vertexstride, GLenum indextype, void (*setupattributes)()) : vertexstride(vertexstride), indextype(indextype)
+        {
+            glGenVertexArrays(1, &VAO);
+            glBindVertexArray(VAO);
+            setupattributes();
+
+            // A mat4 takes four attribute slots and a mat3 three. The buffer itself is left to whoever draws, see Render_queue::execute().
+            for(unsigned int column = 0; column < 4; column++)
+            {
+                glEnableVertexAttribArray(INSTANCE_MODELMATRIX_LOCATION + column);
+                glVertexAttribFormat(INSTANCE_MODELMATRIX_LOCATION + column, 4, GL_FLOAT, GL_FALSE, offsetof(instance_data, instance_modelmatrix) + column * sizeof(glm::vec4));
+                glVertexAttribBinding(INSTANCE_MODELMATRIX_LOCATION + column, INSTANCE_BUFFER_BINDING);
+            }
+            for(unsigned int column = 0; column < 3; column++)
+            {
+                glEnableVertexAttribArray(INSTANCE_NORMALMATRIX_LOCATION + column);
+                glVertexAttribFormat(INSTANCE_NORMALMATRIX_LOCATION + column, 3, GL_FLOAT, GL_FALSE, offsetof(instance_data, instance_normalmatrix) + column * sizeof(glm::vec3));
+                glVertexAttribBinding(INSTANCE_NORMALMATRIX_LOCATION + column, INSTANCE_BUFFER_BINDING);
+            }
+            glEnableVertexAttribArray(INSTANCE_DRAWINDEX_LOCATION);
+            glVertexAttribIFormat(INSTANCE_DRAWINDEX_LOCATION, 1, GL_UNSIGNED_INT, offsetof(instance_data, instance_drawindex));
+            glVertexAttribBinding(INSTANCE_DRAWINDEX_LOCATION, INSTANCE_BUFFER_BINDING);
+            glEnableVertexAttribArray(INSTANCE_BAKEDOFFSET_LOCATION);
+            glVertexAttribIFormat(INSTANCE_BAKEDOFFSET_LOCATION, 1, GL_UNSIGNED_INT, offsetof(instance_data, instance_bakedoffset));
+            glVertexAttribBinding(INSTANCE_BAKEDOFFSET_LOCATION, INSTANCE_BUFFER_BINDING);
+            glEnableVertexAttribArray(INSTANCE_WINDPHASE_LOCATION);
+            glVertexAttribFormat(INSTANCE_WINDPHASE_LOCATION, 1, GL_FLOAT, GL_FALSE, offsetof(instance_data, instance_windphase));
+            glVertexAttribBinding(INSTANCE_WINDPHASE_LOCATION, INSTANCE_BUFFER_BINDING);
+            glVertexBindingDivisor(INSTANCE_BUFFER_BINDING, 1);
+
+            glBindVertexArray(0);
+        }
+
+        static std::vector<std::unique_ptr<Geometry_arena> > &arenas()
+        {
+            static std::vector<std::unique_ptr<Geometry_arena> > allarenas;
+            return allarenas;
+        }
+
+        static bool reserve(unsigned int &buffer, size_t &capacity, size_t usedbytes, size_t required, size_t initialcapacity)
+        {   // Grows into a new buffer and copies the used part of the old one over on the GPU. Loading is the only time this runs.
+            if(required <= capacity)
+                return false;
+
+            size_t newcapacity = glm::max(capacity, initialcapacity);
+            while(newcapacity < required)
+                newcapacity *= 2;
+
+            unsigned int newbuffer;
+            glGenBuffers(1, &newbuffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, newbuffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, newcapacity, nullptr, GL_STATIC_DRAW);
+            if(buffer != 0)
+            {
+                glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedbytes);
+                glBindBuffer(GL_COPY_READ_BUFFER, 0);
+                glDeleteBuffers(1, &buffer);
+            }
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            buffer = newbuffer;
+            capacity = newcapacity;
+            return true;
+        }
+};
+
+#endif
@@ -0,0 +1,357 @@
+#ifndef GRASS_FIELD_H
+#define GRASS_FIELD_H
+
+#include "../deps/glm/glm.hpp"
+#include "../deps/glm/gtc/constants.hpp"
+#include "Model_Loader.hpp"
+#include "Texture_registry.hpp"
+#include "Frustum_culler.hpp"
+#include "Occlusion_culler.hpp"
+#include "Render_queue.hpp"
+#include "shader_compiler.h"
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <iostream>
+
+const float GRASS_TILE_SIZE = 4.0f; // Blades are culled, thinned out and given a detail level per square tile of this size, in world units
+const float GRASS_MIN_UPNESS = 0.8f; // Surface triangles whose normal's y is under this are too steep to grow grass on
+const float GRASS_ROOT_SINK = 0.02f; // Roots go this far under the surface, so blades on a slope don't show a gap under their downhill edge
+const float GRASS_FULL_DENSITY_DISTANCE = 10.0f; // Tiles closer than this draw every blade, further ones keep (distance / this)^-2 of them
+const float GRASS_MAX_WIDENING = 3.0f; // How much wider the remaining blades of a thinned out tile may get to cover for the dropped ones
+const float GRASS_FADE_FRACTION = 0.2f; // Over the last part of the radius the blades sink into the ground instead of popping out
+const float GRASS_SWAY_MARGIN = 0.5f; // Added around the tile bounds, the wind moves the tips past where the blades were scattered
+
+// The blade mesh, one unit tall: GRASS_BLADE_SEGMENTS rows of two vertices that taper towards a single tip vertex, bent forward along z.
+// Each coarser detail level keeps every other row of the one before it.
+const unsigned int GRASS_BLADE_SEGMENTS = 4;
+const unsigned int GRASS_BLADE_LEVELS = 3;
+const float GRASS_BLADE_HALF_WIDTH = 0.05f;
+const float GRASS_BLADE_CURVE = 0.3f;
+
+static_assert(GRASS_BLADE_LEVELS <= MESH_LOD_MAX_LEVELS, "The blade's detail levels must fit in a render command");
+static_assert((GRASS_BLADE_SEGMENTS >> (GRASS_BLADE_LEVELS - 1)) >= 1, "The coarsest blade level still needs its root row");
+
+struct grass_settings
+{ // The attributes of a grass line in the scene file
+    float density = 16.0f; // Blades per square unit where a tile is drawn in full
+    float radius = 60.0f; // No blades are drawn past this distance from the camera
+    float minheight = 0.25f, maxheight = 0.55f;
+    float width = 1.0f; // Multiplies the blade mesh's width
+    bool hasarea = false; // Restricts the blades to area, x and z of one corner and then of the opposite one
+    glm::vec4 area = glm::vec4(0.0f);
+};
+
+struct grass_blade
+{
+    glm::vec3 root; // World space
+    float angle; // Around y, in radians
+    float height;
+    float windphase; // Handed to the vertex shader as instance_windphase, so neighbouring blades don't sway in lockstep
+};
+
+struct grass_tile
+{ // Its blades are shuffled, so any prefix of them is spread as evenly over the tile as the whole range
+    unsigned int firstblade, bladecount;
+    glm::vec3 center;
+    float radius;
+    float maxheight;
+};
+
+class Grass_field
+{   // Procedural grass over the upward facing triangles of an entity, in place of grass meshes. The blades are scattered once on the CPU after loading,
+    // then every frame the tiles around the camera are frustum and occlusion culled, thinned out with distance and sent through the render queue as a
+    // single instanced draw of one blade mesh, with a detail level per tile. Only the blades' roots, rotations and sizes are stored.
+    public:
+        grass_settings settings;
+        std::string texturepath;
+
+        bool loadTexture(const std::string &path)
+        {   // Main thread, with the GL context and before Texture_arrays::build(), so the blade texture ends up in one of the arrays like any model's.
+            texturepath = path;
+            texture.texture_type = "diffuse_texture";
+            texture.texture_path = path;
+            texture.registry_entry = Texture_registry::instance().acquire(path);
+            texture.texture_id = Texture_registry::instance().uploadTexture(texture.registry_entry);
+            return texture.texture_id != 0;
+        }
+
+        void addSurface(const Mesh_data &mesh, const glm::mat4 &modelmatrix)
+        { // Scatters blades over the full detail level of mesh as modelmatrix places it
+            const mesh_lod &fulldetail = mesh.mesh_lods[0];
+            for(unsigned int i = 0; i + 2 < fulldetail.indexcount; i += 3)
+            {
+                glm::vec3 corners[3];
+                for(unsigned int corner = 0; corner < 3; corner++)
+                    corners[corner] = glm::vec3(modelmatrix * glm::vec4(mesh.mesh_vertices[mesh.mesh_vert_indices[fulldetail.indexoffset + i + corner]].vert_pos, 1.0f));
+
+                glm::vec3 facenormal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                float area = glm::length(facenormal) * 0.5f;
+                if(area <= 0.0f || facenormal.y / (2.0f * area) < GRASS_MIN_UPNESS)
+                    continue;
+                surfacearea += area;
+
+                float expected = area * settings.density;
+                unsigned int count = (unsigned int) expected + (unitrandom(random) < expected - std::floor(expected) ? 1 : 0);
+                for(unsigned int j = 0; j < count; j++)
+                { // Uniform over the triangle
+                    float spread = std::sqrt(unitrandom(random)), along = unitrandom(random);
+                    grass_blade blade;
+                    blade.root = corners[0] * (1.0f - spread) + corners[1] * (spread * (1.0f - along)) + corners[2] * (spread * along);
+                    blade.root.y -= GRASS_ROOT_SINK;
+                    blade.angle = unitrandom(random) * glm::two_pi<float>();
+                    blade.height = settings.minheight + unitrandom(random) * (settings.maxheight - settings.minheight);
+                    blade.windphase = unitrandom(random) * glm::two_pi<float>();
+                    if(!settings.hasarea || (blade.root.x >= glm::min(settings.area.x, settings.area.z) && blade.root.x <= glm::max(settings.area.x, settings.area.z) &&
+                                             blade.root.z >= glm::min(settings.area.y, settings.area.w) && blade.root.z <= glm::max(settings.area.y, settings.area.w)))
+                        blades.push_back(blade);
+                }
+            }
+        }
+
+        void build()
+        {   // Once every surface is added. Sorts the blades into tiles, shuffles each tile and uploads the blade mesh.
+            if(blades.empty())
+                return;
+
+            glm::vec2 fieldmin(blades[0].root.x, blades[0].root.z), fieldmax = fieldmin;
+            for(unsigned int i = 1; i < blades.size(); i++)
+            {
+                fieldmin = glm::min(fieldmin, glm::vec2(blades[i].root.x, blades[i].root.z));
+                fieldmax = glm::max(fieldmax, glm::vec2(blades[i].root.x, blades[i].root.z));
+            }
+            unsigned int tilesx = (unsigned int) ((fieldmax.x - fieldmin.x) / GRASS_TILE_SIZE) + 1, tilesz = (unsigned int) ((fieldmax.y - fieldmin.y) / GRASS_TILE_SIZE) + 1;
+
+            // Counting sort by tile
+            std::vector<unsigned int> bladetiles(blades.size()), tilestarts(tilesx * tilesz + 1, 0);
+            for(unsigned int i = 0; i < blades.size(); i++)
+            {
+                unsigned int tilex = glm::min((unsigned int) ((blades[i].root.x - fieldmin.x) / GRASS_TILE_SIZE), tilesx - 1);
+                unsigned int tilez = glm::min((unsigned int) ((blades[i].root.z - fieldmin.y) / GRASS_TILE_SIZE), tilesz - 1);
+                bladetiles[i] = tilex + tilez * tilesx;
+                tilestarts[bladetiles[i] + 1]++;
+            }
+            for(unsigned int i = 1; i < tilestarts.size(); i++)
+                tilestarts[i] += tilestarts[i - 1];
+
+            std::vector<grass_blade> sortedblades(blades.size());
+            std::vector<unsigned int> tilefill(tilestarts.begin(), tilestarts.end() - 1);
+            for(unsigned int i = 0; i < blades.size(); i++)
+                sortedblades[tilefill[bladetiles[i]]++] = blades[i];
+            blades.swap(sortedblades);
+
+            tiles.clear();
+            tilebounds.clear();
+            for(unsigned int i = 0; i + 1 < tilestarts.size(); i++)
+            {
+                grass_tile tile;
+                tile.firstblade = tilestarts[i];
+                tile.bladecount = tilestarts[i + 1] - tilestarts[i];
+                if(tile.bladecount == 0)
+                    continue;
+
+                std::shuffle(blades.begin() + tile.firstblade, blades.begin() + tile.firstblade + tile.bladecount, random);
+                glm::vec3 boundsmin = blades[tile.firstblade].root, boundsmax = boundsmin;
+                tile.maxheight = 0.0f;
+                for(unsigned int j = tile.firstblade; j < tile.firstblade + tile.bladecount; j++)
+                {
+                    boundsmin = glm::min(boundsmin, blades[j].root);
+                    boundsmax = glm::max(boundsmax, blades[j].root);
+                    tile.maxheight = glm::max(tile.maxheight, blades[j].height);
+                }
+                boundsmin -= glm::vec3(GRASS_SWAY_MARGIN, 0.0f, GRASS_SWAY_MARGIN);
+                boundsmax += glm::vec3(GRASS_SWAY_MARGIN, tile.maxheight + GRASS_SWAY_MARGIN, GRASS_SWAY_MARGIN);
+
+                tile.center = (boundsmin + boundsmax) * 0.5f;
+                tile.radius = glm::length(boundsmax - tile.center);
+                tiles.push_back(tile);
+                tilebounds.push(tile.center, boundsmax - tile.center);
+            }
+
+            blademesh.reset(new Mesh_data(buildBlade(texture)));
+            if(USE_PACKED_VERTICES)
+                blademesh->packVertices();
+            blademesh->configureMesh();
+        }
+
+        void queue(Render_queue &queue, Shader &programshader, unsigned int pass, unsigned int material)
+        {   // Needs Model_data::setRenderView() for this frame, and the occluders rasterized when the view has them.
+            lastbladesdrawn = lasttilesdrawn = 0;
+            if(!blademesh)
+                return;
+
+            render_view &view = Model_data::renderView();
+            if(view.hasfrustum)
+            {
+                Frustum_culler::cullBounds(view.frustum, tilebounds, tilevisible);
+                if(view.occlusion)
+                    view.occlusion->cullBounds(tilebounds, tilevisible);
+            }
+            else
+                tilevisible.assign(tiles.size(), 1);
+
+            for(unsigned int level = 0; level < GRASS_BLADE_LEVELS; level++)
+                levelinstances[level].clear();
+
+            float nearestdistance = -1.0f;
+            for(unsigned int i = 0; i < tiles.size(); i++)
+            {
+                const grass_tile &tile = tiles[i];
+                float distance = glm::max(glm::length(tile.center - view.viewposition) - tile.radius, 0.0f);
+                float fade = glm::clamp((settings.radius - distance) / (settings.radius * GRASS_FADE_FRACTION), 0.0f, 1.0f);
+                if(!tilevisible[i] || fade <= 0.01f)
+                    continue;
+
+                float fraction = distance > GRASS_FULL_DENSITY_DISTANCE ? (GRASS_FULL_DENSITY_DISTANCE * GRASS_FULL_DENSITY_DISTANCE) / (distance * distance) : 1.0f;
+                unsigned int count = glm::min(tile.bladecount, (unsigned int) std::ceil(tile.bladecount * fraction));
+                float widening = glm::min(std::sqrt((float) tile.bladecount / count), GRASS_MAX_WIDENING);
+
+                unsigned int level = 0; // Same rule as Mesh_data::selectLod(), for the tile's tallest blade at its nearest point
+                if(view.pixelsperunit > 0.0f && distance > 0.0f)
+                    for(unsigned int j = 1; j < GRASS_BLADE_LEVELS; j++)
+                        if(blademesh->mesh_lods[j].error * tile.maxheight / distance * view.pixelsperunit <= LOD_MAX_PIXEL_ERROR)
+                            level = j;
+
+                for(unsigned int j = tile.firstblade; j < tile.firstblade + count; j++)
+                    levelinstances[level].push_back(bladeInstance(blades[j], widening, fade));
+
+                view.trianglesdrawn      += count * (blademesh->mesh_lods[level].indexcount / 3);
+                view.trianglesfulldetail += count * (blademesh->mesh_lods[0].indexcount / 3);
+                lastbladesdrawn += count;
+                lasttilesdrawn++;
+                if(nearestdistance < 0.0f || distance < nearestdistance)
+                    nearestdistance = distance;
+            }
+
+            if(lastbladesdrawn == 0)
+                return;
+
+            unsigned int levelcounts[MESH_LOD_MAX_LEVELS] = {0};
+            instances.clear();
+            for(unsigned int level = 0; level < GRASS_BLADE_LEVELS; level++)
+            {
+                levelcounts[level] = levelinstances[level].size();
+                instances.insert(instances.end(), levelinstances[level].begin(), levelinstances[level].end());
+            }
+            queue.submitInstanced(programshader, *blademesh, pass, material, nearestdistance, levelcounts, instances.data());
+        }
+
+        unsigned int bladesDrawn() const
+        {
+            return lastbladesdrawn;
+        }
+
+        void printStatistics() const
+        {
+            std::cout << "Grass field " << texturepath << ": " << blades.size() << " blades over " << (unsigned int) surfacearea << " square units in " << tiles.size() << " tiles, "
+                      << blades.size() * sizeof(grass_blade) / 1024 << " KB, blade levels of";
+            for(unsigned int level = 0; blademesh && level < blademesh->mesh_lods.size(); level++)
+                std::cout << " " << blademesh->mesh_lods[level].indexcount / 3;
+            std::cout << " triangles" << std::endl;
+        }
+
+        void releaseTextures()
+        {
+            Texture_registry::instance().release(texture.registry_entry);
+            texture.registry_entry = nullptr;
+            texture.texture_id = 0;
+        }
+
+    private:
+        std::vector<grass_blade> blades; // Grouped by tile once build() ran
+        std::vector<grass_tile> tiles; // Only the ones with blades
+        culling_bounds_soa tilebounds;
+        std::vector<unsigned char> tilevisible;
+        std::vector<instance_data> levelinstances[GRASS_BLADE_LEVELS], instances; // Kept between frames so they don't reallocate
+        std::unique_ptr<Mesh_data> blademesh;
+        texture_data texture;
+        float surfacearea = 0.0f;
+        unsigned int lastbladesdrawn = 0, lasttilesdrawn = 0;
+        std::mt19937 random{0x67726173u}; // Fixed seed, the field comes out the same every launch
+        std::uniform_real_distribution<float> unitrandom{0.0f, 1.0f};
+
+        static instance_data bladeInstance(const grass_blade &blade, float widening, float fade)
+        {   // Translation, rotation around y and scale, built directly. The normal matrix of a rotation times a scale is the rotation times the inverse scale.
+            glm::vec3 scale(blade.height * widening, blade.height * fade, blade.height); // z stays unfaded, the vertex shader sways the blade by it
+            float cosine = std::cos(blade.angle), sine = std::sin(blade.angle);
+            glm::vec3 axisx(cosine, 0.0f, -sine), axisz(sine, 0.0f, cosine);
+
+            instance_data instance;
+            instance.instance_modelmatrix = glm::mat4(glm::vec4(axisx * scale.x, 0.0f), glm::vec4(0.0f, scale.y, 0.0f, 0.0f), glm::vec4(axisz * scale.z, 0.0f), glm::vec4(blade.root, 1.0f));
+            instance.instance_normalmatrix = glm::mat3(axisx / scale.x, glm::vec3(0.0f, 1.0f / scale.y, 0.0f), axisz / scale.z);
+            instance.instance_windphase = blade.windphase;
+            return instance;
+        }
+
+        static glm::vec3 bladePosition(unsigned int row, float side)
+        { // side is -1 or 1, the tip row GRASS_BLADE_SEGMENTS has a single vertex at 0
+            float along = (float) row / GRASS_BLADE_SEGMENTS;
+            return glm::vec3(side * GRASS_BLADE_HALF_WIDTH * (1.0f - along), along, GRASS_BLADE_CURVE * along * along);
+        }
+
+        static Mesh_data buildBlade(const texture_data &bladetexture)
+        {
+            std::vector<vertex_data> vertices;
+            for(unsigned int row = 0; row <= GRASS_BLADE_SEGMENTS; row++)
+            {
+                float along = (float) row / GRASS_BLADE_SEGMENTS;
+                glm::vec3 bladeaxis = glm::normalize(glm::vec3(0.0f, 1.0f, 2.0f * GRASS_BLADE_CURVE * along));
+                glm::vec3 facenormal = glm::cross(glm::vec3(1.0f, 0.0f, 0.0f), bladeaxis);
+                for(int side = -1; side <= 1; side += 2)
+                {
+                    vertex_data vertex;
+                    vertex.vert_pos = bladePosition(row, row < GRASS_BLADE_SEGMENTS ? side : 0.0f);
+                    // Lit from both sides and mostly from above, so the normal leans up and the field shades like the ground it covers.
+                    vertex.vert_normal = glm::normalize(glm::vec3(0.0f, 1.0f, 0.0f) + 0.5f * facenormal);
+                    vertex.vert_texcoord = glm::vec2(row < GRASS_BLADE_SEGMENTS ? (side + 1) * 0.5f : 0.5f, 1.0f - along);
+                    vertex.vert_tangent = glm::vec3(1.0f, 0.0f, 0.0f);
+                    vertex.vert_bitangent = bladeaxis;
+                    vertices.push_back(vertex);
+                    if(row == GRASS_BLADE_SEGMENTS)
+                        break;
+                }
+            }
+
+            std::vector<unsigned int> indices;
+            std::vector<mesh_lod> lods;
+            const unsigned int tip = 2 * GRASS_BLADE_SEGMENTS;
+            for(unsigned int level = 0; level < GRASS_BLADE_LEVELS; level++)
+            {
+                mesh_lod lod = { (unsigned int) indices.size(), 0, 0.0f };
+                unsigned int step = 1u << level;
+                for(unsigned int row = 0; row < GRASS_BLADE_SEGMENTS; row += step)
+                {
+                    unsigned int next = row + step;
+                    if(next < GRASS_BLADE_SEGMENTS)
+                    {
+                        unsigned int quad[6] = { 2 * row, 2 * row + 1, 2 * next + 1, 2 * row, 2 * next + 1, 2 * next };
+                        indices.insert(indices.end(), quad, quad + 6);
+                    }
+                    else
+                    {
+                        unsigned int triangle[3] = { 2 * row, 2 * row + 1, tip };
+                        indices.insert(indices.end(), triangle, triangle + 3);
+                    }
+
+                    for(unsigned int skipped = row + 1; skipped < next && skipped < GRASS_BLADE_SEGMENTS; skipped++)
+                    { // How far the rows this level drops are from the straight edge it draws instead
+                        float blend = (float) (skipped - row) / step;
+                        for(int side = -1; side <= 1; side += 2)
+                        {
+                            glm::vec3 coarse = glm::mix(bladePosition(row, side), bladePosition(next, next < GRASS_BLADE_SEGMENTS ? side : 0.0f), blend);
+                            lod.error = glm::max(lod.error, glm::length(bladePosition(skipped, side) - coarse));
+                        }
+                    }
+                }
+                lod.indexcount = indices.size() - lod.indexoffset;
+                lods.push_back(lod);
+            }
+
+            return Mesh_data(vertices, indices, std::vector<texture_data>(1, bladetexture), lods);
+        }
+};
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef HEADLESS_BENCHMARK_H
+#define HEADLESS_BENCHMARK_H
+
+#include "../deps/GLADLibs/include/glad/glad.h"
+#include "Mesh_cache.hpp"
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+const unsigned int HEADLESS_WARMUP_FRAMES = 10; // Left out of the statistics, they pay for first use driver work (shader variants, residency)
+
+struct benchmark_settings
+{ // Filled in from the command line, see main()
+    bool enabled = false;
+    unsigned int width = 1280, height = 720;
+    float timestep = 1.0f / 60.0f; // Simulated seconds per frame, how far along the path and the animations every frame moves
+    unsigned int frames = 0; // 0 runs the camera path once, start to end
+    std::string pathfile = "scenes/flythrough.path";
+    std::vector<unsigned int> dumpframes; // Written as dumpdirectory/frame_00300.ppm and so on (zero padded to 5 digits), so two builds' output can be diffed
+    std::string dumpdirectory = "benchmark";
+
+    static std::vector<unsigned int> parseFrameList(const char *list)
+    { // "0,120,600"
+        std::vector<unsigned int> frames;
+        const char *cursor = list;
+        while(*cursor)
+        {
+            char *end = nullptr;
+            unsigned long frame = std::strtoul(cursor, &end, 10);
+            if(end == cursor)
+                break;
+            frames.push_back(frame);
+            cursor = *end == ',' ? end + 1 : end;
+        }
+        return frames;
+    }
+};
+
+class Headless_benchmark
+{ // Renders into an FBO of its own, since a headless context has no default framebuffer, and times every frame. CPU time covers the whole
+  // frame's work up to endFrame(), GPU time comes from a GL_TIME_ELAPSED query around the same span. The queries are only read at the end,
+  // so timing never makes the CPU wait on the GPU.
+    public:
+        bool create(const benchmark_settings &benchmarksettings, unsigned int framecount)
+        {
+            settings = benchmarksettings;
+            cpumilliseconds.assign(framecount, 0.0);
+            queries.resize(framecount);
+            glGenQueries(framecount, queries.data());
+
+            glGenRenderbuffers(1, &colorbuffer);
+            glBindRenderbuffer(GL_RENDERBUFFER, colorbuffer);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, settings.width, settings.height);
+            glGenRenderbuffers(1, &depthbuffer);
+            glBindRenderbuffer(GL_RENDERBUFFER, depthbuffer);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, settings.width, settings.height);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+            glGenFramebuffers(1, &framebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorbuffer);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthbuffer);
+            if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            {
+                std::cout << "HEADLESS_BENCHMARK_ERROR: The " << settings.width << "x" << settings.height << " framebuffer is incomplete" << std::endl;
+                return false;
+            }
+
+            if(!settings.dumpframes.empty())
+                Mesh_cache::createDirectory(settings.dumpdirectory);
+            std::cout << "Headless benchmark: " << framecount << " frames at " << settings.width << "x" << settings.height << ", "
+                      << settings.timestep * 1000.0f << " ms per frame of simulated time" << std::endl;
+            return true;
+        }
+
+        void beginFrame(unsigned int frame)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glViewport(0, 0, settings.width, settings.height);
+            framestart = std::chrono::steady_clock::now();
+            if(frame < queries.size())
+                glBeginQuery(GL_TIME_ELAPSED, queries[frame]);
+        }
+
+        void endFrame(unsigned int frame)
+        { // Stands in for the buffer swap. The flush hands the frame to the GPU the way a swap would, a dump waits for it but outside the timed span.
+            if(frame >= queries.size())
+                return;
+            glEndQuery(GL_TIME_ELAPSED);
+            glFlush();
+            cpumilliseconds[frame] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - framestart).count();
+
+            if(std::find(settings.dumpframes.begin(), settings.dumpframes.end(), frame) != settings.dumpframes.end())
+                dumpFrame(frame);
+        }
+
+        void printStatistics()
+        { // Every frame's times, then percentiles over the frames after the warm-up
+            std::vector<double> gpumilliseconds(queries.size(), 0.0);
+            for(unsigned int i = 0; i < queries.size(); i++)
+            {
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed);
+                gpumilliseconds[i] = elapsed / 1000000.0;
+            }
+
+            std::cout << "frame, cpu ms, gpu ms" << std::endl;
+            for(unsigned int i = 0; i < queries.size(); i++)
+            {
+                char row[64];
+                std::snprintf(row, sizeof(row), "%u, %.3f, %.3f", i, cpumilliseconds[i], gpumilliseconds[i]);
+                std::cout << row << std::endl;
+            }
+
+            if(queries.size() <= HEADLESS_WARMUP_FRAMES)
+            {
+                std::cout << "Headless benchmark: too few frames for statistics past the " << HEADLESS_WARMUP_FRAMES << " warm-up frames" << std::endl;
+                return;
+            }
+            printPercentiles("CPU", std::vector<double>(cpumilliseconds.begin() + HEADLESS_WARMUP_FRAMES, cpumilliseconds.end()));
+            printPercentiles("GPU", std::vector<double>(gpumilliseconds.begin() + HEADLESS_WARMUP_FRAMES, gpumilliseconds.end()));
+        }
+
+        void destroy()
+        {
+            if(!queries.empty())
+                glDeleteQueries(queries.size(), queries.data());
+            queries.clear();
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteRenderbuffers(1, &colorbuffer);
+            glDeleteRenderbuffers(1, &depthbuffer);
+            framebuffer = colorbuffer = depthbuffer = 0;
+        }
+
+    private:
+        benchmark_settings settings;
+        GLuint framebuffer = 0, colorbuffer = 0, depthbuffer = 0;
+        std::vector<GLuint> queries; // One per frame
+        std::vector<double> cpumilliseconds;
+        std::chrono::steady_clock::time_point framestart;
+
+        static void printPercentiles(const char *label, std::vector<double> milliseconds)
+        { // Nearest rank percentiles
+            std::sort(milliseconds.begin(), milliseconds.end());
+            double total = 0.0;
+            for(unsigned int i = 0; i < milliseconds.size(); i++)
+                total += milliseconds[i];
+
+            const double percentiles[4] = { 50.0, 90.0, 95.0, 99.0 };
+            char summary[256];
+            int length = std::snprintf(summary, sizeof(summary), "%s frame time over %u frames: mean %.3f ms, min %.3f", label, (unsigned int) milliseconds.size(),
+                                       total / milliseconds.size(), milliseconds.front());
+            for(int i = 0; i < 4; i++)
+            {
+                unsigned int rank = (unsigned int) std::ceil(percentiles[i] / 100.0 * milliseconds.size());
+                length += std::snprintf(summary + length, sizeof(summary) - length, ", p%.0f %.3f", percentiles[i], milliseconds[rank > 0 ? rank - 1 : 0]);
+            }
+            std::snprintf(summary + length, sizeof(summary) - length, ", max %.3f", milliseconds.back());
+            std::cout << summary << std::endl;
+        }
+
+        void dumpFrame(unsigned int frame) const
+        { // Binary PPM, top row first, no dependencies needed to write or to diff it
+            std::vector<unsigned char> pixels(settings.width * settings.height * 3);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+            glReadPixels(0, 0, settings.width, settings.height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+            char filename[32];
+            std::snprintf(filename, sizeof(filename), "/frame_%05u.ppm", frame);
+            std::string filepath = settings.dumpdirectory + filename;
+            std::ofstream image(filepath, std::ios::binary);
+            if(!image)
+            {
+                std::cout << "HEADLESS_BENCHMARK_ERROR: Couldn't write " << filepath << std::endl;
+                return;
+            }
+
+            image << "P6\n" << settings.width << " " << settings.height << "\n255\n";
+            for(unsigned int row = settings.height; row-- > 0;) // GL's rows start at the bottom
+                image.write((const char *) &pixels[row * settings.width * 3], settings.width * 3);
+        }
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include "../deps/GLADLibs/include/glad/glad.h"
+
+#include <iostream>
+
+// Build with -DHEADLESS_EGL and link libEGL to get the --headless mode. It's opt in since the windowed builds don't need EGL at all.
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+class Headless_context
+{ // A GL 4.3 core context with no window and no display server, through EGL on Mesa's surfaceless platform. Mesa's llvmpipe provides one on
+  // machines without a GPU (LIBGL_ALWAYS_SOFTWARE=1 forces it on ones that have one). There's no default framebuffer, whoever renders
+  // has to bring an FBO, see Headless_benchmark.
+    public:
+        bool create()
+        { // Makes the context current and loads GLAD through it
+#ifdef HEADLESS_EGL
+            PFNEGLGETPLATFORMDISPLAYEXTPROC getplatformdisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+            if(getplatformdisplay)
+                display = getplatformdisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if(display == EGL_NO_DISPLAY) // Not Mesa, the default display might still do without a surface
+                display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+            EGLint major = 0, minor = 0;
+            if(display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+            {
+                std::cout << "HEADLESS_CONTEXT_ERROR: No EGL display could be initialized" << std::endl;
+                display = EGL_NO_DISPLAY;
+                return false;
+            }
+
+            const EGLint configattributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                                EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_NONE };
+            EGLConfig config;
+            EGLint configcount = 0;
+            if(!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(display, configattributes, &config, 1, &configcount) || configcount == 0)
+            {
+                std::cout << "HEADLESS_CONTEXT_ERROR: EGL " << major << "." << minor << " has no desktop OpenGL config" << std::endl;
+                destroy();
+                return false;
+            }
+
+            const EGLint contextattributes[] = { EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 3,
+                                                 EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+            context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextattributes);
+            if(context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) // Needs EGL_KHR_surfaceless_context
+            {
+                std::cout << "HEADLESS_CONTEXT_ERROR: Couldn't create and bind a surfaceless OpenGL 4.3 core context" << std::endl;
+                destroy();
+                return false;
+            }
+
+            if(!gladLoadGLLoader((GLADloadproc) eglGetProcAddress))
+            {
+                std::cout << "Failed to load GLAD GL function Loader\n" << std::endl;
+                destroy();
+                return false;
+            }
+            return true;
+#else
+            std::cout << "HEADLESS_CONTEXT_ERROR: This build has no headless support, rebuild with -DHEADLESS_EGL and link libEGL" << std::endl;
+            return false;
+#endif
+        }
+
+        void destroy()
+        {
+#ifdef HEADLESS_EGL
+            if(display == EGL_NO_DISPLAY)
+                return;
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if(context != EGL_NO_CONTEXT)
+                eglDestroyContext(display, context);
+            eglTerminate(display);
+            context = EGL_NO_CONTEXT;
+            display = EGL_NO_DISPLAY;
+#endif
+        }
+
+    private:
+#ifdef HEADLESS_EGL
+        EGLDisplay display = EGL_NO_DISPLAY;
+        EGLContext context = EGL_NO_CONTEXT;
+#endif
+};
+
+#endif
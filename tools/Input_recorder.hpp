@@ -0,0 +1,300 @@
+#ifndef INPUT_RECORDER_H
+#define INPUT_RECORDER_H
+
+#include "../deps/glm/glm.hpp"
+#include "camera_object.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+
+// Bump this whenever the record layout changes, old logs are refused instead of misread.
+const uint32_t INPUT_LOG_VERSION  = 1;
+const char     INPUT_LOG_MAGIC[4] = {'C', 'G', 'I', 'N'};
+
+enum Input_Keys
+{ // Bits of the key state a frame record carries, everything inputPolling() reacts to besides Esc
+    INPUT_KEY_FORWARD   = 1 << 0,
+    INPUT_KEY_BACKWARDS = 1 << 1,
+    INPUT_KEY_LEFT      = 1 << 2,
+    INPUT_KEY_RIGHT     = 1 << 3,
+    INPUT_KEY_RUN       = 1 << 4,
+    INPUT_KEY_CROUCH    = 1 << 5,
+    INPUT_KEY_PREPASS   = 1 << 6,
+    INPUT_KEY_OCCLUSION = 1 << 7,
+    INPUT_KEY_DEFERRED  = 1 << 8
+};
+
+enum Input_Record_Type
+{
+    INPUT_RECORD_FRAME  = 1, // float deltatime, uint16 keys
+    INPUT_RECORD_MOUSE  = 2, // float xoffset, yoffset, as handed to checkMouseMovement()
+    INPUT_RECORD_SCROLL = 3, // float yoffset
+    INPUT_RECORD_CAMERA = 4  // float position xyz, yaw, pitch, zoom
+};
+
+struct input_record
+{ // In the log every record is a type byte and a float time (seconds since recording started) followed by only its own fields
+    uint8_t type;
+    float time;
+    float values[6];
+    uint16_t keys;
+};
+
+struct camera_state
+{
+    glm::vec3 position;
+    float yaw, pitch, zoom;
+
+    static camera_state of(const Camera_Object &camera)
+    {
+        camera_state state = { camera.position, camera.yaw, camera.pitch, camera.zoom };
+        return state;
+    }
+
+    bool operator==(const camera_state &other) const
+    {
+        return position == other.position && yaw == other.yaw && pitch == other.pitch && zoom == other.zoom;
+    }
+};
+
+class Input_recorder
+{ // Writes what drives the camera to a binary log (--record <file>): the key state and frame time of every frame, every mouse and scroll
+  // event in the order GLFW delivered them, and the camera itself whenever it changed, so a replay can tell how far it strayed.
+  // Native byte order, logs are meant to be replayed on the machine family that recorded them.
+    public:
+        bool open(const std::string &logpath, const Camera_Object &camera, double starttime)
+        {
+            logfile.open(logpath, std::ios::binary | std::ios::trunc);
+            if(!logfile)
+            {
+                std::cout << "INPUT_LOG_ERROR: Couldn't create " << logpath << std::endl;
+                return false;
+            }
+
+            path = logpath;
+            start = starttime;
+            lastcamera = camera_state::of(camera);
+            logfile.write(INPUT_LOG_MAGIC, 4);
+            write(INPUT_LOG_VERSION);
+            writeCamera(lastcamera);
+            return true;
+        }
+
+        bool recording() const
+        {
+            return logfile.is_open();
+        }
+
+        void recordFrame(double time, float deltatime, unsigned int keys)
+        {
+            if(!beginRecord(INPUT_RECORD_FRAME, time))
+                return;
+            write(deltatime);
+            write((uint16_t) keys);
+            frames++;
+        }
+
+        void recordMouse(double time, float xoffset, float yoffset)
+        {
+            if(!beginRecord(INPUT_RECORD_MOUSE, time))
+                return;
+            write(xoffset);
+            write(yoffset);
+        }
+
+        void recordScroll(double time, float yoffset)
+        {
+            if(!beginRecord(INPUT_RECORD_SCROLL, time))
+                return;
+            write(yoffset);
+        }
+
+        void recordCamera(double time, const Camera_Object &camera)
+        { // Skipped while the camera stands still
+            camera_state state = camera_state::of(camera);
+            if(state == lastcamera || !beginRecord(INPUT_RECORD_CAMERA, time))
+                return;
+            writeCamera(state);
+            lastcamera = state;
+        }
+
+        void close()
+        {
+            if(!logfile.is_open())
+                return;
+            std::streamoff size = logfile.tellp();
+            logfile.close();
+            std::cout << "Input log " << path << ": " << frames << " frames, " << size / 1024.0 << " KB" << std::endl;
+        }
+
+    private:
+        std::ofstream logfile;
+        std::string path;
+        double start = 0.0;
+        unsigned int frames = 0;
+        camera_state lastcamera;
+
+        bool beginRecord(uint8_t type, double time)
+        {
+            if(!logfile.is_open())
+                return false;
+            logfile.write((const char *) &type, 1);
+            write((float) (time - start));
+            return true;
+        }
+
+        template <typename T> void write(const T &value)
+        {
+            logfile.write((const char *) &value, sizeof(T));
+        }
+
+        void writeCamera(const camera_state &state)
+        {
+            write(state.position.x);
+            write(state.position.y);
+            write(state.position.z);
+            write(state.yaw);
+            write(state.pitch);
+            write(state.zoom);
+        }
+};
+
+class Input_replay
+{ // Plays a log back (--replay <file>) on a fixed timestep instead of the recorded frame times. Every step first hands the mouse and scroll events
+  // recorded up to then to the camera in their original order, then returns every key held in any of the frames recorded since the last step for
+  // the caller to move with, so a key tapped for a single recorded frame between two steps still reaches it. Movement is integrated over fixed
+  // simulation steps, so a replay doesn't retrace the recording to the millimeter, but every replay of the same log at the same timestep retraces
+  // every other one exactly.
+    public:
+        bool load(const std::string &logpath)
+        {
+            std::ifstream logfile(logpath, std::ios::binary);
+            char magic[4];
+            uint32_t version = 0;
+            if(!logfile || !logfile.read(magic, 4) || std::memcmp(magic, INPUT_LOG_MAGIC, 4) != 0 || !read(logfile, version) || version != INPUT_LOG_VERSION
+               || !readCamera(logfile, initialcamera))
+            {
+                std::cout << "INPUT_LOG_ERROR: " << logpath << " is missing or isn't a version " << INPUT_LOG_VERSION << " input log" << std::endl;
+                return false;
+            }
+
+            records.clear();
+            uint8_t type = 0;
+            while(logfile.read((char *) &type, 1))
+            {
+                input_record record = {};
+                record.type = type;
+                bool complete = read(logfile, record.time);
+                if(type == INPUT_RECORD_FRAME)
+                    complete = complete && read(logfile, record.values[0]) && read(logfile, record.keys);
+                else if(type == INPUT_RECORD_MOUSE)
+                    complete = complete && read(logfile, record.values[0]) && read(logfile, record.values[1]);
+                else if(type == INPUT_RECORD_SCROLL)
+                    complete = complete && read(logfile, record.values[0]);
+                else if(type == INPUT_RECORD_CAMERA)
+                    for(int i = 0; i < 6; i++)
+                        complete = complete && read(logfile, record.values[i]);
+                else
+                    complete = false;
+
+                if(!complete)
+                { // A recording cut short by a crash still replays up to where it stops
+                    std::cout << "INPUT_LOG_ERROR: " << logpath << " ends in a damaged record, replaying the " << records.size() << " before it" << std::endl;
+                    break;
+                }
+                records.push_back(record);
+            }
+
+            path = logpath;
+            return true;
+        }
+
+        bool replaying() const
+        {
+            return !path.empty();
+        }
+
+        float duration() const
+        {
+            return records.empty() ? 0.0f : records.back().time;
+        }
+
+        bool finished() const
+        {
+            return cursor >= records.size();
+        }
+
+        void start(Camera_Object &camera)
+        { // Back to where the recording started
+            camera.setPose(initialcamera.position, initialcamera.yaw, initialcamera.pitch);
+            camera.zoom = initialcamera.zoom;
+            cursor = 0;
+            keys = 0;
+            recordedcamera = initialcamera;
+            maxdrift = 0.0f;
+        }
+
+        unsigned int advance(Camera_Object &camera, float time)
+        {
+            unsigned int stepkeys = 0;
+            bool stepframes = false; // Without any, the keys of the last step stay held
+            while(cursor < records.size() && records[cursor].time <= time)
+            {
+                const input_record &record = records[cursor++];
+                if(record.type == INPUT_RECORD_FRAME)
+                {
+                    stepkeys |= record.keys;
+                    stepframes = true;
+                }
+                else if(record.type == INPUT_RECORD_MOUSE)
+                    camera.checkMouseMovement(record.values[0], record.values[1]);
+                else if(record.type == INPUT_RECORD_SCROLL)
+                    camera.checkMouseWheel(record.values[0]);
+                else if(record.type == INPUT_RECORD_CAMERA)
+                {
+                    recordedcamera.position = glm::vec3(record.values[0], record.values[1], record.values[2]);
+                    recordedcamera.yaw   = record.values[3];
+                    recordedcamera.pitch = record.values[4];
+                    recordedcamera.zoom  = record.values[5];
+                }
+            }
+            if(stepframes)
+                keys = stepkeys;
+            return finished() ? 0 : keys; // Nothing stays held past the end of the log
+        }
+
+        void compareCamera(const Camera_Object &camera)
+        { // Against the last camera recorded up to the current step, call after the step's movement
+            maxdrift = glm::max(maxdrift, glm::length(camera.position - recordedcamera.position));
+        }
+
+        void printStatistics(const Camera_Object &camera) const
+        {
+            std::cout << "Input replay " << path << ": " << records.size() << " records over " << duration() << " s, the camera strayed up to " << maxdrift
+                      << " units from the recording and ended " << glm::length(camera.position - recordedcamera.position) << " units from it" << std::endl;
+        }
+
+    private:
+        std::vector<input_record> records;
+        std::string path;
+        camera_state initialcamera, recordedcamera;
+        unsigned int cursor = 0, keys = 0;
+        float maxdrift = 0.0f;
+
+        template <typename T> static bool read(std::ifstream &logfile, T &value)
+        {
+            return (bool) logfile.read((char *) &value, sizeof(T));
+        }
+
+        static bool readCamera(std::ifstream &logfile, camera_state &state)
+        {
+            return read(logfile, state.position.x) && read(logfile, state.position.y) && read(logfile, state.position.z) && read(logfile, state.yaw)
+                && read(logfile, state.pitch) && read(logfile, state.zoom);
+        }
+};
+
+#endif
@@ -0,0 +1,383 @@
+#ifndef LIGHT_BAKER_H
+#define LIGHT_BAKER_H
+
+#include "../deps/GLADLibs/include/glad/glad.h"
+#include "../deps/glm/glm.hpp"
+#include "../deps/glm/gtc/packing.hpp"
+#include "Mesh_loader.hpp"
+#include "Mesh_cache.hpp"
+#include "Light_buffer.hpp"
+#include "Thread_pool.hpp"
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+// Must match the layout(binding = ...) of the BakedLighting block in the basic vertex shader.
+const unsigned int BAKED_LIGHTING_BINDING = 5;
+
+// Bump this whenever the bake itself changes (falloff, offsets, packing), old caches are rebaked instead of reused.
+const uint32_t LIGHT_BAKE_VERSION  = 1;
+const char     LIGHT_BAKE_MAGIC[4] = {'C', 'G', 'L', 'B'};
+const char     LIGHT_BAKE_DIRECTORY[] = "cache/lighting"; // Inside MESH_CACHE_DIRECTORY
+
+const unsigned int LIGHT_BVH_LEAF_TRIANGLES = 4;
+const unsigned int LIGHT_BAKE_JOB_VERTICES  = 2048; // Per Thread_pool job
+const float LIGHT_BAKE_RAY_OFFSET = 0.02f; // Shadow rays start this far off the surface along its normal, so they don't hit the triangle they leave from
+const float LIGHT_BAKE_MIN_CONTRIBUTION = 1.0f / 512.0f; // Lights that can't add half an 8 bit step to a vertex aren't traced, the light clusters drop them the same way
+
+struct light_bvh_node
+{ // Leaves have count triangles from first on. Inner nodes have count 0, their left child right after them and their right child at first.
+    glm::vec3 boundsmin; unsigned int first = 0;
+    glm::vec3 boundsmax; unsigned int count = 0;
+};
+
+class Light_bvh
+{   // Bounding volume hierarchy over world space triangles, only answers whether anything lies between two points. Built top down, every
+    // node splits its triangles at the median centroid along the longest axis of their centroids' bounds.
+    public:
+        std::vector<glm::vec3> vertices; // Three per triangle, filled in by the caller before build()
+
+        void build()
+        {
+            unsigned int trianglecount = vertices.size() / 3;
+            triangles.resize(trianglecount);
+            centroids.resize(trianglecount);
+            for(unsigned int i = 0; i < trianglecount; i++)
+            {
+                triangles[i] = i;
+                centroids[i] = (vertices[i * 3] + vertices[i * 3 + 1] + vertices[i * 3 + 2]) / 3.0f;
+            }
+
+            nodes.clear();
+            nodes.reserve(glm::max(trianglecount / LIGHT_BVH_LEAF_TRIANGLES * 2, 1u));
+            if(trianglecount > 0)
+                buildNode(0, trianglecount);
+
+            std::vector<glm::vec3> ordered(vertices.size()); // Leaves then read their triangles straight from one contiguous run
+            for(unsigned int i = 0; i < trianglecount; i++)
+                for(unsigned int corner = 0; corner < 3; corner++)
+                    ordered[i * 3 + corner] = vertices[triangles[i] * 3 + corner];
+            vertices.swap(ordered);
+            triangles.clear();
+            centroids.clear();
+        }
+
+        bool occluded(const glm::vec3 &origin, const glm::vec3 &direction, float maxdistance) const
+        { // direction must be normalized. Any hit will do, so the first one found ends the walk.
+            if(nodes.empty())
+                return false;
+
+            glm::vec3 inversedirection = 1.0f / direction; // Infinite along axes the ray runs parallel to, which the slab test handles
+            unsigned int stack[64];
+            unsigned int stacksize = 0;
+            stack[stacksize++] = 0;
+            while(stacksize > 0)
+            {
+                const light_bvh_node &node = nodes[stack[--stacksize]];
+                if(!hitsBounds(node, origin, inversedirection, maxdistance))
+                    continue;
+
+                if(node.count > 0)
+                {
+                    for(unsigned int i = node.first; i < node.first + node.count; i++)
+                        if(hitsTriangle(i, origin, direction, maxdistance))
+                            return true;
+                }
+                else
+                {
+                    stack[stacksize++] = node.first;
+                    stack[stacksize++] = &node - nodes.data() + 1;
+                }
+            }
+            return false;
+        }
+
+        unsigned int nodeCount() const
+        {
+            return nodes.size();
+        }
+
+        unsigned int triangleCount() const
+        {
+            return vertices.size() / 3;
+        }
+
+    private:
+        std::vector<light_bvh_node> nodes;
+        std::vector<unsigned int> triangles; // Only while building
+        std::vector<glm::vec3> centroids;
+
+        unsigned int buildNode(unsigned int first, unsigned int count)
+        {
+            unsigned int nodeindex = nodes.size();
+            nodes.push_back(light_bvh_node());
+
+            glm::vec3 boundsmin(1e30f), boundsmax(-1e30f), centroidmin(1e30f), centroidmax(-1e30f);
+            for(unsigned int i = first; i < first + count; i++)
+            {
+                unsigned int triangle = triangles[i];
+                for(unsigned int corner = 0; corner < 3; corner++)
+                {
+                    boundsmin = glm::min(boundsmin, vertices[triangle * 3 + corner]);
+                    boundsmax = glm::max(boundsmax, vertices[triangle * 3 + corner]);
+                }
+                centroidmin = glm::min(centroidmin, centroids[triangle]);
+                centroidmax = glm::max(centroidmax, centroids[triangle]);
+            }
+            nodes[nodeindex].boundsmin = boundsmin;
+            nodes[nodeindex].boundsmax = boundsmax;
+
+            glm::vec3 extent = centroidmax - centroidmin;
+            int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+            if(count <= LIGHT_BVH_LEAF_TRIANGLES || extent[axis] <= 0.0f) // Stacked centroids can't be told apart by any split
+            {
+                nodes[nodeindex].first = first;
+                nodes[nodeindex].count = count;
+                return nodeindex;
+            }
+
+            unsigned int half = count / 2;
+            std::nth_element(triangles.begin() + first, triangles.begin() + first + half, triangles.begin() + first + count,
+                             [this, axis](unsigned int a, unsigned int b) { return centroids[a][axis] < centroids[b][axis]; });
+
+            buildNode(first, half); // Lands right after this node
+            unsigned int right = buildNode(first + half, count - half);
+            nodes[nodeindex].first = right; // By index, the children's push_back()s may have moved the node
+            nodes[nodeindex].count = 0;
+            return nodeindex;
+        }
+
+        static bool hitsBounds(const light_bvh_node &node, const glm::vec3 &origin, const glm::vec3 &inversedirection, float maxdistance)
+        { // Slab test
+            glm::vec3 t0 = (node.boundsmin - origin) * inversedirection;
+            glm::vec3 t1 = (node.boundsmax - origin) * inversedirection;
+            glm::vec3 tnear = glm::min(t0, t1), tfar = glm::max(t0, t1);
+            float enter = glm::max(glm::max(tnear.x, tnear.y), glm::max(tnear.z, 0.0f));
+            float exit  = glm::min(glm::min(tfar.x, tfar.y), glm::min(tfar.z, maxdistance));
+            return enter <= exit;
+        }
+
+        bool hitsTriangle(unsigned int triangle, const glm::vec3 &origin, const glm::vec3 &direction, float maxdistance) const
+        { // Möller-Trumbore, both faces count
+            const glm::vec3 &v0 = vertices[triangle * 3];
+            glm::vec3 edge1 = vertices[triangle * 3 + 1] - v0, edge2 = vertices[triangle * 3 + 2] - v0;
+            glm::vec3 p = glm::cross(direction, edge2);
+            float determinant = glm::dot(edge1, p);
+            if(glm::abs(determinant) < 1e-12f)
+                return false;
+
+            float inversedeterminant = 1.0f / determinant;
+            glm::vec3 s = origin - v0;
+            float u = glm::dot(s, p) * inversedeterminant;
+            if(u < 0.0f || u > 1.0f)
+                return false;
+            glm::vec3 q = glm::cross(s, edge1);
+            float v = glm::dot(direction, q) * inversedeterminant;
+            if(v < 0.0f || u + v > 1.0f)
+                return false;
+            float t = glm::dot(edge2, q) * inversedeterminant;
+            return t > 0.0f && t < maxdistance;
+        }
+};
+
+class Light_baker
+{   // Bakes the diffuse light of point lights that never move into every vertex of the static meshes they shine on, with shadows: each vertex
+    // traces a ray towards each light against a BVH of every shadow casting triangle, spread over a Thread_pool. The result is one storage
+    // buffer of RGB half floats (two uints per vertex) that the basic vertex shader reads through each instance's offset, so the fragment
+    // shader can leave those lights out of its loop. Bakes are cached on disk, keyed by a hash of the lights, receivers and casters they came
+    // from, so only a scene or light change pays for the tracing again.
+    public:
+        void addCaster(const Mesh_data &mesh, const glm::mat4 &modelmatrix)
+        { // The full detail level, in world space
+            const mesh_lod &lod = mesh.mesh_lods[0];
+            for(unsigned int i = 0; i < lod.indexcount; i++)
+                bvh.vertices.push_back(glm::vec3(modelmatrix * glm::vec4(mesh.mesh_vertices[mesh.mesh_vert_indices[lod.indexoffset + i]].vert_pos, 1.0f)));
+        }
+
+        unsigned int addReceiver(const std::vector<Mesh_data> &meshes, const glm::mat4 &modelmatrix, const glm::mat3 &normalmatrix)
+        { // Returns where the copy's block starts in the baked buffer, every mesh of the model one after the other, see Mesh_data::modelvertexoffset
+            unsigned int offset = positions.size();
+            for(unsigned int i = 0; i < meshes.size(); i++)
+            {
+                for(unsigned int j = 0; j < meshes[i].mesh_vertices.size(); j++)
+                {
+                    const vertex_data &vertex = meshes[i].mesh_vertices[j];
+                    positions.push_back(glm::vec3(modelmatrix * glm::vec4(vertex.vert_pos, 1.0f)));
+                    glm::vec3 normal = normalmatrix * vertex.vert_normal;
+                    normals.push_back(glm::dot(normal, normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f, 1.0f, 0.0f));
+                }
+            }
+            receivers++;
+            return offset;
+        }
+
+        void bake(const std::vector<point_light_std430> &lights, bool rebake)
+        { // lights in world space. rebake skips the cache lookup, the result is still written to it.
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            lightcount = lights.size();
+            castertriangles = bvh.triangleCount();
+            std::string cachepath = std::string(LIGHT_BAKE_DIRECTORY) + "/" + hashKey(lights) + ".lightbake";
+            cachehit = !rebake && loadCache(cachepath);
+            if(!cachehit)
+            {
+                bvh.build();
+                bvhnodes = bvh.nodeCount();
+                trace(lights);
+                storeCache(cachepath);
+            }
+            bakemilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            std::vector<glm::vec3>().swap(positions); // Only the packed result is needed from here on
+            std::vector<glm::vec3>().swap(normals);
+            bvh = Light_bvh();
+        }
+
+        void upload()
+        { // Needs the GL context. Stays bound to BAKED_LIGHTING_BINDING, even empty, so the shaders always have a buffer there.
+            if(!bakedbuffer)
+                glGenBuffers(1, &bakedbuffer);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, bakedbuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, glm::max(bakedlighting.size(), (size_t) 1) * sizeof(glm::uvec2), nullptr, GL_STATIC_DRAW);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bakedlighting.size() * sizeof(glm::uvec2), bakedlighting.data());
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BAKED_LIGHTING_BINDING, bakedbuffer);
+        }
+
+        void printStatistics() const
+        {
+            std::cout << "Baked lighting: " << lightcount << " lights into " << bakedlighting.size() << " vertices of " << receivers << " entities, "
+                      << bakedlighting.size() * sizeof(glm::uvec2) / 1024 << " KB, ";
+            if(cachehit)
+                std::cout << "loaded from the cache in " << bakemilliseconds << " ms" << std::endl;
+            else
+                std::cout << castertriangles << " shadow casting triangles in " << bvhnodes << " BVH nodes, " << raystraced << " rays traced in "
+                          << bakemilliseconds << " ms" << std::endl;
+        }
+
+        void destroy()
+        {
+            glDeleteBuffers(1, &bakedbuffer);
+            bakedbuffer = 0;
+        }
+
+    private:
+        Light_bvh bvh;
+        std::vector<glm::vec3> positions, normals; // World space, one per receiving vertex
+        std::vector<glm::uvec2> bakedlighting;     // RGB as half floats, packHalf2x16(r, g) and packHalf2x16(b, 0)
+        unsigned int bakedbuffer = 0;
+        unsigned int receivers = 0, lightcount = 0, castertriangles = 0, bvhnodes = 0;
+        unsigned long long raystraced = 0;
+        bool cachehit = false;
+        double bakemilliseconds = 0.0;
+
+        void trace(const std::vector<point_light_std430> &lights)
+        {
+            bakedlighting.assign(positions.size(), glm::uvec2(0));
+            unsigned int jobcount = (positions.size() + LIGHT_BAKE_JOB_VERTICES - 1) / LIGHT_BAKE_JOB_VERTICES;
+            std::vector<unsigned long long> jobrays(jobcount, 0);
+
+            Thread_pool workers;
+            for(unsigned int job = 0; job < jobcount; job++)
+            {
+                workers.enqueue([this, &lights, &jobrays, job]
+                { // Every job writes its own run of vertices, nothing is shared besides the read only BVH
+                    unsigned int first = job * LIGHT_BAKE_JOB_VERTICES;
+                    unsigned int last = glm::min(first + LIGHT_BAKE_JOB_VERTICES, (unsigned int) positions.size());
+                    for(unsigned int i = first; i < last; i++)
+                    {
+                        glm::vec3 irradiance(0.0f);
+                        glm::vec3 origin = positions[i] + normals[i] * LIGHT_BAKE_RAY_OFFSET;
+                        for(unsigned int j = 0; j < lights.size(); j++)
+                        { // The diffuse term of calculateOmniLight() in BasicFragmentShader.frag, times whether the light can see the vertex
+                            const point_light_std430 &light = lights[j];
+                            glm::vec3 tolight = light.position - positions[i];
+                            float lightdist = glm::length(tolight);
+                            if(lightdist <= 0.0f)
+                                continue;
+                            glm::vec3 lightdirection = tolight / lightdist;
+                            float diffuselightvalue = glm::max(glm::dot(normals[i], lightdirection), 0.0f);
+                            float lightattenuation = 1.0f / (light.constantattenuation + light.linearattenuation * lightdist + light.quadraticattenuation * lightdist * lightdist);
+                            glm::vec3 contribution = light.diffusestrength * diffuselightvalue * lightattenuation;
+                            if(glm::max(contribution.x, glm::max(contribution.y, contribution.z)) < LIGHT_BAKE_MIN_CONTRIBUTION)
+                                continue;
+
+                            glm::vec3 shadowray = light.position - origin;
+                            float raylength = glm::length(shadowray);
+                            jobrays[job]++;
+                            if(!bvh.occluded(origin, shadowray / raylength, raylength - LIGHT_BAKE_RAY_OFFSET))
+                                irradiance += contribution;
+                        }
+                        bakedlighting[i] = glm::uvec2(glm::packHalf2x16(glm::vec2(irradiance.x, irradiance.y)), glm::packHalf2x16(glm::vec2(irradiance.z, 0.0f)));
+                    }
+                });
+            }
+            workers.waitIdle();
+
+            raystraced = 0;
+            for(unsigned int job = 0; job < jobcount; job++)
+                raystraced += jobrays[job];
+        }
+
+        std::string hashKey(const std::vector<point_light_std430> &lights) const
+        {   // 64 bit FNV-1a over everything the bake reads, so moving a light, an entity or editing a model all land on a different cache file.
+            uint64_t hash = 14695981039346656037ULL;
+            hashBytes(hash, &LIGHT_BAKE_VERSION, sizeof(LIGHT_BAKE_VERSION));
+            hashBytes(hash, lights.data(), lights.size() * sizeof(point_light_std430));
+            hashBytes(hash, positions.data(), positions.size() * sizeof(glm::vec3));
+            hashBytes(hash, normals.data(), normals.size() * sizeof(glm::vec3));
+            hashBytes(hash, bvh.vertices.data(), bvh.vertices.size() * sizeof(glm::vec3));
+
+            char hashstr[17];
+            std::snprintf(hashstr, sizeof(hashstr), "%016llx", (unsigned long long) hash);
+            return std::string(hashstr);
+        }
+
+        static void hashBytes(uint64_t &hash, const void *data, size_t length)
+        {
+            const unsigned char *bytes = (const unsigned char*) data;
+            for(size_t i = 0; i < length; i++)
+            {
+                hash ^= bytes[i];
+                hash *= 1099511628211ULL;
+            }
+        }
+
+        bool loadCache(const std::string &cachepath)
+        {
+            std::ifstream cachefile(cachepath, std::ios::binary);
+            char magic[4];
+            uint32_t version = 0, vertexcount = 0;
+            if(!cachefile || !cachefile.read(magic, 4) || std::memcmp(magic, LIGHT_BAKE_MAGIC, 4) != 0 || !cachefile.read((char*) &version, sizeof(version))
+               || version != LIGHT_BAKE_VERSION || !cachefile.read((char*) &vertexcount, sizeof(vertexcount)) || vertexcount != positions.size())
+                return false;
+
+            bakedlighting.resize(vertexcount);
+            return (bool) cachefile.read((char*) bakedlighting.data(), vertexcount * sizeof(glm::uvec2));
+        }
+
+        void storeCache(const std::string &cachepath) const
+        {
+            Mesh_cache::createDirectory(LIGHT_BAKE_DIRECTORY);
+            std::ofstream cachefile(cachepath, std::ios::binary | std::ios::trunc);
+            if(!cachefile)
+            {
+                std::cout << "LIGHT_BAKE_ERROR: Couldn't write " << cachepath << ", the lighting will be baked again next run" << std::endl;
+                return;
+            }
+
+            uint32_t vertexcount = bakedlighting.size();
+            cachefile.write(LIGHT_BAKE_MAGIC, 4);
+            cachefile.write((const char*) &LIGHT_BAKE_VERSION, sizeof(LIGHT_BAKE_VERSION));
+            cachefile.write((const char*) &vertexcount, sizeof(vertexcount));
+            cachefile.write((const char*) bakedlighting.data(), bakedlighting.size() * sizeof(glm::uvec2));
+        }
+};
+
+#endif
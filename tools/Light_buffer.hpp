@@ -0,0 +1,115 @@
+#ifndef LIGHT_BUFFER_H
+#define LIGHT_BUFFER_H
+
+#include "../deps/GLADLibs/include/glad/glad.h"
+#include "../deps/glm/glm.hpp"
+#include "shader_compiler.h"
+
+#include <vector>
+#include <cstring>
+
+// Must match the layout(binding = ...) of the SceneLights and PointLights blocks in the fragment shaders.
+const unsigned int SCENE_LIGHTS_BINDING = 0;
+const unsigned int POINT_LIGHTS_BINDING = 1;
+
+struct directional_light_std140
+{ // Every vec3 is padded to 16 bytes under std140, the pad floats keep glm in step with it.
+    glm::vec3 direction;        float pad0 = 0.0f;
+    glm::vec3 ambientstrength;  float pad1 = 0.0f;
+    glm::vec3 diffusestrength;  float pad2 = 0.0f;
+    glm::vec3 specularstrength; float pad3 = 0.0f;
+};
+
+struct spot_light_std140
+{
+    glm::vec3 position;         float pad0 = 0.0f;
+    glm::vec3 direction;        float coneinnercutoff = 0.0f; // A lone float packs into the end of the vec3 before it
+    glm::vec3 ambientstrength;  float pad1 = 0.0f;
+    glm::vec3 diffusestrength;  float pad2 = 0.0f;
+    glm::vec3 specularstrength; float pad3 = 0.0f;
+};
+
+struct scene_lights_std140
+{ // The SceneLights uniform block, lights every program sees the same way.
+    directional_light_std140 dlight;
+    spot_light_std140        slight[1]; // SPOT_LIGHTS in the fragment shaders
+};
+
+struct point_light_std430
+{ // One element of the PointLights storage buffer, the attenuation terms fill what would otherwise be vec3 padding.
+    glm::vec3 position;         float constantattenuation  = 1.0f;
+    glm::vec3 ambientstrength;  float linearattenuation    = 0.0f;
+    glm::vec3 diffusestrength;  float quadraticattenuation = 0.0f;
+    glm::vec3 specularstrength; float pad0 = 0.0f;
+};
+
+static_assert(sizeof(directional_light_std140) == 64 && sizeof(spot_light_std140) == 80 && sizeof(point_light_std430) == 64, "Light structs out of step with std140/std430");
+
+class Light_buffer
+{   // Owns the two buffers every lit program reads its lights from. The CPU copies are filled in by the caller, upload() only touches the GL when they changed.
+    public:
+        scene_lights_std140 scenelights;
+        std::vector<point_light_std430> pointlights;
+
+        Light_buffer() {}
+
+        void create()
+        {   // Needs the GL context, the buffers stay bound to their binding points for the whole run.
+            glGenBuffers(1, &sceneubo);
+            glGenBuffers(1, &pointssbo);
+
+            glBindBuffer(GL_UNIFORM_BUFFER, sceneubo);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(scene_lights_std140), nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            glBindBufferBase(GL_UNIFORM_BUFFER, SCENE_LIGHTS_BINDING, sceneubo);
+        }
+
+        void upload()
+        {
+            if(std::memcmp(&scenelights, &uploadedscenelights, sizeof(scene_lights_std140)) != 0 || !hasuploaded)
+            {
+                glBindBuffer(GL_UNIFORM_BUFFER, sceneubo);
+                glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(scene_lights_std140), &scenelights);
+                glBindBuffer(GL_UNIFORM_BUFFER, 0);
+                uploadedscenelights = scenelights;
+            }
+
+            if(pointlights.size() != uploadedpointlights.size() || !hasuploaded ||
+               std::memcmp(pointlights.data(), uploadedpointlights.data(), pointlights.size() * sizeof(point_light_std430)) != 0)
+            {   // Orphaned and refilled whole, so the GL doesn't have to wait for last frame's draws to let go of it.
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, pointssbo);
+                glBufferData(GL_SHADER_STORAGE_BUFFER, glm::max(pointlights.size(), (size_t) 1) * sizeof(point_light_std430), nullptr, GL_DYNAMIC_DRAW);
+                glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, pointlights.size() * sizeof(point_light_std430), pointlights.data());
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, POINT_LIGHTS_BINDING, pointssbo);
+                uploadedpointlights = pointlights;
+            }
+            hasuploaded = true;
+        }
+
+        static void setPointLightRange(Shader &lightshader, unsigned int firstlight, unsigned int lightcount)
+        {   // Which slice of pointlights a program shades with, so programs can keep their own tuning of the same lights.
+            lightshader.setInt("pointlightfirst", firstlight);
+            lightshader.setInt("pointlightcount", lightcount);
+        }
+
+        static void setBakedLightRange(Shader &lightshader, unsigned int firstlight, unsigned int lightcount)
+        {   // The lights of that slice Light_baker baked into vertices, skipped for every instance that carries baked lighting.
+            lightshader.setInt("bakedlightfirst", firstlight);
+            lightshader.setInt("bakedlightcount", lightcount);
+        }
+
+        void destroy()
+        {
+            glDeleteBuffers(1, &sceneubo);
+            glDeleteBuffers(1, &pointssbo);
+        }
+
+    private:
+        unsigned int sceneubo = 0, pointssbo = 0;
+        scene_lights_std140 uploadedscenelights;
+        std::vector<point_light_std430> uploadedpointlights;
+        bool hasuploaded = false;
+};
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include "../deps/GLADLibs/include/glad/glad.h"
+#include "../deps/glm/glm.hpp"
+#include "Light_buffer.hpp"
+
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+// Must match the layout(binding = ...) of the LightClusters and LightClusterIndices blocks in the fragment shaders.
+const unsigned int LIGHT_CLUSTERS_BINDING        = 2;
+const unsigned int LIGHT_CLUSTER_INDICES_BINDING = 3;
+
+// Tiles across the screen and exponential depth slices between the near and far plane.
+const unsigned int LIGHT_CLUSTERS_X = 16, LIGHT_CLUSTERS_Y = 9, LIGHT_CLUSTERS_Z = 24;
+
+// A light stops counting once the most it could add to a fragment drops under one step of an 8 bit framebuffer.
+const float LIGHT_CULL_THRESHOLD = 1.0f / 256.0f;
+
+struct light_cluster_header_std430
+{ // Fixed part of the LightClusters storage buffer, the per cluster (offset, count) pairs follow it.
+    glm::uvec4 clustergrid;  // Cluster counts in x, y and z, w unused
+    glm::vec4  clusterscale; // Pixels per tile in x and y, then the scale and bias turning log(view depth) into a depth slice
+};
+
+struct light_cluster_bounds
+{
+    glm::vec3 boundsmin, boundsmax; // View space
+};
+
+class Light_clusters
+{   // Bins the point lights of a Light_buffer into a view space cluster grid on the CPU, so each fragment only walks the lights that can actually reach it.
+    public:
+        std::vector<glm::uvec2>   clusterranges;  // Offset into clusterlights and light count, per cluster, x fastest then y then z
+        std::vector<unsigned int> clusterlights;  // Global indices into Light_buffer::pointlights
+        std::vector<float>        lightradii;     // Influence radius of every point light, refreshed by assignLights()
+
+        Light_clusters() {}
+
+        void create()
+        {
+            glGenBuffers(1, &clusterssbo);
+            glGenBuffers(1, &indicesssbo);
+        }
+
+        static float influenceRadius(const point_light_std430 &pointlight)
+        {   // The diffuse and specular terms are each at most strength * attenuation (textures, N.L and the shininess 1 highlight all stay within 1),
+            // so past the distance where attenuation * (diffuse + specular) drops under the threshold the light is invisible.
+            glm::vec3 strength = pointlight.diffusestrength + pointlight.specularstrength;
+            float peak = glm::max(strength.x, glm::max(strength.y, strength.z));
+            if(peak <= 0.0f)
+                return 0.0f;
+
+            // Solves quadratic * d^2 + linear * d + constant = peak / threshold for d
+            float a = pointlight.quadraticattenuation, b = pointlight.linearattenuation, c = pointlight.constantattenuation - peak / LIGHT_CULL_THRESHOLD;
+            if(c >= 0.0f)
+                return 0.0f; // Never bright enough to matter, even right on top of it
+
+            if(a <= 0.0f)
+                return b > 0.0f ? -c / b : 1e30f; // No falloff at all means it reaches everything
+            return (-b + std::sqrt(b * b - 4.0f * a * c)) / (2.0f * a);
+        }
+
+        void setProjection(const glm::mat4 &projectionmatrix, float nearplane, float farplane, float viewportwidth, float viewportheight)
+        {   // Cluster bounds only depend on the projection, so they're rebuilt when it changes (e.g. zooming) and not every frame.
+            if(projectionmatrix == projection && viewportwidth == viewport.x && viewportheight == viewport.y && !clusterbounds.empty())
+                return;
+
+            projection = projectionmatrix;
+            viewport   = glm::vec2(viewportwidth, viewportheight);
+            znear = nearplane;
+            zfar  = farplane;
+
+            header.clustergrid  = glm::uvec4(LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y, LIGHT_CLUSTERS_Z, 0);
+            header.clusterscale = glm::vec4(viewportwidth / LIGHT_CLUSTERS_X, viewportheight / LIGHT_CLUSTERS_Y,
+                                            LIGHT_CLUSTERS_Z / std::log(zfar / znear), -(LIGHT_CLUSTERS_Z * std::log(znear)) / std::log(zfar / znear));
+
+            glm::mat4 inverseprojection = glm::inverse(projection);
+            clusterbounds.resize(LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z);
+
+            for(unsigned int z = 0; z < LIGHT_CLUSTERS_Z; z++)
+            {
+                float slicenear = sliceDepth(z), slicefar = sliceDepth(z + 1);
+                for(unsigned int y = 0; y < LIGHT_CLUSTERS_Y; y++)
+                {
+                    for(unsigned int x = 0; x < LIGHT_CLUSTERS_X; x++)
+                    {   // The tile's four corner rays, cut at both slice depths. A box around those 8 points holds the whole frustum piece.
+                        light_cluster_bounds &bounds = clusterbounds[clusterIndex(x, y, z)];
+                        bounds.boundsmin = glm::vec3( 1e30f);
+                        bounds.boundsmax = glm::vec3(-1e30f);
+
+                        for(unsigned int corner = 0; corner < 4; corner++)
+                        {
+                            glm::vec2 ndc(-1.0f + 2.0f * (x + (corner & 1)) / LIGHT_CLUSTERS_X, -1.0f + 2.0f * (y + (corner >> 1)) / LIGHT_CLUSTERS_Y);
+                            glm::vec4 raypoint = inverseprojection * glm::vec4(ndc, 1.0f, 1.0f);
+                            glm::vec3 raydirection = glm::vec3(raypoint) / raypoint.w;
+                            raydirection /= -raydirection.z; // Scaled to a view depth of one
+
+                            bounds.boundsmin = glm::min(bounds.boundsmin, glm::min(raydirection * slicenear, raydirection * slicefar));
+                            bounds.boundsmax = glm::max(bounds.boundsmax, glm::max(raydirection * slicenear, raydirection * slicefar));
+                        }
+                    }
+                }
+            }
+        }
+
+        void assignLights(const std::vector<point_light_std430> &pointlights)
+        {   // Each light only visits the depth slices its sphere spans, and within those only tests the tiles.
+            unsigned int clustercount = clusterbounds.size();
+            std::vector<std::vector<unsigned int> > &binned = binnedlights;
+            binned.resize(clustercount);
+            for(unsigned int i = 0; i < clustercount; i++)
+                binned[i].clear();
+
+            lightradii.resize(pointlights.size());
+            for(unsigned int light = 0; light < pointlights.size(); light++)
+            {
+                // Slightly inflated, so fragments right on a cluster border can't fall out of it through rounding
+                float radius = influenceRadius(pointlights[light]);
+                lightradii[light] = radius;
+                if(radius <= 0.0f)
+                    continue;
+                radius = radius * 1.001f + 0.01f;
+
+                const glm::vec3 &center = pointlights[light].position;
+                float depthnear = -center.z - radius, depthfar = -center.z + radius;
+                if(depthfar < znear || depthnear > zfar)
+                    continue;
+
+                unsigned int firstslice = depthSlice(depthnear), lastslice = depthSlice(depthfar);
+                for(unsigned int z = firstslice; z <= lastslice; z++)
+                    for(unsigned int tile = 0; tile < LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y; tile++)
+                    {
+                        unsigned int cluster = z * LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y + tile;
+                        const light_cluster_bounds &bounds = clusterbounds[cluster];
+                        glm::vec3 closest = glm::clamp(center, bounds.boundsmin, bounds.boundsmax);
+                        glm::vec3 offset  = closest - center;
+                        if(glm::dot(offset, offset) <= radius * radius)
+                            binned[cluster].push_back(light);
+                    }
+            }
+
+            clusterranges.resize(clustercount);
+            clusterlights.clear();
+            for(unsigned int i = 0; i < clustercount; i++)
+            {
+                clusterranges[i] = glm::uvec2(clusterlights.size(), binned[i].size());
+                clusterlights.insert(clusterlights.end(), binned[i].begin(), binned[i].end());
+            }
+        }
+
+        void upload()
+        {
+            std::vector<unsigned char> clusterdata(sizeof(light_cluster_header_std430) + clusterranges.size() * sizeof(glm::uvec2));
+            std::memcpy(clusterdata.data(), &header, sizeof(light_cluster_header_std430));
+            std::memcpy(clusterdata.data() + sizeof(light_cluster_header_std430), clusterranges.data(), clusterranges.size() * sizeof(glm::uvec2));
+
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusterssbo);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, clusterdata.size(), clusterdata.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, indicesssbo);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, glm::max(clusterlights.size(), (size_t) 1) * sizeof(unsigned int), nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, clusterlights.size() * sizeof(unsigned int), clusterlights.data());
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_CLUSTERS_BINDING, clusterssbo);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_CLUSTER_INDICES_BINDING, indicesssbo);
+        }
+
+        unsigned int clusterForFragment(float pixelx, float pixely, float viewdepth) const
+        {   // Same lookup as the fragment shaders, pixel coordinates measured from the bottom left like gl_FragCoord.
+            unsigned int x = glm::min((unsigned int) glm::max(pixelx / header.clusterscale.x, 0.0f), LIGHT_CLUSTERS_X - 1);
+            unsigned int y = glm::min((unsigned int) glm::max(pixely / header.clusterscale.y, 0.0f), LIGHT_CLUSTERS_Y - 1);
+            return clusterIndex(x, y, depthSlice(viewdepth));
+        }
+
+        void destroy()
+        {
+            glDeleteBuffers(1, &clusterssbo);
+            glDeleteBuffers(1, &indicesssbo);
+        }
+
+    private:
+        unsigned int clusterssbo = 0, indicesssbo = 0;
+        light_cluster_header_std430 header;
+        std::vector<light_cluster_bounds> clusterbounds;
+        std::vector<std::vector<unsigned int> > binnedlights; // Kept between frames so the per cluster lists don't reallocate
+        glm::mat4 projection = glm::mat4(0.0f);
+        glm::vec2 viewport = glm::vec2(0.0f);
+        float znear = 0.1f, zfar = 1.0f;
+
+        static unsigned int clusterIndex(unsigned int x, unsigned int y, unsigned int z)
+        {
+            return x + LIGHT_CLUSTERS_X * (y + LIGHT_CLUSTERS_Y * z);
+        }
+
+        float sliceDepth(unsigned int slice) const
+        {
+            return znear * std::pow(zfar / znear, (float) slice / LIGHT_CLUSTERS_Z);
+        }
+
+        unsigned int depthSlice(float viewdepth) const
+        {
+            float slice = std::log(glm::max(viewdepth, 1e-4f)) * header.clusterscale.z + header.clusterscale.w;
+            return (unsigned int) glm::clamp(slice, 0.0f, (float) (LIGHT_CLUSTERS_Z - 1));
+        }
+};
+
+#endif
@@ -0,0 +1,330 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "Mesh_loader.hpp"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #include <direct.h>
+#else
+    #include <sys/mman.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+// Bump this whenever the layout of the cache file or the contents of vertex_data change, so stale caches get rebuilt instead of misread.
+const uint32_t MESH_CACHE_VERSION   = 3;
+const char     MESH_CACHE_MAGIC[4]  = {'C', 'G', 'M', 'C'};
+const char     MESH_CACHE_DIRECTORY[] = "cache";
+
+struct mesh_cache_header
+{
+    char     magic[4];
+    uint32_t version;
+    int64_t  source_mtime;
+    uint64_t source_size;
+    uint32_t import_flags;
+    uint32_t vertex_size;   // sizeof(vertex_data) when the cache was written, guards against struct layout changes between builds
+    uint32_t path_length;
+    uint32_t mesh_count;
+};
+
+struct mesh_cache_entry
+{   // Points straight into the mapped cache file, nothing here is owned.
+    const vertex_data  *vertices;
+    const unsigned int *indices;
+    const mesh_lod     *lods;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t lod_count;
+    std::vector<texture_data> textures; // Only texture_type and texture_path are filled, the model resolves the ids itself.
+};
+
+class Mapped_file
+{   // Read-only memory mapping of a whole file, unmapped when the object goes out of scope.
+    public:
+        const unsigned char *data = nullptr;
+        size_t size = 0;
+
+        Mapped_file(const std::string &filepath)
+        {
+        #ifdef _WIN32
+            filehandle = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if(filehandle == INVALID_HANDLE_VALUE)
+                return;
+
+            LARGE_INTEGER filesize;
+            if(!GetFileSizeEx(filehandle, &filesize) || filesize.QuadPart == 0)
+                return;
+
+            maphandle = CreateFileMappingA(filehandle, NULL, PAGE_READONLY, 0, 0, NULL);
+            if(maphandle == NULL)
+                return;
+
+            data = (const unsigned char*) MapViewOfFile(maphandle, FILE_MAP_READ, 0, 0, 0);
+            if(data)
+                size = (size_t) filesize.QuadPart;
+        #else
+            filehandle = open(filepath.c_str(), O_RDONLY);
+            if(filehandle < 0)
+                return;
+
+            struct stat filestat;
+            if(fstat(filehandle, &filestat) != 0 || filestat.st_size == 0)
+                return;
+
+            void *mapping = mmap(NULL, filestat.st_size, PROT_READ, MAP_PRIVATE, filehandle, 0);
+            if(mapping == MAP_FAILED)
+                return;
+
+            data = (const unsigned char*) mapping;
+            size = (size_t) filestat.st_size;
+        #endif
+        }
+
+        ~Mapped_file()
+        {
+        #ifdef _WIN32
+            if(data)
+                UnmapViewOfFile(data);
+            if(maphandle != NULL)
+                CloseHandle(maphandle);
+            if(filehandle != INVALID_HANDLE_VALUE)
+                CloseHandle(filehandle);
+        #else
+            if(data)
+                munmap((void*) data, size);
+            if(filehandle >= 0)
+                close(filehandle);
+        #endif
+        }
+
+        Mapped_file(const Mapped_file&) = delete;
+        Mapped_file &operator=(const Mapped_file&) = delete;
+
+    private:
+    #ifdef _WIN32
+        HANDLE filehandle = INVALID_HANDLE_VALUE;
+        HANDLE maphandle  = NULL;
+    #else
+        int filehandle = -1;
+    #endif
+};
+
+class Mesh_cache
+{   // Binary cache of the final vertex/index arrays of a model, keyed by source path, modification time and the Assimp import flags.
+    public:
+        std::vector<mesh_cache_entry> cached_meshes;
+
+        Mesh_cache(const std::string &modelpath, unsigned int importflags)
+        : modelpath(modelpath), importflags(importflags)
+        {
+            struct stat sourcestat;
+            if(stat(modelpath.c_str(), &sourcestat) == 0)
+            {
+                sourcemtime = (int64_t) sourcestat.st_mtime;
+                sourcesize  = (uint64_t) sourcestat.st_size;
+                sourcefound = true;
+            }
+            cachepath = std::string(MESH_CACHE_DIRECTORY) + "/" + hashPath(modelpath) + ".meshcache";
+        }
+
+        bool load()
+        {   // Maps the cache file and validates its key. On success cached_meshes points into the mapping, which lives as long as this object.
+            if(!sourcefound)
+                return false;
+
+            mappedcache.reset(new Mapped_file(cachepath));
+            const unsigned char *cachedata = mappedcache->data;
+            size_t cachesize = mappedcache->size, offset = 0;
+
+            if(!cachedata || cachesize < sizeof(mesh_cache_header))
+                return false;
+
+            mesh_cache_header header;
+            std::memcpy(&header, cachedata, sizeof(header));
+            offset += sizeof(header);
+
+            if(std::memcmp(header.magic, MESH_CACHE_MAGIC, 4) != 0 || header.version != MESH_CACHE_VERSION || header.vertex_size != sizeof(vertex_data) ||
+               header.source_mtime != sourcemtime || header.source_size != sourcesize || header.import_flags != importflags)
+                return false;
+
+            std::string cachedpath;
+            if(!readString(cachedata, cachesize, offset, header.path_length, cachedpath) || cachedpath != modelpath)
+                return false;
+
+            cached_meshes.clear();
+            for(uint32_t i = 0; i < header.mesh_count; i++)
+            {
+                mesh_cache_entry entry;
+                uint32_t counts[4]; // vertex count, index count, texture count, LOD count
+
+                if(!readBytes(cachedata, cachesize, offset, counts, sizeof(counts)))
+                    return false;
+
+                entry.vertex_count = counts[0];
+                entry.index_count  = counts[1];
+                entry.lod_count    = counts[3];
+
+                for(uint32_t j = 0; j < counts[2]; j++)
+                {
+                    texture_data texdata;
+                    uint32_t lengths[2];
+                    texdata.texture_id = 0;
+
+                    if(!readBytes(cachedata, cachesize, offset, lengths, sizeof(lengths)) ||
+                       !readString(cachedata, cachesize, offset, lengths[0], texdata.texture_type) ||
+                       !readString(cachedata, cachesize, offset, lengths[1], texdata.texture_path))
+                        return false;
+
+                    entry.textures.push_back(texdata);
+                }
+
+                if(offset + (size_t) entry.lod_count * sizeof(mesh_lod) + (size_t) entry.vertex_count * sizeof(vertex_data) + (size_t) entry.index_count * sizeof(unsigned int) > cachesize)
+                    return false;
+
+                entry.lods = (const mesh_lod*) (cachedata + offset);
+                offset += (size_t) entry.lod_count * sizeof(mesh_lod);
+                entry.vertices = (const vertex_data*) (cachedata + offset);
+                offset += (size_t) entry.vertex_count * sizeof(vertex_data);
+                entry.indices = (const unsigned int*) (cachedata + offset);
+                offset += (size_t) entry.index_count * sizeof(unsigned int);
+
+                cached_meshes.push_back(entry);
+            }
+
+            return true;
+        }
+
+        bool store(const std::vector<Mesh_data> &meshes)
+        {
+            if(!sourcefound)
+                return false;
+
+            createDirectory(MESH_CACHE_DIRECTORY);
+
+            std::ofstream cachefile(cachepath.c_str(), std::ios::binary | std::ios::trunc);
+            if(!cachefile)
+            {
+                std::cout << "Failed to write the mesh cache located at: " << cachepath << std::endl;
+                return false;
+            }
+
+            mesh_cache_header header;
+            std::memcpy(header.magic, MESH_CACHE_MAGIC, 4);
+            header.version      = MESH_CACHE_VERSION;
+            header.source_mtime = sourcemtime;
+            header.source_size  = sourcesize;
+            header.import_flags = importflags;
+            header.vertex_size  = sizeof(vertex_data);
+            header.path_length  = modelpath.size();
+            header.mesh_count   = meshes.size();
+
+            cachefile.write((const char*) &header, sizeof(header));
+            writeString(cachefile, modelpath);
+
+            for(unsigned int i = 0; i < meshes.size(); i++)
+            {
+                uint32_t counts[4] = { (uint32_t) meshes[i].mesh_vertices.size(), (uint32_t) meshes[i].mesh_vert_indices.size(), (uint32_t) meshes[i].mesh_textures.size(), (uint32_t) meshes[i].mesh_lods.size() };
+                cachefile.write((const char*) counts, sizeof(counts));
+
+                for(unsigned int j = 0; j < meshes[i].mesh_textures.size(); j++)
+                {
+                    uint32_t lengths[2] = { (uint32_t) meshes[i].mesh_textures[j].texture_type.size(), (uint32_t) meshes[i].mesh_textures[j].texture_path.size() };
+                    cachefile.write((const char*) lengths, sizeof(lengths));
+                    writeString(cachefile, meshes[i].mesh_textures[j].texture_type);
+                    writeString(cachefile, meshes[i].mesh_textures[j].texture_path);
+                }
+
+                cachefile.write((const char*) meshes[i].mesh_lods.data(), meshes[i].mesh_lods.size() * sizeof(mesh_lod));
+                cachefile.write((const char*) meshes[i].mesh_vertices.data(), meshes[i].mesh_vertices.size() * sizeof(vertex_data));
+                cachefile.write((const char*) meshes[i].mesh_vert_indices.data(), meshes[i].mesh_vert_indices.size() * sizeof(unsigned int));
+            }
+
+            return cachefile.good();
+        }
+
+        static void createDirectory(const std::string &dirpath)
+        { // Creates every missing directory along the path. Every tool writing under cache/ or into a directory of the user's goes through this one.
+            for(size_t separator = dirpath.find('/'); ; separator = dirpath.find('/', separator + 1))
+            {
+                std::string partial = dirpath.substr(0, separator);
+            #ifdef _WIN32
+                _mkdir(partial.c_str());
+            #else
+                mkdir(partial.c_str(), 0755);
+            #endif
+                if(separator == std::string::npos)
+                    break;
+            }
+        }
+
+    private:
+        std::string modelpath, cachepath;
+        unsigned int importflags;
+        int64_t  sourcemtime = 0;
+        uint64_t sourcesize  = 0;
+        bool sourcefound = false;
+        std::unique_ptr<Mapped_file> mappedcache;
+
+        static std::string hashPath(const std::string &path)
+        {   // 64 bit FNV-1a, only used to get a flat file name for the cache, the full path is still checked on load.
+            uint64_t hash = 14695981039346656037ULL;
+            for(unsigned int i = 0; i < path.size(); i++)
+            {
+                hash ^= (unsigned char) path[i];
+                hash *= 1099511628211ULL;
+            }
+
+            char hashstr[17];
+            std::snprintf(hashstr, sizeof(hashstr), "%016llx", (unsigned long long) hash);
+            return std::string(hashstr);
+        }
+
+        static size_t paddedLength(size_t length)
+        {   // Strings are padded to 4 bytes so the vertex and index arrays that follow stay aligned inside the mapping.
+            return (length + 3) & ~((size_t) 3);
+        }
+
+        static void writeString(std::ofstream &cachefile, const std::string &str)
+        {
+            const char padding[4] = {0, 0, 0, 0};
+            cachefile.write(str.data(), str.size());
+            cachefile.write(padding, paddedLength(str.size()) - str.size());
+        }
+
+        static bool readBytes(const unsigned char *cachedata, size_t cachesize, size_t &offset, void *destination, size_t length)
+        {
+            if(offset + length > cachesize)
+                return false;
+
+            std::memcpy(destination, cachedata + offset, length);
+            offset += length;
+            return true;
+        }
+
+        static bool readString(const unsigned char *cachedata, size_t cachesize, size_t &offset, uint32_t length, std::string &str)
+        {
+            if(offset + paddedLength(length) > cachesize)
+                return false;
+
+            str.assign((const char*) cachedata + offset, length);
+            offset += paddedLength(length);
+            return true;
+        }
+};
+
+#endif
@@ -1,10 +1,20 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
 #include "../deps/GLADLibs/include/glad/glad.h"
 #include "../deps/glm/glm.hpp"
 #include "../deps/glm/gtc/matrix_transform.hpp"
 #include "shader_compiler.h"
+#include "Vertex_packing.hpp"
+#include "Mesh_simplifier.hpp"
+#include "Geometry_arena.hpp"
 
 #include <string>
 #include <vector>
+#include <cstddef>
+
+// Uploads meshes as packed_vertex_data (20 bytes per vertex) instead of vertex_data (56 bytes). The shaders decode both, so this can be flipped freely.
+const bool USE_PACKED_VERTICES = true;
 
 struct vertex_data
 {
@@ -15,10 +25,13 @@ struct vertex_data
     glm::vec3 vert_bitangent;
 };
 
+struct texture_registry_entry;
+
 struct texture_data
 {
     unsigned int texture_id;
     std::string  texture_type, texture_path;
+    texture_registry_entry *registry_entry = nullptr; // Shared texture this one resolved to, see Texture_registry.hpp
 };
 
 class Mesh_data
@@ -27,99 +40,149 @@ class Mesh_data
         std::vector<vertex_data>     mesh_vertices;
         std::vector<unsigned int>    mesh_vert_indices;
         std::vector<texture_data>    mesh_textures;
-        unsigned int VAO; // VAO = Vertex Array Object
-
-        Mesh_data(std::vector<vertex_data> mesh_vertices, std::vector<unsigned int> mesh_vert_indices, std::vector<texture_data> mesh_textures)
+        std::vector<packed_vertex_data> mesh_packed_vertices; // Only filled by packVertices(), configureMesh() uploads these instead of mesh_vertices when present
+        std::vector<mesh_lod>        mesh_lods; // Index ranges of each detail level inside mesh_vert_indices, level 0 being the full mesh
+        glm::vec3 boundscenter = glm::vec3(0.0f);
+        float     boundsradius = 0.0f;
+        glm::vec3 aabbmin = glm::vec3(0.0f), aabbmax = glm::vec3(0.0f); // Object space, what the frustum culling transforms and tests
+        glm::vec3 positiondecodemin    = glm::vec3(0.0f);
+        glm::vec3 positiondecodeextent = glm::vec3(1.0f);
+        unsigned int VAO = 0; // VAO = Vertex Array Object, the one of the Geometry_arena the mesh was uploaded into
+        GLenum indextype = GL_UNSIGNED_INT; // Dropped to GL_UNSIGNED_SHORT by configureMesh() whenever the mesh has few enough vertices
+        unsigned int basevertex = 0, firstindex = 0; // Where the mesh's vertices and indices start inside its arena, mesh_lods offsets are relative to firstindex
+        unsigned int modelvertexoffset = 0; // Vertices of the model's meshes before this one, how Light_baker lays out a copy's block of baked lighting
+        glm::uvec4 materialtextures = glm::uvec4(0xFFFFFFFFu, 0, 0xFFFFFFFFu, 0); // Array and layer of the diffuse and specular textures, see Texture_arrays::resolveMesh()
+        bool materialresolved = false;
+
+        Mesh_data(std::vector<vertex_data> mesh_vertices, std::vector<unsigned int> mesh_vert_indices, std::vector<texture_data> mesh_textures, std::vector<mesh_lod> mesh_lods = std::vector<mesh_lod>())
         {
             this->mesh_vertices     = mesh_vertices;
             this->mesh_vert_indices = mesh_vert_indices;
             this->mesh_textures     = mesh_textures;
-
-            configureMesh(); // Configures the mesh for rendering by setting its buffers(VBO, VAO, EBO as well as their data) and its attribute array and pointers.
+            this->mesh_lods         = mesh_lods;
+            computeBoundingSphere();
+            // configureMesh() is left to the owner, since meshes can be built on a loader thread and only uploaded later on the one owning the GL context.
         }
 
-        void renderMesh(Shader &meshshader)
-        {
-            unsigned int diffusemapnum  = 1;
-            unsigned int specularmapnum = 1;
-            unsigned int normalmapnum   = 1;
-            unsigned int heightmapnum   = 1;
-
-            for(unsigned int i = 0; i < mesh_textures.size(); i++)
-            {
-                glActiveTexture(GL_TEXTURE0 + i);
+        Mesh_data(const vertex_data *mesh_vertices, unsigned int vertexcount, const unsigned int *mesh_vert_indices, unsigned int indexcount, std::vector<texture_data> mesh_textures,
+                  const mesh_lod *mesh_lods, unsigned int lodcount)
+        { // Used when the mesh comes straight out of a memory mapped cache file instead of Assimp, so there's no intermediate vector to build.
+            this->mesh_vertices.assign(mesh_vertices, mesh_vertices + vertexcount);
+            this->mesh_vert_indices.assign(mesh_vert_indices, mesh_vert_indices + indexcount);
+            this->mesh_textures = mesh_textures;
+            this->mesh_lods.assign(mesh_lods, mesh_lods + lodcount);
+            computeBoundingSphere();
+        }
 
-                std::string texstruct = "material.", texnumber, texname = mesh_textures[i].texture_type;
+        unsigned int selectLod(const glm::mat4 &modelmatrix, const glm::vec3 &viewposition, float pixelsperunit, float maxpixelerror) const
+        { // Picks the coarsest level whose error, projected at the distance of the closest point of the bounding sphere, stays under maxpixelerror.
+            float modelscale = glm::max(glm::length(glm::vec3(modelmatrix[0])), glm::max(glm::length(glm::vec3(modelmatrix[1])), glm::length(glm::vec3(modelmatrix[2]))));
+            glm::vec3 worldcenter = glm::vec3(modelmatrix * glm::vec4(boundscenter, 1.0f));
+            float distance = glm::length(worldcenter - viewposition) - boundsradius * modelscale;
 
-                if(texname == "diffuse_texture")
-                {
-                    texnumber = std::to_string(diffusemapnum);
-                    diffusemapnum++;
-                }
+            if(distance <= 0.0f) // Inside the bounds, every bit of error could end up right in front of the camera
+                return 0;
 
-                else if(texname == "specular_texture")
-                {
-                    texnumber = std::to_string(specularmapnum);
-                    specularmapnum++;
-                }
+            unsigned int lodlevel = 0;
+            for(unsigned int i = 1; i < mesh_lods.size(); i++)
+                if(mesh_lods[i].error * modelscale / distance * pixelsperunit <= maxpixelerror)
+                    lodlevel = i;
 
-                else if(texname == "normal_texture")
-                {
-                    texnumber = std::to_string(normalmapnum);
-                    normalmapnum++;
-                }
+            return lodlevel;
+        }
 
-                else if(texname == "height_texture")
-                {
-                    texnumber = std::to_string(heightmapnum);
-                    heightmapnum++;
-                }
+        vertex_packing_error packVertices()
+        { // Pure CPU work, so it can run on the loader threads before configureMesh().
+            Vertex_packing::computeBounds(mesh_vertices, positiondecodemin, positiondecodeextent);
 
+            mesh_packed_vertices.resize(mesh_vertices.size());
+            for(unsigned int i = 0; i < mesh_vertices.size(); i++)
+                mesh_packed_vertices[i] = Vertex_packing::packVertex(mesh_vertices[i], positiondecodemin, positiondecodeextent);
 
-                glUniform1i(glGetUniformLocation(meshshader.shader_id, (texstruct + texname + texnumber).c_str()), i);
+            return Vertex_packing::measureError(mesh_vertices, mesh_packed_vertices, positiondecodemin, positiondecodeextent);
+        }
 
-                glBindTexture(GL_TEXTURE_2D, mesh_textures[i].texture_id);
+        void configureMesh() // Appends the mesh to the Geometry_arena matching its vertex layout and index type, every mesh of that kind then shares one VAO, vertex and index buffer.
+        {
+            std::vector<unsigned short> shortindices;
+            if(mesh_vertices.size() <= 65536)
+            { // Every mesh but the terrain fits in 16 bit indices, which halves the index buffer. Indices stay mesh relative, the draws add basevertex back.
+                shortindices.assign(mesh_vert_indices.begin(), mesh_vert_indices.end());
+                indextype = GL_UNSIGNED_SHORT;
             }
-
-            glBindVertexArray(VAO); // sets the mesh's vertex array for drawing
-            glDrawElements(GL_TRIANGLES, mesh_vert_indices.size(), GL_UNSIGNED_INT, 0); // draws the mesh
-            glBindVertexArray(0); // Resets to the null vertex array after drawing the mesh
-
-            glActiveTexture(GL_TEXTURE0); // Points back to the first texture sampler
+            else
+                indextype = GL_UNSIGNED_INT;
+
+            const void *indices = indextype == GL_UNSIGNED_SHORT ? (const void*) shortindices.data() : (const void*) mesh_vert_indices.data();
+            Geometry_arena &arena = !mesh_packed_vertices.empty() ? Geometry_arena::forLayout(sizeof(packed_vertex_data), indextype, setupPackedAttributes)
+                                                                  : Geometry_arena::forLayout(sizeof(vertex_data), indextype, setupFloatAttributes);
+            geometry_range range = !mesh_packed_vertices.empty() ? arena.append(mesh_packed_vertices.data(), mesh_packed_vertices.size(), indices, mesh_vert_indices.size())
+                                                                 : arena.append(mesh_vertices.data(), mesh_vertices.size(), indices, mesh_vert_indices.size());
+            VAO        = arena.VAO;
+            basevertex = range.basevertex;
+            firstindex = range.firstindex;
         }
 
     private:
-        unsigned int VBO, EBO; // Vertex Buffer Object and Element Buffer Object respectively.
+        static void setupPackedAttributes()
+        { // Same attribute locations as the float layout, the shaders decode them based on the packedvertices flag of each draw.
+            glEnableVertexAttribArray(0);
+            glVertexAttribFormat(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(packed_vertex_data, vert_pos));
 
-        void configureMesh()
-        {
-            glGenVertexArrays(1, &VAO);
-            glGenBuffers(1, &VBO);
-            glGenBuffers(1, &EBO);
+            glEnableVertexAttribArray(1);
+            glVertexAttribFormat(1, 2, GL_SHORT, GL_TRUE, offsetof(packed_vertex_data, vert_normal));
 
-            glBindVertexArray(VAO);
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            glEnableVertexAttribArray(2);
+            glVertexAttribFormat(2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(packed_vertex_data, vert_texcoord));
 
-            glBufferData(GL_ARRAY_BUFFER, mesh_vertices.size() * sizeof(vertex_data), &mesh_vertices[0], GL_STATIC_DRAW);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh_vert_indices.size() * sizeof(unsigned int), &mesh_vert_indices[0], GL_STATIC_DRAW);
+            glEnableVertexAttribArray(3);
+            glVertexAttribFormat(3, 4, GL_BYTE, GL_TRUE, offsetof(packed_vertex_data, vert_tangent));
+
+            glDisableVertexAttribArray(4); // The bitangent is rebuilt from the normal, the tangent and its handedness
+
+            for(unsigned int location = 0; location < 4; location++)
+                glVertexAttribBinding(location, VERTEX_BUFFER_BINDING);
+        }
 
-            //Attribute pointers: 0-> vertex positions, 1-> vertex normals, 2-> vertex texture coordinates, 3-> vertex tangent angle, 4-> vertex bitangent angle.
-            glEnableVertexAttribArray(0); // RETURN HERE IF IT GLITCHES!!!
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_data), (void*) 0);
+        static void setupFloatAttributes()
+        { //Attribute formats: 0-> vertex positions, 1-> vertex normals, 2-> vertex texture coordinates, 3-> vertex tangent angle, 4-> vertex bitangent angle.
+            glEnableVertexAttribArray(0);
+            glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, offsetof(vertex_data, vert_pos));
 
             glEnableVertexAttribArray(1);
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_data), (void*) sizeof(glm::vec3));
+            glVertexAttribFormat(1, 3, GL_FLOAT, GL_FALSE, offsetof(vertex_data, vert_normal));
 
             glEnableVertexAttribArray(2);
-            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_data), (void*) (2 * sizeof(glm::vec3)) );
+            glVertexAttribFormat(2, 2, GL_FLOAT, GL_FALSE, offsetof(vertex_data, vert_texcoord));
 
             glEnableVertexAttribArray(3);
-            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_data), (void*) (2 * sizeof(glm::vec3) + sizeof(glm::vec2)) );
+            glVertexAttribFormat(3, 3, GL_FLOAT, GL_FALSE, offsetof(vertex_data, vert_tangent));
 
             glEnableVertexAttribArray(4);
-            glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_data), (void*) (3 * sizeof(glm::vec3) + sizeof(glm::vec2)) );
+            glVertexAttribFormat(4, 3, GL_FLOAT, GL_FALSE, offsetof(vertex_data, vert_bitangent));
 
-            glBindVertexArray(0);
+            for(unsigned int location = 0; location < 5; location++)
+                glVertexAttribBinding(location, VERTEX_BUFFER_BINDING);
+        }
+
+        void computeBoundingSphere()
+        { // Centered on the bounding box, which is close enough for LOD selection. Also fills in the single full detail level for meshes built without a LOD chain.
+            glm::vec3 boundsmin, boundsextent;
+            Vertex_packing::computeBounds(mesh_vertices, boundsmin, boundsextent);
+            boundscenter = boundsmin + boundsextent * 0.5f;
+            aabbmin = boundsmin;
+            aabbmax = boundsmin + boundsextent; // Flat axes come back with an extent of 1, which only makes the box a bit more conservative
+
+            boundsradius = 0.0f;
+            for(unsigned int i = 0; i < mesh_vertices.size(); i++)
+                boundsradius = glm::max(boundsradius, glm::length(mesh_vertices[i].vert_pos - boundscenter));
+
+            if(mesh_lods.empty())
+            {
+                mesh_lod fulldetail = { 0, (unsigned int) mesh_vert_indices.size(), 0.0f };
+                mesh_lods.push_back(fulldetail);
+            }
         }
 };
+
+#endif
@@ -0,0 +1,324 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include "../deps/glm/glm.hpp"
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+const unsigned int OPTIMIZER_CACHE_SIZE = 32; // LRU size the triangle order is optimized for
+const unsigned int ANALYZER_CACHE_SIZE  = 16; // FIFO size used to report ACMR, closer to what the hardware actually keeps around
+
+struct mesh_optimization_stats
+{
+    unsigned int vertsbefore = 0, vertsafter = 0, triangles = 0;
+    float acmrbefore = 0.0f, acmrafter = 0.0f;
+
+    void merge(const mesh_optimization_stats &other)
+    { // ACMR is per triangle, so it's weighted by each mesh's triangle count.
+        unsigned int totaltriangles = triangles + other.triangles;
+        if(totaltriangles == 0)
+            return;
+
+        acmrbefore = (acmrbefore * triangles + other.acmrbefore * other.triangles) / totaltriangles;
+        acmrafter  = (acmrafter * triangles + other.acmrafter * other.triangles) / totaltriangles;
+        vertsbefore += other.vertsbefore;
+        vertsafter  += other.vertsafter;
+        triangles = totaltriangles;
+    }
+};
+
+namespace Mesh_optimizer
+{
+    inline float computeACMR(const std::vector<unsigned int> &indices, unsigned int vertexcount, unsigned int cachesize = ANALYZER_CACHE_SIZE)
+    { // Average Cache Miss Ratio: vertex shader invocations per triangle through a FIFO post-transform cache. 3.0 is the worst, ~0.5 the best for regular grids.
+        if(indices.size() < 3)
+            return 0.0f;
+
+        std::vector<unsigned int> cachetimestamp(vertexcount, 0);
+        unsigned int timestamp = cachesize + 1, misses = 0;
+
+        for(unsigned int i = 0; i < indices.size(); i++)
+        {
+            unsigned int vertex = indices[i];
+            if(timestamp - cachetimestamp[vertex] > cachesize)
+            { // Not in the FIFO anymore (or never was), so it gets transformed again and pushed in.
+                cachetimestamp[vertex] = timestamp++;
+                misses++;
+            }
+        }
+
+        return (float) misses / (indices.size() / 3);
+    }
+
+    template <typename Vertex>
+    void weldVertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+    { // Merges bitwise identical vertices. The OBJ importer emits one vertex per face corner, so most of these meshes shrink a lot.
+        struct vertex_hasher
+        {
+            size_t operator()(const Vertex &vertex) const
+            {
+                const unsigned char *bytes = (const unsigned char*) &vertex;
+                uint64_t hash = 14695981039346656037ULL;
+                for(unsigned int i = 0; i < sizeof(Vertex); i++)
+                {
+                    hash ^= bytes[i];
+                    hash *= 1099511628211ULL;
+                }
+                return (size_t) hash;
+            }
+        };
+        struct vertex_equal
+        {
+            bool operator()(const Vertex &a, const Vertex &b) const
+            {
+                return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+            }
+        };
+
+        std::unordered_map<Vertex, unsigned int, vertex_hasher, vertex_equal> uniquevertices;
+        std::vector<unsigned int> remap(vertices.size());
+        std::vector<Vertex> weldedvertices;
+        uniquevertices.reserve(vertices.size());
+
+        for(unsigned int i = 0; i < vertices.size(); i++)
+        {
+            typename std::unordered_map<Vertex, unsigned int, vertex_hasher, vertex_equal>::iterator match = uniquevertices.find(vertices[i]);
+            if(match != uniquevertices.end())
+                remap[i] = match->second;
+            else
+            {
+                remap[i] = weldedvertices.size();
+                uniquevertices[vertices[i]] = weldedvertices.size();
+                weldedvertices.push_back(vertices[i]);
+            }
+        }
+
+        for(unsigned int i = 0; i < indices.size(); i++)
+            indices[i] = remap[indices[i]];
+        vertices.swap(weldedvertices);
+    }
+
+    inline void optimizeVertexCache(std::vector<unsigned int> &indices, unsigned int vertexcount)
+    { // Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": greedily emits the triangle whose vertices score highest, favouring ones still in the cache and ones with few triangles left.
+        unsigned int trianglecount = indices.size() / 3;
+        if(trianglecount == 0)
+            return;
+
+        std::vector<unsigned int> valence(vertexcount, 0), adjacencyoffset(vertexcount + 1, 0), adjacency(indices.size());
+        for(unsigned int i = 0; i < indices.size(); i++)
+            valence[indices[i]]++;
+        for(unsigned int i = 0; i < vertexcount; i++)
+            adjacencyoffset[i + 1] = adjacencyoffset[i] + valence[i];
+
+        std::vector<unsigned int> adjacencyfill(adjacencyoffset.begin(), adjacencyoffset.end() - 1);
+        for(unsigned int i = 0; i < indices.size(); i++)
+            adjacency[adjacencyfill[indices[i]]++] = i / 3;
+
+        std::vector<int>   cacheposition(vertexcount, -1);
+        std::vector<float> vertexscore(vertexcount), trianglescore(trianglecount, 0.0f);
+        std::vector<bool>  emitted(trianglecount, false);
+        std::vector<unsigned int> remaining(valence);
+
+        auto scoreVertex = [&](unsigned int vertex) -> float
+        {
+            if(remaining[vertex] == 0)
+                return -1.0f;
+
+            float score = 0.0f;
+            int position = cacheposition[vertex];
+            if(position >= 0)
+            {
+                if(position < 3) // The last triangle's vertices get a fixed score so it isn't just reused in a strip-like order
+                    score = 0.75f;
+                else
+                    score = std::pow(1.0f - (float) (position - 3) / (OPTIMIZER_CACHE_SIZE - 3), 1.5f);
+            }
+            return score + 2.0f / std::sqrt((float) remaining[vertex]); // Valence boost, clears out lonely vertices before they're lost
+        };
+
+        for(unsigned int i = 0; i < vertexcount; i++)
+            vertexscore[i] = scoreVertex(i);
+        for(unsigned int i = 0; i < trianglecount; i++)
+            trianglescore[i] = vertexscore[indices[i * 3]] + vertexscore[indices[i * 3 + 1]] + vertexscore[indices[i * 3 + 2]];
+
+        std::vector<unsigned int> optimized;
+        std::vector<unsigned int> cache, newcache;
+        optimized.reserve(indices.size());
+
+        unsigned int scancursor = 0;
+        int besttriangle = -1;
+
+        while(optimized.size() < indices.size())
+        {
+            if(besttriangle < 0)
+            { // Nothing in the cache touches an unemitted triangle, restart from the next one in the original order.
+                while(emitted[scancursor])
+                    scancursor++;
+                besttriangle = scancursor;
+            }
+
+            emitted[besttriangle] = true;
+            newcache.clear();
+
+            for(int corner = 0; corner < 3; corner++)
+            {
+                unsigned int vertex = indices[besttriangle * 3 + corner];
+                optimized.push_back(vertex);
+                newcache.push_back(vertex);
+                remaining[vertex]--;
+            }
+
+            for(unsigned int i = 0; i < cache.size(); i++)
+                if(std::find(newcache.begin(), newcache.end(), cache[i]) == newcache.end())
+                    newcache.push_back(cache[i]);
+
+            for(unsigned int i = 0; i < newcache.size(); i++)
+                cacheposition[newcache[i]] = i < OPTIMIZER_CACHE_SIZE ? (int) i : -1;
+
+            // Only the vertices that were or are in the cache can change score, so only their triangles need rescoring.
+            float bestscore = -1.0f;
+            besttriangle = -1;
+            for(unsigned int i = 0; i < newcache.size(); i++)
+            {
+                unsigned int vertex = newcache[i];
+                float oldscore = vertexscore[vertex];
+                vertexscore[vertex] = scoreVertex(vertex);
+
+                for(unsigned int j = adjacencyoffset[vertex]; j < adjacencyoffset[vertex + 1]; j++)
+                {
+                    unsigned int triangle = adjacency[j];
+                    if(emitted[triangle])
+                        continue;
+
+                    trianglescore[triangle] += vertexscore[vertex] - oldscore;
+                    if(trianglescore[triangle] > bestscore)
+                    {
+                        bestscore = trianglescore[triangle];
+                        besttriangle = triangle;
+                    }
+                }
+            }
+
+            if(newcache.size() > OPTIMIZER_CACHE_SIZE)
+                newcache.resize(OPTIMIZER_CACHE_SIZE);
+            cache.swap(newcache);
+        }
+
+        indices.swap(optimized);
+    }
+
+    template <typename Vertex>
+    void optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices)
+    { // Splits the cache-optimized order into clusters wherever the cache fully restarts, then draws the clusters facing away from the mesh center first so they occlude more of the rest.
+        unsigned int trianglecount = indices.size() / 3;
+        if(trianglecount < 2)
+            return;
+
+        std::vector<unsigned int> clusterstart;
+        std::vector<unsigned int> cachetimestamp(vertices.size(), 0);
+        unsigned int timestamp = ANALYZER_CACHE_SIZE + 1;
+
+        for(unsigned int i = 0; i < trianglecount; i++)
+        {
+            unsigned int misses = 0;
+            for(int corner = 0; corner < 3; corner++)
+            {
+                unsigned int vertex = indices[i * 3 + corner];
+                if(timestamp - cachetimestamp[vertex] > ANALYZER_CACHE_SIZE)
+                {
+                    cachetimestamp[vertex] = timestamp++;
+                    misses++;
+                }
+            }
+            if(i == 0 || misses == 3)
+                clusterstart.push_back(i);
+        }
+        clusterstart.push_back(trianglecount);
+
+        glm::vec3 meshcenter(0.0f);
+        for(unsigned int i = 0; i < vertices.size(); i++)
+            meshcenter += vertices[i].vert_pos;
+        meshcenter /= (float) vertices.size();
+
+        unsigned int clustercount = clusterstart.size() - 1;
+        std::vector<float> clusterkey(clustercount);
+        std::vector<unsigned int> clusterorder(clustercount);
+
+        for(unsigned int c = 0; c < clustercount; c++)
+        {
+            glm::vec3 centroid(0.0f), normal(0.0f);
+            float area = 0.0f;
+
+            for(unsigned int i = clusterstart[c]; i < clusterstart[c + 1]; i++)
+            {
+                const glm::vec3 &a = vertices[indices[i * 3]].vert_pos, &b = vertices[indices[i * 3 + 1]].vert_pos, &c2 = vertices[indices[i * 3 + 2]].vert_pos;
+                glm::vec3 areanormal = glm::cross(b - a, c2 - a);
+                float trianglearea = glm::length(areanormal);
+
+                centroid += (a + b + c2) * (trianglearea / 3.0f);
+                normal   += areanormal;
+                area     += trianglearea;
+            }
+
+            centroid = area > 0.0f ? centroid / area : vertices[indices[clusterstart[c] * 3]].vert_pos;
+            float normallength = glm::length(normal);
+            clusterkey[c]   = normallength > 0.0f ? glm::dot(centroid - meshcenter, normal / normallength) : 0.0f;
+            clusterorder[c] = c;
+        }
+
+        std::stable_sort(clusterorder.begin(), clusterorder.end(), [&clusterkey](unsigned int a, unsigned int b) { return clusterkey[a] > clusterkey[b]; });
+
+        std::vector<unsigned int> sorted;
+        sorted.reserve(indices.size());
+        for(unsigned int c = 0; c < clustercount; c++)
+            sorted.insert(sorted.end(), indices.begin() + clusterstart[clusterorder[c]] * 3, indices.begin() + clusterstart[clusterorder[c] + 1] * 3);
+
+        indices.swap(sorted);
+    }
+
+    template <typename Vertex>
+    void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+    { // Reorders the vertex buffer to match the order the index buffer first touches each vertex, which also drops unreferenced ones.
+        std::vector<unsigned int> remap(vertices.size(), ~0u);
+        std::vector<Vertex> fetchordered;
+        fetchordered.reserve(vertices.size());
+
+        for(unsigned int i = 0; i < indices.size(); i++)
+        {
+            unsigned int &newindex = remap[indices[i]];
+            if(newindex == ~0u)
+            {
+                newindex = fetchordered.size();
+                fetchordered.push_back(vertices[indices[i]]);
+            }
+            indices[i] = newindex;
+        }
+
+        vertices.swap(fetchordered);
+    }
+
+    template <typename Vertex>
+    mesh_optimization_stats optimizeMesh(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+    {
+        mesh_optimization_stats stats;
+        stats.vertsbefore = vertices.size();
+        stats.triangles   = indices.size() / 3;
+        stats.acmrbefore  = computeACMR(indices, vertices.size());
+
+        weldVertices(vertices, indices);
+        optimizeVertexCache(indices, vertices.size());
+        optimizeOverdraw(indices, vertices);
+        optimizeVertexFetch(vertices, indices);
+
+        stats.vertsafter = vertices.size();
+        stats.acmrafter  = computeACMR(indices, vertices.size());
+        return stats;
+    }
+}
+
+#endif
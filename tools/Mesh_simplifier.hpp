@@ -0,0 +1,457 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include "../deps/glm/glm.hpp"
+#include "Mesh_optimizer.hpp"
+
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <cfloat>
+
+// Error targets of each generated LOD, relative to the mesh's bounding radius. A level is only kept if it removes a meaningful amount of triangles.
+const float MESH_LOD_ERROR_TARGETS[] = { 0.004f, 0.015f, 0.05f };
+const unsigned int MESH_LOD_MAX_LEVELS = 1 + sizeof(MESH_LOD_ERROR_TARGETS) / sizeof(MESH_LOD_ERROR_TARGETS[0]);
+const float MESH_LOD_MIN_REDUCTION = 0.8f; // A new level needs to have at most this fraction of the previous level's triangles
+
+struct mesh_lod
+{
+    unsigned int indexoffset; // In indices, not bytes
+    unsigned int indexcount;
+    float error;              // Geometric error in model space units, 0 for the full detail level
+};
+
+namespace Mesh_simplifier
+{
+    struct quadric
+    { // Symmetric 4x4 error quadric (Garland & Heckbert), stored as its 10 unique coefficients.
+        double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+        void addPlane(const glm::dvec3 &normal, double distance, double weight)
+        {
+            a2 += weight * normal.x * normal.x; ab += weight * normal.x * normal.y; ac += weight * normal.x * normal.z; ad += weight * normal.x * distance;
+            b2 += weight * normal.y * normal.y; bc += weight * normal.y * normal.z; bd += weight * normal.y * distance;
+            c2 += weight * normal.z * normal.z; cd += weight * normal.z * distance;
+            d2 += weight * distance * distance;
+        }
+
+        void add(const quadric &other)
+        {
+            a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad; b2 += other.b2;
+            bc += other.bc; bd += other.bd; c2 += other.c2; cd += other.cd; d2 += other.d2;
+        }
+
+        double evaluate(const glm::vec3 &point) const
+        { // Sum of squared distances from the point to every plane folded into the quadric.
+            double x = point.x, y = point.y, z = point.z;
+            double result = a2*x*x + 2*ab*x*y + 2*ac*x*z + 2*ad*x + b2*y*y + 2*bc*y*z + 2*bd*y + c2*z*z + 2*cd*z + d2;
+            return result > 0.0 ? result : 0.0;
+        }
+    };
+
+    struct collapse_candidate
+    {
+        double cost;
+        unsigned int source, target;
+        unsigned int sourceversion, targetversion; // Candidates go stale when either end changes, checked against the current versions when popped
+
+        bool operator<(const collapse_candidate &other) const
+        {
+            return cost > other.cost; // std::priority_queue pops the largest, we want the cheapest
+        }
+    };
+
+    inline float pointTriangleDistance(const glm::vec3 &point, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+    { // Closest point on the triangle by Voronoi region (Ericson, Real-Time Collision Detection 5.1.5).
+        glm::vec3 ab = b - a, ac = c - a, ap = point - a;
+        float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+        if(d1 <= 0.0f && d2 <= 0.0f)
+            return glm::length(ap);
+
+        glm::vec3 bp = point - b;
+        float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+        if(d3 >= 0.0f && d4 <= d3)
+            return glm::length(bp);
+
+        float vc = d1 * d4 - d3 * d2;
+        if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+            return glm::length(point - (a + ab * (d1 / (d1 - d3))));
+
+        glm::vec3 cp = point - c;
+        float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+        if(d6 >= 0.0f && d5 <= d6)
+            return glm::length(cp);
+
+        float vb = d5 * d2 - d1 * d6;
+        if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+            return glm::length(point - (a + ac * (d2 / (d2 - d6))));
+
+        float va = d3 * d6 - d5 * d4;
+        if(va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+            return glm::length(point - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))));
+
+        float denominator = 1.0f / (va + vb + vc);
+        return glm::length(point - (a + ab * (vb * denominator) + ac * (vc * denominator)));
+    }
+
+    template <typename Vertex>
+    std::vector<unsigned int> positionRemap(const std::vector<Vertex> &vertices)
+    { // Maps every vertex to the first vertex sharing its position, so UV and normal seams don't read as holes in the topology.
+        struct position_hasher
+        {
+            size_t operator()(const glm::vec3 &position) const
+            {
+                uint32_t bits[3];
+                std::memcpy(bits, &position, sizeof(bits));
+                return (size_t) (bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+            }
+        };
+
+        std::unordered_map<glm::vec3, unsigned int, position_hasher> firstvertex;
+        std::vector<unsigned int> remap(vertices.size());
+
+        for(unsigned int i = 0; i < vertices.size(); i++)
+        {
+            std::pair<typename std::unordered_map<glm::vec3, unsigned int, position_hasher>::iterator, bool> inserted = firstvertex.insert(std::make_pair(vertices[i].vert_pos, i));
+            remap[i] = inserted.first->second;
+        }
+        return remap;
+    }
+
+    template <typename Vertex>
+    std::vector<unsigned int> simplify(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, float targeterror, float &resultingerror)
+    { // Collapses edges cheapest first until the next collapse would exceed targeterror (model space units). Vertices are never moved or created,
+      // so every level can index the same vertex buffer.
+        resultingerror = 0.0f;
+        unsigned int trianglecount = indices.size() / 3;
+        std::vector<unsigned int> remap = positionRemap(vertices);
+
+        std::vector<unsigned int> triangles(indices.size());
+        for(unsigned int i = 0; i < indices.size(); i++)
+            triangles[i] = remap[indices[i]];
+
+        std::vector<quadric> quadrics(vertices.size());
+        std::vector<std::vector<unsigned int> > vertextriangles(vertices.size());
+        std::vector<bool> triangleremoved(trianglecount, false);
+
+        for(unsigned int t = 0; t < trianglecount; t++)
+        {
+            const glm::vec3 &p0 = vertices[triangles[t * 3]].vert_pos, &p1 = vertices[triangles[t * 3 + 1]].vert_pos, &p2 = vertices[triangles[t * 3 + 2]].vert_pos;
+            glm::dvec3 areanormal = glm::cross(glm::dvec3(p1 - p0), glm::dvec3(p2 - p0));
+            double doublearea = glm::length(areanormal);
+
+            if(doublearea <= 0.0)
+            { // Degenerate triangles carry no surface, dropping them right away keeps them from blocking collapses
+                triangleremoved[t] = true;
+                continue;
+            }
+
+            glm::dvec3 normal = areanormal / doublearea;
+            quadric plane;
+            plane.addPlane(normal, -glm::dot(normal, glm::dvec3(p0)), doublearea * 0.5);
+
+            for(int corner = 0; corner < 3; corner++)
+            {
+                quadrics[triangles[t * 3 + corner]].add(plane);
+                vertextriangles[triangles[t * 3 + corner]].push_back(t);
+            }
+        }
+
+        // Open borders get a plane perpendicular to the surface through each border edge, heavily weighted, so collapses don't eat away the outline.
+        std::unordered_map<uint64_t, int> edgeuse;
+        for(unsigned int t = 0; t < trianglecount; t++)
+        {
+            if(triangleremoved[t])
+                continue;
+            for(int corner = 0; corner < 3; corner++)
+            {
+                unsigned int a = triangles[t * 3 + corner], b = triangles[t * 3 + (corner + 1) % 3];
+                edgeuse[((uint64_t) glm::min(a, b) << 32) | glm::max(a, b)]++;
+            }
+        }
+
+        for(unsigned int t = 0; t < trianglecount; t++)
+        {
+            if(triangleremoved[t])
+                continue;
+
+            const glm::vec3 &p0 = vertices[triangles[t * 3]].vert_pos, &p1 = vertices[triangles[t * 3 + 1]].vert_pos, &p2 = vertices[triangles[t * 3 + 2]].vert_pos;
+            glm::dvec3 facenormal = glm::normalize(glm::cross(glm::dvec3(p1 - p0), glm::dvec3(p2 - p0)));
+
+            for(int corner = 0; corner < 3; corner++)
+            {
+                unsigned int a = triangles[t * 3 + corner], b = triangles[t * 3 + (corner + 1) % 3];
+                if(edgeuse[((uint64_t) glm::min(a, b) << 32) | glm::max(a, b)] != 1)
+                    continue;
+
+                glm::dvec3 edge = glm::dvec3(vertices[b].vert_pos - vertices[a].vert_pos);
+                double edgelength = glm::length(edge);
+                if(edgelength <= 0.0)
+                    continue;
+
+                glm::dvec3 bordernormal = glm::normalize(glm::cross(edge, facenormal));
+                quadric border;
+                border.addPlane(bordernormal, -glm::dot(bordernormal, glm::dvec3(vertices[a].vert_pos)), edgelength * edgelength * 10.0);
+                quadrics[a].add(border);
+                quadrics[b].add(border);
+            }
+        }
+
+        std::vector<unsigned int> version(vertices.size(), 0);
+        std::vector<unsigned int> collapsedinto(vertices.size());
+        std::vector<std::vector<unsigned int> > mergedvertices(vertices.size()); // Input vertices each surviving vertex stands in for
+        for(unsigned int i = 0; i < vertices.size(); i++)
+        {
+            collapsedinto[i] = i;
+            if(remap[i] == i)
+                mergedvertices[i].push_back(i);
+        }
+
+        std::priority_queue<collapse_candidate> candidates;
+        auto pushEdge = [&](unsigned int a, unsigned int b)
+        {
+            quadric combined = quadrics[a];
+            combined.add(quadrics[b]);
+
+            double costatb = combined.evaluate(vertices[b].vert_pos), costata = combined.evaluate(vertices[a].vert_pos);
+            collapse_candidate candidate;
+            candidate.source = costatb <= costata ? a : b;
+            candidate.target = costatb <= costata ? b : a;
+            candidate.cost   = glm::min(costatb, costata);
+            candidate.sourceversion = version[candidate.source];
+            candidate.targetversion = version[candidate.target];
+            candidates.push(candidate);
+        };
+
+        for(std::unordered_map<uint64_t, int>::iterator it = edgeuse.begin(); it != edgeuse.end(); ++it)
+            pushEdge((unsigned int) (it->first >> 32), (unsigned int) (it->first & 0xFFFFFFFFu));
+
+        while(!candidates.empty())
+        {
+            collapse_candidate candidate = candidates.top();
+            candidates.pop();
+
+            if(candidate.sourceversion != version[candidate.source] || candidate.targetversion != version[candidate.target] ||
+               collapsedinto[candidate.source] != candidate.source || collapsedinto[candidate.target] != candidate.target)
+                continue;
+
+            // The quadric weights grow as vertices merge, dividing by their sum (a2 + b2 + c2, the planes being unit length) turns the cost back
+            // into an RMS distance. That's a lower bound of the real error, so once it passes the target nothing cheaper is left in the queue.
+            const quadric &sourcequadric = quadrics[candidate.source], &targetquadric = quadrics[candidate.target];
+            double totalweight = sourcequadric.a2 + sourcequadric.b2 + sourcequadric.c2 + targetquadric.a2 + targetquadric.b2 + targetquadric.c2;
+            if(std::sqrt(candidate.cost / glm::max(totalweight, 1e-12)) > targeterror)
+                break;
+
+            // Builds the fan the target would end up with, rejecting collapses that would flip one of the moved triangles.
+            std::vector<glm::vec3> newfan;
+            std::vector<unsigned int> orphans; // Vertices left without any triangle, whose merged vertices have to be accounted for by the target
+            bool flips = false;
+            const glm::vec3 &targetpos = vertices[candidate.target].vert_pos;
+            for(unsigned int i = 0; i < vertextriangles[candidate.source].size() && !flips; i++)
+            {
+                unsigned int t = vertextriangles[candidate.source][i];
+                if(triangleremoved[t])
+                    continue;
+
+                unsigned int v0 = triangles[t * 3], v1 = triangles[t * 3 + 1], v2 = triangles[t * 3 + 2];
+                if(v0 == candidate.target || v1 == candidate.target || v2 == candidate.target)
+                { // This one degenerates and disappears, which orphans its third vertex if it was that vertex's last triangle
+                    unsigned int third = v0 ^ v1 ^ v2 ^ candidate.source ^ candidate.target;
+                    bool lasttriangle = true;
+                    for(unsigned int j = 0; j < vertextriangles[third].size() && lasttriangle; j++)
+                    {
+                        unsigned int other = vertextriangles[third][j];
+                        if(triangleremoved[other])
+                            continue;
+
+                        bool hassource = false, hastarget = false;
+                        for(int corner = 0; corner < 3; corner++)
+                        {
+                            hassource = hassource || triangles[other * 3 + corner] == candidate.source;
+                            hastarget = hastarget || triangles[other * 3 + corner] == candidate.target;
+                        }
+                        lasttriangle = hassource && hastarget;
+                    }
+                    if(lasttriangle && std::find(orphans.begin(), orphans.end(), third) == orphans.end())
+                        orphans.push_back(third);
+                    continue;
+                }
+
+                glm::vec3 p0 = vertices[v0].vert_pos, p1 = vertices[v1].vert_pos, p2 = vertices[v2].vert_pos;
+                glm::vec3 oldnormal = glm::cross(p1 - p0, p2 - p0);
+                if(v0 == candidate.source) p0 = targetpos;
+                if(v1 == candidate.source) p1 = targetpos;
+                if(v2 == candidate.source) p2 = targetpos;
+                glm::vec3 newnormal = glm::cross(p1 - p0, p2 - p0);
+
+                if(glm::dot(oldnormal, newnormal) <= 0.0f)
+                    flips = true;
+
+                newfan.push_back(p0);
+                newfan.push_back(p1);
+                newfan.push_back(p2);
+            }
+            if(flips)
+                continue;
+
+            for(unsigned int i = 0; i < vertextriangles[candidate.target].size(); i++)
+            {
+                unsigned int t = vertextriangles[candidate.target][i];
+                if(triangleremoved[t] || triangles[t * 3] == candidate.source || triangles[t * 3 + 1] == candidate.source || triangles[t * 3 + 2] == candidate.source)
+                    continue;
+
+                for(int corner = 0; corner < 3; corner++)
+                    newfan.push_back(vertices[triangles[t * 3 + corner]].vert_pos);
+            }
+
+            // The error actually reported is measured: how far every input vertex merged into either end lands from the new fan.
+            float error = 0.0f;
+            orphans.push_back(candidate.source);
+            orphans.push_back(candidate.target);
+            for(unsigned int side = 0; side < orphans.size() && error <= targeterror; side++)
+            {
+                const std::vector<unsigned int> &merged = mergedvertices[orphans[side]];
+                for(unsigned int i = 0; i < merged.size() && error <= targeterror; i++)
+                {
+                    // An empty fan means a whole component shrinks down to the target, which then stands in for it.
+                    float closest = newfan.empty() ? glm::length(vertices[merged[i]].vert_pos - targetpos) : FLT_MAX;
+                    for(unsigned int j = 0; j < newfan.size(); j += 3)
+                        closest = glm::min(closest, pointTriangleDistance(vertices[merged[i]].vert_pos, newfan[j], newfan[j + 1], newfan[j + 2]));
+                    error = glm::max(error, closest);
+                }
+            }
+            if(error > targeterror)
+                continue;
+
+            resultingerror = glm::max(resultingerror, error);
+            for(unsigned int i = 0; i + 1 < orphans.size(); i++)
+            {
+                mergedvertices[candidate.target].insert(mergedvertices[candidate.target].end(), mergedvertices[orphans[i]].begin(), mergedvertices[orphans[i]].end());
+                std::vector<unsigned int>().swap(mergedvertices[orphans[i]]);
+            }
+            collapsedinto[candidate.source] = candidate.target;
+            quadrics[candidate.target].add(quadrics[candidate.source]);
+            version[candidate.target]++;
+
+            for(unsigned int i = 0; i < vertextriangles[candidate.source].size(); i++)
+            {
+                unsigned int t = vertextriangles[candidate.source][i];
+                if(triangleremoved[t])
+                    continue;
+
+                for(int corner = 0; corner < 3; corner++)
+                    if(triangles[t * 3 + corner] == candidate.source)
+                        triangles[t * 3 + corner] = candidate.target;
+
+                if(triangles[t * 3] == triangles[t * 3 + 1] || triangles[t * 3 + 1] == triangles[t * 3 + 2] || triangles[t * 3] == triangles[t * 3 + 2])
+                    triangleremoved[t] = true;
+                else
+                    vertextriangles[candidate.target].push_back(t);
+            }
+            vertextriangles[candidate.source].clear();
+
+            // Re-queues every edge around the merged vertex with its new cost.
+            for(unsigned int i = 0; i < vertextriangles[candidate.target].size(); i++)
+            {
+                unsigned int t = vertextriangles[candidate.target][i];
+                if(triangleremoved[t])
+                    continue;
+                for(int corner = 0; corner < 3; corner++)
+                    if(triangles[t * 3 + corner] != candidate.target)
+                        pushEdge(candidate.target, triangles[t * 3 + corner]);
+            }
+        }
+
+        // Back from positions to real vertices: every corner keeps its original vertex if it survived, otherwise it picks the vertex at the
+        // collapse target whose attributes are closest to the original, so UV and normal seams stay on the right side.
+        std::vector<std::vector<unsigned int> > positionsiblings(vertices.size());
+        for(unsigned int i = 0; i < vertices.size(); i++)
+            positionsiblings[remap[i]].push_back(i);
+
+        std::vector<unsigned int> simplified;
+        for(unsigned int t = 0; t < trianglecount; t++)
+        {
+            if(triangleremoved[t])
+                continue;
+
+            for(int corner = 0; corner < 3; corner++)
+            {
+                unsigned int original = indices[t * 3 + corner];
+                unsigned int position = triangles[t * 3 + corner];
+
+                if(remap[original] == position)
+                {
+                    simplified.push_back(original);
+                    continue;
+                }
+
+                const std::vector<unsigned int> &siblings = positionsiblings[position];
+                unsigned int best = siblings[0];
+                float bestdistance = -1.0f;
+                for(unsigned int i = 0; i < siblings.size(); i++)
+                {
+                    const Vertex &candidatevertex = vertices[siblings[i]];
+                    glm::vec2 uvdelta = candidatevertex.vert_texcoord - vertices[original].vert_texcoord;
+                    glm::vec3 normaldelta = candidatevertex.vert_normal - vertices[original].vert_normal;
+                    float distance = glm::dot(uvdelta, uvdelta) + glm::dot(normaldelta, normaldelta);
+
+                    if(bestdistance < 0.0f || distance < bestdistance)
+                    {
+                        bestdistance = distance;
+                        best = siblings[i];
+                    }
+                }
+                simplified.push_back(best);
+            }
+        }
+
+        return simplified;
+    }
+
+    template <typename Vertex>
+    std::vector<mesh_lod> buildLodChain(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+    { // Appends every coarser level to indices after the full detail one, each simplified from the previous level and reordered for the vertex cache.
+        std::vector<mesh_lod> lods;
+        if(vertices.empty())
+            return lods;
+
+        glm::vec3 boundsmin = vertices[0].vert_pos, boundsmax = vertices[0].vert_pos;
+        for(unsigned int i = 1; i < vertices.size(); i++)
+        {
+            boundsmin = glm::min(boundsmin, vertices[i].vert_pos);
+            boundsmax = glm::max(boundsmax, vertices[i].vert_pos);
+        }
+
+        float boundsradius = 0.0f;
+        for(unsigned int i = 0; i < vertices.size(); i++)
+            boundsradius = glm::max(boundsradius, glm::length(vertices[i].vert_pos - (boundsmin + boundsmax) * 0.5f));
+
+        mesh_lod fulldetail = { 0, (unsigned int) indices.size(), 0.0f };
+        lods.push_back(fulldetail);
+
+        std::vector<unsigned int> previouslevel = indices;
+        for(unsigned int level = 1; level < MESH_LOD_MAX_LEVELS && previouslevel.size() >= 3; level++)
+        {
+            float levelerror = 0.0f;
+            std::vector<unsigned int> levelindices = simplify(vertices, previouslevel, MESH_LOD_ERROR_TARGETS[level - 1] * boundsradius, levelerror);
+
+            if(levelindices.size() < 3 || levelindices.size() > previouslevel.size() * MESH_LOD_MIN_REDUCTION)
+                break; // Not worth the extra indices, and later levels would only simplify from the same mesh
+
+            Mesh_optimizer::optimizeVertexCache(levelindices, vertices.size());
+
+            // Errors are accumulated across levels, since each level only measured itself against the previous one.
+            mesh_lod lod = { (unsigned int) indices.size(), (unsigned int) levelindices.size(), lods.back().error + levelerror };
+            lods.push_back(lod);
+            indices.insert(indices.end(), levelindices.begin(), levelindices.end());
+            previouslevel.swap(levelindices);
+        }
+        return lods;
+    }
+}
+
+#endif
@@ -1,36 +1,273 @@
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
 #include "../deps/assimp/Importer.hpp"
 #include "../deps/assimp/scene.h"
 #include "../deps/assimp/postprocess.h"
-#include "../deps/stb_image/stb_image.h"
 #include "Mesh_loader.hpp"
+#include "Texture_registry.hpp"
+#include "Mesh_cache.hpp"
+#include "Mesh_optimizer.hpp"
+#include "Scene_loader.hpp"
 #include "shader_compiler.h"
+#include "Frustum_culler.hpp"
+#include "Occlusion_culler.hpp"
+#include "Render_queue.hpp"
 #include <string>
+#include <cstring>
+
+// Post processing steps applied to every imported model, also part of the mesh cache key so changing them invalidates old caches.
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals;
+const float LOD_MAX_PIXEL_ERROR = 1.0f; // How far, in pixels, a coarser level may stray from the full mesh before it stops being picked
+
+struct render_view
+{ // Camera state the culling and LOD selection of renderModel() work against, set once per frame through Model_data::setRenderView().
+    glm::vec3 viewposition = glm::vec3(0.0f);
+    float pixelsperunit = 0.0f; // Screen pixels covered by one world unit at a distance of one
+    glm::mat4 viewprojection = glm::mat4(1.0f);
+    camera_frustum frustum;
+    bool hasfrustum = false; // Nothing is culled until the first setRenderView()
+    Occlusion_culler *occlusion = nullptr; // When set, meshes that pass the frustum are also tested against its occluders, which must have been rasterized for this view
+
+    // Reset by setRenderView(). Triangles drawn this frame against what LOD 0 everywhere would have cost, and meshes (per instance) drawn against skipped by the frustum
+    // and by the occlusion culling.
+    unsigned int trianglesdrawn = 0, trianglesfulldetail = 0;
+    unsigned int meshesvisible = 0, meshesculled = 0, meshesoccluded = 0;
+};
 
 class Model_data
 {
     public:
         Model_data(std::string const &modelpath) // Change to char if it glitches
         {
-            std::cout << "\nTrying to load Model located at:" << modelpath << std::endl;
             load(modelpath);
+            uploadModel();
+        }
+
+        Model_data(std::string const &modelpath, Scene_loader &sceneloader)
+        { // Parsing and texture decoding happen on one of the loader's workers, the GL upload runs once the owner calls sceneloader.finishLoading(). The model must not be moved until then, and is left empty if loading throws.
+            sceneloader.queueModel(modelpath, [this, modelpath] { load(modelpath); }, [this] { uploadModel(); }, [this] { releaseTextures(); model_meshnum.clear(); });
         }
+
         void renderModel(Shader &modelshader)
         {
+            renderModel(modelshader, glm::mat4(1.0f));
+        }
+
+        void renderModel(Shader &modelshader, const glm::mat4 &modelmatrix)
+        { // Meshes outside the view frustum are skipped and the rest pick their level of detail from where modelmatrix puts them relative to the current render_view.
+            Render_queue &queue = immediateQueue();
+            queueModel(queue, modelshader, modelmatrix, glm::mat3(glm::transpose(glm::inverse(modelmatrix))), RENDER_PASS_OPAQUE, 0);
+            queue.execute();
+        }
+
+        void renderModelInstanced(Shader &modelshader, const std::vector<glm::mat4> &modelmatrices)
+        {
+            std::vector<glm::mat3> normalmatrices(modelmatrices.size());
+            for(unsigned int i = 0; i < modelmatrices.size(); i++)
+                normalmatrices[i] = glm::mat3(glm::transpose(glm::inverse(modelmatrices[i])));
+
+            renderModelInstanced(modelshader, modelmatrices, normalmatrices);
+        }
+
+        void renderModelInstanced(Shader &modelshader, const std::vector<glm::mat4> &modelmatrices, const std::vector<glm::mat3> &normalmatrices)
+        { // Draws right away, through the same queue as renderModel().
+            Render_queue &queue = immediateQueue();
+            queueModelInstanced(queue, modelshader, modelmatrices, normalmatrices, RENDER_PASS_OPAQUE, 0);
+            queue.execute();
+        }
+
+        void queueModel(Render_queue &queue, Shader &modelshader, const glm::mat4 &modelmatrix, const glm::mat3 &normalmatrix, unsigned int pass, unsigned int material,
+                        unsigned int bakedoffset = INSTANCE_NOT_BAKED, const glm::vec3 &sway = glm::vec3(0.0f))
+        {   // Culls and picks detail levels like renderModel() would, but hands the visible meshes to queue instead of drawing them.
+            // sway is how far, in model units, the program moves vertices along each axis (the vegetation shader's forcex, forcey and forcez), the bounds grow by it.
+            render_view &view = renderView();
+            glm::vec3 swaymargin = glm::abs(sway);
+            cullingbounds.clear();
+            for(unsigned int i = 0; i < model_meshnum.size(); i++)
+                cullingbounds.pushTransformed(model_meshnum[i].aabbmin - swaymargin, model_meshnum[i].aabbmax + swaymargin, modelmatrix);
+            cullBounds(view);
+
             for(unsigned int i = 0; i < model_meshnum.size(); i++)
-                model_meshnum[i].renderMesh(modelshader);
+            {
+                if(!boundsvisible[i])
+                    continue;
+
+                Mesh_data &mesh = model_meshnum[i];
+                unsigned int lodlevel = view.pixelsperunit > 0.0f ? mesh.selectLod(modelmatrix, view.viewposition, view.pixelsperunit, LOD_MAX_PIXEL_ERROR) : 0;
+
+                view.trianglesdrawn      += mesh.mesh_lods[lodlevel].indexcount / 3;
+                view.trianglesfulldetail += mesh.mesh_lods[0].indexcount / 3;
+                queue.submit(modelshader, mesh, pass, material, viewDistance(mesh, modelmatrix, view), lodlevel, modelmatrix, normalmatrix, bakedoffset);
+            }
+        }
+
+        void queueModelInstanced(Render_queue &queue, Shader &modelshader, const std::vector<glm::mat4> &modelmatrices, const std::vector<glm::mat3> &normalmatrices,
+                                 unsigned int pass, unsigned int material, const std::vector<unsigned int> *bakedoffsets = nullptr, const glm::vec3 &sway = glm::vec3(0.0f))
+        {   // Every copy of the model in one go, one queued command per mesh with an indirect draw per detail level instead of one draw per copy and mesh.
+            // Each copy still picks its own level, the instances are grouped by level before being handed to the queue's instance stream.
+            // bakedoffsets, when given, holds every copy's instance_bakedoffset. sway grows the bounds like in queueModel().
+            if(modelmatrices.empty())
+                return;
+
+            render_view &view = renderView();
+
+            glm::vec3 swaymargin = glm::abs(sway);
+            cullingbounds.clear();
+            for(unsigned int i = 0; i < model_meshnum.size(); i++)
+                for(unsigned int j = 0; j < modelmatrices.size(); j++)
+                    cullingbounds.pushTransformed(model_meshnum[i].aabbmin - swaymargin, model_meshnum[i].aabbmax + swaymargin, modelmatrices[j]);
+            cullBounds(view);
+
+            std::vector<unsigned int> instancelods(modelmatrices.size());
+            for(unsigned int i = 0; i < model_meshnum.size(); i++)
+            {
+                Mesh_data &mesh = model_meshnum[i];
+                unsigned int meshcounts[MESH_LOD_MAX_LEVELS] = {0};
+                float nearestdistance = -1.0f;
+                instances.clear();
+
+                for(unsigned int j = 0; j < modelmatrices.size(); j++)
+                {
+                    if(!boundsvisible[i * modelmatrices.size() + j])
+                    {
+                        instancelods[j] = MESH_LOD_MAX_LEVELS; // Matches no level, so the copy never makes it into the instance buffer
+                        continue;
+                    }
+
+                    instancelods[j] = view.pixelsperunit > 0.0f ? mesh.selectLod(modelmatrices[j], view.viewposition, view.pixelsperunit, LOD_MAX_PIXEL_ERROR) : 0;
+                    view.trianglesdrawn      += mesh.mesh_lods[instancelods[j]].indexcount / 3;
+                    view.trianglesfulldetail += mesh.mesh_lods[0].indexcount / 3;
+
+                    float distance = viewDistance(mesh, modelmatrices[j], view);
+                    if(nearestdistance < 0.0f || distance < nearestdistance)
+                        nearestdistance = distance;
+                }
+
+                for(unsigned int level = 0; level < mesh.mesh_lods.size(); level++)
+                {
+                    for(unsigned int j = 0; j < modelmatrices.size(); j++)
+                    {
+                        if(instancelods[j] != level)
+                            continue;
+
+                        instance_data instance;
+                        instance.instance_modelmatrix  = modelmatrices[j];
+                        instance.instance_normalmatrix = normalmatrices[j];
+                        instance.instance_bakedoffset  = bakedoffsets ? (*bakedoffsets)[j] : INSTANCE_NOT_BAKED;
+                        instances.push_back(instance);
+                        meshcounts[level]++;
+                    }
+                }
+
+                if(!instances.empty()) // The nearest copy decides where the whole draw sorts
+                    queue.submitInstanced(modelshader, mesh, pass, material, nearestdistance, meshcounts, instances.data());
+            }
+        }
+
+        static render_view &renderView()
+        {
+            static render_view view;
+            return view;
+        }
+
+        static void setRenderView(const glm::vec3 &viewposition, const glm::mat4 &viewprojection, const glm::mat4 &projectionmatrix, float viewportheight)
+        { // projectionmatrix[1][1] is cot(fovy / 2), which turns it into pixels per world unit at a distance of one.
+            render_view &view = renderView();
+            view.viewposition  = viewposition;
+            view.pixelsperunit = projectionmatrix[1][1] * viewportheight * 0.5f;
+            view.viewprojection = viewprojection;
+            view.frustum    = camera_frustum::fromMatrix(viewprojection);
+            view.hasfrustum = true;
+            view.trianglesdrawn = view.trianglesfulldetail = 0;
+            view.meshesvisible  = view.meshesculled = view.meshesoccluded = 0;
+        }
+
+        const std::vector<Mesh_data> &meshes() const
+        {
+            return model_meshnum;
+        }
+
+        void releaseTextures()
+        { // Hands every texture reference back to the shared registry, which frees the GL texture once no other model uses it. Needs the GL context to still be alive.
+            for(unsigned int i = 0; i < model_meshnum.size(); i++)
+            {
+                for(unsigned int j = 0; j < model_meshnum[i].mesh_textures.size(); j++)
+                {
+                    Texture_registry::instance().release(model_meshnum[i].mesh_textures[j].registry_entry);
+                    model_meshnum[i].mesh_textures[j].registry_entry = nullptr;
+                    model_meshnum[i].mesh_textures[j].texture_id = 0;
+                }
+            }
         }
 
     private:
         std::vector<Mesh_data> model_meshnum;
-        std::vector<texture_data> texturesused;
         std::string modeldirectory;
+        mesh_optimization_stats optimizationstats; // Accumulated over every mesh imported through prepareMeshNodes()
+        std::vector<instance_data> instances; // One mesh's visible copies grouped by level, kept between calls so it doesn't reallocate
+        culling_bounds_soa cullingbounds; // World space boxes of whatever the current render call is about to draw
+        std::vector<unsigned char> boundsvisible;
+
+        static Render_queue &immediateQueue()
+        { // Shared by the renderModel() calls that draw on the spot, so its GL buffers are made once rather than every call
+            static Render_queue queue;
+            return queue;
+        }
+
+        static float viewDistance(const Mesh_data &mesh, const glm::mat4 &modelmatrix, const render_view &view)
+        { // From the view position to the mesh's transformed bounds center, what the queue sorts by
+            return glm::length(glm::vec3(modelmatrix * glm::vec4(mesh.boundscenter, 1.0f)) - view.viewposition);
+        }
+
+        void cullBounds(render_view &view)
+        {
+            if(!view.hasfrustum)
+            {
+                boundsvisible.assign(cullingbounds.count, 1);
+                view.meshesvisible += cullingbounds.count;
+                return;
+            }
+
+            unsigned int visiblecount = Frustum_culler::cullBounds(view.frustum, cullingbounds, boundsvisible);
+            view.meshesculled += cullingbounds.count - visiblecount;
+            if(view.occlusion)
+            {
+                unsigned int occludedcount = view.occlusion->cullBounds(cullingbounds, boundsvisible);
+                view.meshesoccluded += occludedcount;
+                visiblecount -= occludedcount;
+            }
+            view.meshesvisible += visiblecount;
+        }
 
         void load(std::string const &modelpath)
         {
+            std::cout << "\nTrying to load Model located at:" << modelpath << std::endl;
+            modeldirectory = modelpath.substr(0, modelpath.find_last_of('/'));
+
+            Mesh_cache modelcache(modelpath, MODEL_IMPORT_FLAGS);
+            if(modelcache.load())
+            { // Cache hit, the meshes come straight out of the mapped file and Assimp is never touched.
+                for(unsigned int i = 0; i < modelcache.cached_meshes.size(); i++)
+                {
+                    const mesh_cache_entry &cachedmesh = modelcache.cached_meshes[i];
+                    std::vector<texture_data> mesh_textures;
+
+                    for(unsigned int j = 0; j < cachedmesh.textures.size(); j++)
+                        mesh_textures.push_back(resolveTexture(cachedmesh.textures[j].texture_path, cachedmesh.textures[j].texture_type));
+
+                    model_meshnum.push_back(Mesh_data(cachedmesh.vertices, cachedmesh.vertex_count, cachedmesh.indices, cachedmesh.index_count, mesh_textures,
+                                                      cachedmesh.lods, cachedmesh.lod_count));
+                }
+                packMeshes(modelpath);
+                std::cout << "Model Loaded from the mesh cache.\n\n" << std::endl;
+                return;
+            }
+
             Assimp::Importer modelimporter;
 
             // Creates a scene containing the model specified in the modelpath, as well as triangulating it(most modeling softwares work with quads) and flipping its texture coordinates to work better with openGL image's y axis.
-            const aiScene *modelscene = modelimporter.ReadFile(modelpath, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals);
+            const aiScene *modelscene = modelimporter.ReadFile(modelpath, MODEL_IMPORT_FLAGS);
 
             if(!modelscene || modelscene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !modelscene->mRootNode)
             {
@@ -39,12 +276,65 @@ class Model_data
             }
             else
             {
-                modeldirectory = modelpath.substr(0, modelpath.find_last_of('/'));
                 prepareSceneNodes(modelscene->mRootNode, modelscene);
+                std::cout << "Optimized " << modelpath << ": " << optimizationstats.vertsbefore << " -> " << optimizationstats.vertsafter << " vertices, ACMR "
+                          << optimizationstats.acmrbefore << " -> " << optimizationstats.acmrafter << " over " << optimizationstats.triangles << " triangles" << std::endl;
+                printLodChain(modelpath);
+                modelcache.store(model_meshnum); // Next launch will skip Assimp entirely for this model.
+                packMeshes(modelpath);
             }
             std::cout << "Model Loaded.\n\n" << std::endl;
         }
 
+        void packMeshes(std::string const &modelpath)
+        { // Quantizes every mesh into packed_vertex_data and reports how far the decoded vertices end up from the float ones.
+            if(!USE_PACKED_VERTICES)
+                return;
+
+            vertex_packing_error modelerror;
+            for(unsigned int i = 0; i < model_meshnum.size(); i++)
+                modelerror.merge(model_meshnum[i].packVertices());
+
+            std::cout << "Packed " << modelerror.vertexcount << " vertices of " << modelpath << " (" << sizeof(vertex_data) << " -> " << sizeof(packed_vertex_data) << " bytes each)"
+                      << "\n    position error: max " << modelerror.maxpositionerror << " avg " << modelerror.avgpositionerror
+                      << "\n    normal error:   max " << modelerror.maxnormalerror << " deg avg " << modelerror.avgnormalerror << " deg"
+                      << "\n    uv error:       max " << modelerror.maxtexcoorderror << std::endl;
+        }
+
+        void printLodChain(std::string const &modelpath)
+        { // Triangle count of every detail level summed over the model's meshes, meshes with a shorter chain count their last level for the missing ones.
+            std::cout << "LOD chain of " << modelpath << ":";
+            for(unsigned int level = 0; level < MESH_LOD_MAX_LEVELS; level++)
+            {
+                unsigned int triangles = 0;
+                float maxerror = 0.0f;
+                for(unsigned int i = 0; i < model_meshnum.size(); i++)
+                {
+                    const mesh_lod &lod = model_meshnum[i].mesh_lods[glm::min(level, (unsigned int) model_meshnum[i].mesh_lods.size() - 1)];
+                    triangles += lod.indexcount / 3;
+                    maxerror = glm::max(maxerror, lod.error);
+                }
+                std::cout << " [" << level << "] " << triangles << " tris (error " << maxerror << ")";
+            }
+            std::cout << std::endl;
+        }
+
+        void uploadModel()
+        { // Every GL call needed by the model lives here, so it can be deferred to the context thread while load() runs elsewhere.
+            unsigned int modelvertices = 0;
+            for(unsigned int i = 0; i < model_meshnum.size(); i++)
+            {
+                model_meshnum[i].modelvertexoffset = modelvertices;
+                modelvertices += model_meshnum[i].mesh_vertices.size();
+                for(unsigned int j = 0; j < model_meshnum[i].mesh_textures.size(); j++)
+                {
+                    texture_data &meshtexture = model_meshnum[i].mesh_textures[j];
+                    meshtexture.texture_id = Texture_registry::instance().uploadTexture(meshtexture.registry_entry);
+                }
+                model_meshnum[i].configureMesh();
+            }
+        }
+
         void prepareSceneNodes(aiNode *rootnode, const aiScene *scenenode)
         {
             for(unsigned int i = 0; i < rootnode->mNumMeshes; i++)
@@ -67,7 +357,7 @@ class Model_data
 
             for(unsigned int i = 0; i < meshnode->mNumVertices; i++)
             {
-                vertex_data newvert;
+                vertex_data newvert = vertex_data(); // Zeroed, so vertices without UVs or normals still weld and cache byte for byte
                 glm::vec3 vertexcoord;
 
                 vertexcoord.x = meshnode->mVertices[i].x;
@@ -119,6 +409,12 @@ class Model_data
                     mesh_vert_indices.push_back(meshface.mIndices[j]);
             }
 
+            // Welds the per-corner vertices the importer emits, then reorders triangles for the post-transform cache and overdraw, and vertices for fetch locality.
+            optimizationstats.merge(Mesh_optimizer::optimizeMesh(mesh_vertices, mesh_vert_indices));
+
+            // Coarser levels are appended to the same index array, all of them sharing the optimized vertices above.
+            std::vector<mesh_lod> mesh_lods = Mesh_simplifier::buildLodChain(mesh_vertices, mesh_vert_indices);
+
             aiMaterial *meshmaterial = scenenode->mMaterials[meshnode->mMaterialIndex];
 
             std::vector<texture_data> texdiffusemap = loadModelMaterialTextures(meshmaterial, aiTextureType_DIFFUSE, "diffuse_texture");
@@ -133,86 +429,33 @@ class Model_data
             std::vector<texture_data> texheightmap = loadModelMaterialTextures(meshmaterial, aiTextureType_HEIGHT, "height_texture");
             mesh_textures.insert(mesh_textures.end(), texheightmap.begin(), texheightmap.end() );
 
-            return Mesh_data(mesh_vertices, mesh_vert_indices, mesh_textures);
+            return Mesh_data(mesh_vertices, mesh_vert_indices, mesh_textures, mesh_lods);
         }
 
         std::vector<texture_data> loadModelMaterialTextures(aiMaterial *material, aiTextureType textype, std::string textypename)
         {
             std::vector<texture_data> mesh_textures;
-            bool loadtexture = true;
-
 
             for(unsigned int i = 0; i < material->GetTextureCount(textype); i++)
             {
                 aiString texturepath;
                 material->GetTexture(textype, i, &texturepath);
-                loadtexture = true; // Sets the texture to be loaded by default
-
-                for(unsigned int j = 0; j < texturesused.size(); j++)
-                { // Loops through all textures currently in use by the mesh in search of a identical texture to prevent the loading of duplicate textures.
-                    if(std::strcmp(texturesused[j].texture_path.data(), texturepath.C_Str()) == 0)
-                    { // If any repeated texture(by location and name) is found, do not load the texture again.
-                        mesh_textures.push_back(texturesused[j]);
-                        loadtexture = false;
-                        break;
-                    }
-                }
-
-                if(loadtexture)
-                {
-                    texture_data texdata;
-                    texdata.texture_id = loadTexture(texturepath.C_Str(), this->modeldirectory);
-                    texdata.texture_type = textypename;
-                    texdata.texture_path = texturepath.C_Str();
-                    mesh_textures.push_back(texdata);
-                    texturesused.push_back(texdata);
-                }
+                mesh_textures.push_back(resolveTexture(texturepath.C_Str(), textypename));
             }
 
             return mesh_textures;
         }
 
-        unsigned int loadTexture(const char *modelpath, const std::string &texdirectory)
-        {
-            std::string texturefilepath = std::string(modelpath);
-            texturefilepath = texdirectory + "/" + texturefilepath;
-
-            std::cout << "Trying to load texture located at:" << texturefilepath.c_str() << std::endl;
-
-            int texwidth, texheight, texchannels;
-            unsigned char *texturedata = stbi_load(texturefilepath.c_str(), &texwidth, &texheight, &texchannels, 0);
-            unsigned int texture_id;
-
-            if(texturedata)
-            {
-                GLenum textureformat;
-                if (texchannels == 1)
-                    textureformat = GL_RED;
-
-                else if(texchannels == 3)
-                    textureformat = GL_RGB;
-
-                else if(texchannels == 4)
-                    textureformat = GL_RGBA;
-
-                glGenTextures(1, &texture_id);
-                glBindTexture(GL_TEXTURE_2D, texture_id);
-                glTexImage2D(GL_TEXTURE_2D, 0, textureformat, texwidth, texheight, 0, textureformat, GL_UNSIGNED_BYTE, texturedata);
-                glGenerateMipmap(GL_TEXTURE_2D);
-
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-                std::cout << "Texture Loaded" << std::endl;
-            }
-            else
-            {
-                std::cout << "Failed to load the texture located at: " << modelpath << std::endl;
-            }
-
-            stbi_image_free(texturedata);
-            return texture_id;
+        texture_data resolveTexture(const std::string &texturepath, const std::string &textypename)
+        { // Every texture goes through the process-wide registry, which dedups by file contents across all models instead of by path within this one.
+            texture_data texdata;
+            texdata.texture_id = 0; // Filled in by uploadModel()
+            texdata.texture_type = textypename;
+            texdata.texture_path = texturepath;
+            texdata.registry_entry = Texture_registry::instance().acquire(this->modeldirectory + "/" + texturepath);
+            return texdata;
         }
 
 };
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef OCCLUSION_BENCHMARK_H
+#define OCCLUSION_BENCHMARK_H
+
+#include "../deps/glm/glm.hpp"
+#include "../deps/glm/gtc/matrix_transform.hpp"
+#include "Occlusion_culler.hpp"
+#include "Frustum_culler.hpp"
+
+#include <vector>
+#include <chrono>
+#include <random>
+#include <iostream>
+
+namespace Occlusion_benchmark
+{   // Standalone run of Occlusion_culler over a made up street: a ground grid, rows of box buildings and a crowd of small props. Needs no window
+    // or GL context. Checks a few boxes with known answers first, so a broken rasterizer fails loudly instead of just getting faster.
+    inline void appendBox(const glm::vec3 &center, const glm::vec3 &extent, std::vector<glm::vec3> &positions, std::vector<unsigned int> &indices)
+    { // Six outward facing quads, counter clockwise seen from outside
+        for(int axis = 0; axis < 3; axis++)
+        {
+            for(int sign = -1; sign <= 1; sign += 2)
+            {
+                glm::vec3 normal(0.0f), tangent(0.0f), bitangent(0.0f);
+                normal[axis] = sign * extent[axis];
+                tangent[(axis + 1) % 3]   = extent[(axis + 1) % 3];
+                bitangent[(axis + 2) % 3] = extent[(axis + 2) % 3];
+
+                unsigned int first = positions.size();
+                positions.push_back(center + normal - tangent - bitangent);
+                positions.push_back(center + normal + tangent - bitangent);
+                positions.push_back(center + normal + tangent + bitangent);
+                positions.push_back(center + normal - tangent + bitangent);
+
+                unsigned int quad[6] = { 0, 1, 2, 0, 2, 3 }, flipped[6] = { 0, 2, 1, 0, 3, 2 };
+                for(int i = 0; i < 6; i++)
+                    indices.push_back(first + (sign > 0 ? quad[i] : flipped[i]));
+            }
+        }
+    }
+
+    inline void appendGround(float height, float halfsize, unsigned int cells, std::vector<glm::vec3> &positions, std::vector<unsigned int> &indices)
+    { // Facing up, like the terrain
+        float step = 2.0f * halfsize / cells;
+        for(unsigned int i = 0; i < cells; i++)
+        {
+            for(unsigned int j = 0; j < cells; j++)
+            {
+                float x0 = -halfsize + i * step, z0 = -halfsize + j * step;
+                unsigned int first = positions.size();
+                positions.push_back(glm::vec3(x0, height, z0));
+                positions.push_back(glm::vec3(x0, height, z0 + step));
+                positions.push_back(glm::vec3(x0 + step, height, z0 + step));
+                positions.push_back(glm::vec3(x0 + step, height, z0));
+
+                unsigned int quad[6] = { 0, 1, 2, 0, 2, 3 };
+                for(int k = 0; k < 6; k++)
+                    indices.push_back(first + quad[k]);
+            }
+        }
+    }
+
+    inline int run(unsigned int iterations)
+    {
+        glm::mat4 viewprojection = glm::perspective(glm::radians(60.0f), 2.0f, 0.1f, 500.0f) * glm::lookAt(glm::vec3(0.0f, 1.7f, 0.0f), glm::vec3(0.0f, 1.7f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+        std::vector<glm::vec3> positions;
+        std::vector<unsigned int> indices;
+        appendGround(0.0f, 200.0f, 64, positions, indices);
+        appendBox(glm::vec3(0.0f, 6.0f, -21.0f), glm::vec3(10.0f, 6.0f, 1.0f), positions, indices); // Straight ahead, what the checks below hide behind
+        for(int i = 0; i < 24; i++)
+            appendBox(glm::vec3(i % 2 ? 35.0f : -35.0f, 8.0f, -30.0f - (i / 2) * 14.0f), glm::vec3(8.0f, 8.0f, 5.0f), positions, indices);
+
+        Occlusion_culler culler;
+        culler.beginFrame(viewprojection);
+        culler.addOccluder(positions.data(), positions.size(), indices.data(), indices.size(), glm::mat4(1.0f));
+        culler.rasterize();
+
+        bool passed = true;
+        if(culler.boxVisible(glm::vec3(0.0f, 2.0f, -40.0f), glm::vec3(1.0f)))
+        {
+            std::cout << "Occlusion benchmark: a box right behind the wall came out visible" << std::endl;
+            passed = false;
+        }
+        if(!culler.boxVisible(glm::vec3(0.0f, 2.0f, -10.0f), glm::vec3(1.0f)) || !culler.boxVisible(glm::vec3(25.0f, 2.0f, -40.0f), glm::vec3(1.0f)))
+        {
+            std::cout << "Occlusion benchmark: a box in plain sight came out occluded" << std::endl;
+            passed = false;
+        }
+        if(culler.boxVisible(glm::vec3(0.0f, -3.0f, -30.0f), glm::vec3(1.0f)))
+        {
+            std::cout << "Occlusion benchmark: a box under the ground came out visible" << std::endl;
+            passed = false;
+        }
+
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<float> spreadx(-60.0f, 60.0f), spreadz(-300.0f, -5.0f), size(0.3f, 2.0f);
+        culling_bounds_soa bounds;
+        for(int i = 0; i < 10000; i++)
+        {
+            glm::vec3 extent(size(random));
+            bounds.push(glm::vec3(spreadx(random), extent.y, spreadz(random)), extent);
+        }
+
+        camera_frustum frustum = camera_frustum::fromMatrix(viewprojection);
+        std::vector<unsigned char> visible;
+        double rasterseconds = 0.0, testseconds = 0.0;
+        unsigned long long occluded = 0, infrustum = 0;
+        for(unsigned int i = 0; i < iterations; i++)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            culler.beginFrame(viewprojection);
+            culler.addOccluder(positions.data(), positions.size(), indices.data(), indices.size(), glm::mat4(1.0f));
+            culler.rasterize();
+            std::chrono::steady_clock::time_point rasterized = std::chrono::steady_clock::now();
+
+            infrustum += Frustum_culler::cullBounds(frustum, bounds, visible);
+            occluded  += culler.cullBounds(bounds, visible);
+            std::chrono::steady_clock::time_point tested = std::chrono::steady_clock::now();
+
+            rasterseconds += std::chrono::duration<double>(rasterized - start).count();
+            testseconds   += std::chrono::duration<double>(tested - rasterized).count();
+        }
+
+        if(iterations > 0)
+            std::cout << "Occlusion benchmark: " << culler.stats().triangles << " of " << indices.size() / 3 << " occluder triangles on screen, "
+                      << rasterseconds * 1000.0 / iterations << " ms to set up and rasterize, " << testseconds * 1000.0 / iterations << " ms to test "
+                      << bounds.count << " boxes, " << occluded / iterations << " of the " << infrustum / iterations << " in the frustum occluded ("
+                      << iterations << " iterations)" << std::endl;
+        std::cout << "Occlusion benchmark checks " << (passed ? "passed" : "FAILED") << std::endl;
+        return passed ? 0 : 1;
+    }
+}
+
+#endif
@@ -0,0 +1,363 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include "../deps/glm/glm.hpp"
+#include "Frustum_culler.hpp"
+#include "Mesh_simplifier.hpp"
+#include "Thread_pool.hpp"
+
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+// Size of the software depth buffer. The width must be a multiple of 4, the rasterizer fills four pixels of a row at a time.
+const unsigned int OCCLUSION_BUFFER_WIDTH  = 256;
+const unsigned int OCCLUSION_BUFFER_HEIGHT = 128;
+const unsigned int OCCLUSION_BANDS = 8; // Horizontal strips of the buffer, rasterized in parallel, one job each
+const float OCCLUSION_NEAR_W = 1e-3f;   // Clip space w under which a vertex counts as behind the camera
+const float OCCLUDER_MAX_LOD_ERROR = 0.1f; // Occluders draw the coarsest detail level of their meshes whose error, in model units, stays under this
+
+static_assert(OCCLUSION_BUFFER_WIDTH % 4 == 0 && OCCLUSION_BUFFER_HEIGHT % OCCLUSION_BANDS == 0, "Occlusion buffer must split evenly into bands of whole SIMD groups");
+
+struct occluder_triangle
+{ // Screen space setup of one occluder triangle. Edge i is inside where edgea[i] * x + edgeb[i] * y + edgec[i] >= 0, depth is a plane over x and y.
+    float edgea[3], edgeb[3], edgec[3];
+    float deptha, depthb, depthc;
+    int minx, maxx, miny, maxy; // Pixel bounds, already clamped to the buffer
+};
+
+struct occlusion_stats
+{
+    unsigned int occluders = 0, triangles = 0; // Submitted this frame, and how many of their triangles made it through setup
+    unsigned int tested = 0, occluded = 0;     // Boxes tested since beginFrame(), and how many of them were hidden
+    float rastermilliseconds = 0.0f;           // Setup is on the caller's thread, this covers the banded rasterization and the pyramid
+};
+
+class Occlusion_culler
+{   // Draws a handful of big occluders into a small CPU depth buffer every frame, reduces it to a max-depth pyramid, and then tells whether a
+    // world space box could still show from behind them. Pixels are covered by their center like the GPU would, which keeps the result close to
+    // conservative: a box only showing inside a buffer pixel whose center the occluder covers gets culled, so at worst a sliver narrower than one
+    // buffer pixel (5 screen pixels at 1280 wide) along an occluder's silhouette goes missing. Anything reaching a full buffer pixel past it is kept,
+    // tests/Occlusion_culler_tests.hpp pins both down.
+    public:
+        Occlusion_culler() : workers(std::min(std::thread::hardware_concurrency(), OCCLUSION_BANDS)) // 0 leaves the count to Thread_pool
+        {
+            depthpyramid.push_back(std::vector<float>(OCCLUSION_BUFFER_WIDTH * OCCLUSION_BUFFER_HEIGHT, 1.0f));
+            pyramidwidths.push_back(OCCLUSION_BUFFER_WIDTH);
+            pyramidheights.push_back(OCCLUSION_BUFFER_HEIGHT);
+            while(pyramidwidths.back() > 1 || pyramidheights.back() > 1)
+            {
+                pyramidwidths.push_back((pyramidwidths.back() + 1) / 2);
+                pyramidheights.push_back((pyramidheights.back() + 1) / 2);
+                depthpyramid.push_back(std::vector<float>(pyramidwidths.back() * pyramidheights.back(), 1.0f));
+            }
+        }
+
+        void beginFrame(const glm::mat4 &viewprojection)
+        {
+            this->viewprojection = viewprojection;
+            triangles.clear();
+            laststats = occlusion_stats();
+        }
+
+        void addOccluder(const glm::vec3 *positions, unsigned int vertexcount, const unsigned int *indices, unsigned int indexcount, const glm::mat4 &modelmatrix)
+        {   // Counter clockwise triangles facing the camera are kept. Any with a vertex behind the near plane is dropped instead of clipped,
+            // losing an occluder only ever costs culling.
+            glm::mat4 clipmatrix = viewprojection * modelmatrix;
+            clipvertices.resize(vertexcount);
+            for(unsigned int i = 0; i < vertexcount; i++)
+                clipvertices[i] = clipmatrix * glm::vec4(positions[i], 1.0f);
+
+            for(unsigned int i = 0; i + 2 < indexcount; i += 3)
+                setupTriangle(clipvertices[indices[i]], clipvertices[indices[i + 1]], clipvertices[indices[i + 2]]);
+            laststats.occluders++;
+        }
+
+        void rasterize()
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            std::fill(depthpyramid[0].begin(), depthpyramid[0].end(), 1.0f);
+
+            for(unsigned int band = 0; band < OCCLUSION_BANDS; band++)
+                workers.enqueue([this, band] { rasterizeBand(band); });
+            workers.waitIdle();
+
+            buildPyramid();
+            laststats.triangles = triangles.size();
+            laststats.rastermilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+            totalrastermilliseconds += laststats.rastermilliseconds;
+            totaltriangles += laststats.triangles;
+            rasterizedframes++;
+        }
+
+        bool boxVisible(const glm::vec3 &center, const glm::vec3 &extent) const
+        {   // Projects the box's corners, then looks at the pyramid level where its screen rectangle spans at most 2x2 texels. Each of those holds the
+            // farthest occluder depth under it, so the box is hidden only if its nearest corner lies behind all of them.
+            float minx = 1e30f, miny = 1e30f, maxx = -1e30f, maxy = -1e30f, nearestdepth = 1.0f;
+            for(int corner = 0; corner < 8; corner++)
+            {
+                glm::vec3 point = center + extent * glm::vec3(corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, corner & 4 ? 1.0f : -1.0f);
+                glm::vec4 clip = viewprojection * glm::vec4(point, 1.0f);
+                if(clip.w <= OCCLUSION_NEAR_W)
+                    return true; // Straddles the camera, nothing sensible to test
+
+                glm::vec3 screen = toScreen(clip);
+                minx = std::min(minx, screen.x); maxx = std::max(maxx, screen.x);
+                miny = std::min(miny, screen.y); maxy = std::max(maxy, screen.y);
+                nearestdepth = std::min(nearestdepth, screen.z);
+            }
+
+            if(maxx < 0.0f || maxy < 0.0f || minx >= OCCLUSION_BUFFER_WIDTH || miny >= OCCLUSION_BUFFER_HEIGHT)
+                return true; // Off the buffer, that's for the frustum to decide
+
+            int x0 = glm::clamp((int) std::floor(minx), 0, (int) OCCLUSION_BUFFER_WIDTH - 1), x1 = glm::clamp((int) std::floor(maxx), 0, (int) OCCLUSION_BUFFER_WIDTH - 1);
+            int y0 = glm::clamp((int) std::floor(miny), 0, (int) OCCLUSION_BUFFER_HEIGHT - 1), y1 = glm::clamp((int) std::floor(maxy), 0, (int) OCCLUSION_BUFFER_HEIGHT - 1);
+            unsigned int level = pyramidLevel(x0, y0, x1, y1);
+
+            const std::vector<float> &depths = depthpyramid[level];
+            for(int y = y0 >> level; y <= y1 >> level; y++)
+                for(int x = x0 >> level; x <= x1 >> level; x++)
+                    if(depths[y * pyramidwidths[level] + x] >= nearestdepth)
+                        return true;
+            return false;
+        }
+
+        unsigned int pyramidLevel(int x0, int y0, int x1, int y1) const
+        { // The finest level where the pixel rectangle from x0, y0 to x1, y1 (inclusive) falls on at most 2x2 texels
+            unsigned int level = 0;
+            while(level + 1 < depthpyramid.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+                level++;
+            return level;
+        }
+
+        unsigned int cullBounds(const culling_bounds_soa &bounds, std::vector<unsigned char> &visible)
+        { // Clears visible for the boxes that passed the frustum but sit behind the occluders, returns how many that was.
+            unsigned int occluded = 0;
+            for(unsigned int i = 0; i < bounds.count; i++)
+            {
+                if(!visible[i])
+                    continue;
+
+                laststats.tested++;
+                if(!boxVisible(glm::vec3(bounds.centerx[i], bounds.centery[i], bounds.centerz[i]), glm::vec3(bounds.extentx[i], bounds.extenty[i], bounds.extentz[i])))
+                {
+                    visible[i] = 0;
+                    occluded++;
+                }
+            }
+            laststats.occluded += occluded;
+            totaloccluded += occluded;
+            return occluded;
+        }
+
+        const occlusion_stats &stats() const
+        {
+            return laststats;
+        }
+
+        const std::vector<float> &depthBuffer(unsigned int level = 0) const
+        { // Level 0 is the rasterized buffer, rows bottom up
+            return depthpyramid[level];
+        }
+
+        unsigned int pyramidLevels() const
+        {
+            return depthpyramid.size();
+        }
+
+        glm::uvec2 pyramidSize(unsigned int level) const
+        {
+            return glm::uvec2(pyramidwidths[level], pyramidheights[level]);
+        }
+
+        void setSimd(bool enabled)
+        { // Picks between the SSE and the scalar rasterizer, when built with SSE. Both fill the same pixels with the same depths, this is there to check that.
+            simd = enabled;
+        }
+
+        static unsigned int occluderLevel(const std::vector<mesh_lod> &lods, float maxerror = OCCLUDER_MAX_LOD_ERROR)
+        { // The coarsest detail level of a mesh still within maxerror, the full mesh if none is
+            unsigned int level = 0;
+            for(unsigned int i = 1; i < lods.size(); i++)
+                if(lods[i].error <= maxerror)
+                    level = i;
+            return level;
+        }
+
+        template<typename vertex_type>
+        static void gatherOccluder(const std::vector<vertex_type> &vertices, const std::vector<unsigned int> &indices, const mesh_lod &lod,
+                                   std::vector<glm::vec3> &positions, std::vector<unsigned int> &occluderindices)
+        { // Copies one detail level of a mesh into addOccluder()'s arrays, keeping only the vert_pos of the vertices its indices use, in the order they are first used.
+            std::vector<unsigned int> remap(vertices.size(), 0xFFFFFFFFu);
+            for(unsigned int i = 0; i < lod.indexcount; i++)
+            {
+                unsigned int vertex = indices[lod.indexoffset + i];
+                if(remap[vertex] == 0xFFFFFFFFu)
+                {
+                    remap[vertex] = positions.size();
+                    positions.push_back(vertices[vertex].vert_pos);
+                }
+                occluderindices.push_back(remap[vertex]);
+            }
+        }
+
+        void printStatistics() const
+        {
+            if(rasterizedframes == 0)
+                return;
+
+            std::cout << "Occlusion culling per frame: " << totaltriangles / rasterizedframes << " occluder triangles into " << OCCLUSION_BUFFER_WIDTH << "x" << OCCLUSION_BUFFER_HEIGHT
+                      << " on " << workers.threadCount() << " threads in " << totalrastermilliseconds / rasterizedframes << " ms, " << totaloccluded / rasterizedframes
+                      << " meshes occluded" << std::endl;
+        }
+
+    private:
+        Thread_pool workers;
+        glm::mat4 viewprojection = glm::mat4(1.0f);
+        std::vector<glm::vec4> clipvertices;
+        std::vector<occluder_triangle> triangles;
+        std::vector<std::vector<float> > depthpyramid; // Level 0 is the depth buffer, every next level holds the max of 2x2 texels of the one before
+        std::vector<unsigned int> pyramidwidths, pyramidheights;
+        occlusion_stats laststats;
+        unsigned long long rasterizedframes = 0, totaltriangles = 0, totaloccluded = 0;
+        float totalrastermilliseconds = 0.0f;
+        bool simd = true;
+
+        static glm::vec3 toScreen(const glm::vec4 &clip)
+        { // Buffer pixels with y going up, and depth in [0, 1] like the GL depth buffer. Depth is z / w, which interpolates linearly across the screen.
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            return glm::vec3((ndc.x * 0.5f + 0.5f) * OCCLUSION_BUFFER_WIDTH, (ndc.y * 0.5f + 0.5f) * OCCLUSION_BUFFER_HEIGHT, ndc.z * 0.5f + 0.5f);
+        }
+
+        void setupTriangle(const glm::vec4 &clip0, const glm::vec4 &clip1, const glm::vec4 &clip2)
+        {
+            if(clip0.w <= OCCLUSION_NEAR_W || clip1.w <= OCCLUSION_NEAR_W || clip2.w <= OCCLUSION_NEAR_W)
+                return;
+
+            glm::vec3 v[3] = { toScreen(clip0), toScreen(clip1), toScreen(clip2) };
+            float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+            if(area <= 0.0f) // Back facing or degenerate
+                return;
+
+            occluder_triangle triangle;
+            triangle.minx = std::max((int) std::floor(std::min(v[0].x, std::min(v[1].x, v[2].x))), 0);
+            triangle.maxx = std::min((int) std::ceil(std::max(v[0].x, std::max(v[1].x, v[2].x))), (int) OCCLUSION_BUFFER_WIDTH - 1);
+            triangle.miny = std::max((int) std::floor(std::min(v[0].y, std::min(v[1].y, v[2].y))), 0);
+            triangle.maxy = std::min((int) std::ceil(std::max(v[0].y, std::max(v[1].y, v[2].y))), (int) OCCLUSION_BUFFER_HEIGHT - 1);
+            if(triangle.minx > triangle.maxx || triangle.miny > triangle.maxy)
+                return;
+
+            for(int edge = 0; edge < 3; edge++)
+            {
+                const glm::vec3 &from = v[edge], &to = v[(edge + 1) % 3];
+                triangle.edgea[edge] = from.y - to.y;
+                triangle.edgeb[edge] = to.x - from.x;
+                triangle.edgec[edge] = -triangle.edgea[edge] * from.x - triangle.edgeb[edge] * from.y;
+            }
+
+            triangle.deptha = ((v[1].z - v[0].z) * (v[2].y - v[0].y) - (v[2].z - v[0].z) * (v[1].y - v[0].y)) / area;
+            triangle.depthb = ((v[2].z - v[0].z) * (v[1].x - v[0].x) - (v[1].z - v[0].z) * (v[2].x - v[0].x)) / area;
+            triangle.depthc = v[0].z - triangle.deptha * v[0].x - triangle.depthb * v[0].y;
+            triangles.push_back(triangle);
+        }
+
+        void rasterizeBand(unsigned int band)
+        {   // Every triangle clipped to this band's rows. Bands never share a pixel, so the jobs need no locking.
+            const int bandrows = OCCLUSION_BUFFER_HEIGHT / OCCLUSION_BANDS;
+            const int bandfirst = band * bandrows, bandlast = bandfirst + bandrows - 1;
+            float *depths = depthpyramid[0].data();
+
+            for(unsigned int i = 0; i < triangles.size(); i++)
+            {
+                const occluder_triangle &triangle = triangles[i];
+                int firstrow = std::max(triangle.miny, bandfirst), lastrow = std::min(triangle.maxy, bandlast);
+
+                for(int y = firstrow; y <= lastrow; y++)
+                {
+#ifdef FRUSTUM_CULLER_SSE
+                    if(simd)
+                    {
+                        rasterizeRowSimd(triangle, y, depths + y * OCCLUSION_BUFFER_WIDTH);
+                        continue;
+                    }
+#endif
+                    rasterizeRow(triangle, y, depths + y * OCCLUSION_BUFFER_WIDTH);
+                }
+            }
+        }
+
+        // Both row fillers evaluate the edges and the depth as a * pixel x + (b * pixel y + c), in that order and without stepping, so they round alike
+        // and cover exactly the same pixels.
+        static void rasterizeRow(const occluder_triangle &triangle, int y, float *row)
+        {
+            float pixely = y + 0.5f;
+            float rowedge[3];
+            for(int e = 0; e < 3; e++)
+                rowedge[e] = triangle.edgeb[e] * pixely + triangle.edgec[e];
+            float rowdepth = triangle.depthb * pixely + triangle.depthc;
+
+            for(int x = triangle.minx & ~3; x <= triangle.maxx; x++)
+            {
+                float pixelx = x + 0.5f;
+                bool inside = true;
+                for(int e = 0; e < 3; e++)
+                    inside = inside && triangle.edgea[e] * pixelx + rowedge[e] >= 0.0f;
+                if(inside)
+                    row[x] = std::min(row[x], triangle.deptha * pixelx + rowdepth);
+            }
+        }
+
+#ifdef FRUSTUM_CULLER_SSE
+        static void rasterizeRowSimd(const occluder_triangle &triangle, int y, float *row)
+        { // Four pixels at a time from the aligned group holding minx, the buffer width being a multiple of 4 keeps the last group inside the row
+            float pixely = y + 0.5f;
+            __m128 edgea[3], rowedge[3];
+            for(int e = 0; e < 3; e++)
+            {
+                edgea[e]   = _mm_set1_ps(triangle.edgea[e]);
+                rowedge[e] = _mm_set1_ps(triangle.edgeb[e] * pixely + triangle.edgec[e]);
+            }
+            __m128 deptha = _mm_set1_ps(triangle.deptha), rowdepth = _mm_set1_ps(triangle.depthb * pixely + triangle.depthc);
+
+            int firstcolumn = triangle.minx & ~3;
+            __m128 pixelx = _mm_add_ps(_mm_set1_ps(firstcolumn + 0.5f), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+            for(int x = firstcolumn; x <= triangle.maxx; x += 4)
+            {
+                __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgea[0], pixelx), rowedge[0]), _mm_setzero_ps());
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgea[1], pixelx), rowedge[1]), _mm_setzero_ps()));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgea[2], pixelx), rowedge[2]), _mm_setzero_ps()));
+                if(_mm_movemask_ps(inside) != 0)
+                {
+                    __m128 current = _mm_loadu_ps(row + x);
+                    __m128 nearer = _mm_min_ps(current, _mm_add_ps(_mm_mul_ps(deptha, pixelx), rowdepth));
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+                }
+                pixelx = _mm_add_ps(pixelx, _mm_set1_ps(4.0f));
+            }
+        }
+#endif
+
+        void buildPyramid()
+        { // Odd sizes clamp to the last row or column, so an edge texel still covers everything under it
+            for(unsigned int level = 1; level < depthpyramid.size(); level++)
+            {
+                const std::vector<float> &source = depthpyramid[level - 1];
+                std::vector<float> &destination = depthpyramid[level];
+                unsigned int sourcewidth = pyramidwidths[level - 1], sourceheight = pyramidheights[level - 1];
+                for(unsigned int y = 0; y < pyramidheights[level]; y++)
+                {
+                    unsigned int y0 = y * 2, y1 = std::min(y * 2 + 1, sourceheight - 1);
+                    for(unsigned int x = 0; x < pyramidwidths[level]; x++)
+                    {
+                        unsigned int x0 = x * 2, x1 = std::min(x * 2 + 1, sourcewidth - 1);
+                        destination[y * pyramidwidths[level] + x] = std::max(std::max(source[y0 * sourcewidth + x0], source[y0 * sourcewidth + x1]),
+                                                                             std::max(source[y1 * sourcewidth + x0], source[y1 * sourcewidth + x1]));
+                    }
+                }
+            }
+        }
+};
+
+#endif
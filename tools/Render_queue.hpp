@@ -0,0 +1,580 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include "../deps/GLADLibs/include/glad/glad.h"
+#include "../deps/glm/glm.hpp"
+#include "Mesh_loader.hpp"
+#include "Geometry_arena.hpp"
+#include "Texture_arrays.hpp"
+#include "Frame_profiler.hpp"
+#include "Deferred_renderer.hpp"
+#include "shader_compiler.h"
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstring>
+#include <iostream>
+
+const unsigned int RENDER_PASS_OPAQUE  = 0; // Grouped by state, then front to back so early-Z throws away what's hidden
+const unsigned int RENDER_PASS_BLENDED = 1; // After every opaque draw and back to front, so partially transparent texels blend over what's behind them
+
+// Field widths of the 64 bit sort key, from the top bit down. Opaque keys are pass | program | VAO | material | depth,
+// blended keys move the (reversed) depth right below the pass. Names wider than their field only cost grouping, never correctness.
+// Textures aren't part of it, every draw finds its own in the arrays of Texture_arrays.
+const unsigned int SORT_KEY_PASS_BITS     = 2;
+const unsigned int SORT_KEY_PROGRAM_BITS  = 8;
+const unsigned int SORT_KEY_VAO_BITS      = 16;
+const unsigned int SORT_KEY_MATERIAL_BITS = 8;
+const unsigned int SORT_KEY_DEPTH_BITS    = 30;
+
+// What drawBatches() is drawing: the depth pre-pass, the G-buffer of the deferred path, or shaded color.
+enum Render_Stage
+{
+    RENDER_STAGE_DEPTH,
+    RENDER_STAGE_GBUFFER,
+    RENDER_STAGE_SHADE
+};
+
+static_assert(SORT_KEY_PASS_BITS + SORT_KEY_PROGRAM_BITS + SORT_KEY_VAO_BITS + SORT_KEY_MATERIAL_BITS + SORT_KEY_DEPTH_BITS == 64, "Sort key fields must fill 64 bits");
+
+// Must match the layout(binding = ...) of the DrawData block in the vertex shaders.
+const unsigned int DRAW_DATA_BINDING = 4;
+
+// Fragment counts come back from GL_SAMPLES_PASSED queries this many frames late, so reading them never waits on the GPU.
+const unsigned int RENDER_QUEUE_QUERY_FRAMES = 3;
+
+struct draw_data_std430
+{ // One element of the DrawData storage buffer per submitted command, found by the shaders through the instance_drawindex attribute.
+    glm::vec3 positiondecodemin;    unsigned int packedvertices = 0;
+    glm::vec3 positiondecodeextent; int bakedvertexbias = 0; // modelvertexoffset - basevertex, takes gl_VertexID to the vertex's slot in an instance's baked block
+    glm::uvec4 materialtextures; // Array and layer of the diffuse texture, then of the specular one
+};
+
+struct draw_elements_indirect_command
+{ // Laid out the way glMultiDrawElementsIndirect reads it
+    unsigned int count, instancecount, firstindex;
+    int basevertex;
+    unsigned int baseinstance;
+};
+
+static_assert(sizeof(draw_data_std430) == 48 && sizeof(draw_elements_indirect_command) == 20, "Draw structs out of step with std430 and the indirect command layout");
+
+struct render_command
+{
+    unsigned long long sortkey;
+    Mesh_data *mesh;
+    unsigned int program, material; // Indices into Render_queue's programs, material 0 being none
+    unsigned int lodinstancecounts[MESH_LOD_MAX_LEVELS], baseinstance; // The instances of each detail level follow each other in the queue's instance stream, from baseinstance on
+};
+
+struct render_queue_stats
+{   // State changes made by the last execute(), next to what the same commands would have cost in the order they were submitted.
+    // Only the shading pass is counted there, the depth pre-pass shows up in the draw calls.
+    unsigned int commands = 0;
+    unsigned int drawcalls = 0, draws = 0; // glMultiDrawElementsIndirect calls, and the indirect draws they carried
+    unsigned int programchanges = 0, vaochanges = 0, materialchanges = 0;
+    unsigned int unsortedprogramchanges = 0, unsortedvaochanges = 0, unsortedmaterialchanges = 0;
+    bool depthprepass = false;
+    bool deferred = false; // Then the shading pass counted below is the G-buffer pass
+    unsigned long long fragmentsshaded = 0;   // Samples that passed the depth test of the shading pass, a few frames ago
+    unsigned long long fragmentsprepassed = 0; // Same for the depth pre-pass, which is what the shading pass would have run without it
+
+    unsigned int changes() const         { return programchanges + vaochanges + materialchanges; }
+    unsigned int unsortedChanges() const { return unsortedprogramchanges + unsortedvaochanges + unsortedmaterialchanges; }
+};
+
+class Render_queue
+{   // Draws are submitted with a sort key instead of being issued on the spot. execute() radix sorts the keys and walks them in order,
+    // only switching program, VAO or material when the next draw actually needs a different one. Every run of draws sharing all three
+    // goes out as one glMultiDrawElementsIndirect, their matrices coming from the instance stream and vertex decode and textures from DrawData.
+    // With the depth pre-pass on, programs that have a depth program are drawn twice: depth only first, then shaded with GL_EQUAL, so each of
+    // their pixels runs the lighting once instead of once per surface that happened to be nearest when it was drawn.
+    // With a Deferred_renderer set, programs that have a G-buffer program are drawn through it instead and lit all at once afterwards.
+    public:
+        Render_queue() {}
+
+        void setDepthProgram(Shader &programshader, Shader &depthshader)
+        { // depthshader writes the depth programshader would, and alpha tests like it, without any of the lighting
+            unsigned int program = programIndex(programshader);
+            if(!programs[program].depthshader)
+                Texture_arrays::assignUnits(depthshader);
+            programs[program].depthshader = &depthshader;
+        }
+
+        void setGbufferProgram(Shader &programshader, Shader &gbuffershader)
+        { // gbuffershader shares programshader's vertex shader and writes the G-buffer targets of Deferred_renderer instead of lighting
+            unsigned int program = programIndex(programshader);
+            if(!programs[program].gbuffershader)
+                Texture_arrays::assignUnits(gbuffershader);
+            programs[program].gbuffershader = &gbuffershader;
+        }
+
+        void setDepthPrepass(bool enabled)
+        {
+            depthprepass = enabled;
+        }
+
+        void setDeferred(Deferred_renderer *renderer)
+        { // nullptr goes back to shading every program forward
+            deferred = renderer;
+        }
+
+        bool depthPrepass() const
+        {
+            return depthprepass;
+        }
+
+        void submit(Shader &programshader, Mesh_data &mesh, unsigned int pass, unsigned int material, float viewdistance, unsigned int lodlevel,
+                    const glm::mat4 &modelmatrix, const glm::mat3 &normalmatrix, unsigned int bakedoffset = INSTANCE_NOT_BAKED)
+        { // A single copy is just an instanced draw of one.
+            unsigned int lodinstancecounts[MESH_LOD_MAX_LEVELS] = {0};
+            lodinstancecounts[glm::min(lodlevel, (unsigned int) mesh.mesh_lods.size() - 1)] = 1;
+
+            instance_data instance;
+            instance.instance_modelmatrix  = modelmatrix;
+            instance.instance_normalmatrix = normalmatrix;
+            instance.instance_bakedoffset  = bakedoffset;
+            submitInstanced(programshader, mesh, pass, material, viewdistance, lodinstancecounts, &instance);
+        }
+
+        void submitInstanced(Shader &programshader, Mesh_data &mesh, unsigned int pass, unsigned int material, float viewdistance,
+                             const unsigned int *lodinstancecounts, const instance_data *meshinstances)
+        { // meshinstances holds the copies of each level one after the other, as many as lodinstancecounts adds up to. They're copied, so the caller can reuse its array.
+            render_command command = makeCommand(programshader, mesh, pass, material, viewdistance);
+            std::memcpy(command.lodinstancecounts, lodinstancecounts, sizeof(command.lodinstancecounts));
+            command.baseinstance = instances.size();
+
+            unsigned int instancecount = 0;
+            for(unsigned int level = 0; level < MESH_LOD_MAX_LEVELS; level++)
+                instancecount += lodinstancecounts[level];
+            for(unsigned int i = 0; i < instancecount; i++)
+            {
+                instances.push_back(meshinstances[i]);
+                instances.back().instance_drawindex = commands.size();
+            }
+
+            Texture_arrays::resolveMesh(mesh);
+            draw_data_std430 drawdata;
+            drawdata.positiondecodemin    = mesh.positiondecodemin;
+            drawdata.positiondecodeextent = mesh.positiondecodeextent;
+            drawdata.packedvertices       = !mesh.mesh_packed_vertices.empty();
+            drawdata.bakedvertexbias      = (int) mesh.modelvertexoffset - (int) mesh.basevertex;
+            drawdata.materialtextures     = mesh.materialtextures;
+            drawrecords.push_back(drawdata);
+            commands.push_back(command);
+        }
+
+        void execute(const std::function<void(Shader&, unsigned int)> &applymaterial = nullptr)
+        {   // Draws and clears everything submitted. applymaterial is called with the program in use whenever the material changes to one other than 0.
+            {
+                Profile_zone zone("Render queue sort and upload");
+                sortCommands();
+                laststats = render_queue_stats();
+                laststats.commands = commands.size();
+                countUnsortedChanges();
+                buildBatches();
+                upload();
+            }
+
+            Texture_arrays::instance().bind(); // The same arrays on the same units for every draw, so this is all the texture binding a frame does
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectbuffer);
+            unsigned int *queries = beginQueryFrame();
+
+            blendenabled = glIsEnabled(GL_BLEND);
+            if(deferred) // The pre-pass below then lays its depth into the G-buffer
+                deferred->beginGeometry();
+
+            if(depthprepass)
+            { // Same order as the shading pass, so the samples it lets through are what shading would have cost without it
+                Profile_zone zone("Depth pre-pass", true);
+                glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                glBeginQuery(GL_SAMPLES_PASSED, queries[1]);
+                drawBatches(RENDER_STAGE_DEPTH, applymaterial);
+                glEndQuery(GL_SAMPLES_PASSED);
+                glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            }
+
+            if(deferred)
+            {
+                {
+                    Profile_zone zone("G-buffer pass", true);
+                    glBeginQuery(GL_SAMPLES_PASSED, queries[0]);
+                    drawBatches(RENDER_STAGE_GBUFFER, applymaterial);
+                    glEndQuery(GL_SAMPLES_PASSED);
+                }
+                {
+                    Profile_zone zone("Deferred lighting", true);
+                    deferred->lightingPass();
+                    Texture_arrays::instance().bind(); // The lighting pass had the G-buffer on the first units
+                }
+            }
+
+            {
+                Profile_zone zone(deferred ? "Forward pass" : "Shading pass", true);
+                if(!deferred)
+                    glBeginQuery(GL_SAMPLES_PASSED, queries[0]);
+                drawBatches(RENDER_STAGE_SHADE, applymaterial);
+                if(!deferred)
+                    glEndQuery(GL_SAMPLES_PASSED);
+            }
+
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+            if(blendenabled)
+                glEnable(GL_BLEND);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            glBindVertexArray(0);
+
+            totalchanges += laststats.changes();
+            totalunsortedchanges += laststats.unsortedChanges();
+            totaldrawcalls += laststats.drawcalls;
+            totaldraws += laststats.draws;
+            commands.clear();
+            instances.clear();
+            drawrecords.clear();
+        }
+
+        const render_queue_stats &stats() const
+        {
+            return laststats;
+        }
+
+        void printStatistics(unsigned long long framecount) const
+        {
+            if(framecount == 0)
+                return;
+
+            std::cout << "Render queue per frame: " << totalchanges / framecount << " state changes after sorting, " << totalunsortedchanges / framecount
+                      << " in submission order (" << ((long long) totalunsortedchanges - (long long) totalchanges) / (long long) framecount << " saved), "
+                      << totaldrawcalls / framecount << " multi-draw calls carrying " << totaldraws / framecount << " draws" << std::endl;
+
+            for(unsigned int prepass = 0; prepass < 2; prepass++)
+            {
+                if(fragmentframes[prepass] == 0)
+                    continue;
+
+                std::cout << "Fragments shaded per frame with the depth pre-pass " << (prepass ? "on: " : "off: ") << totalfragmentsshaded[prepass] / fragmentframes[prepass];
+                if(prepass && totalfragmentsprepassed > 0)
+                    std::cout << " of the " << totalfragmentsprepassed / fragmentframes[prepass] << " it would have been without it ("
+                              << (int) (100.0 - 100.0 * totalfragmentsshaded[prepass] / totalfragmentsprepassed) << "% fewer)";
+                std::cout << std::endl;
+            }
+        }
+
+        void destroy()
+        {
+            glDeleteBuffers(1, &instancebuffer);
+            glDeleteBuffers(1, &drawdatabuffer);
+            glDeleteBuffers(1, &indirectbuffer);
+            instancebuffer = drawdatabuffer = indirectbuffer = 0;
+            if(queryframe > 0)
+                glDeleteQueries(RENDER_QUEUE_QUERY_FRAMES * 2, &fragmentqueries[0][0]);
+            queryframe = 0;
+        }
+
+    private:
+        static const unsigned int NO_STATE = 0xFFFFFFFFu;
+
+        struct render_batch
+        { // Sorted commands sharing program, material and VAO, drawn by a single glMultiDrawElementsIndirect
+            unsigned int firstcommand;  // Into sortedindices
+            unsigned int firstindirect, indirectcount;
+        };
+
+        struct queue_program
+        {
+            Shader *shader;
+            Shader *depthshader = nullptr; // Set through setDepthProgram(), programs without one are left out of the pre-pass
+            Shader *gbuffershader = nullptr; // Set through setGbufferProgram(), programs without one are always shaded forward
+        };
+
+        std::vector<queue_program> programs;
+        std::vector<render_command> commands;
+        std::vector<instance_data> instances;      // Every submitted copy, grouped by command and then by detail level
+        std::vector<draw_data_std430> drawrecords; // One per command, in submission order
+        std::vector<draw_elements_indirect_command> indirectcommands;
+        std::vector<render_batch> batches;
+        std::vector<unsigned long long> sortkeys, sortscratch;
+        std::vector<unsigned int> sortedindices, indexscratch;
+        unsigned int instancebuffer = 0, drawdatabuffer = 0, indirectbuffer = 0; // Created by the first execute()
+        render_queue_stats laststats;
+        unsigned long long totalchanges = 0, totalunsortedchanges = 0, totaldrawcalls = 0, totaldraws = 0;
+        bool depthprepass = false, blendenabled = true;
+        Deferred_renderer *deferred = nullptr;
+        unsigned int fragmentqueries[RENDER_QUEUE_QUERY_FRAMES][2]; // Shading pass, then pre-pass, of each frame in flight
+        bool queriedprepass[RENDER_QUEUE_QUERY_FRAMES];
+        unsigned long long queryframe = 0;
+        unsigned long long totalfragmentsshaded[2] = {0, 0}, totalfragmentsprepassed = 0, fragmentframes[2] = {0, 0}; // Indexed by whether the pre-pass was on
+        render_queue_stats fragmentstats; // Only the fragment fields, carried over from the last readback into every frame's stats
+
+        unsigned int programIndex(Shader &programshader)
+        {
+            for(unsigned int i = 0; i < programs.size(); i++)
+                if(programs[i].shader == &programshader)
+                    return i;
+
+            Texture_arrays::assignUnits(programshader);
+            queue_program program;
+            program.shader = &programshader;
+            programs.push_back(program);
+            return programs.size() - 1;
+        }
+
+        void drawBatches(Render_Stage stage, const std::function<void(Shader&, unsigned int)> &applymaterial)
+        {   // RENDER_STAGE_DEPTH draws the batches of every program with a depth program through it. RENDER_STAGE_GBUFFER draws the deferred programs
+            // through their G-buffer programs, unblended. RENDER_STAGE_SHADE shades every batch the G-buffer didn't take. The pre-passed ones of the last
+            // two are drawn against the depth already laid down: GL_EQUAL, no depth writes and no blending, since what's behind them was never shaded.
+            unsigned int currentprogram = NO_STATE, currentmaterial = NO_STATE, currentvao = NO_STATE;
+            for(unsigned int i = 0; i < batches.size(); i++)
+            {
+                render_batch &batch = batches[i];
+                render_command &command = commands[sortedindices[batch.firstcommand]];
+                queue_program &program = programs[command.program];
+                bool gbuffered = deferred && program.gbuffershader;
+                bool prepassed = depthprepass && program.depthshader && (!deferred || gbuffered); // Under the deferred path the pre-pass depth only lives in the G-buffer
+                if((stage == RENDER_STAGE_DEPTH && !prepassed) || (stage == RENDER_STAGE_GBUFFER && !gbuffered) || (stage == RENDER_STAGE_SHADE && gbuffered))
+                    continue;
+
+                Shader &programshader = stage == RENDER_STAGE_DEPTH ? *program.depthshader : stage == RENDER_STAGE_GBUFFER ? *program.gbuffershader : *program.shader;
+                Mesh_data &mesh = *command.mesh;
+
+                if(command.program != currentprogram)
+                {
+                    programshader.useShader();
+                    if(stage != RENDER_STAGE_DEPTH)
+                    {
+                        glDepthFunc(prepassed ? GL_EQUAL : GL_LESS);
+                        glDepthMask(prepassed ? GL_FALSE : GL_TRUE);
+                        if(prepassed || stage == RENDER_STAGE_GBUFFER)
+                            glDisable(GL_BLEND);
+                        else if(blendenabled)
+                            glEnable(GL_BLEND);
+                        laststats.programchanges++;
+                    }
+                    currentprogram = command.program;
+                    currentmaterial = NO_STATE;
+                }
+                if(command.material != currentmaterial)
+                {
+                    if(command.material != 0 && applymaterial)
+                        applymaterial(programshader, command.material);
+                    currentmaterial = command.material;
+                    if(stage != RENDER_STAGE_DEPTH)
+                        laststats.materialchanges++;
+                }
+                if(mesh.VAO != currentvao)
+                { // The instance stream is VAO state, each arena's VAO gets pointed at this queue's on the way in
+                    glBindVertexArray(mesh.VAO);
+                    glBindVertexBuffer(INSTANCE_BUFFER_BINDING, instancebuffer, 0, sizeof(instance_data));
+                    currentvao = mesh.VAO;
+                    if(stage != RENDER_STAGE_DEPTH)
+                        laststats.vaochanges++;
+                }
+
+                glMultiDrawElementsIndirect(GL_TRIANGLES, mesh.indextype, (void*) (batch.firstindirect * sizeof(draw_elements_indirect_command)), batch.indirectcount, 0);
+                laststats.drawcalls++;
+                laststats.draws += batch.indirectcount;
+            }
+        }
+
+        unsigned int *beginQueryFrame()
+        {   // Reads back the counts of the frame that last used this slot, if the GPU is done with them, then hands the slot's queries to this frame.
+            if(queryframe == 0)
+                glGenQueries(RENDER_QUEUE_QUERY_FRAMES * 2, &fragmentqueries[0][0]);
+
+            unsigned int slot = queryframe % RENDER_QUEUE_QUERY_FRAMES;
+            if(queryframe >= RENDER_QUEUE_QUERY_FRAMES)
+            {
+                GLuint available = 0;
+                glGetQueryObjectuiv(fragmentqueries[slot][0], GL_QUERY_RESULT_AVAILABLE, &available);
+                if(available)
+                { // The pre-pass query ended before the shading one, so it's done as well
+                    GLuint64 shaded = 0, prepassed = 0;
+                    glGetQueryObjectui64v(fragmentqueries[slot][0], GL_QUERY_RESULT, &shaded);
+                    if(queriedprepass[slot])
+                        glGetQueryObjectui64v(fragmentqueries[slot][1], GL_QUERY_RESULT, &prepassed);
+
+                    fragmentstats.depthprepass       = queriedprepass[slot];
+                    fragmentstats.fragmentsshaded    = shaded;
+                    fragmentstats.fragmentsprepassed = prepassed;
+                    totalfragmentsshaded[queriedprepass[slot]] += shaded;
+                    totalfragmentsprepassed += prepassed;
+                    fragmentframes[queriedprepass[slot]]++;
+                }
+            }
+            laststats.depthprepass       = fragmentstats.depthprepass;
+            laststats.fragmentsshaded    = fragmentstats.fragmentsshaded;
+            laststats.fragmentsprepassed = fragmentstats.fragmentsprepassed;
+            laststats.deferred           = deferred != nullptr;
+
+            queriedprepass[slot] = depthprepass;
+            queryframe++;
+            return fragmentqueries[slot];
+        }
+
+        void buildBatches()
+        { // Walks the sorted commands once, turning every detail level with instances into an indirect draw and cutting a new batch whenever any bound state would change.
+            indirectcommands.clear();
+            batches.clear();
+            for(unsigned int i = 0; i < sortedindices.size(); i++)
+            {
+                const render_command &command = commands[sortedindices[i]];
+                const Mesh_data &mesh = *command.mesh;
+                if(i == 0 || !sameState(commands[sortedindices[batches.back().firstcommand]], command))
+                {
+                    render_batch batch;
+                    batch.firstcommand  = i;
+                    batch.firstindirect = indirectcommands.size();
+                    batch.indirectcount = 0;
+                    batches.push_back(batch);
+                }
+
+                unsigned int baseinstance = command.baseinstance;
+                for(unsigned int level = 0; level < mesh.mesh_lods.size(); level++)
+                {
+                    if(command.lodinstancecounts[level] > 0)
+                    { // Every level lives in the same index range of the arena, drawing one is just a different part of it
+                        draw_elements_indirect_command indirect;
+                        indirect.count         = mesh.mesh_lods[level].indexcount;
+                        indirect.instancecount = command.lodinstancecounts[level];
+                        indirect.firstindex    = mesh.firstindex + mesh.mesh_lods[level].indexoffset;
+                        indirect.basevertex    = mesh.basevertex;
+                        indirect.baseinstance  = baseinstance;
+                        indirectcommands.push_back(indirect);
+                        batches.back().indirectcount++;
+                    }
+                    baseinstance += command.lodinstancecounts[level];
+                }
+            }
+        }
+
+        static bool sameState(const render_command &first, const render_command &second)
+        {
+            return first.program == second.program && first.material == second.material && first.mesh->VAO == second.mesh->VAO;
+        }
+
+        void upload()
+        {   // All three are orphaned and refilled whole every frame, so the driver never has to wait for last frame's draws to let go of them.
+            if(instancebuffer == 0)
+            {
+                glGenBuffers(1, &instancebuffer);
+                glGenBuffers(1, &drawdatabuffer);
+                glGenBuffers(1, &indirectbuffer);
+            }
+
+            glBindBuffer(GL_ARRAY_BUFFER, instancebuffer);
+            glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(instance_data), instances.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawdatabuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, glm::max(drawrecords.size(), (size_t) 1) * sizeof(draw_data_std430), nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, drawrecords.size() * sizeof(draw_data_std430), drawrecords.data());
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, drawdatabuffer);
+
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectbuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, indirectcommands.size() * sizeof(draw_elements_indirect_command), indirectcommands.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+
+        static unsigned long long depthBits(float viewdistance)
+        { // The bits of a positive float sort like the float itself, its top SORT_KEY_DEPTH_BITS are a logarithmic depth bucket.
+            viewdistance = glm::max(viewdistance, 0.0f);
+            unsigned int floatbits;
+            std::memcpy(&floatbits, &viewdistance, sizeof(floatbits));
+            return floatbits >> (31 - SORT_KEY_DEPTH_BITS);
+        }
+
+        static unsigned long long field(unsigned long long value, unsigned int bits)
+        {
+            return value & ((1ull << bits) - 1);
+        }
+
+        render_command makeCommand(Shader &programshader, Mesh_data &mesh, unsigned int pass, unsigned int material, float viewdistance)
+        {
+            render_command command;
+            command.mesh     = &mesh;
+            command.program  = programIndex(programshader);
+            command.material = material;
+
+            unsigned long long statekey = field(command.program, SORT_KEY_PROGRAM_BITS);
+            statekey = (statekey << SORT_KEY_VAO_BITS)      | field(mesh.VAO, SORT_KEY_VAO_BITS);
+            statekey = (statekey << SORT_KEY_MATERIAL_BITS) | field(material, SORT_KEY_MATERIAL_BITS);
+
+            unsigned long long depth = depthBits(viewdistance);
+            if(pass == RENDER_PASS_BLENDED)
+                command.sortkey = (field(pass, SORT_KEY_PASS_BITS) << (64 - SORT_KEY_PASS_BITS)) | (((1ull << SORT_KEY_DEPTH_BITS) - 1 - depth) << (64 - SORT_KEY_PASS_BITS - SORT_KEY_DEPTH_BITS)) | statekey;
+            else
+                command.sortkey = (field(pass, SORT_KEY_PASS_BITS) << (64 - SORT_KEY_PASS_BITS)) | (statekey << SORT_KEY_DEPTH_BITS) | depth;
+            return command;
+        }
+
+        void sortCommands()
+        {   // Least significant digit radix sort, 8 bits per pass. Digits that are the same for every key leave the order alone and are skipped,
+            // which with a handful of programs and materials is most of the upper ones.
+            unsigned int count = commands.size();
+            sortkeys.resize(count);
+            sortscratch.resize(count);
+            sortedindices.resize(count);
+            indexscratch.resize(count);
+            for(unsigned int i = 0; i < count; i++)
+            {
+                sortkeys[i] = commands[i].sortkey;
+                sortedindices[i] = i;
+            }
+
+            for(unsigned int shift = 0; shift < 64; shift += 8)
+            {
+                unsigned int offsets[256] = {0};
+                for(unsigned int i = 0; i < count; i++)
+                    offsets[(sortkeys[i] >> shift) & 0xFF]++;
+                if(count == 0 || offsets[(sortkeys[0] >> shift) & 0xFF] == count)
+                    continue;
+
+                unsigned int total = 0;
+                for(unsigned int digit = 0; digit < 256; digit++)
+                {
+                    unsigned int digitcount = offsets[digit];
+                    offsets[digit] = total;
+                    total += digitcount;
+                }
+
+                for(unsigned int i = 0; i < count; i++)
+                {
+                    unsigned int destination = offsets[(sortkeys[i] >> shift) & 0xFF]++;
+                    sortscratch[destination]  = sortkeys[i];
+                    indexscratch[destination] = sortedindices[i];
+                }
+                sortkeys.swap(sortscratch);
+                sortedindices.swap(indexscratch);
+            }
+        }
+
+        void countUnsortedChanges()
+        { // Same rules execute() binds by, walked in submission order and without touching the GL.
+            unsigned int currentprogram = NO_STATE, currentmaterial = NO_STATE, currentvao = NO_STATE;
+            for(unsigned int i = 0; i < commands.size(); i++)
+            {
+                const render_command &command = commands[i];
+                if(command.program != currentprogram)
+                {
+                    currentprogram = command.program;
+                    currentmaterial = NO_STATE;
+                    laststats.unsortedprogramchanges++;
+                }
+                if(command.material != currentmaterial)
+                {
+                    currentmaterial = command.material;
+                    laststats.unsortedmaterialchanges++;
+                }
+                if(command.mesh->VAO != currentvao)
+                {
+                    currentvao = command.mesh->VAO;
+                    laststats.unsortedvaochanges++;
+                }
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,696 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include "../deps/glm/glm.hpp"
+#include "../deps/glm/gtc/matrix_transform.hpp"
+#include "Model_Loader.hpp"
+#include "Render_queue.hpp"
+#include "Light_baker.hpp"
+#include "Grass_field.hpp"
+#include "Scene_loader.hpp"
+#include "Frame_profiler.hpp"
+#include "shader_compiler.h"
+
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <utility>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+const int SCENE_NO_PARENT = -1; // Also the model and material of entities that only carry a transform
+
+struct scene_program_uniforms
+{ // The per draw uniforms of one Shader, resolved once in bindProgram(). A name the program doesn't have stays a handle that sets nothing.
+    Uniform_handle<bool>      emit;
+    Uniform_handle<float>     emitmul, forcex, forcey, forcez;
+};
+
+struct scene_program
+{ // A Shader the scene file refers to by name, along with the depth only program that stands in for it during the depth pre-pass and the
+  // G-buffer program that stands in for it under deferred shading, if it has them.
+    std::string name;
+    Shader *shader = nullptr, *depthshader = nullptr, *gbuffershader = nullptr;
+    scene_program_uniforms uniforms, depthuniforms, gbufferuniforms;
+};
+
+struct scene_material
+{ // What a draw sets on its program besides the camera and lights, which main() still sets once per frame.
+    std::string name;
+    int program = SCENE_NO_PARENT;
+    bool emit = false;
+    float emitmul = 1.0f;
+    glm::vec3 wind = glm::vec3(0.0f); // forcex, forcey and forcez of the vegetation shader
+    unsigned int pass = RENDER_PASS_OPAQUE;
+    bool bake = false; // The static lights are baked into its entities' vertices, see Scene_graph::bakeLighting()
+    bool reportedunbound = false;
+};
+
+struct scene_occluder
+{ // A simplified copy of one mesh of an occluder entity, kept on the CPU for Occlusion_culler. Only the vertices its indices use.
+    unsigned int entity;
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+};
+
+struct scene_batch
+{ // Every entity sharing a model and material. The matrices are gathered from the entities only when one of them moved.
+    int model = SCENE_NO_PARENT, material = SCENE_NO_PARENT;
+    std::vector<unsigned int> entities;
+    std::vector<glm::mat4> modelmatrices;
+    std::vector<glm::mat3> normalmatrices;
+    std::vector<unsigned int> bakedoffsets; // Of each entity, INSTANCE_NOT_BAKED unless bakeLighting() gave it a block
+    bool dirty = true;
+};
+
+class Scene_graph
+{   // Entities read from a scene file, stored one array per field so the per frame transform pass walks flat arrays.
+    // Write transforms through the setters, they raise the dirty flags updateTransforms() relies on.
+    public:
+        std::vector<std::string> entitynames;
+        std::vector<glm::vec3> translations, rotations, scales; // Rotations are euler angles in degrees, applied as Y, then X, then Z
+        std::vector<int> parents;                              // Always a lower index than the entity itself, or SCENE_NO_PARENT
+        std::vector<int> models, materials;
+        std::vector<unsigned char> dirty;
+        std::vector<glm::mat4> worldmatrices;                  // Cached, valid after updateTransforms()
+        std::vector<glm::mat3> normalmatrices;
+        std::vector<unsigned char> haslight;
+        std::vector<glm::vec3> lightoffsets;                   // World space offset of the entity's point light from its origin
+        std::vector<unsigned char> occluders;                  // Drawn into the occlusion culler's depth buffer every frame, see buildOccluders()
+        std::vector<unsigned int> bakedoffsets;                // Start of the entity's baked lighting, INSTANCE_NOT_BAKED for everything lit at runtime only
+
+        Scene_graph() {}
+
+        bool loadScene(const std::string &scenepath, Scene_loader &sceneloader)
+        { // Queues every model on sceneloader, the owner still has to call sceneloader.finishLoading() before the first render().
+            std::ifstream scenefile(scenepath);
+            if(!scenefile)
+            {
+                std::cout << "SCENE_FILE_NOT_FOUND: " << scenepath << std::endl;
+                return false;
+            }
+
+            std::string line;
+            unsigned int linenumber = 0;
+            while(std::getline(scenefile, line))
+            {
+                linenumber++;
+                std::vector<std::string> tokens = tokenize(line);
+                if(tokens.empty())
+                    continue;
+
+                bool parsed = false;
+                if(tokens[0] == "model")
+                    parsed = parseModel(tokens, sceneloader);
+                else if(tokens[0] == "material")
+                    parsed = parseMaterial(tokens);
+                else if(tokens[0] == "entity")
+                    parsed = parseEntity(tokens);
+                else if(tokens[0] == "grass")
+                    parsed = parseGrass(tokens);
+
+                if(!parsed)
+                {
+                    std::cout << "SCENE_FILE_ERROR: " << scenepath << ":" << linenumber << ": " << line << std::endl;
+                    return false;
+                }
+            }
+
+            std::cout << "Scene " << scenepath << ": " << entitynames.size() << " entities, " << scenemodels.size() << " models, " << batches.size() << " batches" << std::endl;
+            return true;
+        }
+
+        void bindProgram(const std::string &programname, Shader &programshader, Shader *depthshader = nullptr, Shader *gbuffershader = nullptr)
+        {   // Materials name their program, this hands the scene the Shader behind that name. depthshader and gbuffershader must share programshader's
+            // vertex shader, the shading pass only keeps the fragments whose depth comes out exactly equal to what the pre-pass wrote.
+            int program = findProgram(programname);
+            if(program == SCENE_NO_PARENT)
+            {
+                program = programs.size();
+                programs.push_back(scene_program());
+                programs.back().name = programname;
+            }
+
+            scene_program &sceneprogram = programs[program];
+            sceneprogram.shader      = &programshader;
+            sceneprogram.depthshader = depthshader;
+            sceneprogram.gbuffershader = gbuffershader;
+            resolveUniforms(programshader, sceneprogram.uniforms);
+            if(depthshader)
+            { // The wind moves the vegetation's vertices, so the pre-pass has to get the same forces
+                resolveUniforms(*depthshader, sceneprogram.depthuniforms);
+                renderqueue.setDepthProgram(programshader, *depthshader);
+            }
+            if(gbuffershader)
+            {
+                resolveUniforms(*gbuffershader, sceneprogram.gbufferuniforms);
+                renderqueue.setGbufferProgram(programshader, *gbuffershader);
+            }
+        }
+
+        void buildOccluders()
+        {   // Once the models are loaded. The occluders keep their own index and position arrays of the simplified level, the GPU copies can't be read back cheaply.
+            sceneoccluders.clear();
+            unsigned int triangles = 0;
+            for(unsigned int i = 0; i < entitynames.size(); i++)
+            {
+                if(!occluders[i] || models[i] == SCENE_NO_PARENT)
+                    continue;
+
+                const std::vector<Mesh_data> &meshes = scenemodels[models[i]]->meshes();
+                for(unsigned int j = 0; j < meshes.size(); j++)
+                {
+                    const Mesh_data &mesh = meshes[j];
+                    scene_occluder occluder;
+                    occluder.entity = i;
+                    Occlusion_culler::gatherOccluder(mesh.mesh_vertices, mesh.mesh_vert_indices, mesh.mesh_lods[Occlusion_culler::occluderLevel(mesh.mesh_lods)],
+                                                     occluder.positions, occluder.indices);
+                    triangles += occluder.indices.size() / 3;
+                    sceneoccluders.push_back(occluder);
+                }
+            }
+            std::cout << "Scene occluders: " << sceneoccluders.size() << " meshes, " << triangles << " triangles" << std::endl;
+        }
+
+        void buildGrass()
+        {   // Once the models are loaded. Scatters every grass field over the meshes of its surface entity where they are now, the surface must stay put.
+            updateTransforms();
+            for(unsigned int i = 0; i < grassfields.size(); i++)
+            {
+                Grass_field &field = *grassfields[i];
+                unsigned int surface = grasssurfaces[i];
+                const std::vector<Mesh_data> &meshes = scenemodels[models[surface]]->meshes();
+                for(unsigned int j = 0; j < meshes.size(); j++)
+                    field.addSurface(meshes[j], worldmatrices[surface]);
+                field.build();
+                field.printStatistics();
+            }
+        }
+
+        unsigned int grassBladesDrawn() const
+        { // Over every grass field, in the last render()
+            unsigned int blades = 0;
+            for(unsigned int i = 0; i < grassfields.size(); i++)
+                blades += grassfields[i]->bladesDrawn();
+            return blades;
+        }
+
+        void bakeLighting(const std::vector<point_light_std430> &lights, bool rebake)
+        {   // Once, after the models are loaded, lights in world space. Bakes lights that never move into the vertices of every entity whose material has bake=1,
+            // the basic program then leaves them out for those entities (see Light_buffer::setBakedLightRange()). Shadows come from every opaque,
+            // non emissive entity except the ones carrying a light, whose own fixtures would otherwise swallow it. Baked entities must stay where they are.
+            updateTransforms();
+            for(unsigned int i = 0; i < entitynames.size(); i++)
+            {
+                if(models[i] == SCENE_NO_PARENT)
+                    continue;
+
+                const scene_material &material = scenematerials[materials[i]];
+                const std::vector<Mesh_data> &meshes = scenemodels[models[i]]->meshes();
+                if(!haslight[i] && !material.emit && material.pass == RENDER_PASS_OPAQUE)
+                    for(unsigned int j = 0; j < meshes.size(); j++)
+                        lightbaker.addCaster(meshes[j], worldmatrices[i]);
+                if(material.bake)
+                    bakedoffsets[i] = lightbaker.addReceiver(meshes, worldmatrices[i], normalmatrices[i]);
+            }
+
+            lightbaker.bake(lights, rebake);
+            lightbaker.upload();
+            lightbaker.printStatistics();
+
+            for(unsigned int i = 0; i < batches.size(); i++)
+                for(unsigned int j = 0; j < batches[i].entities.size(); j++)
+                    batches[i].bakedoffsets[j] = bakedoffsets[batches[i].entities[j]];
+        }
+
+        void setOcclusionCulling(bool enabled)
+        {
+            occlusionculling = enabled;
+        }
+
+        const Occlusion_culler &occlusionCuller() const
+        {
+            return occlusionculler;
+        }
+
+        void setDepthPrepass(bool enabled)
+        {
+            renderqueue.setDepthPrepass(enabled);
+        }
+
+        void setDeferred(Deferred_renderer *renderer)
+        { // Programs bound with a G-buffer program go through renderer, nullptr shades everything forward
+            renderqueue.setDeferred(renderer);
+        }
+
+        int findEntity(const std::string &entityname) const
+        { // Only named entities can be found, "-" in the scene file leaves the name empty.
+            if(entityname.empty())
+                return SCENE_NO_PARENT;
+            for(unsigned int i = 0; i < entitynames.size(); i++)
+                if(entitynames[i] == entityname)
+                    return i;
+            return SCENE_NO_PARENT;
+        }
+
+        void setTranslation(unsigned int entity, const glm::vec3 &translation)
+        {
+            translations[entity] = translation;
+            dirty[entity] = 1;
+        }
+
+        void setRotation(unsigned int entity, const glm::vec3 &rotation)
+        {
+            rotations[entity] = rotation;
+            dirty[entity] = 1;
+        }
+
+        void setScale(unsigned int entity, const glm::vec3 &scale)
+        {
+            scales[entity] = scale;
+            dirty[entity] = 1;
+        }
+
+        glm::vec3 lightPosition(unsigned int entity) const
+        {
+            return glm::vec3(worldmatrices[entity][3]) + lightoffsets[entity];
+        }
+
+        unsigned int updateTransforms()
+        {   // One pass in index order, parents always come first so their flag and world matrix are final by the time a child reads them.
+            // Returns how many entities were recomputed, on a still frame that's zero and the pass is a walk over the dirty bytes.
+            unsigned int updated = 0;
+            for(unsigned int i = 0; i < entitynames.size(); i++)
+            {
+                int parent = parents[i];
+                if(parent != SCENE_NO_PARENT && dirty[parent])
+                    dirty[i] = 1;
+
+                if(!dirty[i])
+                    continue;
+
+                glm::mat4 localmatrix = glm::translate(glm::mat4(1.0f), translations[i]);
+                if(rotations[i].y != 0.0f)
+                    localmatrix = glm::rotate(localmatrix, glm::radians(rotations[i].y), glm::vec3(0.0f, 1.0f, 0.0f));
+                if(rotations[i].x != 0.0f)
+                    localmatrix = glm::rotate(localmatrix, glm::radians(rotations[i].x), glm::vec3(1.0f, 0.0f, 0.0f));
+                if(rotations[i].z != 0.0f)
+                    localmatrix = glm::rotate(localmatrix, glm::radians(rotations[i].z), glm::vec3(0.0f, 0.0f, 1.0f));
+                if(scales[i] != glm::vec3(1.0f))
+                    localmatrix = glm::scale(localmatrix, scales[i]);
+
+                worldmatrices[i]  = parent != SCENE_NO_PARENT ? worldmatrices[parent] * localmatrix : localmatrix;
+                normalmatrices[i] = glm::mat3(glm::transpose(glm::inverse(worldmatrices[i])));
+
+                if(entitybatches[i] != SCENE_NO_PARENT)
+                    batches[entitybatches[i]].dirty = true;
+                updated++;
+            }
+
+            if(updated > 0)
+                std::fill(dirty.begin(), dirty.end(), 0);
+
+            for(unsigned int i = 0; i < batches.size(); i++)
+            {
+                scene_batch &batch = batches[i];
+                if(!batch.dirty)
+                    continue;
+
+                for(unsigned int j = 0; j < batch.entities.size(); j++)
+                {
+                    batch.modelmatrices[j]  = worldmatrices[batch.entities[j]];
+                    batch.normalmatrices[j] = normalmatrices[batch.entities[j]];
+                }
+                batch.dirty = false;
+            }
+            return updated;
+        }
+
+        void render()
+        {   // Every batch goes through one render queue, which sorts the frame's draws by state instead of keeping the scene file's order
+            // and sends each run of draws sharing program, material, textures and geometry arena out as a single multi-draw.
+            // Needs Model_data::setRenderView() for this frame first, the occluders are rasterized for its view.
+            render_view &view = Model_data::renderView();
+            view.occlusion = nullptr;
+            if(occlusionculling && !sceneoccluders.empty())
+            { // Occluders first, so every batch below can be tested against them
+                Profile_zone zone("Occlusion culling");
+                occlusionculler.beginFrame(view.viewprojection);
+                for(unsigned int i = 0; i < sceneoccluders.size(); i++)
+                {
+                    const scene_occluder &occluder = sceneoccluders[i];
+                    occlusionculler.addOccluder(occluder.positions.data(), occluder.positions.size(), occluder.indices.data(), occluder.indices.size(), worldmatrices[occluder.entity]);
+                }
+                occlusionculler.rasterize();
+                view.occlusion = &occlusionculler;
+            }
+
+            for(unsigned int i = 0; i < batches.size(); i++)
+            {
+                scene_batch &batch = batches[i];
+                scene_material &material = scenematerials[batch.material];
+                scene_program &program = programs[material.program];
+                if(!program.shader)
+                {
+                    if(!material.reportedunbound)
+                        std::cout << "Scene material " << material.name << " uses program " << program.name << ", which was never bound" << std::endl;
+                    material.reportedunbound = true;
+                    continue;
+                }
+
+                Profile_zone zone(modelzonenames[batch.model].c_str()); // Culling, detail levels and queueing, the GPU side of a model is spread over the queue's multi-draws
+                Model_data &model = *scenemodels[batch.model];
+                unsigned int queuematerial = batch.material + 1; // 0 is the queue's "no material"
+                if(batch.entities.size() > 1)
+                    model.queueModelInstanced(renderqueue, *program.shader, batch.modelmatrices, batch.normalmatrices, material.pass, queuematerial, &batch.bakedoffsets, material.wind);
+                else
+                    model.queueModel(renderqueue, *program.shader, batch.modelmatrices[0], batch.normalmatrices[0], material.pass, queuematerial, batch.bakedoffsets[0], material.wind);
+            }
+
+            for(unsigned int i = 0; i < grassfields.size(); i++)
+            {
+                scene_material &material = scenematerials[grassmaterials[i]];
+                scene_program &program = programs[material.program];
+                if(!program.shader)
+                {
+                    if(!material.reportedunbound)
+                        std::cout << "Scene material " << material.name << " uses program " << program.name << ", which was never bound" << std::endl;
+                    material.reportedunbound = true;
+                    continue;
+                }
+
+                Profile_zone zone("Grass");
+                grassfields[i]->queue(renderqueue, *program.shader, material.pass, grassmaterials[i] + 1);
+            }
+
+            view.occlusion = nullptr; // Only valid for this scene and this frame
+            renderqueue.execute([this](Shader &programshader, unsigned int queuematerial) { applyMaterial(programshader, scenematerials[queuematerial - 1]); });
+        }
+
+        const Render_queue &renderQueue() const
+        {
+            return renderqueue;
+        }
+
+        void releaseTextures()
+        {
+            for(unsigned int i = 0; i < scenemodels.size(); i++)
+                scenemodels[i]->releaseTextures();
+            for(unsigned int i = 0; i < grassfields.size(); i++)
+                grassfields[i]->releaseTextures();
+            renderqueue.destroy(); // Its stream buffers go with the rest of the scene's GL objects
+            lightbaker.destroy();
+        }
+
+    private:
+        std::vector<std::unique_ptr<Model_data> > scenemodels; // Behind pointers, a Model_data must not move while its load is queued
+        std::vector<std::string> modelnames;
+        std::vector<std::string> modelzonenames; // "model <name>", what the profiler shows a model's share of render() as
+        std::vector<scene_material> scenematerials;
+        std::vector<scene_program> programs;
+        std::vector<scene_batch> batches;
+        std::vector<int> entitybatches;
+        Render_queue renderqueue;
+        std::vector<scene_occluder> sceneoccluders;
+        Occlusion_culler occlusionculler;
+        bool occlusionculling = true;
+        Light_baker lightbaker;
+        std::vector<std::unique_ptr<Grass_field> > grassfields;
+        std::vector<int> grassmaterials;
+        std::vector<unsigned int> grasssurfaces; // The entity each field grows on
+
+        void applyMaterial(Shader &programshader, const scene_material &material)
+        { // Called with the material's program, its depth program during the depth pre-pass or its G-buffer program under deferred shading
+            scene_program &program = programs[material.program];
+            scene_program_uniforms &uniforms = &programshader == program.shader ? program.uniforms : &programshader == program.gbuffershader ? program.gbufferuniforms : program.depthuniforms;
+            uniforms.emit.set(material.emit);
+            uniforms.emitmul.set(material.emitmul);
+            uniforms.forcex.set(material.wind.x);
+            uniforms.forcey.set(material.wind.y);
+            uniforms.forcez.set(material.wind.z);
+        }
+
+        static void resolveUniforms(Shader &programshader, scene_program_uniforms &uniforms)
+        {
+            uniforms.emit    = programshader.uniform<bool>("emit");
+            uniforms.emitmul = programshader.uniform<float>("emitmul");
+            uniforms.forcex  = programshader.uniform<float>("forcex");
+            uniforms.forcey  = programshader.uniform<float>("forcey");
+            uniforms.forcez  = programshader.uniform<float>("forcez");
+        }
+
+        static std::vector<std::string> tokenize(const std::string &line)
+        { // Whitespace separated, double quotes keep paths with spaces together and # starts a comment.
+            std::vector<std::string> tokens;
+            std::string token;
+            bool quoted = false, intoken = false;
+            for(unsigned int i = 0; i < line.size(); i++)
+            {
+                char c = line[i];
+                if(c == '"')
+                {
+                    quoted = !quoted;
+                    intoken = true;
+                }
+                else if(!quoted && c == '#')
+                    break;
+                else if(!quoted && (c == ' ' || c == '\t' || c == '\r'))
+                {
+                    if(intoken)
+                        tokens.push_back(token);
+                    token.clear();
+                    intoken = false;
+                }
+                else
+                {
+                    token += c;
+                    intoken = true;
+                }
+            }
+            if(intoken)
+                tokens.push_back(token);
+            return tokens;
+        }
+
+        static bool parseFloat(const std::string &text, float &value)
+        {
+            char *end = nullptr;
+            value = std::strtof(text.c_str(), &end);
+            return !text.empty() && *end == '\0';
+        }
+
+        static bool parseVec3(const std::string &text, glm::vec3 &value)
+        { // x,y,z
+            return parseFloatList(text, &value[0], 3);
+        }
+
+        static bool parseFloatList(const std::string &text, float *values, int count)
+        { // count comma separated floats
+            std::stringstream components(text);
+            std::string component;
+            for(int i = 0; i < count; i++)
+                if(!std::getline(components, component, ',') || !parseFloat(component, values[i]))
+                    return false;
+            return components.eof();
+        }
+
+        static bool splitAttribute(const std::string &token, std::string &key, std::string &value)
+        { // key=value
+            size_t separator = token.find('=');
+            if(separator == std::string::npos)
+                return false;
+            key = token.substr(0, separator);
+            value = token.substr(separator + 1);
+            return true;
+        }
+
+        int findModel(const std::string &modelname) const
+        {
+            for(unsigned int i = 0; i < modelnames.size(); i++)
+                if(modelnames[i] == modelname)
+                    return i;
+            return SCENE_NO_PARENT;
+        }
+
+        int findMaterial(const std::string &materialname) const
+        {
+            for(unsigned int i = 0; i < scenematerials.size(); i++)
+                if(scenematerials[i].name == materialname)
+                    return i;
+            return SCENE_NO_PARENT;
+        }
+
+        int findProgram(const std::string &programname) const
+        {
+            for(unsigned int i = 0; i < programs.size(); i++)
+                if(programs[i].name == programname)
+                    return i;
+            return SCENE_NO_PARENT;
+        }
+
+        bool parseModel(const std::vector<std::string> &tokens, Scene_loader &sceneloader)
+        { // model <name> <path>
+            if(tokens.size() != 3 || findModel(tokens[1]) != SCENE_NO_PARENT)
+                return false;
+
+            modelnames.push_back(tokens[1]);
+            modelzonenames.push_back("model " + tokens[1]);
+            scenemodels.push_back(std::unique_ptr<Model_data>(new Model_data(tokens[2], sceneloader)));
+            return true;
+        }
+
+        bool parseMaterial(const std::vector<std::string> &tokens)
+        { // material <name> <program> [emit=0|1] [emitmul=f] [wind=x,y,z] [pass=opaque|blended] [bake=0|1]
+            if(tokens.size() < 3 || findMaterial(tokens[1]) != SCENE_NO_PARENT)
+                return false;
+
+            scene_material material;
+            material.name = tokens[1];
+            material.program = findProgram(tokens[2]);
+            if(material.program == SCENE_NO_PARENT)
+            { // Bound to a Shader later through bindProgram()
+                material.program = programs.size();
+                programs.push_back(scene_program());
+                programs.back().name = tokens[2];
+            }
+
+            for(unsigned int i = 3; i < tokens.size(); i++)
+            {
+                std::string key, value;
+                float number = 0.0f;
+                if(!splitAttribute(tokens[i], key, value))
+                    return false;
+
+                if(key == "emit" && parseFloat(value, number))
+                    material.emit = number != 0.0f;
+                else if(key == "emitmul" && parseFloat(value, number))
+                    material.emitmul = number;
+                else if(key == "bake" && parseFloat(value, number))
+                    material.bake = number != 0.0f;
+                else if(key == "pass" && (value == "opaque" || value == "blended"))
+                    material.pass = value == "opaque" ? RENDER_PASS_OPAQUE : RENDER_PASS_BLENDED;
+                else if(!(key == "wind" && parseVec3(value, material.wind)))
+                    return false;
+            }
+
+            scenematerials.push_back(material);
+            return true;
+        }
+
+        bool parseEntity(const std::vector<std::string> &tokens)
+        { // entity <name|-> <model|-> <material|-> <x> <y> <z> [rotation=x,y,z] [scale=x,y,z] [parent=name] [light=x,y,z] [occluder=0|1]
+            if(tokens.size() < 7)
+                return false;
+
+            glm::vec3 translation, rotation = glm::vec3(0.0f), scale = glm::vec3(1.0f), lightoffset = glm::vec3(0.0f);
+            int model = tokens[2] == "-" ? SCENE_NO_PARENT : findModel(tokens[2]);
+            int material = tokens[3] == "-" ? SCENE_NO_PARENT : findMaterial(tokens[3]);
+            int parent = SCENE_NO_PARENT;
+            bool light = false;
+            float occluder = 0.0f;
+
+            if((model == SCENE_NO_PARENT) != (tokens[2] == "-") || (material == SCENE_NO_PARENT) != (tokens[3] == "-") || (model == SCENE_NO_PARENT) != (material == SCENE_NO_PARENT))
+                return false; // Unknown name, or a model without a material to draw it with
+            for(int axis = 0; axis < 3; axis++)
+                if(!parseFloat(tokens[4 + axis], translation[axis]))
+                    return false;
+
+            for(unsigned int i = 7; i < tokens.size(); i++)
+            {
+                std::string key, value;
+                if(!splitAttribute(tokens[i], key, value))
+                    return false;
+
+                if(key == "parent")
+                {
+                    parent = findEntity(value);
+                    if(parent == SCENE_NO_PARENT)
+                        return false;
+                }
+                else if(key == "light" && parseVec3(value, lightoffset))
+                    light = true;
+                else if(!(key == "rotation" && parseVec3(value, rotation)) && !(key == "scale" && parseVec3(value, scale)) && !(key == "occluder" && parseFloat(value, occluder)))
+                    return false;
+            }
+
+            unsigned int entity = entitynames.size();
+            entitynames.push_back(tokens[1] == "-" ? std::string() : tokens[1]);
+            translations.push_back(translation);
+            rotations.push_back(rotation);
+            scales.push_back(scale);
+            parents.push_back(parent);
+            models.push_back(model);
+            materials.push_back(material);
+            dirty.push_back(1);
+            worldmatrices.push_back(glm::mat4(1.0f));
+            normalmatrices.push_back(glm::mat3(1.0f));
+            haslight.push_back(light ? 1 : 0);
+            lightoffsets.push_back(lightoffset);
+            occluders.push_back(occluder != 0.0f && model != SCENE_NO_PARENT ? 1 : 0);
+            bakedoffsets.push_back(INSTANCE_NOT_BAKED);
+            entitybatches.push_back(SCENE_NO_PARENT);
+
+            if(model == SCENE_NO_PARENT)
+                return true;
+
+            unsigned int batch = 0;
+            while(batch < batches.size() && (batches[batch].model != model || batches[batch].material != material))
+                batch++;
+            if(batch == batches.size())
+            {
+                batches.push_back(scene_batch());
+                batches.back().model = model;
+                batches.back().material = material;
+            }
+
+            batches[batch].entities.push_back(entity);
+            batches[batch].modelmatrices.push_back(glm::mat4(1.0f));
+            batches[batch].normalmatrices.push_back(glm::mat3(1.0f));
+            batches[batch].bakedoffsets.push_back(INSTANCE_NOT_BAKED);
+            entitybatches[entity] = batch;
+            return true;
+        }
+
+        bool parseGrass(const std::vector<std::string> &tokens)
+        { // grass <material> <texture> <surface entity> [density=f] [radius=f] [height=min,max] [width=f] [area=x,z,x,z]
+            if(tokens.size() < 4)
+                return false;
+
+            int material = findMaterial(tokens[1]);
+            int surface = findEntity(tokens[3]);
+            if(material == SCENE_NO_PARENT || surface == SCENE_NO_PARENT || models[surface] == SCENE_NO_PARENT)
+                return false;
+
+            std::unique_ptr<Grass_field> field(new Grass_field());
+            grass_settings &settings = field->settings;
+            for(unsigned int i = 4; i < tokens.size(); i++)
+            {
+                std::string key, value;
+                float heights[2];
+                if(!splitAttribute(tokens[i], key, value))
+                    return false;
+
+                if(key == "height" && parseFloatList(value, heights, 2))
+                {
+                    settings.minheight = heights[0];
+                    settings.maxheight = heights[1];
+                }
+                else if(key == "area" && parseFloatList(value, &settings.area[0], 4))
+                    settings.hasarea = true;
+                else if(!(key == "density" && parseFloat(value, settings.density)) && !(key == "radius" && parseFloat(value, settings.radius)) && !(key == "width" && parseFloat(value, settings.width)))
+                    return false;
+            }
+            if(settings.density <= 0.0f || settings.radius <= 0.0f || settings.minheight <= 0.0f || settings.maxheight < settings.minheight || settings.width <= 0.0f)
+                return false;
+
+            if(!field->loadTexture(tokens[2]))
+                std::cout << "Grass texture " << tokens[2] << " could not be loaded, the blades will be white" << std::endl;
+            grassfields.push_back(std::move(field));
+            grassmaterials.push_back(material);
+            grasssurfaces.push_back(surface);
+            return true;
+        }
+};
+
+#endif
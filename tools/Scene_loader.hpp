@@ -0,0 +1,100 @@
+#ifndef SCENE_LOADER_H
+#define SCENE_LOADER_H
+
+#include "Thread_pool.hpp"
+
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class Scene_loader
+{   // Parses models and decodes their textures on a pool of worker threads, while every GL call they need is queued back to the thread owning the context.
+    public:
+        Scene_loader(unsigned int threadcount = 0) : workers(threadcount)
+        {
+            loadstart = std::chrono::steady_clock::now();
+        }
+
+        void queueModel(const std::string &name, std::function<void()> cpujob, std::function<void()> gljob, std::function<void()> failjob = nullptr)
+        {   // cpujob runs on a worker, gljob is handed to finishLoading() once cpujob is done. Should cpujob throw, gljob is dropped and finishLoading()
+            // reports the failure and runs failjob in its place, so the owner can put the model back into an empty but drawable state.
+            {
+                std::lock_guard<std::mutex> lock(uploadmutex);
+                pendingmodels++;
+            }
+
+            workers.enqueue([this, name, cpujob, gljob, failjob]
+            {
+                std::string failure;
+                try
+                {
+                    cpujob();
+                }
+                catch(const std::exception &error)
+                {
+                    failure = error.what();
+                }
+                catch(...)
+                {
+                    failure = "unknown exception";
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(uploadmutex);
+                    if(failure.empty())
+                        uploadjobs.push_back(gljob);
+                    else
+                    {
+                        failures.push_back(name + ": " + failure);
+                        uploadjobs.push_back(failjob ? failjob : [] {});
+                    }
+                }
+                uploadcondition.notify_one();
+            });
+        }
+
+        void finishLoading()
+        {   // Must be called from the thread that owns the GL context. Runs uploads as soon as models finish parsing and returns once everything is on the GPU.
+            while(true)
+            {
+                std::function<void()> gljob;
+                {
+                    std::unique_lock<std::mutex> lock(uploadmutex);
+                    uploadcondition.wait(lock, [this] { return !uploadjobs.empty() || pendingmodels == 0; });
+
+                    if(uploadjobs.empty())
+                        break;
+
+                    gljob = uploadjobs.front();
+                    uploadjobs.pop_front();
+                }
+
+                gljob();
+
+                std::lock_guard<std::mutex> lock(uploadmutex);
+                pendingmodels--;
+            }
+
+            for(unsigned int i = 0; i < failures.size(); i++)
+                std::cout << "SCENE_LOADER_ERROR: Failed to load " << failures[i] << std::endl;
+
+            double loadtime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadstart).count();
+            std::cout << "Scene loaded in " << loadtime << "ms using " << workers.threadCount() << " worker threads";
+            if(!failures.empty())
+                std::cout << ", " << failures.size() << " model(s) failed";
+            std::cout << "." << std::endl;
+        }
+
+    private:
+        Thread_pool workers;
+        std::deque<std::function<void()> > uploadjobs;
+        std::vector<std::string> failures; // "model: what went wrong", filled by the workers under uploadmutex
+        std::mutex uploadmutex;
+        std::condition_variable uploadcondition;
+        unsigned int pendingmodels = 0;
+        std::chrono::steady_clock::time_point loadstart;
+};
+
+#endif
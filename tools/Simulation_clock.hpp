@@ -0,0 +1,83 @@
+#ifndef SIMULATION_CLOCK_H
+#define SIMULATION_CLOCK_H
+
+#include "../deps/glm/glm.hpp"
+
+const double       SIMULATION_STEP      = 1.0 / 60.0; // Seconds per update, the rate the firefly paths and the camera speeds were tuned at
+const unsigned int SIMULATION_MAX_STEPS = 8; // Per frame. Past that the simulation falls behind real time instead of spending ever longer frames catching up
+
+class Simulation_clock
+{ // Fixed step updates decoupled from the frame rate. Every frame adds its duration to an accumulator and the simulation runs as many whole steps
+  // as fit, so it advances the same way whether frames come at 30, 60 or 300 per second. What's left over becomes alpha(), how far rendering
+  // should blend from the previous step's state towards the latest one (see simulated_value). The update only reads its own state and writes
+  // the next one, nothing in it depends on the renderer, so it could be moved onto a thread of its own.
+    public:
+        explicit Simulation_clock(double stepseconds = SIMULATION_STEP)
+        : step(stepseconds)
+        {
+        }
+
+        void beginFrame(double frameseconds)
+        {
+            accumulator += glm::max(frameseconds, 0.0);
+            if(accumulator > step * SIMULATION_MAX_STEPS) // Loading hitches and breakpoints get dropped rather than simulated
+                accumulator = step * SIMULATION_MAX_STEPS;
+        }
+
+        bool nextStep()
+        { // while(clock.nextStep()) update(clock.stepSeconds(), clock.time());
+            if(accumulator < step)
+                return false;
+            accumulator -= step;
+            simulatedtime += step;
+            steps++;
+            return true;
+        }
+
+        float alpha() const
+        {
+            return (float) (accumulator / step);
+        }
+
+        double time() const
+        { // Of the latest step
+            return simulatedtime;
+        }
+
+        double stepSeconds() const
+        {
+            return step;
+        }
+
+        unsigned long long stepCount() const
+        {
+            return steps;
+        }
+
+    private:
+        double step;
+        double accumulator = 0.0, simulatedtime = 0.0;
+        unsigned long long steps = 0;
+};
+
+template <typename T> struct simulated_value
+{ // A piece of simulation state at the last two steps. The simulation writes current, rendering reads interpolated().
+    T previous, current;
+
+    void reset(const T &value)
+    { // For jumps that shouldn't be smoothed over
+        previous = current = value;
+    }
+
+    void beginStep()
+    {
+        previous = current;
+    }
+
+    T interpolated(float alpha) const
+    {
+        return glm::mix(previous, current, alpha);
+    }
+};
+
+#endif
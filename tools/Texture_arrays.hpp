@@ -0,0 +1,172 @@
+#ifndef TEXTURE_ARRAYS_H
+#define TEXTURE_ARRAYS_H
+
+#include "../deps/GLADLibs/include/glad/glad.h"
+#include "../deps/glm/glm.hpp"
+#include "Texture_registry.hpp"
+#include "Mesh_loader.hpp"
+#include "shader_compiler.h"
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+// Must match the size of materialarrays in the fragment shaders. Array i sits on texture unit i for the whole run.
+const unsigned int MATERIAL_TEXTURE_ARRAYS = 12;
+
+struct texture_array_bucket
+{ // Textures that can share one GL_TEXTURE_2D_ARRAY, which needs every layer to have the same format, size and mip count
+    GLenum internalformat = 0;
+    int width = 0, height = 0;
+    unsigned int levels = 0;
+    std::vector<texture_registry_entry*> entries; // Layer i is entries[i]
+    unsigned int texture_id = 0;
+};
+
+class Texture_arrays
+{   // Moves every texture in the registry into a handful of texture arrays, one per format and size, all bound once to fixed units.
+    // A draw then only needs the array and layer of its textures, which go into the per draw data instead of being bound.
+    public:
+        static Texture_arrays &instance()
+        {
+            static Texture_arrays arrays;
+            return arrays;
+        }
+
+        void build()
+        {   // Main thread, once the scene has finished loading. The 2D textures are copied level by level on the GPU and deleted afterwards.
+            GLint textureunits = 0;
+            glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &textureunits);
+            unsigned int maxarrays = glm::min(MATERIAL_TEXTURE_ARRAYS, (unsigned int) textureunits);
+
+            std::vector<texture_registry_entry*> entries = Texture_registry::instance().uploadedEntries();
+            for(unsigned int i = 0; i < entries.size(); i++)
+            {
+                texture_registry_entry *entry = entries[i];
+                int bucketindex = findBucket(entry);
+                if(bucketindex < 0)
+                {
+                    if(buckets.size() >= maxarrays)
+                    {
+                        std::cout << "Texture arrays: no unit left for a " << entry->width << "x" << entry->height << " texture, raise MATERIAL_TEXTURE_ARRAYS" << std::endl;
+                        continue;
+                    }
+
+                    texture_array_bucket bucket;
+                    bucket.internalformat = entry->internalformat;
+                    bucket.width  = entry->width;
+                    bucket.height = entry->height;
+                    bucket.levels = entry->levels;
+                    buckets.push_back(bucket);
+                    bucketindex = buckets.size() - 1;
+                }
+                buckets[bucketindex].entries.push_back(entry);
+            }
+
+            for(unsigned int i = 0; i < buckets.size(); i++)
+            {
+                texture_array_bucket &bucket = buckets[i];
+                glGenTextures(1, &bucket.texture_id);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, bucket.texture_id);
+                glTexStorage3D(GL_TEXTURE_2D_ARRAY, bucket.levels, bucket.internalformat, bucket.width, bucket.height, bucket.entries.size());
+
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+                for(unsigned int layer = 0; layer < bucket.entries.size(); layer++)
+                {
+                    texture_registry_entry *entry = bucket.entries[layer];
+                    for(unsigned int level = 0; level < bucket.levels; level++)
+                        glCopyImageSubData(entry->texture_id, GL_TEXTURE_2D, level, 0, 0, 0, bucket.texture_id, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+                                           glm::max(bucket.width >> level, 1), glm::max(bucket.height >> level, 1), 1);
+
+                    glDeleteTextures(1, &entry->texture_id);
+                    entry->texture_id = 0;
+                    entry->arrayindex = i;
+                    entry->arraylayer = layer;
+                }
+            }
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+            hasbuilt = true;
+        }
+
+        bool built() const
+        {
+            return hasbuilt;
+        }
+
+        void bind() const
+        {
+            for(unsigned int i = 0; i < buckets.size(); i++)
+            {
+                glActiveTexture(GL_TEXTURE0 + i);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, buckets[i].texture_id);
+            }
+            glActiveTexture(GL_TEXTURE0);
+        }
+
+        static void assignUnits(Shader &programshader)
+        {   // Once per program, the sampler of array i always reads unit i.
+            for(unsigned int i = 0; i < MATERIAL_TEXTURE_ARRAYS; i++)
+                programshader.setInt("materialarrays[" + std::to_string(i) + "]", i);
+        }
+
+        static void resolveMesh(Mesh_data &mesh)
+        {   // Looks up the array and layer of the mesh's first diffuse and specular textures, once. A mesh without a specular map samples its diffuse one,
+            // which is what the unset specular sampler used to fall back to on unit 0.
+            if(mesh.materialresolved || !instance().built())
+                return;
+
+            glm::uvec2 diffuse(TEXTURE_NO_ARRAY, 0), specular(TEXTURE_NO_ARRAY, 0);
+            for(unsigned int i = 0; i < mesh.mesh_textures.size(); i++)
+            {
+                const texture_registry_entry *entry = mesh.mesh_textures[i].registry_entry;
+                if(!entry)
+                    continue;
+
+                if(mesh.mesh_textures[i].texture_type == "diffuse_texture" && diffuse.x == TEXTURE_NO_ARRAY)
+                    diffuse = glm::uvec2(entry->arrayindex, entry->arraylayer);
+                else if(mesh.mesh_textures[i].texture_type == "specular_texture" && specular.x == TEXTURE_NO_ARRAY)
+                    specular = glm::uvec2(entry->arrayindex, entry->arraylayer);
+            }
+            if(specular.x == TEXTURE_NO_ARRAY)
+                specular = diffuse;
+
+            mesh.materialtextures = glm::uvec4(diffuse, specular);
+            mesh.materialresolved = true;
+        }
+
+        void printStatistics() const
+        {
+            std::cout << "Texture arrays: " << buckets.size() << " arrays on units 0 to " << (int) buckets.size() - 1 << ":";
+            for(unsigned int i = 0; i < buckets.size(); i++)
+                std::cout << " [" << i << "] " << buckets[i].width << "x" << buckets[i].height << " x" << buckets[i].entries.size();
+            std::cout << std::endl;
+        }
+
+        void destroy()
+        {
+            for(unsigned int i = 0; i < buckets.size(); i++)
+                glDeleteTextures(1, &buckets[i].texture_id);
+            buckets.clear();
+            hasbuilt = false;
+        }
+
+    private:
+        std::vector<texture_array_bucket> buckets;
+        bool hasbuilt = false;
+
+        Texture_arrays() {}
+
+        int findBucket(const texture_registry_entry *entry) const
+        {
+            for(unsigned int i = 0; i < buckets.size(); i++)
+                if(buckets[i].internalformat == entry->internalformat && buckets[i].width == entry->width && buckets[i].height == entry->height && buckets[i].levels == entry->levels)
+                    return i;
+            return -1;
+        }
+};
+
+#endif
@@ -0,0 +1,881 @@
+#ifndef TEXTURE_BAKER_H
+#define TEXTURE_BAKER_H
+
+#include "../deps/GLADLibs/include/glad/glad.h"
+#include "../deps/stb_image/stb_image.h" // The only place stb_image is included from, main.cpp holds its implementation
+#include "Mesh_cache.hpp"
+
+#include <string>
+#include <vector>
+#include <set>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <cctype>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// Changing the writer string invalidates every baked texture, bump it whenever the filtering or the encoders change.
+const char  TEXTURE_BAKE_WRITER[]    = "CG-Final texture baker 1";
+const char  TEXTURE_BAKE_DIRECTORY[] = "cache/textures";
+const float TEXTURE_ALPHA_TEST_THRESHOLD = 0.18f; // Same cutoff the fragment shaders discard at, the mips keep the coverage it produces on the base level
+// Tolerances of block compressed bakes against the uncompressed chain, uncompressed bakes have to match it exactly. The per level floor is lower since
+// the last few levels pack several distinct colors into a single block, which BC1 can't represent, but they cover too few texels to matter.
+const float TEXTURE_BAKE_MIN_CHAIN_PSNR = 30.0f;
+const float TEXTURE_BAKE_MIN_LEVEL_PSNR = 20.0f;
+
+// Vulkan format numbers, which is what KTX2 stores, and the S3TC enums GLAD leaves out since they're an extension in GL 4.3.
+const uint32_t VK_FORMAT_R8_UNORM_VALUE          = 9;
+const uint32_t VK_FORMAT_R8G8B8_UNORM_VALUE      = 23;
+const uint32_t VK_FORMAT_R8G8B8A8_UNORM_VALUE    = 37;
+const uint32_t VK_FORMAT_BC1_RGB_UNORM_VALUE     = 131;
+const uint32_t VK_FORMAT_BC3_UNORM_VALUE         = 137;
+const GLenum   GL_COMPRESSED_RGB_S3TC_DXT1_VALUE  = 0x83F0;
+const GLenum   GL_COMPRESSED_RGBA_S3TC_DXT5_VALUE = 0x83F3;
+
+struct ktx2_header
+{ // Same layout as the KTX 2.0 header and index, without the level index that follows it.
+    uint8_t  identifier[12];
+    uint32_t vkformat, typesize, pixelwidth, pixelheight, pixeldepth, layercount, facecount, levelcount, supercompressionscheme;
+    uint32_t dfdbyteoffset, dfdbytelength, kvdbyteoffset, kvdbytelength;
+    uint64_t sgdbyteoffset, sgdbytelength;
+};
+
+struct ktx2_level_index
+{
+    uint64_t byteoffset, bytelength, uncompressedbytelength;
+};
+
+const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct baked_texture_level
+{
+    unsigned int width, height;
+    size_t offset, size; // Into baked_texture::filebytes
+};
+
+struct baked_texture
+{ // A baked container read back into memory, ready to be handed level by level to glTexSubImage2D / glCompressedTexSubImage2D.
+    std::vector<unsigned char> filebytes;
+    std::vector<baked_texture_level> levels;
+    uint32_t vkformat = 0;
+    unsigned int width = 0, height = 0, channels = 0;
+    GLenum internalformat = 0, pixelformat = 0; // pixelformat stays 0 for block compressed formats
+    size_t gpubytes = 0;
+
+    bool compressed() const { return pixelformat == 0; }
+};
+
+struct texture_bake_report
+{
+    unsigned int levels = 0;
+    size_t sourcebytes = 0, bakedbytes = 0;
+    float chainpsnr = INFINITY, minpsnr = INFINITY; // Over the whole chain and for the worst level, infinite when they matched exactly
+    bool verified = false;
+};
+
+namespace Texture_baker
+{
+    inline uint64_t contentHash(const unsigned char *bytes, size_t length)
+    { // 64 bit FNV-1a over the whole file, with the length folded in at the end so files that only differ in size never share a key.
+        uint64_t hash = 14695981039346656037ULL;
+        for(size_t i = 0; i < length; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return (hash ^ (uint64_t) length) * 1099511628211ULL;
+    }
+
+    inline std::string bakedPath(uint64_t contenthash)
+    { // Keyed by the source's contents rather than its path, so an edited image can never pick up a stale bake.
+        char hashstr[17];
+        std::snprintf(hashstr, sizeof(hashstr), "%016llx", (unsigned long long) contenthash);
+        return std::string(TEXTURE_BAKE_DIRECTORY) + "/" + hashstr + ".ktx2";
+    }
+
+    inline bool formatInfo(uint32_t vkformat, unsigned int &blockbytes, bool &blockcompressed, GLenum &internalformat, GLenum &pixelformat)
+    {
+        blockcompressed = false;
+        pixelformat = 0;
+        switch(vkformat)
+        {
+            case VK_FORMAT_R8_UNORM_VALUE:       blockbytes = 1;  internalformat = GL_R8;    pixelformat = GL_RED;  return true;
+            case VK_FORMAT_R8G8B8_UNORM_VALUE:   blockbytes = 3;  internalformat = GL_RGB8;  pixelformat = GL_RGB;  return true;
+            case VK_FORMAT_R8G8B8A8_UNORM_VALUE: blockbytes = 4;  internalformat = GL_RGBA8; pixelformat = GL_RGBA; return true;
+            case VK_FORMAT_BC1_RGB_UNORM_VALUE:  blockbytes = 8;  internalformat = GL_COMPRESSED_RGB_S3TC_DXT1_VALUE;  blockcompressed = true; return true;
+            case VK_FORMAT_BC3_UNORM_VALUE:      blockbytes = 16; internalformat = GL_COMPRESSED_RGBA_S3TC_DXT5_VALUE; blockcompressed = true; return true;
+        }
+        return false;
+    }
+
+    inline size_t levelSize(uint32_t vkformat, unsigned int width, unsigned int height)
+    {
+        unsigned int blockbytes;
+        bool blockcompressed;
+        GLenum internalformat, pixelformat;
+        if(!formatInfo(vkformat, blockbytes, blockcompressed, internalformat, pixelformat))
+            return 0;
+
+        if(blockcompressed)
+            return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * blockbytes;
+        return (size_t) width * height * blockbytes;
+    }
+
+    inline bool readBaked(const std::string &bakedpath, baked_texture &baked)
+    { // Reads the whole container in one go and checks it against what this build writes. Anything off means the texture gets decoded from its source instead.
+        std::ifstream bakedfile(bakedpath.c_str(), std::ios::binary);
+        if(!bakedfile)
+            return false;
+
+        baked.filebytes.assign(std::istreambuf_iterator<char>(bakedfile), std::istreambuf_iterator<char>());
+        if(baked.filebytes.size() < sizeof(ktx2_header))
+            return false;
+
+        ktx2_header header;
+        std::memcpy(&header, baked.filebytes.data(), sizeof(header));
+
+        unsigned int blockbytes;
+        bool blockcompressed;
+        if(std::memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0 || header.supercompressionscheme != 0 || header.facecount != 1 ||
+           header.pixeldepth != 0 || header.layercount != 0 || header.levelcount == 0 || header.levelcount > 32 ||
+           !formatInfo(header.vkformat, blockbytes, blockcompressed, baked.internalformat, baked.pixelformat))
+            return false;
+
+        // The writer string is the only key/value pair, and doubles as the version check.
+        std::string writerkey = std::string("KTXwriter") + '\0' + TEXTURE_BAKE_WRITER + '\0';
+        if((uint64_t) header.kvdbyteoffset + header.kvdbytelength > baked.filebytes.size() || header.kvdbytelength < 4 + writerkey.size() ||
+           std::memcmp(baked.filebytes.data() + header.kvdbyteoffset + 4, writerkey.data(), writerkey.size()) != 0)
+            return false;
+
+        if(sizeof(ktx2_header) + header.levelcount * sizeof(ktx2_level_index) > baked.filebytes.size())
+            return false;
+
+        baked.vkformat = header.vkformat;
+        baked.width    = header.pixelwidth;
+        baked.height   = header.pixelheight;
+        baked.channels = header.vkformat == VK_FORMAT_R8_UNORM_VALUE ? 1 : (header.vkformat == VK_FORMAT_R8G8B8_UNORM_VALUE || header.vkformat == VK_FORMAT_BC1_RGB_UNORM_VALUE) ? 3 : 4;
+        baked.levels.clear();
+        baked.gpubytes = 0;
+
+        for(uint32_t level = 0; level < header.levelcount; level++)
+        {
+            ktx2_level_index levelindex;
+            std::memcpy(&levelindex, baked.filebytes.data() + sizeof(ktx2_header) + level * sizeof(ktx2_level_index), sizeof(levelindex));
+
+            baked_texture_level bakedlevel;
+            bakedlevel.width  = std::max(1u, baked.width >> level);
+            bakedlevel.height = std::max(1u, baked.height >> level);
+            bakedlevel.offset = levelindex.byteoffset;
+            bakedlevel.size   = levelindex.bytelength;
+
+            if(levelindex.byteoffset + levelindex.bytelength > baked.filebytes.size() || levelindex.bytelength != levelSize(header.vkformat, bakedlevel.width, bakedlevel.height))
+                return false;
+
+            baked.levels.push_back(bakedlevel);
+            baked.gpubytes += bakedlevel.size;
+        }
+        return true;
+    }
+
+    inline float srgbToLinear(float value)
+    {
+        return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+
+    inline float linearToSrgb(float value)
+    {
+        return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    }
+
+    inline float lanczos3(float x)
+    {
+        x = std::fabs(x);
+        if(x < 1e-6f)
+            return 1.0f;
+        if(x >= 3.0f)
+            return 0.0f;
+
+        const float pi = 3.14159265358979f;
+        return 3.0f * std::sin(pi * x) * std::sin(pi * x / 3.0f) / (pi * pi * x * x);
+    }
+
+    inline void resampleAxis(const std::vector<float> &source, unsigned int sourcewidth, unsigned int sourceheight, unsigned int channels,
+                             std::vector<float> &destination, unsigned int destinationsize, bool horizontal)
+    { // One separable pass of a Lanczos-3 filter widened by the downscale factor, sampling past the edges with wrap around to match GL_REPEAT.
+        unsigned int sourcesize = horizontal ? sourcewidth : sourceheight;
+        unsigned int othersize  = horizontal ? sourceheight : sourcewidth;
+        float scale  = (float) sourcesize / destinationsize;
+        float radius = 3.0f * scale;
+
+        destination.assign((size_t) destinationsize * othersize * channels, 0.0f);
+        std::vector<int>   taps;
+        std::vector<float> weights;
+
+        for(unsigned int d = 0; d < destinationsize; d++)
+        {
+            float center = (d + 0.5f) * scale - 0.5f;
+            int first = (int) std::floor(center - radius), last = (int) std::ceil(center + radius);
+
+            taps.clear();
+            weights.clear();
+            float weightsum = 0.0f;
+            for(int s = first; s <= last; s++)
+            {
+                float weight = lanczos3((s - center) / scale);
+                if(weight == 0.0f)
+                    continue;
+
+                taps.push_back(((s % (int) sourcesize) + (int) sourcesize) % (int) sourcesize);
+                weights.push_back(weight);
+                weightsum += weight;
+            }
+
+            for(unsigned int o = 0; o < othersize; o++)
+            {
+                float *out = &destination[horizontal ? ((size_t) o * destinationsize + d) * channels : ((size_t) d * othersize + o) * channels];
+                for(unsigned int t = 0; t < taps.size(); t++)
+                {
+                    const float *in = &source[horizontal ? ((size_t) o * sourcewidth + taps[t]) * channels : ((size_t) taps[t] * sourcewidth + o) * channels];
+                    for(unsigned int c = 0; c < channels; c++)
+                        out[c] += in[c] * weights[t];
+                }
+                for(unsigned int c = 0; c < channels; c++)
+                    out[c] /= weightsum;
+            }
+        }
+    }
+
+    inline float alphaCoverage(const std::vector<float> &pixels, unsigned int channels, float alphascale)
+    {
+        size_t covered = 0, pixelcount = pixels.size() / channels;
+        for(size_t i = 0; i < pixelcount; i++)
+            if(pixels[i * channels + 3] * alphascale >= TEXTURE_ALPHA_TEST_THRESHOLD)
+                covered++;
+        return pixelcount ? (float) covered / pixelcount : 0.0f;
+    }
+
+    inline std::vector<std::vector<unsigned char> > buildMipChain(const unsigned char *pixels, unsigned int width, unsigned int height, unsigned int channels)
+    { // Every level is filtered from the float copy of the previous one, color in linear light and alpha as is, then rounded to 8 bits.
+        std::vector<std::vector<unsigned char> > levels;
+        levels.push_back(std::vector<unsigned char>(pixels, pixels + (size_t) width * height * channels));
+
+        float srgbdecode[256];
+        for(int i = 0; i < 256; i++)
+            srgbdecode[i] = srgbToLinear(i / 255.0f);
+
+        unsigned int colorchannels = channels >= 3 ? 3 : 0; // Single channel textures aren't color, they're filtered linearly
+        std::vector<float> current((size_t) width * height * channels), horizontalpass, next;
+        for(size_t i = 0; i < current.size(); i++)
+            current[i] = (i % channels) < colorchannels ? srgbdecode[pixels[i]] : pixels[i] / 255.0f;
+
+        bool alphatested = false;
+        float basecoverage = 0.0f;
+        if(channels == 4)
+        { // Only textures actually relying on the alpha test get their coverage preserved, fully opaque ones would gain nothing.
+            basecoverage = alphaCoverage(current, channels, 1.0f);
+            alphatested = basecoverage > 0.0f && basecoverage < 1.0f;
+        }
+
+        while(width > 1 || height > 1)
+        {
+            unsigned int nextwidth = std::max(1u, width / 2), nextheight = std::max(1u, height / 2);
+            resampleAxis(current, width, height, channels, horizontalpass, nextwidth, true);
+            resampleAxis(horizontalpass, nextwidth, height, channels, next, nextheight, false);
+
+            for(size_t i = 0; i < next.size(); i++)
+                next[i] = std::min(std::max(next[i], 0.0f), 1.0f); // The negative lobes can overshoot
+
+            if(alphatested)
+            { // Scales alpha until as many texels pass the shaders' alpha test as on the base level, otherwise foliage thins out with distance.
+                float low = 0.0f, high = 8.0f;
+                for(int step = 0; step < 16; step++)
+                {
+                    float middle = (low + high) * 0.5f;
+                    if(alphaCoverage(next, channels, middle) < basecoverage)
+                        low = middle;
+                    else
+                        high = middle;
+                }
+                for(size_t i = 3; i < next.size(); i += channels)
+                    next[i] = std::min(next[i] * high, 1.0f);
+            }
+
+            std::vector<unsigned char> level(next.size());
+            for(size_t i = 0; i < next.size(); i++)
+            {
+                float value = (i % channels) < colorchannels ? linearToSrgb(next[i]) : next[i];
+                level[i] = (unsigned char) std::min(255.0f, std::max(0.0f, value * 255.0f + 0.5f));
+            }
+
+            levels.push_back(level);
+            current.swap(next);
+            width  = nextwidth;
+            height = nextheight;
+        }
+        return levels;
+    }
+
+    inline uint16_t packColor565(const float color[3])
+    {
+        int r = (int) std::min(31.0f, std::max(0.0f, color[0] * 31.0f / 255.0f + 0.5f));
+        int g = (int) std::min(63.0f, std::max(0.0f, color[1] * 63.0f / 255.0f + 0.5f));
+        int b = (int) std::min(31.0f, std::max(0.0f, color[2] * 31.0f / 255.0f + 0.5f));
+        return (uint16_t) ((r << 11) | (g << 5) | b);
+    }
+
+    inline void unpackColor565(uint16_t packed, int color[3])
+    {
+        int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    inline void colorPalette(uint16_t color0, uint16_t color1, int palette[4][3])
+    { // Four color mode only, the encoder never emits the three color one.
+        unpackColor565(color0, palette[0]);
+        unpackColor565(color1, palette[1]);
+        for(int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+    }
+
+    inline void encodeColorBlock(const unsigned char block[16][4], unsigned char *output)
+    { // BC1 color block: endpoints from the principal axis of the block's colors, then two rounds of least squares refitting against the chosen indices.
+        float mean[3] = {0.0f, 0.0f, 0.0f};
+        for(int i = 0; i < 16; i++)
+            for(int c = 0; c < 3; c++)
+                mean[c] += block[i][c] / 16.0f;
+
+        float covariance[6] = {0, 0, 0, 0, 0, 0}; // xx xy xz yy yz zz
+        for(int i = 0; i < 16; i++)
+        {
+            float d[3] = { block[i][0] - mean[0], block[i][1] - mean[1], block[i][2] - mean[2] };
+            covariance[0] += d[0] * d[0]; covariance[1] += d[0] * d[1]; covariance[2] += d[0] * d[2];
+            covariance[3] += d[1] * d[1]; covariance[4] += d[1] * d[2]; covariance[5] += d[2] * d[2];
+        }
+
+        float axis[3] = {1.0f, 1.0f, 1.0f};
+        for(int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[3] = { covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+                              covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+                              covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2] };
+            float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+            if(length < 1e-6f)
+                break;
+            for(int c = 0; c < 3; c++)
+                axis[c] = next[c] / length;
+        }
+
+        float minprojection = INFINITY, maxprojection = -INFINITY;
+        for(int i = 0; i < 16; i++)
+        {
+            float projection = (block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] + (block[i][2] - mean[2]) * axis[2];
+            minprojection = std::min(minprojection, projection);
+            maxprojection = std::max(maxprojection, projection);
+        }
+
+        float endpoint0[3], endpoint1[3];
+        for(int c = 0; c < 3; c++)
+        {
+            endpoint0[c] = mean[c] + axis[c] * maxprojection;
+            endpoint1[c] = mean[c] + axis[c] * minprojection;
+        }
+
+        uint16_t color0 = 0, color1 = 0;
+        unsigned char indices[16] = {0};
+        for(int round = 0; round < 3; round++)
+        {
+            color0 = packColor565(endpoint0);
+            color1 = packColor565(endpoint1);
+            if(color0 < color1)
+                std::swap(color0, color1);
+
+            int palette[4][3];
+            colorPalette(color0, color1, palette);
+            for(int i = 0; i < 16; i++)
+            {
+                int besterror = 1 << 30;
+                for(int p = 0; p < 4; p++)
+                {
+                    int dr = block[i][0] - palette[p][0], dg = block[i][1] - palette[p][1], db = block[i][2] - palette[p][2];
+                    int error = dr * dr + dg * dg + db * db;
+                    if(error < besterror)
+                    {
+                        besterror = error;
+                        indices[i] = (unsigned char) p;
+                    }
+                }
+            }
+
+            if(color0 == color1 || round == 2)
+                break;
+
+            // Least squares endpoints for the current indices, each texel being a known blend of the two.
+            const float blend[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+            float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = {0, 0, 0}, bx[3] = {0, 0, 0};
+            for(int i = 0; i < 16; i++)
+            {
+                float a = blend[indices[i]], b = 1.0f - a;
+                aa += a * a; ab += a * b; bb += b * b;
+                for(int c = 0; c < 3; c++)
+                {
+                    ax[c] += a * block[i][c];
+                    bx[c] += b * block[i][c];
+                }
+            }
+
+            float determinant = aa * bb - ab * ab;
+            if(std::fabs(determinant) < 1e-6f)
+                break;
+            for(int c = 0; c < 3; c++)
+            {
+                endpoint0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+                endpoint1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+            }
+        }
+
+        if(color0 == color1) // Would read as the three color mode, where index 3 is transparent black
+            std::fill(indices, indices + 16, 0);
+
+        uint32_t packedindices = 0;
+        for(int i = 0; i < 16; i++)
+            packedindices |= (uint32_t) indices[i] << (i * 2);
+
+        std::memcpy(output, &color0, 2);
+        std::memcpy(output + 2, &color1, 2);
+        std::memcpy(output + 4, &packedindices, 4);
+    }
+
+    inline void alphaPalette(unsigned char alpha0, unsigned char alpha1, int palette[8])
+    {
+        palette[0] = alpha0;
+        palette[1] = alpha1;
+        if(alpha0 > alpha1)
+        {
+            for(int i = 1; i < 7; i++)
+                palette[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+        }
+        else
+        {
+            for(int i = 1; i < 5; i++)
+                palette[i + 1] = ((5 - i) * alpha0 + i * alpha1) / 5;
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    inline void encodeAlphaBlock(const unsigned char block[16][4], unsigned char *output)
+    { // BC3 alpha block. Tries both the eight step mode and the six step one with exact 0 and 255, which suits the hard edges of alpha tested foliage.
+        int minalpha = 255, maxalpha = 0, mininner = 255, maxinner = 0;
+        for(int i = 0; i < 16; i++)
+        {
+            minalpha = std::min(minalpha, (int) block[i][3]);
+            maxalpha = std::max(maxalpha, (int) block[i][3]);
+            if(block[i][3] != 0 && block[i][3] != 255)
+            {
+                mininner = std::min(mininner, (int) block[i][3]);
+                maxinner = std::max(maxinner, (int) block[i][3]);
+            }
+        }
+        if(mininner > maxinner)
+            mininner = maxinner = minalpha;
+
+        // alpha0 > alpha1 selects the eight step mode. A flat block ends up with both equal, the six step mode, where index 0 is still exact.
+        unsigned char candidates[2][2] = { { (unsigned char) maxalpha, (unsigned char) minalpha },
+                                           { (unsigned char) mininner, (unsigned char) maxinner } };
+
+        int besterror = 1 << 30;
+        for(int mode = 0; mode < 2; mode++)
+        {
+            int palette[8];
+            alphaPalette(candidates[mode][0], candidates[mode][1], palette);
+
+            int error = 0;
+            unsigned char indices[16];
+            for(int i = 0; i < 16; i++)
+            {
+                int bestpalette = 1 << 30;
+                for(int p = 0; p < 8; p++)
+                {
+                    int difference = (int) block[i][3] - palette[p];
+                    if(difference * difference < bestpalette)
+                    {
+                        bestpalette = difference * difference;
+                        indices[i] = (unsigned char) p;
+                    }
+                }
+                error += bestpalette;
+            }
+
+            if(error < besterror)
+            {
+                besterror = error;
+                uint64_t packedindices = 0;
+                for(int i = 0; i < 16; i++)
+                    packedindices |= (uint64_t) indices[i] << (i * 3);
+
+                output[0] = candidates[mode][0];
+                output[1] = candidates[mode][1];
+                for(int b = 0; b < 6; b++)
+                    output[2 + b] = (unsigned char) (packedindices >> (b * 8));
+            }
+        }
+    }
+
+    inline std::vector<unsigned char> compressLevel(const std::vector<unsigned char> &pixels, unsigned int width, unsigned int height, unsigned int channels, bool withalpha)
+    {
+        unsigned int blockbytes = withalpha ? 16 : 8;
+        std::vector<unsigned char> compressed((size_t) ((width + 3) / 4) * ((height + 3) / 4) * blockbytes);
+        size_t outoffset = 0;
+
+        for(unsigned int by = 0; by < height; by += 4)
+        {
+            for(unsigned int bx = 0; bx < width; bx += 4)
+            {
+                unsigned char block[16][4];
+                for(int i = 0; i < 16; i++)
+                { // Blocks hanging past the edge of small levels repeat the last row and column.
+                    unsigned int x = std::min(bx + (i % 4), width - 1), y = std::min(by + (i / 4), height - 1);
+                    const unsigned char *texel = &pixels[((size_t) y * width + x) * channels];
+                    block[i][0] = texel[0];
+                    block[i][1] = texel[1];
+                    block[i][2] = texel[2];
+                    block[i][3] = channels == 4 ? texel[3] : 255;
+                }
+
+                if(withalpha)
+                    encodeAlphaBlock(block, &compressed[outoffset]);
+                encodeColorBlock(block, &compressed[outoffset + (withalpha ? 8 : 0)]);
+                outoffset += blockbytes;
+            }
+        }
+        return compressed;
+    }
+
+    inline std::vector<unsigned char> decodeLevel(const unsigned char *data, uint32_t vkformat, unsigned int width, unsigned int height, unsigned int channels)
+    { // Back to plain texels with the same channel count as the source, only used to verify bakes.
+        if(vkformat != VK_FORMAT_BC1_RGB_UNORM_VALUE && vkformat != VK_FORMAT_BC3_UNORM_VALUE)
+            return std::vector<unsigned char>(data, data + (size_t) width * height * channels);
+
+        bool withalpha = vkformat == VK_FORMAT_BC3_UNORM_VALUE;
+        unsigned int blockbytes = withalpha ? 16 : 8, blocksperrow = (width + 3) / 4;
+        std::vector<unsigned char> pixels((size_t) width * height * channels);
+
+        for(unsigned int y = 0; y < height; y++)
+        {
+            for(unsigned int x = 0; x < width; x++)
+            {
+                const unsigned char *block = data + ((size_t) (y / 4) * blocksperrow + x / 4) * blockbytes;
+                unsigned int texel = (y % 4) * 4 + x % 4;
+                unsigned char *out = &pixels[((size_t) y * width + x) * channels];
+
+                const unsigned char *colorblock = block + (withalpha ? 8 : 0);
+                uint16_t color0, color1;
+                uint32_t colorindices;
+                std::memcpy(&color0, colorblock, 2);
+                std::memcpy(&color1, colorblock + 2, 2);
+                std::memcpy(&colorindices, colorblock + 4, 4);
+
+                int palette[4][3];
+                colorPalette(color0, color1, palette);
+                unsigned int index = (colorindices >> (texel * 2)) & 3;
+                for(int c = 0; c < 3; c++)
+                    out[c] = (unsigned char) palette[index][c];
+
+                if(channels == 4)
+                {
+                    out[3] = 255;
+                    if(withalpha)
+                    {
+                        int alphas[8];
+                        alphaPalette(block[0], block[1], alphas);
+                        uint64_t alphaindices = 0;
+                        for(int b = 0; b < 6; b++)
+                            alphaindices |= (uint64_t) block[2 + b] << (b * 8);
+                        out[3] = (unsigned char) alphas[(alphaindices >> (texel * 3)) & 7];
+                    }
+                }
+            }
+        }
+        return pixels;
+    }
+
+    inline double squaredError(const std::vector<unsigned char> &reference, const std::vector<unsigned char> &decoded, unsigned int channels)
+    { // Color errors are weighted by the reference alpha, what hides under fully transparent texels never reaches the screen.
+        double squarederror = 0.0;
+        for(size_t i = 0; i < reference.size() && i < decoded.size(); i++)
+        {
+            double difference = (double) reference[i] - decoded[i];
+            if(channels == 4 && i % 4 != 3)
+                difference *= reference[i - i % 4 + 3] / 255.0;
+            squarederror += difference * difference;
+        }
+        return reference.size() == decoded.size() ? squarederror : INFINITY;
+    }
+
+    inline float computePSNR(double squarederror, size_t samplecount)
+    {
+        if(squarederror == 0.0)
+            return INFINITY;
+        return (float) (10.0 * std::log10(255.0 * 255.0 * samplecount / squarederror));
+    }
+
+    inline void appendPadding(std::vector<unsigned char> &bytes, size_t alignment)
+    {
+        while(bytes.size() % alignment != 0)
+            bytes.push_back(0);
+    }
+
+    template <typename T>
+    void appendValue(std::vector<unsigned char> &bytes, const T &value)
+    {
+        const unsigned char *raw = (const unsigned char*) &value;
+        bytes.insert(bytes.end(), raw, raw + sizeof(T));
+    }
+
+    inline std::vector<unsigned char> writeContainer(uint32_t vkformat, unsigned int width, unsigned int height, const std::vector<std::vector<unsigned char> > &levels)
+    { // KTX 2.0 layout: header, level index, a basic data format descriptor, the writer key, then the levels from the smallest to the largest.
+        unsigned int blockbytes;
+        bool blockcompressed;
+        GLenum internalformat, pixelformat;
+        formatInfo(vkformat, blockbytes, blockcompressed, internalformat, pixelformat);
+
+        // Data format descriptor: one basic block, one sample per channel (or per BC plane).
+        std::vector<unsigned char> dfd;
+        uint32_t samplecount = vkformat == VK_FORMAT_BC3_UNORM_VALUE ? 2 : vkformat == VK_FORMAT_BC1_RGB_UNORM_VALUE ? 1 : blockbytes;
+        uint32_t colormodel  = vkformat == VK_FORMAT_BC3_UNORM_VALUE ? 130 : vkformat == VK_FORMAT_BC1_RGB_UNORM_VALUE ? 128 : 1; // KHR_DF_MODEL BC3, BC1A, RGBSDA
+        appendValue(dfd, (uint32_t) (4 + 24 + 16 * samplecount));
+        appendValue(dfd, (uint32_t) 0);                                       // Khronos vendor, basic descriptor type
+        appendValue(dfd, (uint32_t) (2 | ((24 + 16 * samplecount) << 16)));   // Version 1.3, block size
+        appendValue(dfd, (uint32_t) (colormodel | (1 << 8) | (1 << 16)));     // BT.709 primaries, linear transfer since the shaders treat texels as linear too
+        appendValue(dfd, (uint32_t) (blockcompressed ? (3 | (3 << 8)) : 0));  // Texel block dimensions minus one
+        appendValue(dfd, (uint32_t) blockbytes);                               // Bytes in plane 0
+        appendValue(dfd, (uint32_t) 0);
+        for(uint32_t sample = 0; sample < samplecount; sample++)
+        {
+            // Channel ids: 0-2 red to blue, 15 alpha. The BC models call their color plane 0 and BC3's leading alpha plane 15.
+            uint32_t channeltype = blockcompressed ? (vkformat == VK_FORMAT_BC3_UNORM_VALUE && sample == 0 ? 15 : 0) : (sample == 3 ? 15 : sample);
+
+            uint32_t bitoffset = blockcompressed ? sample * 64 : sample * 8, bitlength = blockcompressed ? 63 : 7;
+            appendValue(dfd, (uint32_t) (bitoffset | (bitlength << 16) | (channeltype << 24)));
+            appendValue(dfd, (uint32_t) 0);
+            appendValue(dfd, (uint32_t) 0);
+            appendValue(dfd, (uint32_t) (blockcompressed ? 0xFFFFFFFFu : 255u));
+        }
+
+        std::vector<unsigned char> kvd;
+        std::string writerkey = std::string("KTXwriter") + '\0' + TEXTURE_BAKE_WRITER + '\0';
+        appendValue(kvd, (uint32_t) writerkey.size());
+        kvd.insert(kvd.end(), writerkey.begin(), writerkey.end());
+        appendPadding(kvd, 4);
+
+        ktx2_header header;
+        std::memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+        header.vkformat = vkformat;
+        header.typesize = 1;
+        header.pixelwidth  = width;
+        header.pixelheight = height;
+        header.pixeldepth  = 0;
+        header.layercount  = 0;
+        header.facecount   = 1;
+        header.levelcount  = levels.size();
+        header.supercompressionscheme = 0;
+        header.dfdbyteoffset = sizeof(ktx2_header) + levels.size() * sizeof(ktx2_level_index);
+        header.dfdbytelength = dfd.size();
+        header.kvdbyteoffset = header.dfdbyteoffset + header.dfdbytelength;
+        header.kvdbytelength = kvd.size();
+        header.sgdbyteoffset = 0;
+        header.sgdbytelength = 0;
+
+        std::vector<unsigned char> bytes;
+        appendValue(bytes, header);
+        bytes.resize(header.dfdbyteoffset); // Level index, filled in below once the offsets are known
+        bytes.insert(bytes.end(), dfd.begin(), dfd.end());
+        bytes.insert(bytes.end(), kvd.begin(), kvd.end());
+
+        size_t alignment = blockcompressed ? blockbytes : (blockbytes % 4 == 0 ? blockbytes : blockbytes * 4); // lcm(texel block size, 4)
+        std::vector<ktx2_level_index> levelindex(levels.size());
+        for(size_t level = levels.size(); level-- > 0; )
+        {
+            appendPadding(bytes, alignment);
+            levelindex[level].byteoffset = bytes.size();
+            levelindex[level].bytelength = levels[level].size();
+            levelindex[level].uncompressedbytelength = levels[level].size();
+            bytes.insert(bytes.end(), levels[level].begin(), levels[level].end());
+        }
+        std::memcpy(&bytes[sizeof(ktx2_header)], levelindex.data(), levelindex.size() * sizeof(ktx2_level_index));
+        return bytes;
+    }
+
+    inline bool bakeTexture(const std::vector<unsigned char> &sourcebytes, bool compress, texture_bake_report &report)
+    { // Decodes one source image, bakes it into cache/textures and reads the result back through readBaked() to check it against what was meant to be written.
+        report = texture_bake_report();
+        report.sourcebytes = sourcebytes.size();
+
+        int width, height, channels;
+        unsigned char *pixels = stbi_load_from_memory(sourcebytes.data(), sourcebytes.size(), &width, &height, &channels, 0);
+        if(!pixels)
+            return false;
+
+        if(channels == 2)
+        { // Grey and alpha has no plain GL upload format the old path handled either, so it's expanded to RGBA.
+            stbi_image_free(pixels);
+            pixels = stbi_load_from_memory(sourcebytes.data(), sourcebytes.size(), &width, &height, &channels, 4);
+            channels = 4;
+        }
+
+        std::vector<std::vector<unsigned char> > levels = buildMipChain(pixels, width, height, channels);
+        stbi_image_free(pixels);
+
+        bool hasalpha = false;
+        if(channels == 4)
+            for(size_t i = 3; i < levels[0].size() && !hasalpha; i += 4)
+                hasalpha = levels[0][i] != 255;
+
+        uint32_t vkformat = channels == 1 ? VK_FORMAT_R8_UNORM_VALUE : channels == 3 ? VK_FORMAT_R8G8B8_UNORM_VALUE : VK_FORMAT_R8G8B8A8_UNORM_VALUE;
+        std::vector<std::vector<unsigned char> > payloads = levels;
+        if(compress && channels >= 3)
+        { // Opaque RGBA textures go to BC1 as well, their alpha was 255 everywhere anyway.
+            vkformat = hasalpha ? VK_FORMAT_BC3_UNORM_VALUE : VK_FORMAT_BC1_RGB_UNORM_VALUE;
+            for(size_t level = 0; level < levels.size(); level++)
+                payloads[level] = compressLevel(levels[level], std::max(1, width >> level), std::max(1, height >> level), channels, hasalpha);
+        }
+
+        std::vector<unsigned char> bakedbytes = writeContainer(vkformat, width, height, payloads);
+        std::string bakedpath = bakedPath(contentHash(sourcebytes.data(), sourcebytes.size()));
+
+        Mesh_cache::createDirectory(TEXTURE_BAKE_DIRECTORY);
+        std::ofstream bakedfile(bakedpath.c_str(), std::ios::binary | std::ios::trunc);
+        bakedfile.write((const char*) bakedbytes.data(), bakedbytes.size());
+        bakedfile.close();
+        if(!bakedfile)
+            return false;
+
+        report.levels = levels.size();
+        report.bakedbytes = bakedbytes.size();
+
+        baked_texture readback;
+        if(!readBaked(bakedpath, readback) || readback.levels.size() != levels.size() || readback.width != (unsigned int) width || readback.height != (unsigned int) height)
+            return false;
+
+        double chainerror = 0.0;
+        size_t chainsamples = 0;
+        for(size_t level = 0; level < levels.size(); level++)
+        {
+            const baked_texture_level &bakedlevel = readback.levels[level];
+            std::vector<unsigned char> decoded = decodeLevel(readback.filebytes.data() + bakedlevel.offset, vkformat, bakedlevel.width, bakedlevel.height, channels);
+            double levelerror = squaredError(levels[level], decoded, channels);
+
+            report.minpsnr = std::min(report.minpsnr, computePSNR(levelerror, levels[level].size()));
+            chainerror   += levelerror;
+            chainsamples += levels[level].size();
+        }
+        report.chainpsnr = computePSNR(chainerror, chainsamples);
+
+        if(readback.compressed())
+            report.verified = report.chainpsnr >= TEXTURE_BAKE_MIN_CHAIN_PSNR && report.minpsnr >= TEXTURE_BAKE_MIN_LEVEL_PSNR;
+        else
+            report.verified = chainerror == 0.0;
+
+        if(!report.verified)
+            std::remove(bakedpath.c_str()); // Never leave a bad bake around for the runtime to pick up
+        return report.verified;
+    }
+
+    inline void findImages(const std::string &directory, std::vector<std::string> &imagepaths)
+    {
+        DIR *dir = opendir(directory.c_str());
+        if(!dir)
+            return;
+
+        while(dirent *item = readdir(dir))
+        {
+            std::string name = item->d_name;
+            if(name == "." || name == "..")
+                continue;
+
+            std::string itempath = directory + "/" + name;
+            struct stat itemstat;
+            if(stat(itempath.c_str(), &itemstat) != 0)
+                continue;
+
+            if(S_ISDIR(itemstat.st_mode))
+            {
+                findImages(itempath, imagepaths);
+                continue;
+            }
+
+            std::string extension = name.substr(name.find_last_of('.') + 1);
+            std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+            if(extension == "png" || extension == "jpg" || extension == "jpeg" || extension == "tga" || extension == "bmp")
+                imagepaths.push_back(itempath);
+        }
+        closedir(dir);
+    }
+
+    inline int bakeDirectory(const std::string &directory, bool compress)
+    { // Entry point of --bake-textures. Returns the number of images that failed to bake or verify.
+        std::vector<std::string> imagepaths;
+        findImages(directory, imagepaths);
+        std::sort(imagepaths.begin(), imagepaths.end());
+
+        std::set<uint64_t> bakedhashes;
+        size_t totalsource = 0, totalbaked = 0;
+        int failures = 0;
+        std::chrono::steady_clock::time_point bakestart = std::chrono::steady_clock::now();
+
+        for(unsigned int i = 0; i < imagepaths.size(); i++)
+        {
+            std::ifstream sourcefile(imagepaths[i].c_str(), std::ios::binary);
+            std::vector<unsigned char> sourcebytes((std::istreambuf_iterator<char>(sourcefile)), std::istreambuf_iterator<char>());
+
+            if(!bakedhashes.insert(contentHash(sourcebytes.data(), sourcebytes.size())).second)
+            {
+                std::cout << "Skipped " << imagepaths[i] << ", same contents as an image baked already." << std::endl;
+                continue;
+            }
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            texture_bake_report report;
+            bool baked = bakeTexture(sourcebytes, compress, report);
+            double baketime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            if(!baked)
+            {
+                std::cout << "FAILED to bake " << imagepaths[i] << (report.levels ? " (verification failed, PSNR " : " (could not decode or write it") ;
+                if(report.levels)
+                    std::cout << report.chainpsnr << "dB, worst level " << report.minpsnr << "dB";
+                std::cout << ")" << std::endl;
+                failures++;
+                continue;
+            }
+
+            totalsource += report.sourcebytes;
+            totalbaked  += report.bakedbytes;
+            std::cout << "Baked " << imagepaths[i] << ": " << report.levels << " levels, " << report.sourcebytes / 1024 << "KB -> " << report.bakedbytes / 1024 << "KB, ";
+            if(report.chainpsnr == INFINITY)
+                std::cout << "exact";
+            else
+                std::cout << "PSNR " << report.chainpsnr << "dB, worst level " << report.minpsnr << "dB";
+            std::cout << " (" << baketime << "ms)" << std::endl;
+        }
+
+        double totaltime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - bakestart).count();
+        std::cout << "Texture bake done in " << totaltime << "ms: " << bakedhashes.size() - failures << " textures, " << totalsource / 1024 << "KB of sources -> "
+                  << totalbaked / 1024 << "KB baked" << (compress ? " (block compressed)" : "") << ", " << failures << " failures." << std::endl;
+        return failures;
+    }
+}
+
+#endif
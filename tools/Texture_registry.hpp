@@ -0,0 +1,294 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include "../deps/GLADLibs/include/glad/glad.h"
+#include "Texture_baker.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+
+struct decoded_texture
+{ // Texture pixels decoded by stb_image, waiting to be uploaded by the thread that owns the GL context.
+    unsigned char *pixels = nullptr;
+    int width = 0, height = 0, channels = 0;
+};
+
+const unsigned int TEXTURE_NO_ARRAY = 0xFFFFFFFFu; // arrayindex of an entry that isn't in any of Texture_arrays' arrays
+
+struct texture_registry_entry
+{
+    uint64_t content_hash = 0;
+    uint64_t file_size    = 0;
+    unsigned int texture_id = 0;
+    unsigned int refcount   = 0;
+    unsigned int sharedcount = 0; // Other paths found holding the same image, only used for the statistics
+    bool uploaded = false;
+    GLenum internalformat = 0; // Sized format and mip count of the uploaded texture, what Texture_arrays buckets it by
+    unsigned int levels = 0;
+    unsigned int arrayindex = TEXTURE_NO_ARRAY, arraylayer = 0; // Set once Texture_arrays has moved the texture into one of its arrays
+
+    int width = 0, height = 0, channels = 0;
+    size_t vrambytes = 0; // Estimated, the driver's padding isn't visible to us
+    std::vector<unsigned char> filebytes; // Raw file contents, only kept until the entry has been decoded
+    decoded_texture decoded;
+    baked_texture baked; // Filled instead of decoded when a matching container from --bake-textures exists
+    bool hasbaked = false;
+    std::once_flag decodeonce;
+};
+
+class Texture_registry
+{   // Process-wide texture cache keyed by the hash of each file's contents, so identical images decode once and share one GL texture no matter which model asks for them.
+    public:
+        static Texture_registry &instance()
+        {
+            static Texture_registry registry;
+            return registry;
+        }
+
+        texture_registry_entry *acquire(const std::string &texturefilepath)
+        {   // Safe to call from the loader threads. Returns with the entry decoded (or failed), the GL upload is left to uploadTexture().
+            texture_registry_entry *entry = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(registrymutex);
+                std::unordered_map<std::string, texture_registry_entry*>::iterator pathmatch = pathlookup.find(texturefilepath);
+                if(pathmatch != pathlookup.end())
+                {
+                    entry = pathmatch->second;
+                    entry->refcount++;
+                    hits++;
+                }
+            }
+
+            if(!entry)
+            {
+                std::cout << "Trying to load texture located at:" << texturefilepath.c_str() << std::endl;
+
+                std::vector<unsigned char> filebytes;
+                std::ifstream texturefile(texturefilepath.c_str(), std::ios::binary);
+                if(texturefile)
+                    filebytes.assign(std::istreambuf_iterator<char>(texturefile), std::istreambuf_iterator<char>());
+
+                // Missing or unreadable files are keyed by their path instead, so they don't all collapse into a single failed entry.
+                uint64_t contenthash = filebytes.empty() ? Texture_baker::contentHash((const unsigned char*) texturefilepath.data(), texturefilepath.size())
+                                                         : Texture_baker::contentHash(filebytes.data(), filebytes.size());
+
+                std::lock_guard<std::mutex> lock(registrymutex);
+                std::unordered_map<uint64_t, std::unique_ptr<texture_registry_entry> >::iterator contentmatch = contentlookup.find(contenthash);
+
+                if(contentmatch != contentlookup.end())
+                { // Same image under a different path, e.g. the "Tree Bark.jpg" copies in the Big Tree and Maple Tree folders.
+                    entry = contentmatch->second.get();
+                    entry->sharedcount++;
+                    hits++;
+                    contenthits++;
+                }
+                else
+                {
+                    entry = new texture_registry_entry;
+                    entry->content_hash = contenthash;
+                    entry->file_size    = filebytes.size();
+                    entry->filebytes.swap(filebytes);
+                    contentlookup[contenthash].reset(entry);
+                    misses++;
+                }
+
+                entry->refcount++;
+                pathlookup[texturefilepath] = entry;
+            }
+
+            // Whoever created the entry decodes it, anyone else asking for it meanwhile waits here instead of decoding a second copy.
+            bool compressionsupported = s3tcsupported;
+            std::call_once(entry->decodeonce, [entry, &texturefilepath, compressionsupported]
+            {   // A baked container skips decoding and mip generation entirely, as long as the GL can take its format.
+                if(!entry->filebytes.empty() && Texture_baker::readBaked(Texture_baker::bakedPath(entry->content_hash), entry->baked) &&
+                   (!entry->baked.compressed() || compressionsupported))
+                {
+                    entry->hasbaked  = true;
+                    entry->width     = entry->baked.width;
+                    entry->height    = entry->baked.height;
+                    entry->channels  = entry->baked.channels;
+                    entry->vrambytes = entry->baked.gpubytes;
+                    std::vector<unsigned char>().swap(entry->filebytes);
+                    return;
+                }
+                entry->baked = baked_texture();
+
+                if(!entry->filebytes.empty())
+                    entry->decoded.pixels = stbi_load_from_memory(entry->filebytes.data(), entry->filebytes.size(), &entry->decoded.width, &entry->decoded.height, &entry->decoded.channels, 0);
+
+                if(!entry->decoded.pixels)
+                    std::cout << "Failed to load the texture located at: " << texturefilepath << std::endl;
+
+                entry->width    = entry->decoded.width;
+                entry->height   = entry->decoded.height;
+                entry->channels = entry->decoded.channels;
+                entry->vrambytes = (size_t) entry->width * entry->height * entry->channels * 4 / 3; // The mip chain adds roughly another third on top of the base level
+                std::vector<unsigned char>().swap(entry->filebytes);
+            });
+
+            return entry;
+        }
+
+        unsigned int uploadTexture(texture_registry_entry *entry)
+        {   // Main thread only. The first call creates the GL texture, every later one just hands out the same id.
+            if(!entry || entry->uploaded)
+                return entry ? entry->texture_id : 0;
+
+            entry->uploaded = true;
+            if(entry->hasbaked)
+                return uploadBaked(entry);
+
+            if(!entry->decoded.pixels)
+                return 0;
+
+            GLenum textureformat = GL_RGBA;
+            entry->internalformat = GL_RGBA8;
+            if (entry->channels == 1)
+            {
+                textureformat = GL_RED;
+                entry->internalformat = GL_R8;
+            }
+
+            else if(entry->channels == 3)
+            {
+                textureformat = GL_RGB;
+                entry->internalformat = GL_RGB8;
+            }
+
+            // Sized, so the texture can later be copied into an array of the same format. glGenerateMipmap fills the whole chain.
+            entry->levels = 1;
+            while((std::max(entry->width, entry->height) >> entry->levels) > 0)
+                entry->levels++;
+
+            glGenTextures(1, &entry->texture_id);
+            glBindTexture(GL_TEXTURE_2D, entry->texture_id);
+            glTexImage2D(GL_TEXTURE_2D, 0, entry->internalformat, entry->width, entry->height, 0, textureformat, GL_UNSIGNED_BYTE, entry->decoded.pixels);
+            glGenerateMipmap(GL_TEXTURE_2D);
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            std::cout << "Texture Loaded" << std::endl;
+
+            stbi_image_free(entry->decoded.pixels);
+            entry->decoded.pixels = nullptr;
+
+            return entry->texture_id;
+        }
+
+        std::vector<texture_registry_entry*> uploadedEntries()
+        {   // Every texture that made it onto the GPU, in no particular order.
+            std::lock_guard<std::mutex> lock(registrymutex);
+            std::vector<texture_registry_entry*> entries;
+            for(std::unordered_map<uint64_t, std::unique_ptr<texture_registry_entry> >::iterator it = contentlookup.begin(); it != contentlookup.end(); ++it)
+                if(it->second->texture_id != 0)
+                    entries.push_back(it->second.get());
+            return entries;
+        }
+
+        void queryCapabilities()
+        {   // Main thread, once the context exists and before anything is acquired. S3TC is an extension in 4.3, without it block compressed bakes are skipped.
+            GLint extensioncount = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &extensioncount);
+            for(GLint i = 0; i < extensioncount; i++)
+                if(std::string((const char*) glGetStringi(GL_EXTENSIONS, i)) == "GL_EXT_texture_compression_s3tc")
+                    s3tcsupported = true;
+        }
+
+        void release(texture_registry_entry *entry)
+        {   // Main thread only. Drops one reference and frees the GL texture once nothing uses it anymore.
+            if(!entry)
+                return;
+
+            std::lock_guard<std::mutex> lock(registrymutex);
+            if(--entry->refcount > 0)
+                return;
+
+            if(entry->texture_id != 0)
+                glDeleteTextures(1, &entry->texture_id);
+            if(entry->decoded.pixels)
+                stbi_image_free(entry->decoded.pixels);
+
+            for(std::unordered_map<std::string, texture_registry_entry*>::iterator it = pathlookup.begin(); it != pathlookup.end(); )
+            {
+                if(it->second == entry)
+                    it = pathlookup.erase(it);
+                else
+                    ++it;
+            }
+            contentlookup.erase(entry->content_hash);
+        }
+
+        void printStatistics()
+        {
+            std::lock_guard<std::mutex> lock(registrymutex);
+            uint64_t filebytessaved = 0, vrambytessaved = 0, vrambytes = 0;
+            unsigned int bakedcount = 0;
+
+            for(std::unordered_map<uint64_t, std::unique_ptr<texture_registry_entry> >::iterator it = contentlookup.begin(); it != contentlookup.end(); ++it)
+            { // Only images shared between different paths count as saved, a path asked for again was already loaded once per model before the registry
+                const texture_registry_entry &entry = *it->second;
+
+                filebytessaved += entry.sharedcount * entry.file_size;
+                vrambytessaved += entry.sharedcount * entry.vrambytes;
+                vrambytes += entry.vrambytes;
+                bakedcount += entry.hasbaked ? 1 : 0;
+            }
+
+            std::cout << "Texture registry: " << contentlookup.size() << " unique textures (" << bakedcount << " baked), " << hits << " hits (" << contenthits << " by content), " << misses << " misses, "
+                      << filebytessaved / 1024 << "KB of decoding and " << vrambytessaved / 1024 << "KB of VRAM saved, " << vrambytes / 1024 << "KB of VRAM in use." << std::endl;
+        }
+
+    private:
+        std::unordered_map<std::string, texture_registry_entry*> pathlookup;
+        std::unordered_map<uint64_t, std::unique_ptr<texture_registry_entry> > contentlookup;
+        std::mutex registrymutex;
+        unsigned int hits = 0, contenthits = 0, misses = 0;
+        bool s3tcsupported = false;
+
+        Texture_registry() {}
+
+        unsigned int uploadBaked(texture_registry_entry *entry)
+        {   // Immutable storage sized for the whole chain, then every precomputed level copied straight out of the container.
+            const baked_texture &baked = entry->baked;
+            entry->internalformat = baked.internalformat;
+            entry->levels = baked.levels.size();
+
+            glGenTextures(1, &entry->texture_id);
+            glBindTexture(GL_TEXTURE_2D, entry->texture_id);
+            glTexStorage2D(GL_TEXTURE_2D, baked.levels.size(), baked.internalformat, baked.width, baked.height);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Levels are tightly packed, RGB rows aren't 4 byte aligned
+
+            for(unsigned int level = 0; level < baked.levels.size(); level++)
+            {
+                const baked_texture_level &bakedlevel = baked.levels[level];
+                const unsigned char *leveldata = baked.filebytes.data() + bakedlevel.offset;
+
+                if(baked.compressed())
+                    glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, bakedlevel.width, bakedlevel.height, baked.internalformat, bakedlevel.size, leveldata);
+                else
+                    glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, bakedlevel.width, bakedlevel.height, baked.pixelformat, GL_UNSIGNED_BYTE, leveldata);
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            std::cout << "Baked Texture Loaded" << std::endl;
+
+            entry->baked = baked_texture(); // Frees the file contents, the GL has its own copy now
+            return entry->texture_id;
+        }
+};
+
+#endif
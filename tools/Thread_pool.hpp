@@ -0,0 +1,97 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <deque>
+
+class Thread_pool
+{   // Fixed set of worker threads pulling jobs from a shared queue. Jobs must never touch the GL context, that one lives on the main thread only.
+    public:
+        Thread_pool(unsigned int threadcount = 0)
+        {
+            if(threadcount == 0)
+                threadcount = std::thread::hardware_concurrency();
+            if(threadcount == 0) // hardware_concurrency() is allowed to return 0 when it can't tell
+                threadcount = 1;
+
+            for(unsigned int i = 0; i < threadcount; i++)
+                workers.push_back(std::thread(&Thread_pool::workerLoop, this));
+        }
+
+        ~Thread_pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(queuemutex);
+                stopping = true;
+            }
+            queuecondition.notify_all();
+
+            for(unsigned int i = 0; i < workers.size(); i++)
+                workers[i].join();
+        }
+
+        Thread_pool(const Thread_pool&) = delete;
+        Thread_pool &operator=(const Thread_pool&) = delete;
+
+        void enqueue(std::function<void()> job)
+        {
+            {
+                std::lock_guard<std::mutex> lock(queuemutex);
+                jobs.push_back(job);
+                unfinishedjobs++;
+            }
+            queuecondition.notify_one();
+        }
+
+        void waitIdle()
+        {   // Blocks until every job enqueued so far has finished running.
+            std::unique_lock<std::mutex> lock(queuemutex);
+            idlecondition.wait(lock, [this] { return unfinishedjobs == 0; });
+        }
+
+        unsigned int threadCount() const
+        {
+            return workers.size();
+        }
+
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()> > jobs;
+        std::mutex queuemutex;
+        std::condition_variable queuecondition, idlecondition;
+        unsigned int unfinishedjobs = 0;
+        bool stopping = false;
+
+        void workerLoop()
+        {
+            while(true)
+            {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> lock(queuemutex);
+                    queuecondition.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+                    if(stopping && jobs.empty())
+                        return;
+
+                    job = jobs.front();
+                    jobs.pop_front();
+                }
+
+                job();
+
+                {
+                    std::lock_guard<std::mutex> lock(queuemutex);
+                    unfinishedjobs--;
+                    if(unfinishedjobs == 0)
+                        idlecondition.notify_all();
+                }
+            }
+        }
+};
+
+#endif
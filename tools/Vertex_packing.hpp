@@ -0,0 +1,163 @@
+#ifndef VERTEX_PACKING_H
+#define VERTEX_PACKING_H
+
+#include "../deps/glm/glm.hpp"
+#include "../deps/glm/gtc/packing.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+struct packed_vertex_data
+{ // 20 bytes instead of the 56 used by vertex_data, decoded back to floats by the vertex shaders.
+    uint16_t vert_pos[4];       // unorm16, relative to the mesh bounds (positiondecodemin + pos * positiondecodeextent), w is padding
+    int16_t  vert_normal[2];    // snorm16, octahedral encoded unit vector
+    int8_t   vert_tangent[4];   // snorm8, octahedral encoded tangent in xy, bitangent handedness in z, w is padding
+    uint16_t vert_texcoord[2];  // half floats, the UVs of the tiled meshes go well outside of [0, 1]
+};
+
+struct vertex_packing_error
+{ // Difference between the float vertices and what the shaders decode out of their packed version.
+    float maxpositionerror = 0.0f, avgpositionerror = 0.0f;
+    float maxnormalerror   = 0.0f, avgnormalerror   = 0.0f; // In degrees
+    float maxtexcoorderror = 0.0f;
+    unsigned int vertexcount = 0;
+
+    void merge(const vertex_packing_error &other)
+    {
+        unsigned int totalcount = vertexcount + other.vertexcount;
+        if(totalcount == 0)
+            return;
+
+        avgpositionerror = (avgpositionerror * vertexcount + other.avgpositionerror * other.vertexcount) / totalcount;
+        avgnormalerror   = (avgnormalerror * vertexcount + other.avgnormalerror * other.vertexcount) / totalcount;
+        maxpositionerror = glm::max(maxpositionerror, other.maxpositionerror);
+        maxnormalerror   = glm::max(maxnormalerror, other.maxnormalerror);
+        maxtexcoorderror = glm::max(maxtexcoorderror, other.maxtexcoorderror);
+        vertexcount = totalcount;
+    }
+};
+
+namespace Vertex_packing
+{
+    inline glm::vec2 octEncode(glm::vec3 vector)
+    { // Projects the unit sphere onto an octahedron and unfolds it into the [-1, 1] square.
+        vector /= (std::fabs(vector.x) + std::fabs(vector.y) + std::fabs(vector.z));
+        glm::vec2 encoded(vector.x, vector.y);
+
+        if(vector.z < 0.0f)
+        {
+            encoded.x = (1.0f - std::fabs(vector.y)) * (vector.x >= 0.0f ? 1.0f : -1.0f);
+            encoded.y = (1.0f - std::fabs(vector.x)) * (vector.y >= 0.0f ? 1.0f : -1.0f);
+        }
+        return encoded;
+    }
+
+    inline glm::vec3 octDecode(glm::vec2 encoded)
+    { // Same math as octDecode() in the vertex shaders.
+        glm::vec3 vector(encoded.x, encoded.y, 1.0f - std::fabs(encoded.x) - std::fabs(encoded.y));
+        float fold = glm::max(-vector.z, 0.0f);
+        vector.x += vector.x >= 0.0f ? -fold : fold;
+        vector.y += vector.y >= 0.0f ? -fold : fold;
+        return glm::normalize(vector);
+    }
+
+    inline glm::vec3 safeNormalize(const glm::vec3 &vector, const glm::vec3 &fallback)
+    { // The importer leaves some tangents and normals zeroed, which normalize() would turn into NaNs.
+        float vectorlength = glm::length(vector);
+        return vectorlength > 1e-8f ? vector / vectorlength : fallback;
+    }
+
+    template <typename Vertex>
+    void computeBounds(const std::vector<Vertex> &vertices, glm::vec3 &boundsmin, glm::vec3 &boundsextent)
+    {
+        if(vertices.empty())
+        {
+            boundsmin = glm::vec3(0.0f);
+            boundsextent = glm::vec3(1.0f);
+            return;
+        }
+
+        glm::vec3 boundsmax = vertices[0].vert_pos;
+        boundsmin = vertices[0].vert_pos;
+        for(unsigned int i = 1; i < vertices.size(); i++)
+        {
+            boundsmin = glm::min(boundsmin, vertices[i].vert_pos);
+            boundsmax = glm::max(boundsmax, vertices[i].vert_pos);
+        }
+
+        boundsextent = boundsmax - boundsmin;
+        for(int axis = 0; axis < 3; axis++)
+            if(boundsextent[axis] <= 0.0f) // Flat meshes (like the grass cards) would otherwise divide by zero
+                boundsextent[axis] = 1.0f;
+    }
+
+    template <typename Vertex>
+    packed_vertex_data packVertex(const Vertex &vertex, const glm::vec3 &boundsmin, const glm::vec3 &boundsextent)
+    {
+        packed_vertex_data packed;
+        glm::vec3 relativepos = (vertex.vert_pos - boundsmin) / boundsextent;
+
+        for(int axis = 0; axis < 3; axis++)
+            packed.vert_pos[axis] = glm::packUnorm1x16(relativepos[axis]);
+        packed.vert_pos[3] = 0;
+
+        glm::vec3 normal  = safeNormalize(vertex.vert_normal, glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::vec3 tangent = safeNormalize(vertex.vert_tangent, glm::vec3(1.0f, 0.0f, 0.0f));
+        glm::vec2 octnormal  = octEncode(normal);
+        glm::vec2 octtangent = octEncode(tangent);
+
+        packed.vert_normal[0] = (int16_t) glm::packSnorm1x16(octnormal.x);
+        packed.vert_normal[1] = (int16_t) glm::packSnorm1x16(octnormal.y);
+
+        // The bitangent is rebuilt as cross(normal, tangent) * handedness, so only its sign has to be stored.
+        float handedness = glm::dot(glm::cross(normal, tangent), vertex.vert_bitangent) < 0.0f ? -1.0f : 1.0f;
+        packed.vert_tangent[0] = (int8_t) glm::packSnorm1x8(octtangent.x);
+        packed.vert_tangent[1] = (int8_t) glm::packSnorm1x8(octtangent.y);
+        packed.vert_tangent[2] = (int8_t) glm::packSnorm1x8(handedness);
+        packed.vert_tangent[3] = 0;
+
+        packed.vert_texcoord[0] = glm::packHalf1x16(vertex.vert_texcoord.x);
+        packed.vert_texcoord[1] = glm::packHalf1x16(vertex.vert_texcoord.y);
+        return packed;
+    }
+
+    template <typename Vertex>
+    vertex_packing_error measureError(const std::vector<Vertex> &vertices, const std::vector<packed_vertex_data> &packedvertices, const glm::vec3 &boundsmin, const glm::vec3 &boundsextent)
+    { // Decodes every packed vertex exactly like the vertex shaders do and compares it against the float original.
+        vertex_packing_error packingerror;
+        packingerror.vertexcount = vertices.size();
+
+        for(unsigned int i = 0; i < vertices.size() && i < packedvertices.size(); i++)
+        {
+            const packed_vertex_data &packed = packedvertices[i];
+
+            glm::vec3 decodedpos;
+            for(int axis = 0; axis < 3; axis++)
+                decodedpos[axis] = boundsmin[axis] + glm::unpackUnorm1x16(packed.vert_pos[axis]) * boundsextent[axis];
+
+            glm::vec3 decodednormal = octDecode(glm::vec2(glm::unpackSnorm1x16((uint16_t) packed.vert_normal[0]), glm::unpackSnorm1x16((uint16_t) packed.vert_normal[1])));
+            glm::vec3 normal = safeNormalize(vertices[i].vert_normal, glm::vec3(0.0f, 1.0f, 0.0f));
+            glm::vec2 decodedtexcoord(glm::unpackHalf1x16(packed.vert_texcoord[0]), glm::unpackHalf1x16(packed.vert_texcoord[1]));
+
+            float positionerror = glm::length(decodedpos - vertices[i].vert_pos);
+            float normalerror   = glm::degrees(std::acos(glm::clamp(glm::dot(decodednormal, normal), -1.0f, 1.0f)));
+            float texcoorderror = glm::max(std::fabs(decodedtexcoord.x - vertices[i].vert_texcoord.x), std::fabs(decodedtexcoord.y - vertices[i].vert_texcoord.y));
+
+            packingerror.maxpositionerror = glm::max(packingerror.maxpositionerror, positionerror);
+            packingerror.maxnormalerror   = glm::max(packingerror.maxnormalerror, normalerror);
+            packingerror.maxtexcoorderror = glm::max(packingerror.maxtexcoorderror, texcoorderror);
+            packingerror.avgpositionerror += positionerror;
+            packingerror.avgnormalerror   += normalerror;
+        }
+
+        if(packingerror.vertexcount > 0)
+        {
+            packingerror.avgpositionerror /= packingerror.vertexcount;
+            packingerror.avgnormalerror   /= packingerror.vertexcount;
+        }
+        return packingerror;
+    }
+}
+
+#endif
@@ -1,6 +1,10 @@
+#ifndef CAMERA_OBJECT_H
+#define CAMERA_OBJECT_H
+
 #include "../deps/GLADLibs/include/glad/glad.h"
 #include "../deps/glm/glm.hpp"
 #include "../deps/glm/gtc/matrix_transform.hpp"
+#include "Frustum_culler.hpp"
 
 enum Movement_Directions
 {
@@ -59,6 +63,11 @@ class Camera_Object
             return glm::lookAt(position, position + front, up);
         }
 
+        camera_frustum getFrustum(const glm::mat4 &projectionmatrix)
+        {
+            return camera_frustum::fromMatrix(projectionmatrix * getViewMatrix());
+        }
+
         void checkKeyboardPresses(Movement_Directions movedirection, bool running, bool crouching, float timedelta)
         {
             float movementvelocity = movespeed * timedelta;
@@ -100,6 +109,14 @@ class Camera_Object
             updateDirectionVectors();
         }
 
+        void setPose(const glm::vec3 &newposition, float newyaw, float newpitch)
+        { // For scripted cameras, puts the camera somewhere directly instead of moving it there through the input callbacks
+            position = newposition;
+            yaw      = newyaw;
+            pitch    = newpitch;
+            updateDirectionVectors();
+        }
+
         void checkMouseWheel(float zoomoffset)
         {
             zoom -= zoomoffset;
@@ -124,3 +141,5 @@ class Camera_Object
         }
 
 };
+
+#endif
@@ -8,7 +8,54 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <cstring>
+
+class Shader;
+
+struct shader_uniform
+{ // One active uniform (or one element of a uniform array) found at link time, along with the last value sent to it.
+    GLint  location = -1;
+    GLenum type = 0;
+    bool   hasvalue = false;
+    float  lastvalue[16]; // Big enough for a mat4, ints and bools are kept bitwise
+};
+
+struct shader_uniform_block
+{
+    GLuint blockindex = 0;
+    GLint  datasize = 0; // Bytes the buffer bound to it has to cover, std140 padding included
+};
+
+struct shader_uniform_stats
+{ // Shared by every Shader, so the whole frame's uniform traffic can be read (and reset) in one place.
+    unsigned long long uploads = 0;      // Values that actually went to the GL
+    unsigned long long skipped = 0;      // Values equal to what the program already had, dropped without a GL call
+    unsigned long long namelookups = 0;  // Uniforms set by name instead of through a Uniform_handle
+    unsigned long long unknownnames = 0; // Names the program doesn't have (or the compiler optimized out), silently ignored like a -1 location would be
+};
+
+template <typename Value>
+class Uniform_handle
+{   // A uniform resolved once through Shader::uniform<Value>(), setting it is a table index and a compare instead of a string lookup.
+    public:
+        Uniform_handle() {}
 
+        void set(const Value &value) const;
+
+        bool valid() const
+        {
+            return slot >= 0;
+        }
+
+    private:
+        Shader *shader = nullptr;
+        int slot = -1;
+
+        Uniform_handle(Shader *shader, int slot) : shader(shader), slot(slot) {}
+        friend class Shader;
+};
 
 class Shader
 {
@@ -122,72 +169,225 @@ class Shader
             glDeleteShader(fragmentShader);
             if(geometryShaderFilePath != nullptr)
                 glDeleteShader(geometryShader);
+
+            reflectUniforms();
         }
 
+        // Uniform_handles point back at the Shader that made them, so it has to stay where it was created instead of being copied or moved
+        Shader(const Shader&) = delete;
+        Shader &operator=(const Shader&) = delete;
+
         void useShader()
         {
             glUseProgram(shader_id);
         }
 
-        void setBool(const std::string &varname, bool varvalue) const
+        // The name based setters look the uniform up in the table built by reflectUniforms(), never in the GL. Hot paths should hold a Uniform_handle instead.
+        void setBool(const std::string &varname, bool varvalue)
         {
-            glUniform1i(glGetUniformLocation(shader_id, varname.c_str()), (int) varvalue);
+            setUniform(varname, (int) varvalue);
         }
 
-        void setInt(const std::string &varname, int varvalue) const
+        void setInt(const std::string &varname, int varvalue)
         {
-            glUniform1i(glGetUniformLocation(shader_id, varname.c_str()), varvalue);
+            setUniform(varname, varvalue);
         }
 
-        void setFloat(const std::string &varname, float varvalue) const
+        void setFloat(const std::string &varname, float varvalue)
         {
-            glUniform1f(glGetUniformLocation(shader_id, varname.c_str()), varvalue);
+            setUniform(varname, varvalue);
         }
 
-        void setVec2vect(const std::string &varname, const glm::vec2 &vecvalue) const
+        void setVec2vect(const std::string &varname, const glm::vec2 &vecvalue)
         {
-            glUniform2fv(glGetUniformLocation(shader_id, varname.c_str()), 1, &vecvalue[0]);
+            setUniform(varname, vecvalue);
         }
 
-        void setVec2(const std::string &varname, float x, float y) const
+        void setVec2(const std::string &varname, float x, float y)
         {
-            glUniform2f(glGetUniformLocation(shader_id, varname.c_str()), x, y);
+            setUniform(varname, glm::vec2(x, y));
         }
 
-        void setVec3vect(const std::string &varname, const glm::vec3 &vecvalue) const
+        void setVec3vect(const std::string &varname, const glm::vec3 &vecvalue)
         {
-            glUniform3fv(glGetUniformLocation(shader_id, varname.c_str()), 1, &vecvalue[0]);
+            setUniform(varname, vecvalue);
         }
-        void setVec3(const std::string &varname, float x, float y, float z) const
+        void setVec3(const std::string &varname, float x, float y, float z)
         {
-            glUniform3f(glGetUniformLocation(shader_id, varname.c_str()), x, y, z);
+            setUniform(varname, glm::vec3(x, y, z));
         }
 
-        void setVec4vect(const std::string &varname, const glm::vec4 &vecvalue) const
+        void setVec4vect(const std::string &varname, const glm::vec4 &vecvalue)
         {
-            glUniform4fv(glGetUniformLocation(shader_id, varname.c_str()), 1, &vecvalue[0]);
+            setUniform(varname, vecvalue);
         }
         void setVec4(const std::string &varname, float x, float y, float z, float w)
         {
-            glUniform4f(glGetUniformLocation(shader_id, varname.c_str()), x, y, z, w);
+            setUniform(varname, glm::vec4(x, y, z, w));
+        }
+
+        void setMat2(const std::string &varname, const glm::mat2 &matrix)
+        {
+            setUniform(varname, matrix);
+        }
+
+        void setMat3(const std::string &varname, const glm::mat3 &matrix)
+        {
+            setUniform(varname, matrix);
+        }
+
+        void setMat4(const std::string &varname, const glm::mat4 &matrix)
+        {
+            setUniform(varname, matrix);
+        }
+
+        template <typename Value>
+        Uniform_handle<Value> uniform(const std::string &varname)
+        {   // Resolves varname once. Unknown names give an invalid handle whose set() does nothing, a type that doesn't match the GLSL declaration is reported and does the same.
+            std::unordered_map<std::string, int>::const_iterator match = uniformslots.find(varname);
+            if(match == uniformslots.end())
+                return Uniform_handle<Value>();
+
+            if(!typeMatches(uniforms[match->second].type, Value()))
+            {
+                std::cout << "ERROR::SHADER_UNIFORM_TYPE_MISMATCH: " << varname << " in program " << shader_id << std::endl;
+                return Uniform_handle<Value>();
+            }
+            return Uniform_handle<Value>(this, match->second);
+        }
+
+        template <typename Value>
+        void uploadUniform(int slot, const Value &value)
+        {   // Goes through glProgramUniform, so the cached value stays right even when another program happens to be bound.
+            static_assert(sizeof(Value) <= sizeof(shader_uniform().lastvalue), "Uniform value too big for the cache");
+            shader_uniform &entry = uniforms[slot];
+            if(entry.hasvalue && std::memcmp(entry.lastvalue, &value, sizeof(Value)) == 0)
+            {
+                uniformStats().skipped++;
+                return;
+            }
+
+            std::memset(entry.lastvalue, 0, sizeof(entry.lastvalue)); // So a bool and an int holding the same value compare equal
+            std::memcpy(entry.lastvalue, &value, sizeof(Value));
+            entry.hasvalue = true;
+            uniformStats().uploads++;
+            writeUniform(entry.location, value);
+        }
+
+        const shader_uniform_block *uniformBlock(const std::string &blockname) const
+        {
+            std::unordered_map<std::string, shader_uniform_block>::const_iterator match = uniformblocks.find(blockname);
+            return match == uniformblocks.end() ? nullptr : &match->second;
         }
 
-        void setMat2(const std::string &varname, const glm::mat2 &matrix) const
+        void bindUniformBlock(const std::string &blockname, unsigned int bindingpoint)
         {
-            glUniformMatrix2fv(glGetUniformLocation(shader_id, varname.c_str()), 1, GL_FALSE, &matrix[0][0]);
+            const shader_uniform_block *block = uniformBlock(blockname);
+            if(block)
+                glUniformBlockBinding(shader_id, block->blockindex, bindingpoint);
         }
 
-        void setMat3(const std::string &varname, const glm::mat3 &matrix) const
+        static shader_uniform_stats &uniformStats()
         {
-            glUniformMatrix3fv(glGetUniformLocation(shader_id, varname.c_str()), 1, GL_FALSE, &matrix[0][0]);
+            static shader_uniform_stats stats;
+            return stats;
         }
 
-        void setMat4(const std::string &varname, const glm::mat4 &matrix) const
+        static void printUniformStatistics(unsigned long long framecount)
         {
-            glUniformMatrix4fv(glGetUniformLocation(shader_id, varname.c_str()), 1, GL_FALSE, &matrix[0][0]);
+            shader_uniform_stats &stats = uniformStats();
+            if(framecount == 0)
+                return;
+
+            std::cout << "Uniforms per frame: " << stats.uploads / framecount << " uploaded, " << stats.skipped / framecount << " skipped as unchanged, "
+                      << stats.namelookups / framecount << " set by name (" << stats.unknownnames / framecount << " unknown)" << std::endl;
         }
 
     private:
+        std::vector<shader_uniform> uniforms;
+        std::unordered_map<std::string, int> uniformslots; // Uniform name to its index in uniforms
+        std::unordered_map<std::string, shader_uniform_block> uniformblocks;
+
+        void reflectUniforms()
+        {   // Walks every active uniform and uniform block once after linking. Arrays get one entry per element, reachable both as "name[i]" and (element 0) as "name".
+            GLint uniformcount = 0, blockcount = 0, maxnamelength = 0, maxblocknamelength = 0;
+            glGetProgramiv(shader_id, GL_ACTIVE_UNIFORMS, &uniformcount);
+            glGetProgramiv(shader_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxnamelength);
+            glGetProgramiv(shader_id, GL_ACTIVE_UNIFORM_BLOCKS, &blockcount);
+            glGetProgramiv(shader_id, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxblocknamelength);
+
+            std::vector<char> namebuffer(glm::max(maxnamelength, maxblocknamelength) + 1);
+            for(GLint i = 0; i < uniformcount; i++)
+            {
+                GLint arraysize = 0;
+                GLenum type = 0;
+                glGetActiveUniform(shader_id, i, namebuffer.size(), nullptr, &arraysize, &type, namebuffer.data());
+
+                std::string uniformname(namebuffer.data());
+                if(glGetUniformLocation(shader_id, uniformname.c_str()) < 0)
+                    continue; // Lives in a uniform block, set through its buffer instead
+
+                std::string basename = uniformname.substr(0, uniformname.size() - (uniformname.size() > 3 && uniformname.compare(uniformname.size() - 3, 3, "[0]") == 0 ? 3 : 0));
+                for(GLint element = 0; element < arraysize; element++)
+                {
+                    std::string elementname = arraysize > 1 ? basename + "[" + std::to_string(element) + "]" : uniformname;
+
+                    shader_uniform entry;
+                    entry.location = glGetUniformLocation(shader_id, elementname.c_str());
+                    entry.type = type;
+                    uniformslots[elementname] = uniforms.size();
+                    if(element == 0)
+                        uniformslots[basename] = uniforms.size();
+                    uniforms.push_back(entry);
+                }
+            }
+
+            for(GLint i = 0; i < blockcount; i++)
+            {
+                shader_uniform_block block;
+                block.blockindex = i;
+                glGetActiveUniformBlockName(shader_id, i, namebuffer.size(), nullptr, namebuffer.data());
+                glGetActiveUniformBlockiv(shader_id, i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.datasize);
+                uniformblocks[namebuffer.data()] = block;
+            }
+        }
+
+        template <typename Value>
+        void setUniform(const std::string &varname, const Value &value)
+        {
+            uniformStats().namelookups++;
+            std::unordered_map<std::string, int>::const_iterator match = uniformslots.find(varname);
+            if(match == uniformslots.end())
+            {
+                uniformStats().unknownnames++;
+                return;
+            }
+            uploadUniform(match->second, value);
+        }
+
+        static bool typeMatches(GLenum type, int)
+        {   // Samplers are set through their texture unit, bools are uploaded as ints
+            return type == GL_INT || type == GL_BOOL || type == GL_SAMPLER_2D || type == GL_SAMPLER_2D_ARRAY || type == GL_SAMPLER_CUBE || type == GL_SAMPLER_2D_SHADOW;
+        }
+        static bool typeMatches(GLenum type, bool)             { return type == GL_BOOL || type == GL_INT; }
+        static bool typeMatches(GLenum type, float)            { return type == GL_FLOAT; }
+        static bool typeMatches(GLenum type, const glm::vec2&) { return type == GL_FLOAT_VEC2; }
+        static bool typeMatches(GLenum type, const glm::vec3&) { return type == GL_FLOAT_VEC3; }
+        static bool typeMatches(GLenum type, const glm::vec4&) { return type == GL_FLOAT_VEC4; }
+        static bool typeMatches(GLenum type, const glm::mat2&) { return type == GL_FLOAT_MAT2; }
+        static bool typeMatches(GLenum type, const glm::mat3&) { return type == GL_FLOAT_MAT3; }
+        static bool typeMatches(GLenum type, const glm::mat4&) { return type == GL_FLOAT_MAT4; }
+
+        void writeUniform(GLint location, int value)              { glProgramUniform1i(shader_id, location, value); }
+        void writeUniform(GLint location, bool value)             { glProgramUniform1i(shader_id, location, (int) value); }
+        void writeUniform(GLint location, float value)            { glProgramUniform1f(shader_id, location, value); }
+        void writeUniform(GLint location, const glm::vec2 &value) { glProgramUniform2fv(shader_id, location, 1, &value[0]); }
+        void writeUniform(GLint location, const glm::vec3 &value) { glProgramUniform3fv(shader_id, location, 1, &value[0]); }
+        void writeUniform(GLint location, const glm::vec4 &value) { glProgramUniform4fv(shader_id, location, 1, &value[0]); }
+        void writeUniform(GLint location, const glm::mat2 &value) { glProgramUniformMatrix2fv(shader_id, location, 1, GL_FALSE, &value[0][0]); }
+        void writeUniform(GLint location, const glm::mat3 &value) { glProgramUniformMatrix3fv(shader_id, location, 1, GL_FALSE, &value[0][0]); }
+        void writeUniform(GLint location, const glm::mat4 &value) { glProgramUniformMatrix4fv(shader_id, location, 1, GL_FALSE, &value[0][0]); }
+
         void checkErrors(GLuint shader_id, std::string shadertype)
         {
             GLint compiling_succeeded;
@@ -215,4 +415,11 @@ class Shader
 
 };
 
+template <typename Value>
+void Uniform_handle<Value>::set(const Value &value) const
+{
+    if(shader && slot >= 0)
+        shader->uploadUniform(slot, value);
+}
+
 #endif